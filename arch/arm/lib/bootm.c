@@ -57,6 +57,9 @@ static void announce_and_cleanup(int fake)
 #ifdef CONFIG_BOOTSTAGE_FDT
 	bootstage_fdt_add_report();
 #endif
+#ifdef CONFIG_BOOTSTAGE_TRACE
+	bootstage_trace_handoff();
+#endif
 #ifdef CONFIG_BOOTSTAGE_REPORT
 	bootstage_report();
 #endif
@@ -8,6 +8,7 @@
 #include <cpu_func.h>
 #include <errno.h>
 #include <log.h>
+#include <of_live.h>
 #include <asm/global_data.h>
 #include <linux/delay.h>
 #include <linux/libfdt.h>
@@ -338,6 +339,31 @@ fail:
 	return NULL;
 }
 
+/*
+ * The live tree image is built next to the device tree, e.g. test.live for
+ * test.dtb. Each call reads a new copy, which the caller must os_free().
+ */
+void *board_of_live_image(void)
+{
+	struct sandbox_state *state = state_get_current();
+	const char *fname = state->fdt_fname;
+	char live_fname[256];
+	void *image;
+	int len, size;
+
+	if (!fname)
+		return NULL;
+	len = strlen(fname);
+	if (len < 4 || strcmp(fname + len - 4, ".dtb") ||
+	    len + 2 > sizeof(live_fname))
+		return NULL;
+	snprintf(live_fname, sizeof(live_fname), "%.*s.live", len - 4, fname);
+	if (os_read_file(live_fname, &image, &size))
+		return NULL;
+
+	return image;
+}
+
 ulong timer_get_boot_us(void)
 {
 	static uint64_t base_count;
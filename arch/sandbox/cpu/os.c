@@ -273,6 +273,78 @@ int os_setup_signal_handlers(void)
 	return 0;
 }
 
+/* Largest number of stack frames passed to os_profile_action() */
+#define OS_PROFILE_DEPTH	64
+
+/* Top of the stack of the main thread, from the C library */
+extern void *__libc_stack_end;
+
+static void __attribute__((no_instrument_function))
+		os_profile_handler(int sig, siginfo_t *info, void *con)
+{
+	ucontext_t __maybe_unused *context = con;
+	unsigned long pcs[OS_PROFILE_DEPTH];
+	unsigned long *fp, sp;
+	int count = 0;
+
+#if defined(__x86_64__)
+	pcs[count++] = context->uc_mcontext.gregs[REG_RIP];
+	fp = (unsigned long *)context->uc_mcontext.gregs[REG_RBP];
+	sp = context->uc_mcontext.gregs[REG_RSP];
+#elif defined(__aarch64__)
+	pcs[count++] = context->uc_mcontext.pc;
+	fp = (unsigned long *)context->uc_mcontext.regs[29];
+	sp = context->uc_mcontext.sp;
+#else
+	return;
+#endif
+
+	/*
+	 * Each frame record holds the previous frame pointer then the return
+	 * address. Stop at anything which is not a frame further up the
+	 * stack, e.g. when the signal hits code built without frame pointers.
+	 */
+	while (count < OS_PROFILE_DEPTH && (unsigned long)fp >= sp &&
+	       (void *)(fp + 2) <= __libc_stack_end &&
+	       !((unsigned long)fp & (sizeof(*fp) - 1))) {
+		pcs[count++] = fp[1];
+		if (fp[0] <= (unsigned long)fp)
+			break;
+		fp = (unsigned long *)fp[0];
+	}
+
+	os_profile_action(pcs, count);
+}
+
+int os_profile_start(unsigned long period_us)
+{
+	struct itimerval timer;
+	struct sigaction act;
+
+	act.sa_sigaction = os_profile_handler;
+	sigemptyset(&act.sa_mask);
+	act.sa_flags = SA_SIGINFO | SA_RESTART;
+	if (sigaction(SIGPROF, &act, NULL))
+		return -1;
+
+	timer.it_interval.tv_sec = period_us / 1000000;
+	timer.it_interval.tv_usec = period_us % 1000000;
+	timer.it_value = timer.it_interval;
+	if (setitimer(ITIMER_PROF, &timer, NULL))
+		return -1;
+
+	return 0;
+}
+
+void os_profile_stop(void)
+{
+	struct itimerval timer;
+
+	memset(&timer, '\0', sizeof(timer));
+	setitimer(ITIMER_PROF, &timer, NULL);
+	signal(SIGPROF, SIG_IGN);
+}
+
 /* Put tty into raw mode so <tab> and <ctrl+c> work */
 void os_tty_raw(int fd, bool allow_sigs)
 {
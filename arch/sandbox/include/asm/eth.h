@@ -71,6 +71,15 @@ int sandbox_eth_recv_ping_req(struct udevice *dev);
 typedef int sandbox_eth_tx_hand_f(struct udevice *dev, void *pkt,
 				   unsigned int len);
 
+/**
+ * A traffic generator, making up received packets
+ *
+ * dev - device pointer
+ * pkt - buffer of PKTSIZE_ALIGN bytes to fill with the packet
+ * returns the packet length, 0 when there are no more packets
+ */
+typedef int sandbox_eth_rx_gen_f(struct udevice *dev, void *pkt);
+
 /**
  * struct eth_sandbox_priv - memory for sandbox mock driver
  *
@@ -80,8 +89,17 @@ typedef int sandbox_eth_tx_hand_f(struct udevice *dev, void *pkt,
  * recv_packet_buffer - buffers of the packet returned as received
  * recv_packet_length - lengths of the packet returned as received
  * recv_packets - number of packets returned
+ * recv_busy - number of packets at the head of the queue handed to the stack
+ *	and not freed yet
  * tx_handler - function to generate responses to sent packets
  * priv - a pointer to some structure a test may want to keep track of
+ * rx_drop - numbers of the received packets to drop, see sandbox_eth_drop_rx()
+ * rx_drop_count - number of entries left in rx_drop
+ * rx_count - number of packets received since sandbox_eth_drop_rx() was called
+ * rx_dropped - number of packets dropped
+ * mcast_ethaddr - multicast address joined, see sb_eth_mcast()
+ * mcast_joined - mcast_ethaddr is joined
+ * rx_gen - traffic generator keeping the receive queue full, or NULL
  */
 struct eth_sandbox_priv {
 	uchar fake_host_hwaddr[ARP_HLEN];
@@ -90,8 +108,16 @@ struct eth_sandbox_priv {
 	uchar * recv_packet_buffer[PKTBUFSRX];
 	int recv_packet_length[PKTBUFSRX];
 	int recv_packets;
+	int recv_busy;
 	sandbox_eth_tx_hand_f *tx_handler;
 	void *priv;
+	const uint *rx_drop;
+	int rx_drop_count;
+	uint rx_count;
+	uint rx_dropped;
+	u8 mcast_ethaddr[ARP_HLEN];
+	bool mcast_joined;
+	sandbox_eth_rx_gen_f *rx_gen;
 };
 
 /*
@@ -108,4 +134,29 @@ void sandbox_eth_set_tx_handler(int index, sandbox_eth_tx_hand_f *handler);
  */
 void sandbox_eth_set_priv(int index, void *priv);
 
+/*
+ * Drop received packets, as a lossy link would
+ *
+ * The packets are counted from 0 from this call, and dropped when the
+ * network stack asks for them, after any tx handler queued them.
+ *
+ * index - interface to drop packets on
+ * drop - numbers of the packets to drop, in increasing order; the array is
+ *	used in place and must stay valid. NULL to stop dropping packets
+ * count - number of entries in drop
+ */
+void sandbox_eth_drop_rx(int index, const uint *drop, int count);
+
+/*
+ * Receive the packets of a traffic generator
+ *
+ * Whenever the network stack polls the device, the receive queue is filled
+ * up with packets from the generator, until it returns 0. This has the stack
+ * receive as fast as it can, without any tx handler in the loop.
+ *
+ * index - interface to receive on
+ * gen - traffic generator, NULL to stop
+ */
+void sandbox_eth_set_rx_generator(int index, sandbox_eth_rx_gen_f *gen);
+
 #endif /* __ETH_H */
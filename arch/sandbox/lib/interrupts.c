@@ -9,6 +9,7 @@
 #include <efi_loader.h>
 #include <irq_func.h>
 #include <os.h>
+#include <trace.h>
 #include <asm/global_data.h>
 #include <asm-generic/signal.h>
 #include <asm/u-boot-sandbox.h>
@@ -57,3 +58,21 @@ void os_signal_action(int sig, unsigned long pc)
 		sandbox_exit();
 	}
 }
+
+#ifdef CONFIG_TRACE_SAMPLE
+int arch_trace_sample_start(ulong period_us)
+{
+	return os_profile_start(period_us) ? -EINVAL : 0;
+}
+
+void arch_trace_sample_stop(void)
+{
+	os_profile_stop();
+}
+
+void __attribute__((no_instrument_function)) os_profile_action(
+		unsigned long *pcs, int count)
+{
+	trace_sample_add(pcs, count);
+}
+#endif
@@ -373,6 +373,72 @@ static int handle_decomp_error(int comp_type, size_t uncomp_size, int ret)
 #endif
 
 #ifndef USE_HOSTCC
+static bool bootm_overlaps(ulong start, ulong size, ulong other,
+			   ulong other_size)
+{
+	return other_size && start < other + other_size &&
+		other < start + size;
+}
+
+bool bootm_in_place_ok(bootm_headers_t *images, ulong start, ulong size)
+{
+	image_info_t *os = &images->os;
+	ulong image_end = os->image_start + os->image_len;
+
+	if (lmb_get_free_size(&images->lmb, start) < size ||
+	    bootm_overlaps(start, size, images->rd_start,
+			   images->rd_end - images->rd_start) ||
+	    (images->ft_addr &&
+	     bootm_overlaps(start, size, map_to_sysmem(images->ft_addr),
+			    images->ft_len)))
+		return false;
+
+	/*
+	 * The blob holding the image is not reserved in the lmb. Past the end
+	 * of the kernel data it may hold loadables, or the FDT or ramdisk
+	 * before they are relocated.
+	 */
+	if (start + size > image_end &&
+	    bootm_overlaps(image_end, start + size - image_end, os->start,
+			   os->end - os->start))
+		return false;
+
+	return true;
+}
+
+/**
+ * bootm_os_in_place() - Check if an uncompressed kernel can run where it is
+ *
+ * A Linux Image is only tied to its load address by the alignment rules
+ * that booti_setup() knows about. If the Image data already sits where it
+ * could run, it does not need copying, as long as bootm_in_place_ok().
+ *
+ * @images: Images information
+ * @sizep: Returns the size of memory used by the kernel
+ * @return true if the kernel can run where its data is
+ */
+static bool bootm_os_in_place(bootm_headers_t *images, ulong *sizep)
+{
+	image_info_t *os = &images->os;
+	ulong start = os->image_start;
+	ulong addr, size;
+
+	if (!IS_ENABLED(CONFIG_BOOTM_IN_PLACE) || os->comp != IH_COMP_NONE ||
+	    os->os != IH_OS_LINUX || os->arch != IH_ARCH_DEFAULT ||
+	    os->load == start)
+		return false;
+
+	if (booti_setup(start, &addr, &size, false) || addr != start)
+		return false;
+	size = max(size, os->image_len);
+	if (!bootm_in_place_ok(images, start, size))
+		return false;
+
+	*sizep = size;
+
+	return true;
+}
+
 static int bootm_load_os(bootm_headers_t *images, int boot_progress)
 {
 	image_info_t os = images->os;
@@ -382,11 +448,21 @@ static int bootm_load_os(bootm_headers_t *images, int boot_progress)
 	ulong blob_end = os.end;
 	ulong image_start = os.image_start;
 	ulong image_len = os.image_len;
-	ulong flush_start = ALIGN_DOWN(load, ARCH_DMA_MINALIGN);
-	bool no_overlap;
+	ulong flush_start;
+	ulong in_place_size = 0;
+	bool no_overlap, in_place;
 	void *load_buf, *image_buf;
 	int err;
 
+	in_place = bootm_os_in_place(images, &in_place_size);
+	if (in_place) {
+		/* The entry point keeps its offset into the image */
+		images->ep = images->ep - load + image_start;
+		load = image_start;
+		images->os.load = load;
+	}
+	flush_start = ALIGN_DOWN(load, ARCH_DMA_MINALIGN);
+
 	load_buf = map_sysmem(load, 0);
 	image_buf = map_sysmem(os.image_start, image_len);
 	err = image_decomp(os.comp, load, os.image_start, os.type,
@@ -403,7 +479,11 @@ static int bootm_load_os(bootm_headers_t *images, int boot_progress)
 	flush_cache(flush_start, ALIGN(load_end, ARCH_DMA_MINALIGN) - flush_start);
 
 	debug("   kernel loaded at 0x%08lx, end = 0x%08lx\n", load, load_end);
-	bootstage_mark(BOOTSTAGE_ID_KERNEL_LOADED);
+	if (in_place)
+		bootstage_mark_name(BOOTSTAGE_ID_KERNEL_LOADED,
+				    "kernel_in_place");
+	else
+		bootstage_mark(BOOTSTAGE_ID_KERNEL_LOADED);
 
 	no_overlap = (os.comp == IH_COMP_NONE && load == image_start);
 
@@ -426,8 +506,8 @@ static int bootm_load_os(bootm_headers_t *images, int boot_progress)
 		}
 	}
 
-	lmb_reserve(&images->lmb, images->os.load, (load_end -
-						    images->os.load));
+	lmb_reserve(&images->lmb, images->os.load,
+		    max(load_end - images->os.load, in_place_size));
 	return 0;
 }
 
@@ -0,0 +1,727 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * Applying several device tree overlays to one base tree
+ *
+ * fdt_overlay_apply() looks up each label used by an overlay by searching
+ * /__symbols__ of the base tree, and the node behind each fragment target
+ * phandle by scanning the whole tree. Here the labels are held in a hash
+ * table and each overlay is prepared before fdt_overlay_apply() sees it: its
+ * fixups are resolved through the table and removed, and each fragment which
+ * targets a label is given the path of that label instead of its phandle.
+ *
+ * The table also holds the offset of each labelled node. Offsets are moved
+ * along as overlays change the tree, and are checked against the node name
+ * and phandle before use, so a stale one only costs a walk down the path.
+ */
+
+#include <common.h>
+#include <fdt_support.h>
+#include <malloc.h>
+#include <linux/libfdt.h>
+#include <linux/string.h>
+
+/* Smallest label table, leaving room for labels added by overlays */
+#define OVERLAY_CACHE_MIN_SLOTS	16
+
+/* Longest path and deepest node for which labels are found up front */
+#define OVERLAY_CACHE_PATH	256
+#define OVERLAY_CACHE_DEPTH	32
+
+/**
+ * struct overlay_cache_fixup - One entry of a property in /__fixups__
+ *
+ * The entry is a string of the form "path:property:offset"
+ *
+ * @path: Path of the node holding the phandle to fix up
+ * @path_len: Length of @path
+ * @name: Name of the property holding the phandle
+ * @name_len: Length of @name
+ * @poffset: Offset of the phandle within the property
+ */
+struct overlay_cache_fixup {
+	const char *path;
+	int path_len;
+	const char *name;
+	int name_len;
+	uint poffset;
+};
+
+/**
+ * struct overlay_cache_region - Part of the base tree an overlay changes
+ *
+ * @start: Offset of the node changed by the overlay
+ * @end: Offset just after the node and its subnodes, INT_MAX for the last
+ * @delta: How far the offsets after @end move once the overlay is applied
+ */
+struct overlay_cache_region {
+	int start;
+	int end;
+	int delta;
+};
+
+static u32 overlay_cache_hash(const char *s)
+{
+	u32 hash = 2166136261U;
+
+	while (*s) {
+		hash ^= (unsigned char)*s++;
+		hash *= 16777619U;
+	}
+
+	return hash;
+}
+
+static struct fdt_overlay_label *
+overlay_cache_find(struct fdt_overlay_cache *cache, const char *label,
+		   u32 hash)
+{
+	struct fdt_overlay_label *entry;
+	uint i;
+
+	if (!cache->label)
+		return NULL;
+
+	/* The table is never full, so this ends on a free entry */
+	for (i = hash; ; i++) {
+		entry = &cache->label[i & (cache->slots - 1)];
+		if (!entry->label ||
+		    (entry->hash == hash && !strcmp(entry->label, label)))
+			return entry;
+	}
+}
+
+/* Record the path of a label, returning the copy or @path if none */
+static const char *overlay_cache_add(struct fdt_overlay_cache *cache,
+				     struct fdt_overlay_label *entry,
+				     const char *label, u32 hash,
+				     const char *path)
+{
+	const char *copy;
+
+	if (!entry)
+		return path;
+	if (!entry->label) {
+		if (cache->used >= cache->slots / 4 * 3)
+			return path;
+		entry->label = arena_strdup(&cache->arena, label);
+		if (!entry->label)
+			return path;
+		entry->hash = hash;
+		cache->used++;
+	}
+	copy = arena_strdup(&cache->arena, path);
+	entry->path = copy;
+	entry->offset = -1;
+
+	return copy ?: path;
+}
+
+/* Get the offset just after a node and its subnodes, INT_MAX for the last */
+static int overlay_cache_node_end(const void *fdt, int node)
+{
+	int depth = 0;
+
+	do {
+		node = fdt_next_node(fdt, node, &depth);
+	} while (node >= 0 && depth > 0);
+
+	if (node < 0)
+		return INT_MAX;
+
+	return node;
+}
+
+/* Get the offset of /__symbols__ in the base tree */
+static int overlay_cache_symbols(const void *fdt,
+				 struct fdt_overlay_cache *cache)
+{
+	const char *name;
+
+	if (cache->symbols >= 0) {
+		name = fdt_get_name(fdt, cache->symbols, NULL);
+		if (name && !strcmp(name, "__symbols__"))
+			return cache->symbols;
+	}
+	cache->symbols = fdt_subnode_offset(fdt, 0, "__symbols__");
+
+	return cache->symbols;
+}
+
+/*
+ * Same as fdt_path_offset(), also telling whether @path is the one which
+ * fdt_get_path() gives for the node, with the full name of each node
+ */
+static int overlay_cache_path_offset(const void *fdt, const char *path,
+				     bool *fullp)
+{
+	const char *end;
+	int node = 0;
+	int len;
+
+	*fullp = false;
+	if (*path != '/' || strstr(path, "//") ||
+	    (path[1] && path[strlen(path) - 1] == '/'))
+		return fdt_path_offset(fdt, path);
+
+	*fullp = true;
+	for (path++; *path; path = *end ? end + 1 : end) {
+		end = strchrnul(path, '/');
+		node = fdt_subnode_offset_namelen(fdt, node, path, end - path);
+		if (node < 0)
+			return node;
+		if (!fdt_get_name(fdt, node, &len) || len != end - path)
+			*fullp = false;
+	}
+
+	return node;
+}
+
+/*
+ * Check the remembered offset of a label. Another node cannot have the same
+ * name and phandle, so the offset is still that of the labelled node.
+ */
+static bool overlay_cache_valid(const void *fdt,
+				const struct fdt_overlay_label *entry)
+{
+	const char *name, *last;
+	int len;
+
+	if (entry->offset < 0 || !entry->phandle || !entry->full)
+		return false;
+
+	last = strrchr(entry->path, '/') + 1;
+	name = fdt_get_name(fdt, entry->offset, &len);
+
+	return name && len == strlen(last) && !memcmp(name, last, len) &&
+		fdt_get_phandle(fdt, entry->offset) == entry->phandle;
+}
+
+/* Find the node behind a label of the base tree, setting @found */
+static int overlay_cache_lookup(const void *fdt,
+				struct fdt_overlay_cache *cache,
+				const char *label,
+				struct fdt_overlay_label *found)
+{
+	struct fdt_overlay_label *entry;
+	const char *path;
+	int symbols, len;
+	u32 hash;
+
+	hash = overlay_cache_hash(label);
+	entry = overlay_cache_find(cache, label, hash);
+	if (entry && entry->label && entry->path) {
+		if (overlay_cache_valid(fdt, entry)) {
+			*found = *entry;
+			return 0;
+		}
+		path = entry->path;
+	} else {
+		symbols = overlay_cache_symbols(fdt, cache);
+		if (symbols < 0)
+			return symbols;
+		path = fdt_getprop(fdt, symbols, label, &len);
+		if (!path)
+			return len;
+		if (len < 1 || path[len - 1])
+			return -FDT_ERR_BADVALUE;
+		path = overlay_cache_add(cache, entry, label, hash, path);
+	}
+
+	found->path = path;
+	found->offset = overlay_cache_path_offset(fdt, path, &found->full);
+	if (found->offset < 0)
+		return found->offset;
+	found->phandle = fdt_get_phandle(fdt, found->offset);
+	if (entry && entry->label && entry->path) {
+		entry->offset = found->offset;
+		entry->phandle = found->phandle;
+		entry->full = found->full;
+	}
+
+	return 0;
+}
+
+/* Parse the next entry of a fixup, as fdt_overlay_apply() does */
+static int overlay_cache_next_fixup(const char **valuep, int *lenp,
+				    struct overlay_cache_fixup *fixup)
+{
+	const char *value = *valuep;
+	const char *end, *sep;
+	char *endptr;
+
+	end = memchr(value, '\0', *lenp);
+	if (!end)
+		return -FDT_ERR_BADOVERLAY;
+	*valuep = end + 1;
+	*lenp -= end - value + 1;
+
+	sep = memchr(value, ':', end - value);
+	if (!sep || sep == end - 1)
+		return -FDT_ERR_BADOVERLAY;
+	fixup->path = value;
+	fixup->path_len = sep - value;
+
+	fixup->name = sep + 1;
+	sep = memchr(fixup->name, ':', end - fixup->name);
+	if (!sep || sep == fixup->name)
+		return -FDT_ERR_BADOVERLAY;
+	fixup->name_len = sep - fixup->name;
+
+	fixup->poffset = simple_strtoul(sep + 1, &endptr, 10);
+	if (*endptr || endptr == sep + 1)
+		return -FDT_ERR_BADOVERLAY;
+
+	return 0;
+}
+
+/*
+ * Write the phandle of each label used by @fdto where it is needed. On error
+ * the fixups are left for fdt_overlay_apply(), which does them all again.
+ */
+static int overlay_cache_fixup(const void *fdt, void *fdto,
+			       struct fdt_overlay_cache *cache, int fixups)
+{
+	struct overlay_cache_fixup fixup;
+	struct fdt_overlay_label found;
+	const char *value, *label;
+	int prop, len, node, ret;
+	fdt32_t phandle;
+
+	fdt_for_each_property_offset(prop, fdto, fixups) {
+		value = fdt_getprop_by_offset(fdto, prop, &label, &len);
+		if (!value)
+			return len;
+
+		ret = overlay_cache_lookup(fdt, cache, label, &found);
+		if (ret)
+			return ret;
+		if (!found.phandle)
+			return -FDT_ERR_NOTFOUND;
+		phandle = cpu_to_fdt32(found.phandle);
+
+		do {
+			ret = overlay_cache_next_fixup(&value, &len, &fixup);
+			if (ret)
+				return ret;
+			node = fdt_path_offset_namelen(fdto, fixup.path,
+						       fixup.path_len);
+			if (node < 0)
+				return node;
+			ret = fdt_setprop_inplace_namelen_partial(fdto, node,
+					fixup.name, fixup.name_len,
+					fixup.poffset, &phandle,
+					sizeof(phandle));
+			if (ret)
+				return ret;
+		} while (len > 0);
+	}
+
+	return 0;
+}
+
+/* Get the label whose phandle is the target of a fragment, NULL if none */
+static const char *overlay_cache_target_label(const void *fdto, int fixups,
+					      const char *frag, int frag_len)
+{
+	struct overlay_cache_fixup fixup;
+	const char *value, *label;
+	int prop, len;
+
+	fdt_for_each_property_offset(prop, fdto, fixups) {
+		value = fdt_getprop_by_offset(fdto, prop, &label, &len);
+		while (value && len > 0) {
+			if (overlay_cache_next_fixup(&value, &len, &fixup))
+				break;
+			if (fixup.path_len == frag_len + 1 &&
+			    *fixup.path == '/' &&
+			    !memcmp(fixup.path + 1, frag, frag_len) &&
+			    fixup.name_len == strlen("target") &&
+			    !memcmp(fixup.name, "target", fixup.name_len) &&
+			    !fixup.poffset)
+				return label;
+		}
+	}
+
+	return NULL;
+}
+
+/*
+ * Resolve the fixups of @fdto through the cache and remove them. Then give
+ * each fragment which targets a label the path of that label, so that
+ * fdt_overlay_apply() does not search the base tree for its phandle. This
+ * stops at the first fragment for which there is no space in @fdto.
+ *
+ * The offset of the node targeted by each fragment is set in @target, or -1
+ * if not known.
+ */
+static int overlay_cache_prepare(const void *fdt, void *fdto,
+				 struct fdt_overlay_cache *cache,
+				 const char **path, int *target, int count)
+{
+	struct fdt_overlay_label found;
+	const char *name, *label;
+	int fragment, fixups, len;
+	int i, ret;
+
+	for (i = 0; i < count; i++) {
+		path[i] = NULL;
+		target[i] = -1;
+	}
+	fixups = fdt_subnode_offset(fdto, 0, "__fixups__");
+	if (fixups < 0 || overlay_cache_fixup(fdt, fdto, cache, fixups))
+		return 0;
+
+	/* Find the paths first, as removing the fixups makes space for them */
+	i = 0;
+	fdt_for_each_subnode(fragment, fdto, 0) {
+		if (i == count)
+			break;
+		name = fdt_get_name(fdto, fragment, &len);
+		label = overlay_cache_target_label(fdto, fixups, name, len);
+		if (fdt_subnode_offset(fdto, fragment, "__overlay__") >= 0 &&
+		    fdt_getprop(fdto, fragment, "target", &len) &&
+		    len == sizeof(fdt32_t) && label &&
+		    !overlay_cache_lookup(fdt, cache, label, &found) &&
+		    found.full) {
+			path[i] = found.path;
+			target[i] = found.offset;
+		}
+		i++;
+	}
+
+	/* All done, so stop fdt_overlay_apply() doing it again */
+	ret = fdt_del_node(fdto, fixups);
+	if (ret)
+		return ret;
+
+	i = 0;
+	fdt_for_each_subnode(fragment, fdto, 0) {
+		if (i == count)
+			break;
+		if (path[i]) {
+			if (fdt_setprop_string(fdto, fragment, "target-path",
+					       path[i])) {
+				target[i] = -1;
+				break;
+			}
+			fdt_delprop(fdto, fragment, "target");
+		}
+		i++;
+	}
+
+	return 0;
+}
+
+/* Forget the paths of the labels which applying @fdto may change */
+static void overlay_cache_forget(const void *fdto,
+				 struct fdt_overlay_cache *cache)
+{
+	struct fdt_overlay_label *entry;
+	const char *label, *path;
+	int fragment, overlay, symbols, prop, i;
+
+	fdt_for_each_subnode(fragment, fdto, 0) {
+		overlay = fdt_subnode_offset(fdto, fragment, "__overlay__");
+		if (overlay < 0)
+			continue;
+
+		/* Anything may be written to /__symbols__ of the base tree */
+		path = fdt_getprop(fdto, fragment, "target-path", NULL);
+		if (fdt_getprop(fdto, fragment, "target", NULL) || !path ||
+		    *path != '/' || !strncmp(path, "/__symbols__", 12) ||
+		    (!strcmp(path, "/") &&
+		     fdt_subnode_offset(fdto, overlay, "__symbols__") >= 0)) {
+			for (i = 0; i < cache->slots; i++)
+				cache->label[i].path = NULL;
+			return;
+		}
+	}
+
+	symbols = fdt_subnode_offset(fdto, 0, "__symbols__");
+	if (symbols < 0)
+		return;
+	fdt_for_each_property_offset(prop, fdto, symbols) {
+		if (!fdt_getprop_by_offset(fdto, prop, &label, NULL))
+			continue;
+		entry = overlay_cache_find(cache, label,
+					   overlay_cache_hash(label));
+		if (entry && entry->label)
+			entry->path = NULL;
+	}
+}
+
+/*
+ * Find the parts of @fdt which applying @fdto changes: the target of each
+ * fragment and /__symbols__. Targets already found are given in @target.
+ * Return the number of regions, sorted and not overlapping, or -1 if they are
+ * not all known.
+ */
+static int overlay_cache_regions(const void *fdt, const void *fdto,
+				 struct fdt_overlay_cache *cache,
+				 const int *target,
+				 struct overlay_cache_region *region, int max)
+{
+	struct overlay_cache_region new;
+	int fragment, node, count = 0;
+	const char *path;
+	bool full;
+	int i, j;
+
+	i = 0;
+	fdt_for_each_subnode(fragment, fdto, 0) {
+		if (i == max - 1)
+			return -1;
+		node = target[i++];
+		if (fdt_subnode_offset(fdto, fragment, "__overlay__") < 0)
+			continue;
+		if (node < 0) {
+			path = fdt_getprop(fdto, fragment, "target-path", NULL);
+			if (fdt_getprop(fdto, fragment, "target", NULL) || !path)
+				return -1;
+			node = overlay_cache_path_offset(fdt, path, &full);
+			if (node < 0)
+				return -1;
+		}
+		region[count++].start = node;
+	}
+	if (fdt_subnode_offset(fdto, 0, "__symbols__") >= 0) {
+		/* A new /__symbols__ goes before all other nodes */
+		node = overlay_cache_symbols(fdt, cache);
+		if (node < 0)
+			return -1;
+		region[count++].start = node;
+	}
+
+	for (i = 1; i < count; i++) {
+		new = region[i];
+		for (j = i; j > 0 && region[j - 1].start > new.start; j--)
+			region[j] = region[j - 1];
+		region[j] = new;
+	}
+	for (i = 0, j = 0; i < count; i++) {
+		if (j && region[j - 1].start == region[i].start)
+			continue;
+		region[j] = region[i];
+		region[j].end = overlay_cache_node_end(fdt, region[j].start);
+		if (j && region[j].start < region[j - 1].end)
+			return -1;
+		j++;
+	}
+
+	return j;
+}
+
+/* Get where an offset moved to, or -1 if it was inside a changed region */
+static int overlay_cache_moved(const struct overlay_cache_region *region,
+			       int count, int known, int offset)
+{
+	int delta = 0;
+	int i;
+
+	for (i = 0; i < count; i++) {
+		if (offset <= region[i].start)
+			break;
+		if (i == known || offset < region[i].end)
+			return -1;
+		delta = region[i].delta;
+	}
+
+	return offset + delta;
+}
+
+/*
+ * Move the remembered offsets after the regions changed by an overlay, and
+ * drop those inside them
+ */
+static void overlay_cache_move(const void *fdt,
+			       struct fdt_overlay_cache *cache,
+			       struct overlay_cache_region *region, int count)
+{
+	struct fdt_overlay_label *entry;
+	int delta = 0;
+	int start, end, known;
+	int i;
+
+	/* Changes are made inside each region, so its start only moves */
+	for (known = 0; known < count; known++) {
+		if (region[known].end == INT_MAX)
+			break;
+		start = region[known].start + delta;
+		end = overlay_cache_node_end(fdt, start);
+		if (end == INT_MAX)
+			break;
+		delta += end - start - (region[known].end - region[known].start);
+		region[known].delta = delta;
+	}
+
+	for (i = 0; i < cache->slots; i++) {
+		entry = &cache->label[i];
+		if (entry->offset >= 0)
+			entry->offset = overlay_cache_moved(region, count, known,
+							    entry->offset);
+	}
+	if (cache->symbols >= 0)
+		cache->symbols = overlay_cache_moved(region, count, known,
+						     cache->symbols);
+}
+
+/* Find the node behind each label in one pass over the tree */
+static void overlay_cache_find_nodes(const void *fdt,
+				     struct fdt_overlay_cache *cache)
+{
+	int path_len[OVERLAY_CACHE_DEPTH];
+	char path[OVERLAY_CACHE_PATH];
+	struct fdt_overlay_label *entry;
+	int node, depth, len, i;
+	const char *name;
+	uint mask, j;
+	int *paths;
+
+	/* Index the labels by the hash of their path */
+	paths = malloc(cache->slots * sizeof(*paths));
+	if (!paths)
+		return;
+	mask = cache->slots - 1;
+	for (i = 0; i < cache->slots; i++)
+		paths[i] = -1;
+	for (i = 0; i < cache->slots; i++) {
+		if (!cache->label[i].path)
+			continue;
+		for (j = overlay_cache_hash(cache->label[i].path);
+		     paths[j & mask] != -1; j++)
+			;
+		paths[j & mask] = i;
+	}
+
+	depth = -1;
+	for (node = fdt_next_node(fdt, -1, &depth); node >= 0 && depth >= 0;
+	     node = fdt_next_node(fdt, node, &depth)) {
+		if (depth >= OVERLAY_CACHE_DEPTH)
+			continue;
+		if (!depth) {
+			path_len[0] = 0;
+			strcpy(path, "/");
+		} else {
+			path_len[depth] = -1;
+			name = fdt_get_name(fdt, node, &len);
+			if (!name || path_len[depth - 1] < 0 ||
+			    path_len[depth - 1] + len + 2 > OVERLAY_CACHE_PATH)
+				continue;
+			path[path_len[depth - 1]] = '/';
+			memcpy(path + path_len[depth - 1] + 1, name, len);
+			path_len[depth] = path_len[depth - 1] + len + 1;
+			path[path_len[depth]] = '\0';
+		}
+
+		for (j = overlay_cache_hash(path); paths[j & mask] != -1; j++) {
+			entry = &cache->label[paths[j & mask]];
+			if (strcmp(entry->path, path))
+				continue;
+			entry->offset = node;
+			entry->phandle = fdt_get_phandle(fdt, node);
+			entry->full = true;
+		}
+	}
+
+	free(paths);
+}
+
+int fdt_overlay_cache_init(const void *fdt, struct fdt_overlay_cache *cache)
+{
+	const char *label, *path;
+	int symbols, prop, len;
+	int count = 0;
+	u32 hash;
+
+	memset(cache, '\0', sizeof(*cache));
+	arena_init(&cache->arena, 0);
+
+	cache->symbols = -1;
+	symbols = overlay_cache_symbols(fdt, cache);
+	if (symbols < 0 && symbols != -FDT_ERR_NOTFOUND)
+		return symbols;
+	if (symbols >= 0) {
+		fdt_for_each_property_offset(prop, fdt, symbols)
+			count++;
+	}
+
+	for (cache->slots = OVERLAY_CACHE_MIN_SLOTS; cache->slots < count * 2;)
+		cache->slots <<= 1;
+	cache->label = calloc(cache->slots, sizeof(*cache->label));
+	if (!cache->label) {
+		cache->slots = 0;
+		return 0;
+	}
+	if (symbols < 0)
+		return 0;
+
+	fdt_for_each_property_offset(prop, fdt, symbols) {
+		path = fdt_getprop_by_offset(fdt, prop, &label, &len);
+		if (!path) {
+			fdt_overlay_cache_uninit(cache);
+			return len;
+		}
+		if (len < 1 || path[len - 1])
+			continue;
+		hash = overlay_cache_hash(label);
+		overlay_cache_add(cache, overlay_cache_find(cache, label, hash),
+				  label, hash, path);
+	}
+	overlay_cache_find_nodes(fdt, cache);
+
+	return 0;
+}
+
+void fdt_overlay_cache_uninit(struct fdt_overlay_cache *cache)
+{
+	free(cache->label);
+	cache->label = NULL;
+	cache->slots = 0;
+	cache->used = 0;
+	arena_uninit(&cache->arena);
+}
+
+int fdt_overlay_apply_cached(void *fdt, void *fdto,
+			     struct fdt_overlay_cache *cache)
+{
+	struct overlay_cache_region *region;
+	int fragment, count, ret;
+	const char **path;
+	int *target;
+	int i;
+
+	/* One region for each fragment and one for /__symbols__ */
+	count = 1;
+	fdt_for_each_subnode(fragment, fdto, 0)
+		count++;
+	region = malloc(count * (sizeof(*region) + sizeof(*path) +
+				 sizeof(*target)));
+	if (region) {
+		path = (const char **)(region + count);
+		target = (int *)(path + count);
+		ret = overlay_cache_prepare(fdt, fdto, cache, path, target,
+					    count);
+		if (ret) {
+			free(region);
+			fdt_set_magic(fdto, ~0);
+			return ret;
+		}
+		overlay_cache_forget(fdto, cache);
+		count = overlay_cache_regions(fdt, fdto, cache, target, region,
+					      count);
+	} else {
+		overlay_cache_forget(fdto, cache);
+	}
+
+	ret = fdt_overlay_apply(fdt, fdto);
+	if (!ret && region && count >= 0) {
+		overlay_cache_move(fdt, cache, region, count);
+	} else {
+		for (i = 0; i < cache->slots; i++)
+			cache->label[i].offset = -1;
+		cache->symbols = -1;
+	}
+	free(region);
+
+	return ret;
+}
@@ -0,0 +1,319 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * Load a FIT with external data directly from storage
+ *
+ * Only the FDT part of the FIT is read into memory. The images used by the
+ * selected configuration are then read in the order they are stored, each
+ * straight to its load address when it has one, and their hashes are checked
+ * while the data comes in. Images of other configurations are never read.
+ */
+
+#define LOG_CATEGORY LOGC_BOOT
+
+#include <common.h>
+#include <errno.h>
+#include <hash.h>
+#include <image.h>
+#include <log.h>
+#include <mapmem.h>
+#include <watchdog.h>
+#include <linux/libfdt.h>
+#include <linux/sizes.h>
+
+/* Amount of image data read and hashed at once */
+#define FIT_EXT_CHUNK		SZ_1M
+
+/* Number of hash nodes of an image checked while reading */
+#define FIT_EXT_MAX_HASHES	4
+
+/* FDT space to reserve for adding a data-position property to an image */
+#define FIT_EXT_PROP_ROOM	32
+
+/**
+ * struct fit_ext_hash - Hash being calculated while an image is read
+ *
+ * @algo: Hash algorithm
+ * @ctx: Context for progressive hashing, NULL to hash once fully read
+ * @value: Expected value, from the FIT
+ * @value_len: Length of @value in bytes
+ */
+struct fit_ext_hash {
+	struct hash_algo *algo;
+	void *ctx;
+	const uint8_t *value;
+	int value_len;
+};
+
+static int fit_ext_read(struct fit_ext_load *ld, ulong offset, ulong size,
+			void *buf)
+{
+	if (ld->read(ld, offset, size, buf) != size) {
+		log_err("Failed to read %#lx bytes at %#lx\n", size, offset);
+		return -EIO;
+	}
+
+	return 0;
+}
+
+static void fit_ext_hash_abort(struct fit_ext_hash *hash, int count)
+{
+	uint8_t value[FIT_MAX_HASH_LEN];
+	int i;
+
+	/* hash_finish() is the only way to free a context */
+	for (i = 0; i < count; i++) {
+		if (hash[i].ctx)
+			hash[i].algo->hash_finish(hash[i].algo, hash[i].ctx,
+						  value, sizeof(value));
+	}
+}
+
+static int fit_ext_hash_setup(const void *fit, int noffset,
+			      struct fit_ext_hash *hash)
+{
+	struct fit_ext_hash *h;
+	uint8_t *value;
+	char *algo;
+	int count = 0;
+	int hnode;
+
+	fdt_for_each_subnode(hnode, fit, noffset) {
+		const char *name = fit_get_name(fit, hnode, NULL);
+
+		if (strncmp(name, FIT_HASH_NODENAME,
+			    strlen(FIT_HASH_NODENAME)))
+			continue;
+		if (count == FIT_EXT_MAX_HASHES)
+			break;
+
+		h = &hash[count];
+		if (fit_image_hash_get_algo(fit, hnode, &algo) ||
+		    fit_image_hash_get_value(fit, hnode, &value,
+					     &h->value_len)) {
+			fit_ext_hash_abort(hash, count);
+			return -EINVAL;
+		}
+		h->value = value;
+		h->ctx = NULL;
+		if (!hash_progressive_lookup_algo(algo, &h->algo)) {
+			if (h->algo->hash_init(h->algo, &h->ctx)) {
+				fit_ext_hash_abort(hash, count);
+				return -ENOMEM;
+			}
+		} else if (hash_lookup_algo(algo, &h->algo)) {
+			/* Left for fit_image_load() to check */
+			log_debug("No streaming support for '%s'\n", algo);
+			continue;
+		}
+		count++;
+	}
+
+	return count;
+}
+
+static int fit_ext_hash_check(struct fit_ext_hash *hash, int count,
+			      const void *data, ulong size)
+{
+	uint8_t value[FIT_MAX_HASH_LEN];
+	struct fit_ext_hash *h;
+	int ret = 0;
+	int i;
+
+	for (i = 0; i < count; i++) {
+		h = &hash[i];
+		if (h->ctx) {
+			if (h->algo->hash_finish(h->algo, h->ctx, value,
+						 sizeof(value)))
+				ret = -EIO;
+		} else {
+			h->algo->hash_func_ws(data, size, value,
+					      h->algo->chunk_size);
+		}
+		if (!ret && (h->value_len != h->algo->digest_size ||
+			     memcmp(value, h->value, h->value_len)))
+			ret = -EACCES;
+	}
+
+	return ret;
+}
+
+static int fit_ext_load_image(struct fit_ext_load *ld, const void *fit,
+			      struct fit_plan_image *img, void *buf)
+{
+	struct fit_ext_hash hash[FIT_EXT_MAX_HASHES];
+	ulong done, chunk;
+	int count, i;
+	int ret;
+
+	count = fit_ext_hash_setup(fit, img->noffset, hash);
+	if (count < 0)
+		return count;
+
+	for (done = 0; done < img->size; done += chunk) {
+		chunk = min_t(ulong, img->size - done, FIT_EXT_CHUNK);
+		ret = fit_ext_read(ld, img->pos + done, chunk, buf + done);
+		for (i = 0; !ret && i < count; i++) {
+			if (hash[i].ctx &&
+			    hash[i].algo->hash_update(hash[i].algo, hash[i].ctx,
+						      buf + done, chunk,
+						      done + chunk ==
+						      img->size)) {
+				/* hash_update() frees the context on error */
+				hash[i].ctx = NULL;
+				ret = -EIO;
+			}
+		}
+		if (ret) {
+			fit_ext_hash_abort(hash, count);
+			return ret;
+		}
+		WATCHDOG_RESET();
+	}
+
+	return fit_ext_hash_check(hash, count, buf, img->size);
+}
+
+static bool fit_ext_overlaps(ulong start, ulong size, ulong other_start,
+			     ulong other_size)
+{
+	return start < other_start + other_size && other_start < start + size;
+}
+
+int fit_ext_load(struct fit_ext_load *ld, ulong addr, const char *conf_uname,
+		 ulong *sizep)
+{
+	ulong dest[FIT_PLAN_MAX_IMAGES];
+	struct fit_load_plan plan;
+	struct fit_plan_image *img;
+	ulong hdr_size, room, shift, win_end;
+	ulong total = 0;
+	int cfg_noffset;
+	void *fit;
+	uint8_t comp;
+	ulong load;
+	int i, j;
+	int ret;
+
+	fit = map_sysmem(addr, 0);
+	ret = fit_ext_read(ld, 0, sizeof(struct fdt_header), fit);
+	if (ret)
+		return ret;
+	if (fdt_magic(fit) != FDT_MAGIC ||
+	    fdt_totalsize(fit) < sizeof(struct fdt_header)) {
+		puts("Bad FIT image format\n");
+		return -EINVAL;
+	}
+	hdr_size = fdt_totalsize(fit);
+	ret = fit_ext_read(ld, sizeof(struct fdt_header),
+			   hdr_size - sizeof(struct fdt_header),
+			   fit + sizeof(struct fdt_header));
+	if (ret)
+		return ret;
+
+	ret = fit_check_format(fit, IMAGE_SIZE_INVAL);
+	if (ret) {
+		printf("Bad FIT image format! (err=%d)\n", ret);
+		return ret;
+	}
+
+	cfg_noffset = fit_conf_get_node(fit, conf_uname);
+	if (cfg_noffset < 0) {
+		puts("Could not find configuration node\n");
+		return -ENOENT;
+	}
+	printf("   Using '%s' configuration\n",
+	       fdt_get_name(fit, cfg_noffset, NULL));
+
+	ret = fit_conf_get_load_plan(fit, cfg_noffset, &plan);
+	if (ret) {
+		printf("Too many images in configuration (max %d)\n",
+		       FIT_PLAN_MAX_IMAGES);
+		return ret;
+	}
+
+	/*
+	 * The FDT grows by up to @room to hold data-position properties, so
+	 * images without a load address are placed @shift bytes after where
+	 * they would be if the whole FIT had been loaded.
+	 */
+	room = ALIGN(hdr_size + plan.count * FIT_EXT_PROP_ROOM, 4);
+	shift = room - ALIGN(hdr_size, 4);
+	win_end = addr + room;
+	for (i = 0; i < plan.count; i++) {
+		img = &plan.image[i];
+		if (img->pos >= hdr_size)
+			win_end = max(win_end, addr + shift + img->pos +
+				      img->size);
+	}
+
+	for (i = 0; i < plan.count; i++) {
+		img = &plan.image[i];
+		dest[i] = 0;
+		if (img->pos < hdr_size)
+			continue;	/* data is embedded in the FDT */
+
+		dest[i] = addr + shift + img->pos;
+		if (fit_image_get_load(fit, img->noffset, &load) ||
+		    fit_image_get_comp(fit, img->noffset, &comp) ||
+		    comp != IH_COMP_NONE || load < addr ||
+		    load - addr > INT_MAX ||
+		    fit_ext_overlaps(load, img->size, addr, win_end - addr))
+			continue;
+		for (j = 0; j < i; j++) {
+			if (dest[j] && fit_ext_overlaps(load, img->size,
+							dest[j],
+							plan.image[j].size))
+				break;
+		}
+		if (j == i)
+			dest[i] = load;
+	}
+
+	for (i = 0; i < plan.count; i++) {
+		img = &plan.image[i];
+		if (!dest[i])
+			continue;
+		printf("   Loading '%s' (%lu bytes) to %08lx ... ",
+		       fit_get_name(fit, img->noffset, NULL), img->size,
+		       dest[i]);
+		ret = fit_ext_load_image(ld, fit, img,
+					 map_sysmem(dest[i], img->size));
+		if (ret) {
+			puts(ret == -EACCES ? "Bad Data Hash\n" : "Failed\n");
+			return ret;
+		}
+		puts("OK\n");
+		total += img->size;
+	}
+
+	/*
+	 * Point each image at the place it was loaded to. Properties are
+	 * added from the last node backwards so that the offsets of the
+	 * nodes still to be updated do not move.
+	 */
+	ret = fdt_open_into(fit, fit, room);
+	for (i = 0; !ret && i < plan.count; i++) {
+		int last = -1;
+
+		for (j = 0; j < plan.count; j++) {
+			if (dest[j] && (last < 0 || plan.image[j].noffset >
+					plan.image[last].noffset))
+				last = j;
+		}
+		if (last < 0)
+			break;
+		ret = fdt_setprop_u32(fit, plan.image[last].noffset,
+				      FIT_DATA_POSITION_PROP,
+				      dest[last] - addr);
+		dest[last] = 0;
+	}
+	if (ret) {
+		printf("Failed to update FIT: %s\n", fdt_strerror(ret));
+		return -ENOSPC;
+	}
+
+	if (sizep)
+		*sizep = total;
+
+	return 0;
+}
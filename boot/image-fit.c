@@ -1915,6 +1915,127 @@ int fit_conf_get_prop_node(const void *fit, int noffset,
 	return fit_conf_get_prop_node_index(fit, noffset, prop_name, 0);
 }
 
+static const char *const fit_plan_props[] = {
+	FIT_KERNEL_PROP,
+	FIT_FDT_PROP,
+	FIT_RAMDISK_PROP,
+	FIT_LOADABLE_PROP,
+	FIT_SETUP_PROP,
+	FIT_FPGA_PROP,
+	FIT_FIRMWARE_PROP,
+	FIT_STANDALONE_PROP,
+};
+
+static int fit_plan_add(const void *fit, struct fit_load_plan *plan,
+			int noffset)
+{
+	struct fit_plan_image *img;
+	const void *data;
+	size_t size;
+	ulong pos;
+	int i;
+
+	for (i = 0; i < plan->count; i++) {
+		if (plan->image[i].noffset == noffset)
+			return 0;
+	}
+	if (plan->count == FIT_PLAN_MAX_IMAGES)
+		return -ENOSPC;
+
+	/* Leave broken images to be reported when they are loaded */
+	if (fit_image_get_data_and_size(fit, noffset, &data, &size))
+		return 0;
+	pos = (ulong)((const char *)data - (const char *)fit);
+
+	/* Insert sorted by data position; the list is short */
+	for (i = plan->count; i > 0 && plan->image[i - 1].pos > pos; i--)
+		plan->image[i] = plan->image[i - 1];
+	img = &plan->image[i];
+	img->noffset = noffset;
+	img->pos = pos;
+	img->size = size;
+	img->verified = false;
+	plan->count++;
+
+	return 0;
+}
+
+int fit_conf_get_load_plan(const void *fit, int cfg_noffset,
+			   struct fit_load_plan *plan)
+{
+	int i, j, count, noffset, ret;
+
+	memset(plan, '\0', sizeof(*plan));
+	for (i = 0; i < ARRAY_SIZE(fit_plan_props); i++) {
+		count = fit_conf_get_prop_node_count(fit, cfg_noffset,
+						     fit_plan_props[i]);
+		for (j = 0; j < count; j++) {
+			noffset = fit_conf_get_prop_node_index(fit, cfg_noffset,
+							       fit_plan_props[i],
+							       j);
+			if (noffset < 0)
+				continue;
+			ret = fit_plan_add(fit, plan, noffset);
+			if (ret) {
+				plan->count = 0;
+				return ret;
+			}
+		}
+	}
+	plan->fit = fit;
+	plan->cfg_noffset = cfg_noffset;
+
+	return 0;
+}
+
+int fit_conf_verify_plan(const void *fit, struct fit_load_plan *plan)
+{
+	struct fit_plan_image *img;
+	const char *uname;
+	char *name;
+	int i;
+
+	for (i = 0; i < plan->count; i++) {
+		img = &plan->image[i];
+		if (img->verified)
+			continue;
+		uname = fit_get_name(fit, img->noffset, NULL);
+		printf("   Verifying '%s' (%lu bytes at %#lx) ... ", uname,
+		       img->size, img->pos);
+		if (!fit_image_verify(fit, img->noffset)) {
+			puts("Bad Data Hash\n");
+			return -EACCES;
+		}
+		puts("OK\n");
+		img->verified = true;
+
+		if (IS_ENABLED(CONFIG_BOOTSTAGE)) {
+			name = malloc(strlen(uname) + 8);
+			if (name) {
+				sprintf(name, "verify %s", uname);
+				bootstage_mark_name(BOOTSTAGE_ID_ALLOC, name);
+			}
+		}
+	}
+
+	return 0;
+}
+
+bool fit_plan_image_verified(const struct fit_load_plan *plan,
+			     const void *fit, int noffset)
+{
+	int i;
+
+	if (plan->fit != fit)
+		return false;
+	for (i = 0; i < plan->count; i++) {
+		if (plan->image[i].noffset == noffset)
+			return plan->image[i].verified;
+	}
+
+	return false;
+}
+
 static int fit_image_select(const void *fit, int rd_noffset, int verify)
 {
 	fit_image_print(fit, rd_noffset, "   ");
@@ -2072,6 +2193,19 @@ int fit_image_load(bootm_headers_t *images, ulong addr,
 
 		bootstage_mark(BOOTSTAGE_ID_FIT_CONFIG);
 
+		if (CONFIG_IS_ENABLED(FIT_LOAD_PLAN) && images->verify &&
+		    (images->fit_plan.fit != fit ||
+		     images->fit_plan.cfg_noffset != cfg_noffset)) {
+			/* If the plan cannot be built, verify per image */
+			if (!fit_conf_get_load_plan(fit, cfg_noffset,
+						    &images->fit_plan) &&
+			    fit_conf_verify_plan(fit, &images->fit_plan)) {
+				bootstage_error(bootstage_id +
+						BOOTSTAGE_SUB_HASH);
+				return -EACCES;
+			}
+		}
+
 		noffset = fit_conf_get_prop_node(fit, cfg_noffset,
 						 prop_name);
 		fit_uname = fit_get_name(fit, noffset, NULL);
@@ -2084,7 +2218,10 @@ int fit_image_load(bootm_headers_t *images, ulong addr,
 
 	printf("   Trying '%s' %s subimage\n", fit_uname, prop_name);
 
-	ret = fit_image_select(fit, noffset, images->verify);
+	ret = fit_image_select(fit, noffset, images->verify &&
+			       !(CONFIG_IS_ENABLED(FIT_LOAD_PLAN) &&
+				 fit_plan_image_verified(&images->fit_plan,
+							 fit, noffset)));
 	if (ret) {
 		bootstage_error(bootstage_id + BOOTSTAGE_SUB_HASH);
 		return ret;
@@ -2285,7 +2422,8 @@ int boot_get_fdt_fit(bootm_headers_t *images, ulong addr,
 	ulong load, len;
 #ifdef CONFIG_OF_LIBFDT_OVERLAY
 	ulong image_start, image_end;
-	ulong ovload, ovlen, ovcopylen;
+	ulong ovload, ovlen, ovcopylen, used;
+	struct fdt_overlay_cache cache = { };
 	const char *uconfig;
 	const char *uname;
 	void *base, *ov, *ovcopy = NULL;
@@ -2342,6 +2480,23 @@ int boot_get_fdt_fit(bootm_headers_t *images, ulong addr,
 	}
 
 	base = map_sysmem(load, len);
+	err = fdt_open_into(base, base, len);
+	if (err < 0) {
+		printf("failed on fdt_open_into\n");
+		fdt_noffset = err;
+		goto out;
+	}
+
+	/*
+	 * Look up the labels of the base tree through one cache for all the
+	 * overlays, and only pack the result at the end
+	 */
+	err = fdt_overlay_cache_init(base, &cache);
+	if (err < 0) {
+		printf("failed on fdt_overlay_cache_init\n");
+		fdt_noffset = err;
+		goto out;
+	}
 
 	/* apply extra configs in FIT first, followed by args */
 	for (i = 1; ; i++) {
@@ -2402,26 +2557,30 @@ int boot_get_fdt_fit(bootm_headers_t *images, ulong addr,
 			goto out;
 		}
 
-		base = map_sysmem(load, len + ovlen);
-		err = fdt_open_into(base, base, len + ovlen);
-		if (err < 0) {
-			printf("failed on fdt_open_into\n");
-			fdt_noffset = err;
-			goto out;
+		/* free space is at the end after fdt_open_into() */
+		used = fdt_off_dt_strings(base) + fdt_size_dt_strings(base);
+		if (used + ovlen > fdt_totalsize(base)) {
+			base = map_sysmem(load, used + ovlen);
+			err = fdt_open_into(base, base, used + ovlen);
+			if (err < 0) {
+				printf("failed on fdt_open_into\n");
+				fdt_noffset = err;
+				goto out;
+			}
 		}
 
 		/* the verbose method prints out messages on error */
-		err = fdt_overlay_apply_verbose(base, ovcopy);
+		err = fdt_overlay_apply_cached_verbose(base, ovcopy, &cache);
 		if (err < 0) {
 			fdt_noffset = err;
 			goto out;
 		}
-		fdt_pack(base);
-		len = fdt_totalsize(base);
 
 		free(ovcopy);
 		ovcopy = NULL;
 	}
+	fdt_pack(base);
+	len = fdt_totalsize(base);
 #else
 	printf("config with overlays but CONFIG_OF_LIBFDT_OVERLAY not set\n");
 	fdt_noffset = -EBADF;
@@ -2440,6 +2599,7 @@ out:
 #ifdef CONFIG_OF_LIBFDT_OVERLAY
 	if (ovcopy)
 		free(ovcopy);
+	fdt_overlay_cache_uninit(&cache);
 #endif
 	if (fit_uname_config_copy)
 		free(fit_uname_config_copy);
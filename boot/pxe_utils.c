@@ -79,27 +79,21 @@ int format_mac_pxe(char *outbuf, size_t outbuf_len)
 }
 
 /**
- * get_relfile() - read a file relative to the PXE file
+ * get_relpath() - join a path relative to the PXE file with the bootfile path
  *
  * As in pxelinux, paths to files referenced from files we retrieve are
- * relative to the location of bootfile. get_relfile takes such a path and
- * joins it with the bootfile path to get the full path to the target file. If
- * the bootfile path is NULL, we use file_path as is.
+ * relative to the location of bootfile. If the bootfile path is NULL, we use
+ * file_path as is.
  *
  * @ctx: PXE context
- * @file_path: File path to read (relative to the PXE file)
- * @file_addr: Address to load file to
- * @filesizep: If not NULL, returns the file size in bytes
- * Returns 1 for success, or < 0 on error
+ * @file_path: File path (relative to the PXE file)
+ * @relfile: Returns the full path, MAX_TFTP_PATH_LEN + 1 bytes
+ * Returns 0 for success, -ENAMETOOLONG if the full path is too long
  */
-static int get_relfile(struct pxe_context *ctx, const char *file_path,
-		       unsigned long file_addr, ulong *filesizep)
+static int get_relpath(struct pxe_context *ctx, const char *file_path,
+		       char *relfile)
 {
 	size_t path_len;
-	char relfile[MAX_TFTP_PATH_LEN + 1];
-	char addr_buf[18];
-	ulong size;
-	int ret;
 
 	if (file_path[0] == '/' && ctx->allow_abs_path)
 		*relfile = '\0';
@@ -116,13 +110,77 @@ static int get_relfile(struct pxe_context *ctx, const char *file_path,
 
 	strcat(relfile, file_path);
 
-	printf("Retrieving file: %s\n", relfile);
+	return 0;
+}
+
+/**
+ * get_prefetched() - look for a file fetched by label_prefetch()
+ *
+ * A file is only used once, so that a later label loading other contents to
+ * the same place still fetches them.
+ *
+ * @ctx: PXE context
+ * @relfile: Full path to the file
+ * @file_addr: Address the file must be at
+ * @sizep: Returns the file size in bytes
+ * Returns true if the file is already at @file_addr
+ */
+static bool get_prefetched(struct pxe_context *ctx, const char *relfile,
+			   ulong file_addr, ulong *sizep)
+{
+	struct pxe_file *file;
+	int i;
+
+	for (i = 0; i < ctx->num_prefetched; i++) {
+		file = &ctx->prefetched[i];
+		if (file->path && !file->err && file->addr == file_addr &&
+		    !strcmp(file->path, relfile)) {
+			*sizep = file->size;
+			free(file->path);
+			file->path = NULL;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+/**
+ * get_relfile() - read a file relative to the PXE file
+ *
+ * The path is joined with the bootfile path by get_relpath(). A file
+ * fetched ahead by label_prefetch() is not read again.
+ *
+ * @ctx: PXE context
+ * @file_path: File path to read (relative to the PXE file)
+ * @file_addr: Address to load file to
+ * @filesizep: If not NULL, returns the file size in bytes
+ * Returns 1 for success, or < 0 on error
+ */
+static int get_relfile(struct pxe_context *ctx, const char *file_path,
+		       unsigned long file_addr, ulong *filesizep)
+{
+	char relfile[MAX_TFTP_PATH_LEN + 1];
+	char addr_buf[18];
+	ulong size;
+	int ret;
+
+	ret = get_relpath(ctx, file_path, relfile);
+	if (ret)
+		return ret;
 
-	sprintf(addr_buf, "%lx", file_addr);
+	if (get_prefetched(ctx, relfile, file_addr, &size)) {
+		printf("Retrieving file: %s (prefetched)\n", relfile);
+		env_set_hex("filesize", size);
+	} else {
+		printf("Retrieving file: %s\n", relfile);
 
-	ret = ctx->getfile(ctx, relfile, addr_buf, &size);
-	if (ret < 0)
-		return log_msg_ret("get", ret);
+		sprintf(addr_buf, "%lx", file_addr);
+
+		ret = ctx->getfile(ctx, relfile, addr_buf, &size);
+		if (ret < 0)
+			return log_msg_ret("get", ret);
+	}
 	if (filesizep)
 		*filesizep = size;
 
@@ -401,6 +459,157 @@ skip_overlay:
 }
 #endif
 
+/**
+ * label_get_fdtfile() - work out the device tree file of a label
+ *
+ * This is the "fdt" file of the label, or else a file in its "fdtdir"
+ * directory named after $fdtfile, or after $soc and $board.
+ *
+ * @label: Label to process
+ * @fdtfilep: Returns the file name, or NULL if the label gives none
+ * @freep: Returns the memory to free once done with the name, or NULL
+ * Returns 0 if OK, -ENOMEM if out of memory
+ */
+static int label_get_fdtfile(struct pxe_label *label, char **fdtfilep,
+			     char **freep)
+{
+	char *f1, *f2, *f3, *f4, *slash;
+	char *fdtfile;
+	int len;
+
+	*fdtfilep = NULL;
+	*freep = NULL;
+	if (label->fdt) {
+		*fdtfilep = label->fdt;
+		return 0;
+	}
+	if (!label->fdtdir)
+		return 0;
+
+	f1 = env_get("fdtfile");
+	if (f1) {
+		f2 = "";
+		f3 = "";
+		f4 = "";
+	} else {
+		/*
+		 * For complex cases where this code doesn't
+		 * generate the correct filename, the board
+		 * code should set $fdtfile during early boot,
+		 * or the boot scripts should set $fdtfile
+		 * before invoking "pxe" or "sysboot".
+		 */
+		f1 = env_get("soc");
+		f2 = "-";
+		f3 = env_get("board");
+		f4 = ".dtb";
+		if (!f1) {
+			f1 = "";
+			f2 = "";
+		}
+		if (!f3) {
+			f2 = "";
+			f3 = "";
+		}
+	}
+
+	len = strlen(label->fdtdir);
+	if (!len)
+		slash = "./";
+	else if (label->fdtdir[len - 1] != '/')
+		slash = "/";
+	else
+		slash = "";
+
+	len = strlen(label->fdtdir) + strlen(slash) +
+		strlen(f1) + strlen(f2) + strlen(f3) +
+		strlen(f4) + 1;
+	fdtfile = malloc(len);
+	if (!fdtfile) {
+		printf("malloc fail (FDT filename)\n");
+		return -ENOMEM;
+	}
+
+	snprintf(fdtfile, len, "%s%s%s%s%s%s",
+		 label->fdtdir, slash, f1, f2, f3, f4);
+	*fdtfilep = fdtfile;
+	*freep = fdtfile;
+
+	return 0;
+}
+
+/**
+ * label_drop_prefetched() - forget the files fetched for a label
+ *
+ * @ctx: PXE context
+ */
+static void label_drop_prefetched(struct pxe_context *ctx)
+{
+	int i;
+
+	for (i = 0; i < ctx->num_prefetched; i++)
+		free(ctx->prefetched[i].path);
+	ctx->num_prefetched = 0;
+}
+
+/**
+ * label_prefetch() - fetch the files of a label all at once
+ *
+ * The initrd, kernel and device tree are fetched together with
+ * ctx->prefetch, if there is one, and get_relfile() then finds them loaded.
+ * Those which failed are fetched again by get_relfile(), which reports the
+ * error as usual.
+ *
+ * @ctx: PXE context
+ * @label: Label to process
+ * @fdtfile: Device tree file of the label, or NULL
+ */
+static void label_prefetch(struct pxe_context *ctx, struct pxe_label *label,
+			   const char *fdtfile)
+{
+	const char *paths[PXE_MAX_PREFETCH] = {
+		label->initrd, label->kernel, fdtfile
+	};
+	static const char *const envaddrs[PXE_MAX_PREFETCH] = {
+		"ramdisk_addr_r", "kernel_addr_r", "fdt_addr_r"
+	};
+	char relfile[MAX_TFTP_PATH_LEN + 1];
+	struct pxe_file *file;
+	char *envaddr;
+	ulong addr;
+	int i;
+
+	label_drop_prefetched(ctx);
+	if (!ctx->prefetch)
+		return;
+
+	for (i = 0; i < PXE_MAX_PREFETCH; i++) {
+		envaddr = env_get(envaddrs[i]);
+		if (!paths[i] || !envaddr ||
+		    strict_strtoul(envaddr, 16, &addr) < 0 ||
+		    get_relpath(ctx, paths[i], relfile))
+			continue;
+
+		file = &ctx->prefetched[ctx->num_prefetched];
+		memset(file, '\0', sizeof(*file));
+		file->path = strdup(relfile);
+		if (!file->path)
+			break;
+		file->addr = addr;
+		ctx->num_prefetched++;
+	}
+
+	/* One file alone is fetched just as fast by getfile() */
+	if (ctx->num_prefetched < 2) {
+		label_drop_prefetched(ctx);
+		return;
+	}
+
+	printf("Prefetching %d files\n", ctx->num_prefetched);
+	if (ctx->prefetch(ctx, ctx->prefetched, ctx->num_prefetched))
+		printf("Prefetch incomplete, retrieving the rest one by one\n");
+}
+
 /**
  * label_boot() - Boot according to the contents of a pxe_label
  *
@@ -434,8 +643,9 @@ static int label_boot(struct pxe_context *ctx, struct pxe_label *label)
 	char *fit_addr = NULL;
 	int bootm_argc = 2;
 	int zboot_argc = 3;
-	int len = 0;
 	ulong kernel_addr_r;
+	char *fdtfile = NULL;
+	char *fdtfilefree = NULL;
 	void *buf;
 
 	label_print(label);
@@ -454,6 +664,12 @@ static int label_boot(struct pxe_context *ctx, struct pxe_label *label)
 		return 1;
 	}
 
+	if (env_get("fdt_addr_r") &&
+	    label_get_fdtfile(label, &fdtfile, &fdtfilefree))
+		return 1;
+
+	label_prefetch(ctx, label, fdtfile);
+
 	if (label->initrd) {
 		ulong size;
 
@@ -461,7 +677,7 @@ static int label_boot(struct pxe_context *ctx, struct pxe_label *label)
 					&size) < 0) {
 			printf("Skipping %s for failure retrieving initrd\n",
 			       label->name);
-			return 1;
+			goto cleanup;
 		}
 
 		initrd_addr_str = env_get("ramdisk_addr_r");
@@ -476,7 +692,7 @@ static int label_boot(struct pxe_context *ctx, struct pxe_label *label)
 				NULL) < 0) {
 		printf("Skipping %s for failure retrieving kernel\n",
 		       label->name);
-		return 1;
+		goto cleanup;
 	}
 
 	if (label->ipappend & 0x1) {
@@ -506,7 +722,7 @@ static int label_boot(struct pxe_context *ctx, struct pxe_label *label)
 			       strlen(label->append ?: ""),
 			       strlen(ip_str), strlen(mac_str),
 			       sizeof(bootargs));
-			return 1;
+			goto cleanup;
 		}
 
 		if (label->append)
@@ -530,7 +746,7 @@ static int label_boot(struct pxe_context *ctx, struct pxe_label *label)
 		fit_addr = malloc(len);
 		if (!fit_addr) {
 			printf("malloc fail (FIT address)\n");
-			return 1;
+			goto cleanup;
 		}
 		snprintf(fit_addr, len, "%s%s", kernel_addr, label->config);
 		kernel_addr = fit_addr;
@@ -556,68 +772,10 @@ static int label_boot(struct pxe_context *ctx, struct pxe_label *label)
 
 	/* if fdt label is defined then get fdt from server */
 	if (bootm_argv[3]) {
-		char *fdtfile = NULL;
-		char *fdtfilefree = NULL;
-
-		if (label->fdt) {
-			fdtfile = label->fdt;
-		} else if (label->fdtdir) {
-			char *f1, *f2, *f3, *f4, *slash;
-
-			f1 = env_get("fdtfile");
-			if (f1) {
-				f2 = "";
-				f3 = "";
-				f4 = "";
-			} else {
-				/*
-				 * For complex cases where this code doesn't
-				 * generate the correct filename, the board
-				 * code should set $fdtfile during early boot,
-				 * or the boot scripts should set $fdtfile
-				 * before invoking "pxe" or "sysboot".
-				 */
-				f1 = env_get("soc");
-				f2 = "-";
-				f3 = env_get("board");
-				f4 = ".dtb";
-				if (!f1) {
-					f1 = "";
-					f2 = "";
-				}
-				if (!f3) {
-					f2 = "";
-					f3 = "";
-				}
-			}
-
-			len = strlen(label->fdtdir);
-			if (!len)
-				slash = "./";
-			else if (label->fdtdir[len - 1] != '/')
-				slash = "/";
-			else
-				slash = "";
-
-			len = strlen(label->fdtdir) + strlen(slash) +
-				strlen(f1) + strlen(f2) + strlen(f3) +
-				strlen(f4) + 1;
-			fdtfilefree = malloc(len);
-			if (!fdtfilefree) {
-				printf("malloc fail (FDT filename)\n");
-				goto cleanup;
-			}
-
-			snprintf(fdtfilefree, len, "%s%s%s%s%s%s",
-				 label->fdtdir, slash, f1, f2, f3, f4);
-			fdtfile = fdtfilefree;
-		}
-
 		if (fdtfile) {
 			int err = get_relfile_envaddr(ctx, fdtfile,
 						      "fdt_addr_r", NULL);
 
-			free(fdtfilefree);
 			if (err < 0) {
 				bootm_argv[3] = NULL;
 
@@ -677,6 +835,7 @@ static int label_boot(struct pxe_context *ctx, struct pxe_label *label)
 
 cleanup:
 	free(fit_addr);
+	free(fdtfilefree);
 
 	return 1;
 }
@@ -1492,6 +1651,7 @@ int pxe_setup_ctx(struct pxe_context *ctx, struct cmd_tbl *cmdtp,
 
 void pxe_destroy_ctx(struct pxe_context *ctx)
 {
+	label_drop_prefetched(ctx);
 	free(ctx->bootdir);
 }
 
@@ -6,6 +6,7 @@
 
 #include <common.h>
 #include <bootm.h>
+#include <bootstage.h>
 #include <command.h>
 #include <image.h>
 #include <irq_func.h>
@@ -83,6 +84,10 @@ static int booti_start(struct cmd_tbl *cmdtp, int flag, int argc,
 		printf("Moving Image from 0x%lx to 0x%lx, end=%lx\n", ld,
 		       relocated_addr, relocated_addr + image_size);
 		memmove((void *)relocated_addr, (void *)ld, image_size);
+		bootstage_mark(BOOTSTAGE_ID_KERNEL_LOADED);
+	} else {
+		bootstage_mark_name(BOOTSTAGE_ID_KERNEL_LOADED,
+				    "kernel_in_place");
 	}
 
 	images->ep = relocated_addr;
@@ -6,6 +6,9 @@
 #include <common.h>
 #include <bootstage.h>
 #include <command.h>
+#include <env.h>
+#include <malloc.h>
+#include <mapmem.h>
 
 static int do_bootstage_report(struct cmd_tbl *cmdtp, int flag, int argc,
 			       char *const argv[])
@@ -59,10 +62,50 @@ static int do_bootstage_stash(struct cmd_tbl *cmdtp, int flag, int argc,
 	return 0;
 }
 
+#ifdef CONFIG_BOOTSTAGE_TRACE
+static int do_bootstage_trace(struct cmd_tbl *cmdtp, int flag, int argc,
+			      char *const argv[])
+{
+	ulong addr, size;
+	char *buf;
+	int len;
+
+	len = bootstage_trace_json(NULL, 0);
+	if (argc < 2) {
+		buf = malloc(len + 1);
+		if (!buf) {
+			printf("Out of memory\n");
+			return CMD_RET_FAILURE;
+		}
+		bootstage_trace_json(buf, len + 1);
+		puts(buf);
+		free(buf);
+
+		return 0;
+	}
+
+	addr = hextoul(argv[1], NULL);
+	size = argc > 2 ? hextoul(argv[2], NULL) : len + 1;
+	buf = map_sysmem(addr, size);
+	len = bootstage_trace_json(buf, size);
+	unmap_sysmem(buf);
+	if (len >= size) {
+		printf("Trace needs %x bytes\n", len + 1);
+		return CMD_RET_FAILURE;
+	}
+	env_set_hex("filesize", len);
+
+	return 0;
+}
+#endif
+
 static struct cmd_tbl cmd_bootstage_sub[] = {
 	U_BOOT_CMD_MKENT(report, 2, 1, do_bootstage_report, "", ""),
 	U_BOOT_CMD_MKENT(stash, 4, 0, do_bootstage_stash, "", ""),
 	U_BOOT_CMD_MKENT(unstash, 4, 0, do_bootstage_stash, "", ""),
+#ifdef CONFIG_BOOTSTAGE_TRACE
+	U_BOOT_CMD_MKENT(trace, 3, 0, do_bootstage_trace, "", ""),
+#endif
 };
 
 /*
@@ -93,4 +136,7 @@ U_BOOT_CMD(bootstage, 4, 1, do_boostage,
 	"report                      - Print a report\n"
 	"stash [<start> [<size>]]    - Stash data into memory\n"
 	"unstash [<start> [<size>]]  - Unstash data from memory"
+#ifdef CONFIG_BOOTSTAGE_TRACE
+	"\ntrace [<start> [<size>]]    - Write timings as Chrome trace JSON"
+#endif
 );
@@ -0,0 +1,250 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * Load one configuration of a FIT with external data from storage
+ */
+
+#include <common.h>
+#include <blk.h>
+#include <command.h>
+#include <env.h>
+#include <fs.h>
+#include <image.h>
+#include <log.h>
+#include <malloc.h>
+#include <mapmem.h>
+#include <memalign.h>
+#include <mtd.h>
+#include <part.h>
+#include <linux/err.h>
+#include <linux/math64.h>
+#include <linux/mtd/mtd.h>
+
+struct fitload_fs {
+	const char *ifname;
+	const char *dev_part;
+	const char *filename;
+};
+
+struct fitload_blk {
+	struct blk_desc *desc;
+	lbaint_t start;
+	ulong offset;
+	void *bounce;
+};
+
+static ulong fitload_fs_read(struct fit_ext_load *ld, ulong offset,
+			     ulong size, void *buf)
+{
+	struct fitload_fs *priv = ld->priv;
+	loff_t actread;
+
+	/* fs_read() closes the filesystem each time */
+	if (fs_set_blk_dev(priv->ifname, priv->dev_part, FS_TYPE_ANY))
+		return 0;
+	if (fs_read(priv->filename, map_to_sysmem(buf), offset, size,
+		    &actread))
+		return 0;
+
+	return actread;
+}
+
+static ulong fitload_blk_read(struct fit_ext_load *ld, ulong offset,
+			      ulong size, void *buf)
+{
+	struct fitload_blk *priv = ld->priv;
+	ulong blksz = priv->desc->blksz;
+	ulong done = 0, skip, len;
+	lbaint_t blk, cnt;
+
+	offset += priv->offset;
+	while (done < size) {
+		blk = priv->start + offset / blksz;
+		skip = offset % blksz;
+		if (!skip && size - done >= blksz) {
+			/* Whole blocks go straight to the destination */
+			cnt = (size - done) / blksz;
+			if (blk_dread(priv->desc, blk, cnt, buf + done) != cnt)
+				break;
+			len = cnt * blksz;
+		} else {
+			if (blk_dread(priv->desc, blk, 1, priv->bounce) != 1)
+				break;
+			len = min(blksz - skip, size - done);
+			memcpy(buf + done, priv->bounce + skip, len);
+		}
+		done += len;
+		offset += len;
+	}
+
+	return done;
+}
+
+static int fitload_run(struct fit_ext_load *ld, const char *addr_str,
+		       const char *conf_uname)
+{
+	ulong addr, size, time;
+	int ret;
+
+	addr = hextoul(addr_str, NULL);
+	printf("## Loading FIT configuration to %08lx ...\n", addr);
+	time = get_timer(0);
+	ret = fit_ext_load(ld, addr, conf_uname, &size);
+	time = get_timer(time);
+	if (ret)
+		return CMD_RET_FAILURE;
+
+	printf("%lu bytes read in %lu ms", size, time);
+	if (time > 0) {
+		puts(" (");
+		print_size(div_u64(size, time) * 1000, "/s");
+		puts(")");
+	}
+	puts("\n");
+	env_set_hex("filesize", size);
+
+	return CMD_RET_SUCCESS;
+}
+
+static int do_fitload_fs(struct cmd_tbl *cmdtp, int flag, int argc,
+			 char *const argv[])
+{
+	struct fitload_fs priv;
+	struct fit_ext_load ld = {
+		.priv = &priv,
+		.read = fitload_fs_read,
+	};
+
+	if (argc < 5 || argc > 6)
+		return CMD_RET_USAGE;
+
+	priv.ifname = argv[1];
+	priv.dev_part = argv[2];
+	priv.filename = argv[4];
+	if (fs_set_blk_dev(priv.ifname, priv.dev_part, FS_TYPE_ANY)) {
+		log_err("Can't set block device\n");
+		return CMD_RET_FAILURE;
+	}
+	fs_close();
+
+	return fitload_run(&ld, argv[3], argc > 5 ? argv[5] : NULL);
+}
+
+static int do_fitload_blk(struct cmd_tbl *cmdtp, int flag, int argc,
+			  char *const argv[])
+{
+	struct disk_partition info;
+	struct fitload_blk priv;
+	struct fit_ext_load ld = {
+		.priv = &priv,
+		.read = fitload_blk_read,
+	};
+	int ret;
+
+	if (argc < 4 || argc > 6)
+		return CMD_RET_USAGE;
+
+	if (blk_get_device_part_str(argv[1], argv[2], &priv.desc, &info,
+				    1) < 0)
+		return CMD_RET_FAILURE;
+	priv.start = info.start;
+	priv.offset = argc > 4 ? hextoul(argv[4], NULL) : 0;
+	priv.bounce = malloc_cache_aligned(priv.desc->blksz);
+	if (!priv.bounce)
+		return CMD_RET_FAILURE;
+
+	ret = fitload_run(&ld, argv[3], argc > 5 ? argv[5] : NULL);
+	free(priv.bounce);
+
+	return ret;
+}
+
+#if CONFIG_IS_ENABLED(MTD)
+struct fitload_mtd {
+	struct mtd_info *mtd;
+	ulong offset;
+};
+
+static ulong fitload_mtd_read(struct fit_ext_load *ld, ulong offset,
+			      ulong size, void *buf)
+{
+	struct fitload_mtd *priv = ld->priv;
+	size_t retlen = 0;
+	int ret;
+
+	ret = mtd_read(priv->mtd, priv->offset + offset, size, &retlen, buf);
+	if (ret && !mtd_is_bitflip(ret))
+		return 0;
+
+	return retlen;
+}
+
+static int do_fitload_mtd(struct cmd_tbl *cmdtp, int flag, int argc,
+			  char *const argv[])
+{
+	struct fitload_mtd priv;
+	struct fit_ext_load ld = {
+		.priv = &priv,
+		.read = fitload_mtd_read,
+	};
+	int ret;
+
+	if (argc < 3 || argc > 5)
+		return CMD_RET_USAGE;
+
+	mtd_probe_devices();
+	priv.mtd = get_mtd_device_nm(argv[1]);
+	if (IS_ERR_OR_NULL(priv.mtd)) {
+		printf("MTD device %s not found\n", argv[1]);
+		return CMD_RET_FAILURE;
+	}
+	priv.offset = argc > 3 ? hextoul(argv[3], NULL) : 0;
+
+	ret = fitload_run(&ld, argv[2], argc > 4 ? argv[4] : NULL);
+	put_mtd_device(priv.mtd);
+
+	return ret;
+}
+#endif
+
+static struct cmd_tbl cmd_fitload_sub[] = {
+	U_BOOT_CMD_MKENT(fs, 6, 0, do_fitload_fs, "", ""),
+	U_BOOT_CMD_MKENT(blk, 6, 0, do_fitload_blk, "", ""),
+#if CONFIG_IS_ENABLED(MTD)
+	U_BOOT_CMD_MKENT(mtd, 5, 0, do_fitload_mtd, "", ""),
+#endif
+};
+
+static int do_fitload(struct cmd_tbl *cmdtp, int flag, int argc,
+		      char *const argv[])
+{
+	struct cmd_tbl *cp;
+
+	if (argc < 2)
+		return CMD_RET_USAGE;
+
+	/* drop sub-command argument */
+	argc--;
+	argv++;
+
+	cp = find_cmd_tbl(argv[0], cmd_fitload_sub,
+			  ARRAY_SIZE(cmd_fitload_sub));
+	if (!cp)
+		return CMD_RET_USAGE;
+
+	return cp->cmd(cmdtp, flag, argc, argv);
+}
+
+U_BOOT_CMD(fitload, 7, 0, do_fitload,
+	"load a FIT configuration with external data from storage",
+	"fs <interface> <dev[:part]> <addr> <filename> [config]\n"
+	"    - load from a file\n"
+	"fitload blk <interface> <dev[:part]> <addr> [offset [config]]\n"
+	"    - load from a block device or partition, at byte offset\n"
+#if CONFIG_IS_ENABLED(MTD)
+	"fitload mtd <name> <addr> [offset [config]]\n"
+	"    - load from an MTD device, at byte offset\n"
+#endif
+	"\n"
+	"Only the images used by the configuration are read. Use\n"
+	"'bootm <addr>[#config]' to boot it afterwards."
+);
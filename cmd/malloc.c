@@ -0,0 +1,55 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * Command-line access to malloc() heap statistics
+ */
+
+#include <common.h>
+#include <command.h>
+#include <display_options.h>
+#include <malloc.h>
+#include <asm/global_data.h>
+
+DECLARE_GLOBAL_DATA_PTR;
+
+static void show_size(const char *name, ulong size)
+{
+	printf("%-14s%#10lx  ", name, size);
+	print_size(size, "\n");
+}
+
+static int do_malloc_stats(struct cmd_tbl *cmdtp, int flag, int argc,
+			   char *const argv[])
+{
+	struct malloc_usage usage;
+	uint frag;
+
+#if CONFIG_VAL(SYS_MALLOC_F_LEN)
+	printf("pre-relocation: %#lx bytes used of %#lx\n", gd->malloc_ptr,
+	       gd->malloc_limit);
+#endif
+	if (malloc_get_usage(&usage)) {
+		printf("malloc() heap not set up\n");
+		return CMD_RET_FAILURE;
+	}
+
+	/* Share of the free space not in the largest free chunk */
+	frag = usage.free ? 100 - usage.largest_free * 100 / usage.free : 0;
+
+	show_size("heap size", usage.heap_size);
+	show_size("peak", usage.peak);
+	show_size("in use", usage.in_use);
+	show_size("free", usage.free);
+	show_size("largest free", usage.largest_free);
+	printf("%-14s%10u\n", "free chunks", usage.free_chunks);
+	printf("%-14s%9u%%\n", "fragmentation", frag);
+
+	return 0;
+}
+
+#ifdef CONFIG_SYS_LONGHELP
+static char malloc_help_text[] =
+	"stats  - show how the malloc() heap is used and how fragmented it is";
+#endif
+
+U_BOOT_CMD_WITH_SUBCMDS(malloc, "malloc() heap", malloc_help_text,
+	U_BOOT_SUBCMD_MKENT(stats, 1, 1, do_malloc_stats));
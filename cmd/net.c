@@ -8,14 +8,19 @@
  * Boot support
  */
 #include <common.h>
+#include <blk.h>
 #include <bootstage.h>
 #include <command.h>
 #include <dm.h>
 #include <env.h>
 #include <image.h>
 #include <net.h>
+#include <part.h>
+#include <net/bench.h>
 #include <net/udp.h>
 #include <net/sntp.h>
+#include <net/mcload.h>
+#include <net/wget.h>
 
 static int netboot_common(enum proto_t, struct cmd_tbl *, int, char * const []);
 
@@ -124,6 +129,142 @@ U_BOOT_CMD(
 );
 #endif
 
+#if defined(CONFIG_CMD_WGET)
+static int do_wget(struct cmd_tbl *cmdtp, int flag, int argc,
+		   char *const argv[])
+{
+	struct disk_partition info;
+	struct blk_desc *desc = NULL;
+	lbaint_t start = 0, end = 0;
+	const char *url;
+	char *s;
+	int ret;
+
+	if (argc > 1 && !strcmp(argv[1], "blk")) {
+		if (argc != 6)
+			return CMD_RET_USAGE;
+		if (blk_get_device_part_str(argv[2], argv[3], &desc, &info,
+					    1) < 0)
+			return CMD_RET_FAILURE;
+		start = info.start + hextoul(argv[4], NULL);
+		end = info.start + info.size;
+		url = argv[5];
+	} else {
+		s = env_get("loadaddr");
+		if (s)
+			image_load_addr = hextoul(s, NULL);
+		if (argc == 2) {
+			url = argv[1];
+		} else if (argc == 3) {
+			image_load_addr = hextoul(argv[1], NULL);
+			url = argv[2];
+		} else {
+			return CMD_RET_USAGE;
+		}
+	}
+
+	if (wget_set_url(url)) {
+		printf("Invalid URL '%s'\n", url);
+		return CMD_RET_FAILURE;
+	}
+	wget_set_blk(desc, start, end);
+
+	bootstage_mark_name(BOOTSTAGE_KERNELREAD_START, "wget_start");
+	ret = net_loop(WGET);
+	bootstage_mark_name(BOOTSTAGE_KERNELREAD_STOP, "wget_done");
+	wget_set_blk(NULL, 0, 0);
+
+	return ret < 0 ? CMD_RET_FAILURE : CMD_RET_SUCCESS;
+}
+
+U_BOOT_CMD(
+	wget,	6,	1,	do_wget,
+	"load a file via network using HTTP",
+	"[loadAddress] URL\n"
+	"    - load the file to memory\n"
+	"wget blk <interface> <dev[:part]> <blk#> URL\n"
+	"    - write the file to a block device or partition, starting at\n"
+	"      block blk# (hex)\n"
+	"URL is http://<ip>[:<port>]/<path>, or [<ip>:]<path> to use\n"
+	"serverip and port 80"
+);
+#endif
+
+#if defined(CONFIG_CMD_MCLOAD)
+static int do_mcload(struct cmd_tbl *cmdtp, int flag, int argc,
+		     char *const argv[])
+{
+	struct disk_partition info;
+	struct blk_desc *desc = NULL;
+	const char *volume = NULL;
+	lbaint_t start = 0, end = 0;
+	const char *group;
+	char *s;
+	int ret;
+
+	if (argc > 1 && !strcmp(argv[1], "blk")) {
+		if (argc != 6)
+			return CMD_RET_USAGE;
+		if (blk_get_device_part_str(argv[2], argv[3], &desc, &info,
+					    1) < 0)
+			return CMD_RET_FAILURE;
+		start = info.start + hextoul(argv[4], NULL);
+		end = info.start + info.size;
+		group = argv[5];
+	} else if (IS_ENABLED(CONFIG_CMD_UBI) && argc > 1 &&
+		   !strcmp(argv[1], "ubi")) {
+		if (argc != 4)
+			return CMD_RET_USAGE;
+		volume = argv[2];
+		group = argv[3];
+	} else {
+		s = env_get("loadaddr");
+		if (s)
+			image_load_addr = hextoul(s, NULL);
+		if (argc == 2) {
+			group = argv[1];
+		} else if (argc == 3) {
+			image_load_addr = hextoul(argv[1], NULL);
+			group = argv[2];
+		} else {
+			return CMD_RET_USAGE;
+		}
+	}
+
+	if (mcload_set_group(group)) {
+		printf("Invalid multicast group '%s'\n", group);
+		return CMD_RET_FAILURE;
+	}
+	mcload_set_blk(desc, start, end);
+	mcload_set_ubi(volume);
+
+	bootstage_mark_name(BOOTSTAGE_KERNELREAD_START, "mcload_start");
+	ret = net_loop(MCLOAD);
+	bootstage_mark_name(BOOTSTAGE_KERNELREAD_STOP, "mcload_done");
+	mcload_set_blk(NULL, 0, 0);
+	mcload_set_ubi(NULL);
+	/* Also when interrupted */
+	net_mcast_addr.s_addr = 0;
+
+	return ret < 0 ? CMD_RET_FAILURE : CMD_RET_SUCCESS;
+}
+
+U_BOOT_CMD(
+	mcload,	6,	1,	do_mcload,
+	"receive an image sent to a multicast group",
+	"[loadAddress] <group>[:<port>]\n"
+	"    - load the image to memory\n"
+	"mcload blk <interface> <dev[:part]> <blk#> <group>[:<port>]\n"
+	"    - write the image to a block device or partition, starting at\n"
+	"      block blk# (hex)\n"
+#if defined(CONFIG_CMD_UBI)
+	"mcload ubi <volume> <group>[:<port>]\n"
+	"    - write the image to a volume of the attached UBI partition\n"
+#endif
+	"The port defaults to 1758"
+);
+#endif
+
 static void netboot_update_env(void)
 {
 	char tmp[22];
@@ -498,8 +639,111 @@ static int do_net_list(struct cmd_tbl *cmdtp, int flag, int argc, char *const ar
 	return CMD_RET_SUCCESS;
 }
 
+static int do_net_stats(struct cmd_tbl *cmdtp, int flag, int argc,
+			char *const argv[])
+{
+	const struct net_defrag_stats *defrag;
+	const struct eth_stats *stats;
+	struct udevice *dev;
+	struct uclass *uc;
+	bool reset = false;
+
+	if (argc > 1) {
+		if (strcmp(argv[1], "reset"))
+			return CMD_RET_USAGE;
+		reset = true;
+	}
+
+	uclass_id_foreach_dev(UCLASS_ETH, dev, uc) {
+		/* Counters only exist once the device is probed */
+		if (!device_active(dev))
+			continue;
+		if (reset) {
+			eth_reset_stats(dev);
+			continue;
+		}
+		stats = eth_get_stats(dev);
+		printf("eth%d : %s\n", dev_seq(dev), dev->name);
+		printf("  rx: %lu packets, %lu polls, %u max batch, %lu overruns, %lu errors\n",
+		       stats->rx_packets, stats->rx_polls, stats->rx_max_batch,
+		       stats->rx_overruns, stats->rx_errors);
+		printf("  tx: %lu packets, %lu errors\n", stats->tx_packets,
+		       stats->tx_errors);
+	}
+
+	if (IS_ENABLED(CONFIG_IP_DEFRAG)) {
+		if (reset) {
+			net_defrag_reset_stats();
+			return CMD_RET_SUCCESS;
+		}
+		defrag = net_defrag_get_stats();
+		printf("IP reassembly: %lu datagrams, %lu fragments, %lu timeouts, %lu evicted, %lu dropped\n",
+		       defrag->datagrams, defrag->fragments, defrag->timeouts,
+		       defrag->evicted, defrag->dropped);
+	}
+	return CMD_RET_SUCCESS;
+}
+
+#if defined(CONFIG_CMD_NET_BENCH)
+static int do_net_bench(struct cmd_tbl *cmdtp, int flag, int argc,
+			char *const argv[])
+{
+	const char *colon;
+	struct in_addr dest;
+	u16 port = NET_BENCH_PORT;
+	ulong seconds = 10;
+	uint size = 1472;
+	char ip[16];
+
+	if (argc < 2)
+		return CMD_RET_USAGE;
+
+	if (!strcmp(argv[1], "sink")) {
+		if (argc > 4)
+			return CMD_RET_USAGE;
+		if (argc > 2)
+			port = dectoul(argv[2], NULL);
+		if (argc > 3)
+			seconds = dectoul(argv[3], NULL);
+		net_bench_set_sink(port, seconds * 1000);
+	} else if (!strcmp(argv[1], "source")) {
+		if (argc < 3)
+			return CMD_RET_USAGE;
+		colon = strchr(argv[2], ':');
+		if (colon) {
+			if (colon - argv[2] >= sizeof(ip))
+				return CMD_RET_USAGE;
+			strlcpy(ip, argv[2], colon - argv[2] + 1);
+			port = dectoul(colon + 1, NULL);
+		} else {
+			strlcpy(ip, argv[2], sizeof(ip));
+		}
+		dest = string_to_ip(ip);
+		if (argc > 3)
+			seconds = dectoul(argv[3], NULL);
+		if (argc > 4)
+			size = dectoul(argv[4], NULL);
+		if (!dest.s_addr ||
+		    net_bench_set_source(dest, port, seconds * 1000, size)) {
+			printf("Invalid destination or packet size\n");
+			return CMD_RET_FAILURE;
+		}
+	} else {
+		return CMD_RET_USAGE;
+	}
+	if (!port || !seconds)
+		return CMD_RET_USAGE;
+
+	return net_loop(BENCH) < 0 ? CMD_RET_FAILURE : CMD_RET_SUCCESS;
+}
+#endif
+
 static struct cmd_tbl cmd_net[] = {
 	U_BOOT_CMD_MKENT(list, 1, 0, do_net_list, "", ""),
+	U_BOOT_CMD_MKENT(stats, 2, 0, do_net_stats, "", ""),
+#if defined(CONFIG_CMD_NET_BENCH)
+	U_BOOT_CMD_MKENT(bench, 5, 0, do_net_bench, "", ""),
+#endif
 };
 
 static int do_net(struct cmd_tbl *cmdtp, int flag, int argc, char *const argv[])
@@ -521,8 +765,16 @@ static int do_net(struct cmd_tbl *cmdtp, int flag, int argc, char *const argv[])
 }
 
 U_BOOT_CMD(
-	net, 2, 1, do_net,
+	net, 6, 1, do_net,
 	"NET sub-system",
 	"list - list available devices\n"
+	"net stats [reset] - show (or clear) the packet counters of the devices\n"
+	"    and of IP reassembly\n"
+#if defined(CONFIG_CMD_NET_BENCH)
+	"net bench sink [port [seconds]]\n"
+	"    - count the UDP packets sent to port (5001) for seconds (10)\n"
+	"net bench source <ip>[:port] [seconds [size]]\n"
+	"    - send UDP packets of size bytes (1472) to ip for seconds (10)\n"
+#endif
 );
 #endif // CONFIG_DM_ETH
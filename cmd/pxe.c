@@ -8,6 +8,7 @@
 #include <command.h>
 #include <fs.h>
 #include <net.h>
+#include <net/tftp.h>
 
 #include "pxe_utils.h"
 
@@ -43,6 +44,29 @@ static int do_get_tftp(struct pxe_context *ctx, const char *file_path,
 	return 1;
 }
 
+static int do_prefetch_tftp(struct pxe_context *ctx, struct pxe_file *files,
+			    int count)
+{
+	struct tftp_fetch fetch[PXE_MAX_PREFETCH];
+	int ret, i;
+
+	memset(fetch, '\0', sizeof(fetch));
+	for (i = 0; i < count; i++) {
+		fetch[i].name = files[i].path;
+		fetch[i].addr = files[i].addr;
+		fetch[i].err = -EINPROGRESS;
+	}
+
+	ret = tftp_fetch_files(fetch, count);
+	for (i = 0; i < count; i++) {
+		files[i].size = fetch[i].size;
+		files[i].ms = fetch[i].ms;
+		files[i].err = fetch[i].err;
+	}
+
+	return ret;
+}
+
 /*
  * Looks for a pxe file with a name based on the pxeuuid environment variable.
  *
@@ -233,6 +257,8 @@ do_pxe_boot(struct cmd_tbl *cmdtp, int flag, int argc, char *const argv[])
 		printf("Out of memory\n");
 		return CMD_RET_FAILURE;
 	}
+	if (IS_ENABLED(CONFIG_TFTP_MULTI))
+		ctx.prefetch = do_prefetch_tftp;
 	ret = pxe_process(&ctx, pxefile_addr_r, false);
 	pxe_destroy_ctx(&ctx);
 	if (ret)
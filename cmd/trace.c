@@ -76,12 +76,74 @@ static int create_call_list(int argc, char *const argv[])
 	return 0;
 }
 
+#ifdef CONFIG_TRACE_SAMPLE
+static int create_sample_list(int argc, char *const argv[])
+{
+	size_t buff_size, avail, buff_ptr, needed, used;
+	char *buff;
+	int err;
+
+	if (get_args(argc, argv, &buff, &buff_ptr, &buff_size))
+		return -1;
+
+	avail = buff_size - buff_ptr;
+	err = trace_list_samples(buff + buff_ptr, avail, &needed);
+	if (err)
+		printf("Error: truncated (%#zx bytes needed)\n", needed);
+	used = min(avail, (size_t)needed);
+	printf("Samples dumped to %08lx, size %#zx\n",
+	       (ulong)map_to_sysmem(buff + buff_ptr), used);
+
+	env_set_hex("profbase", map_to_sysmem(buff));
+	env_set_hex("profsize", buff_size);
+	env_set_hex("profoffset", buff_ptr + used);
+
+	return 0;
+}
+
+static int do_sample(int argc, char *const argv[])
+{
+	ulong period_us = CONFIG_TRACE_SAMPLE_PERIOD_US;
+	int ret;
+
+	if (argc < 3)
+		return CMD_RET_USAGE;
+	if (!strcmp(argv[2], "stop")) {
+		trace_sample_stop();
+		return 0;
+	}
+	if (strcmp(argv[2], "start"))
+		return CMD_RET_USAGE;
+	if (argc > 3)
+		period_us = dectoul(argv[3], NULL);
+	if (!period_us)
+		return CMD_RET_USAGE;
+
+	ret = trace_sample_start(period_us);
+	if (ret) {
+		printf("Cannot sample the call stack (err=%d)\n", ret);
+		return CMD_RET_FAILURE;
+	}
+
+	return 0;
+}
+#endif
+
 int do_trace(struct cmd_tbl *cmdtp, int flag, int argc, char *const argv[])
 {
 	const char *cmd = argc < 2 ? NULL : argv[1];
 
 	if (!cmd)
 		return cmd_usage(cmdtp);
+#ifdef CONFIG_TRACE_SAMPLE
+	if (!strcmp(cmd, "sample"))
+		return do_sample(argc, argv);
+	if (!strcmp(cmd, "samples")) {
+		if (create_sample_list(argc, argv))
+			return cmd_usage(cmdtp);
+		return 0;
+	}
+#endif
 	switch (*cmd) {
 	case 'p':
 		trace_set_enabled(0);
@@ -116,4 +178,10 @@ U_BOOT_CMD(
 	"trace funclist [<addr> <size>]     - dump function list into buffer\n"
 	"trace calls  [<addr> <size>]       "
 		"- dump function call trace into buffer"
+#ifdef CONFIG_TRACE_SAMPLE
+	"\ntrace sample start [<period_us>]   - sample the call stack\n"
+	"trace sample stop                  - stop sampling\n"
+	"trace samples [<addr> <size>]      "
+		"- dump call stack samples into buffer"
+#endif
 );
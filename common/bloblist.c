@@ -40,6 +40,7 @@ static const char *const tag_name[] = {
 	[BLOBLISTT_TCPA_LOG]		= "TPM log space",
 	[BLOBLISTT_ACPI_TABLES]		= "ACPI tables for x86",
 	[BLOBLISTT_SMBIOS_TABLES]	= "SMBIOS tables for x86",
+	[BLOBLISTT_BOOTSTAGE_TRACE]	= "Bootstage trace",
 };
 
 const char *bloblist_tag_name(enum bloblist_tag_t tag)
@@ -107,6 +107,19 @@ static int initr_trace(void)
 	return 0;
 }
 
+#ifdef CONFIG_TRACE_SAMPLE
+static int initr_trace_sample(void)
+{
+	if (trace_sample_start(CONFIG_TRACE_SAMPLE_PERIOD_US))
+		puts("trace: cannot sample the call stack\n");
+	else
+		printf("trace: sampling every %d us\n",
+		       CONFIG_TRACE_SAMPLE_PERIOD_US);
+
+	return 0;
+}
+#endif
+
 static int initr_reloc(void)
 {
 	/* tell others: relocation done */
@@ -237,11 +250,16 @@ static int initr_malloc(void)
 static int initr_of_live(void)
 {
 	if (CONFIG_IS_ENABLED(OF_LIVE)) {
-		int ret;
+		struct device_node **rootp;
+		int ret = -ENOENT;
 
+		rootp = (struct device_node **)gd_of_root_ptr();
 		bootstage_start(BOOTSTAGE_ID_ACCUM_OF_LIVE, "of_live");
-		ret = of_live_build(gd->fdt_blob,
-				    (struct device_node **)gd_of_root_ptr());
+		if (IS_ENABLED(CONFIG_OF_LIVE_IMAGE))
+			ret = of_live_map(board_of_live_image(), gd->fdt_blob,
+					  rootp);
+		if (ret)
+			ret = of_live_build(gd->fdt_blob, rootp);
 		bootstage_accum(BOOTSTAGE_ID_ACCUM_OF_LIVE);
 		if (ret)
 			return ret;
@@ -260,9 +278,18 @@ static int initr_dm(void)
 	gd->dm_root = NULL;
 #ifdef CONFIG_TIMER
 	gd->timer = NULL;
+#endif
+#if CONFIG_IS_ENABLED(DM_COMPAT_INDEX)
+	gd->dm_compat_index = NULL;
+#endif
+#if CONFIG_IS_ENABLED(DM_NODE_INDEX)
+	gd->dm_node_index = NULL;
 #endif
 	bootstage_start(BOOTSTAGE_ID_ACCUM_DM_R, "dm_r");
-	ret = dm_init_and_scan(false);
+	if (CONFIG_IS_ENABLED(DM_RELOC_DEVICES) && gd->dm_root_f)
+		ret = dm_init_and_relocate(gd->dm_root_f);
+	else
+		ret = dm_init_and_scan(false);
 	bootstage_accum(BOOTSTAGE_ID_ACCUM_DM_R);
 	if (ret)
 		return ret;
@@ -292,6 +319,9 @@ static int initr_dm_devices(void)
 			return ret;
 	}
 
+	/* Until the main loop, probe only the devices needed to boot */
+	dm_boot_path_begin();
+
 	return 0;
 }
 
@@ -428,7 +458,9 @@ static int initr_onenand(void)
 static int initr_mmc(void)
 {
 	puts("MMC:   ");
+	bootstage_start(BOOTSTAGE_ID_ACCUM_MMC_INIT, "mmc_init");
 	mmc_initialize(gd->bd);
+	bootstage_accum(BOOTSTAGE_ID_ACCUM_MMC_INIT);
 	return 0;
 }
 #endif
@@ -544,7 +576,9 @@ static int initr_scsi(void)
 static int initr_net(void)
 {
 	puts("Net:   ");
+	bootstage_start(BOOTSTAGE_ID_ACCUM_ETH_INIT, "eth_init");
 	eth_initialize();
+	bootstage_accum(BOOTSTAGE_ID_ACCUM_ETH_INIT);
 #if defined(CONFIG_RESET_PHY_R)
 	debug("Reset Ethernet PHY\n");
 	reset_phy();
@@ -595,6 +629,7 @@ int initr_mem(void)
 
 static int run_main_loop(void)
 {
+	dm_boot_path_end();
 #ifdef CONFIG_SANDBOX
 	sandbox_main_loop_init();
 #endif
@@ -629,6 +664,9 @@ static init_fnc_t init_sequence_r[] = {
 #endif
 	initr_barrier,
 	initr_malloc,
+#ifdef CONFIG_TRACE_SAMPLE
+	initr_trace_sample,	/* Needs malloc() */
+#endif
 	log_init,
 	initr_bootstage,	/* Needs malloc() but has its own timer */
 #if defined(CONFIG_CONSOLE_RECORD)
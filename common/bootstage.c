@@ -12,6 +12,7 @@
 #define LOG_CATEGORY	LOGC_BOOT
 
 #include <common.h>
+#include <bloblist.h>
 #include <bootstage.h>
 #include <hang.h>
 #include <log.h>
@@ -26,6 +27,9 @@ DECLARE_GLOBAL_DATA_PTR;
 
 enum {
 	RECORD_COUNT = CONFIG_VAL(BOOTSTAGE_RECORD_COUNT),
+#if CONFIG_IS_ENABLED(BOOTSTAGE_TRACE)
+	TRACE_COUNT = CONFIG_BOOTSTAGE_TRACE_COUNT,
+#endif
 };
 
 struct bootstage_record {
@@ -40,6 +44,10 @@ struct bootstage_data {
 	uint rec_count;
 	uint next_id;
 	struct bootstage_record record[RECORD_COUNT];
+#if CONFIG_IS_ENABLED(BOOTSTAGE_TRACE)
+	uint trace_count;	/* Number of timings ever added */
+	struct bootstage_trace_rec trace[TRACE_COUNT];	/* Ring of timings */
+#endif
 };
 
 enum {
@@ -365,6 +373,166 @@ void bootstage_report(void)
 	}
 }
 
+#if CONFIG_IS_ENABLED(BOOTSTAGE_TRACE)
+ulong bootstage_trace_start(void)
+{
+	/* The timer may not be usable before bootstage is set up */
+	if (!gd->bootstage)
+		return 0;
+
+	return timer_get_boot_us();
+}
+
+void bootstage_trace_add(enum bootstage_trace_type type, const char *name,
+			 ulong addr, ulong start_us)
+{
+	struct bootstage_data *data = gd->bootstage;
+	struct bootstage_trace_rec *rec;
+
+	if (!data || !start_us)
+		return;
+	rec = &data->trace[data->trace_count++ % TRACE_COUNT];
+	rec->addr = addr;
+	rec->start_us = start_us;
+	rec->duration_us = timer_get_boot_us() - start_us;
+	rec->type = type;
+	strlcpy(rec->name, name ? name : "", sizeof(rec->name));
+}
+
+/* Get the number of timings still in the ring */
+static uint trace_get_count(struct bootstage_data *data)
+{
+	return min(data->trace_count, (uint)TRACE_COUNT);
+}
+
+/* Get a timing still in the ring, 0 being the oldest one */
+static struct bootstage_trace_rec *trace_get_rec(struct bootstage_data *data,
+						 uint i)
+{
+	uint first = data->trace_count - trace_get_count(data);
+
+	return &data->trace[(first + i) % TRACE_COUNT];
+}
+
+/**
+ * struct trace_buf - Buffer the JSON text is written to
+ *
+ * @buf: Start of the buffer
+ * @size: Size of the buffer in bytes
+ * @len: Length of the whole text so far, which may be more than @size
+ */
+struct trace_buf {
+	char *buf;
+	int size;
+	int len;
+};
+
+static void trace_printf(struct trace_buf *tb, const char *fmt, ...)
+{
+	int used = min(tb->len, tb->size);
+	va_list args;
+
+	va_start(args, fmt);
+	tb->len += vsnprintf(tb->buf + used, tb->size - used, fmt, args);
+	va_end(args);
+}
+
+/* Write a string as a JSON string, escaping what needs it */
+static void trace_put_str(struct trace_buf *tb, const char *str)
+{
+	trace_printf(tb, "\"");
+	for (; *str; str++) {
+		if (*str == '"' || *str == '\\')
+			trace_printf(tb, "\\%c", *str);
+		else if (*str >= ' ')
+			trace_printf(tb, "%c", *str);
+	}
+	trace_printf(tb, "\"");
+}
+
+int bootstage_trace_json(char *buf, int size)
+{
+	struct bootstage_data *data = gd->bootstage;
+	struct trace_buf tb = { .buf = buf, .size = size };
+	struct bootstage_trace_rec *rec;
+	struct bootstage_record *mark;
+	const char *sep = "";
+	char name[20];
+	uint i;
+
+	if (size)
+		*buf = '\0';
+	trace_printf(&tb, "{\"traceEvents\":[");
+	for (i = 0; i < trace_get_count(data); i++) {
+		rec = trace_get_rec(data, i);
+		trace_printf(&tb, "%s\n{\"name\":", sep);
+		if (rec->type == BOOTSTAGE_TRACE_INITCALL) {
+			snprintf(name, sizeof(name), "0x%llx",
+				 (unsigned long long)rec->addr);
+			trace_put_str(&tb, name);
+		} else {
+			trace_put_str(&tb, rec->name);
+		}
+		trace_printf(&tb,
+			     ",\"cat\":\"%s\",\"ph\":\"X\",\"ts\":%u,\"dur\":%u,\"pid\":0,\"tid\":0}",
+			     rec->type == BOOTSTAGE_TRACE_INITCALL ?
+			     "initcall" : "probe", rec->start_us,
+			     rec->duration_us);
+		sep = ",";
+	}
+
+	/* Marks show as instants; accumulated times have no start to show */
+	for (i = 0, mark = data->record; i < data->rec_count; i++, mark++) {
+		if (mark->start_us)
+			continue;
+		trace_printf(&tb, "%s\n{\"name\":", sep);
+		trace_put_str(&tb, get_record_name(name, sizeof(name), mark));
+		trace_printf(&tb,
+			     ",\"cat\":\"bootstage\",\"ph\":\"i\",\"s\":\"g\",\"ts\":%lu,\"pid\":0,\"tid\":0}",
+			     mark->time_us);
+		sep = ",";
+	}
+	trace_printf(&tb, "\n],\"displayTimeUnit\":\"ms\"}\n");
+
+	return tb.len;
+}
+
+int bootstage_trace_handoff(void)
+{
+	struct bootstage_data *data = gd->bootstage;
+	struct bootstage_trace_rec *recs;
+	struct bootstage_trace_hdr *hdr;
+	uint count, i;
+	int size, ret;
+
+	if (!CONFIG_IS_ENABLED(BLOBLIST))
+		return -ENOSYS;
+	count = trace_get_count(data);
+	size = sizeof(*hdr) + count * sizeof(*recs);
+
+	/* The timings may be handed over more than once, e.g. by 'bootm fake' */
+	ret = bloblist_resize(BLOBLISTT_BOOTSTAGE_TRACE, size);
+	if (!ret)
+		hdr = bloblist_find(BLOBLISTT_BOOTSTAGE_TRACE, size);
+	else if (ret == -ENOENT)
+		hdr = bloblist_add(BLOBLISTT_BOOTSTAGE_TRACE, size, 0);
+	else
+		return log_msg_ret("resize", ret);
+	if (!hdr)
+		return log_msg_ret("add", -ENOSPC);
+
+	hdr->version = BOOTSTAGE_TRACE_VERSION;
+	hdr->count = count;
+	hdr->rec_size = sizeof(*recs);
+	hdr->dropped = data->trace_count - count;
+	recs = (struct bootstage_trace_rec *)(hdr + 1);
+	for (i = 0; i < count; i++)
+		recs[i] = *trace_get_rec(data, i);
+
+	return bloblist_finish();
+}
+#endif
+
 /**
  * Append data to a memory buffer
  *
@@ -18,6 +18,7 @@
 
 #include <malloc.h>
 #include <asm/io.h>
+#include <linux/errno.h>
 
 #ifdef DEBUG
 #if __STD_C
@@ -2388,7 +2389,42 @@ struct mallinfo mALLINFo()
 }
 #endif	/* DEBUG */
 
+int malloc_get_usage(struct malloc_usage *usage)
+{
+	INTERNAL_SIZE_T avail, size;
+	mbinptr b;
+	mchunkptr p;
+	ulong unused;
+	int i;
+
+	memset(usage, '\0', sizeof(*usage));
+	if (!mem_malloc_end)
+		return -ENOENT;
+
+	/* The top chunk can still grow into the space not yet obtained */
+	unused = mem_malloc_end - mem_malloc_brk;
+	avail = chunksize(top);
+	usage->largest_free = avail + unused;
+	usage->free_chunks = avail >= MINSIZE ? 1 : 0;
+
+	for (i = 1; i < NAV; ++i) {
+		b = bin_at(i);
+		for (p = last(b); p != b; p = p->bk) {
+			size = chunksize(p);
+			avail += size;
+			if (size > usage->largest_free)
+				usage->largest_free = size;
+			usage->free_chunks++;
+		}
+	}
 
+	usage->heap_size = mem_malloc_end - mem_malloc_start;
+	usage->peak = max_sbrked_mem;
+	usage->in_use = sbrked_mem - avail;
+	usage->free = avail + unused;
+
+	return 0;
+}
 
 
 /*
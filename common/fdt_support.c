@@ -1896,15 +1896,18 @@ int fdt_fixup_display(void *blob, const char *path, const char *display)
 
 #ifdef CONFIG_OF_LIBFDT_OVERLAY
 /**
- * fdt_overlay_apply_verbose - Apply an overlay with verbose error reporting
+ * fdt_overlay_apply_cached_verbose - Apply an overlay with verbose error
+ * reporting
  *
  * @fdt: ptr to device tree
  * @fdto: ptr to device tree overlay
+ * @cache: overlay cache set up for @fdt, or NULL to use none
  *
  * Convenience function to apply an overlay and display helpful messages
  * in the case of an error
  */
-int fdt_overlay_apply_verbose(void *fdt, void *fdto)
+int fdt_overlay_apply_cached_verbose(void *fdt, void *fdto,
+				     struct fdt_overlay_cache *cache)
 {
 	int err;
 	bool has_symbols;
@@ -1912,7 +1915,10 @@ int fdt_overlay_apply_verbose(void *fdt, void *fdto)
 	err = fdt_path_offset(fdt, "/__symbols__");
 	has_symbols = err >= 0;
 
-	err = fdt_overlay_apply(fdt, fdto);
+	if (cache)
+		err = fdt_overlay_apply_cached(fdt, fdto, cache);
+	else
+		err = fdt_overlay_apply(fdt, fdto);
 	if (err < 0) {
 		printf("failed on fdt_overlay_apply(): %s\n",
 				fdt_strerror(err));
@@ -1923,6 +1929,20 @@ int fdt_overlay_apply_verbose(void *fdt, void *fdto)
 	}
 	return err;
 }
+
+/**
+ * fdt_overlay_apply_verbose - Apply an overlay with verbose error reporting
+ *
+ * @fdt: ptr to device tree
+ * @fdto: ptr to device tree overlay
+ *
+ * Convenience function to apply an overlay and display helpful messages
+ * in the case of an error
+ */
+int fdt_overlay_apply_verbose(void *fdt, void *fdto)
+{
+	return fdt_overlay_apply_cached_verbose(fdt, fdto, NULL);
+}
 #endif
 
 /**
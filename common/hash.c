@@ -173,7 +173,8 @@ static int hash_finish_crc16_ccitt(struct hash_algo *algo, void *ctx,
 	if (size < algo->digest_size)
 		return -1;
 
-	*((uint16_t *)dest_buf) = *((uint16_t *)ctx);
+	/* Big-endian, like crc16_ccitt_wd_buf() */
+	*((uint16_t *)dest_buf) = cpu_to_be16(*((uint16_t *)ctx));
 	free(ctx);
 	return 0;
 }
@@ -200,7 +201,8 @@ static int __maybe_unused hash_finish_crc32(struct hash_algo *algo, void *ctx,
 	if (size < algo->digest_size)
 		return -1;
 
-	*((uint32_t *)dest_buf) = *((uint32_t *)ctx);
+	/* Big-endian, like crc32_wd_buf() */
+	*((uint32_t *)dest_buf) = cpu_to_be32(*((uint32_t *)ctx));
 	free(ctx);
 	return 0;
 }
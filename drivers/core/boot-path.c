@@ -0,0 +1,136 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * Probe only the devices on the boot path during start-up
+ *
+ * Start-up code such as mmc_initialize() and eth_initialize() probes every
+ * device of its uclass. When a boot path is declared, it asks
+ * dm_probe_deferred() first and skips the devices booting does not need.
+ * These stay bound, so the first command looking them up probes them.
+ */
+
+#define LOG_CATEGORY LOGC_DM
+
+#include <common.h>
+#include <dm.h>
+#include <env.h>
+#include <log.h>
+#include <asm/global_data.h>
+#include <dm/ofnode.h>
+#include <dm/root.h>
+
+DECLARE_GLOBAL_DATA_PTR;
+
+/* Largest number of nodes on the boot path */
+#define BOOT_PATH_MAX_NODES	8
+/* Longest value of the 'bootdevices' environment variable */
+#define BOOT_PATH_MAX_LEN	256
+
+/**
+ * struct boot_path - The devices probed during start-up
+ *
+ * @active: between dm_boot_path_begin() and dm_boot_path_end()
+ * @env_ready: the boot path was read with the environment loaded
+ * @count: number of nodes in @node, 0 to probe every device
+ * @node: nodes of the devices on the boot path
+ */
+struct boot_path {
+	bool active;
+	bool env_ready;
+	int count;
+	ofnode node[BOOT_PATH_MAX_NODES];
+};
+
+static struct boot_path boot_path;
+
+static void boot_path_add(const char *path)
+{
+	ofnode node;
+
+	node = ofnode_path(path);
+	if (!ofnode_valid(node)) {
+		log_warning("Boot path: no node '%s'\n", path);
+		return;
+	}
+	if (boot_path.count == BOOT_PATH_MAX_NODES) {
+		log_warning("Boot path: too many nodes, ignoring '%s'\n", path);
+		return;
+	}
+	boot_path.node[boot_path.count++] = node;
+}
+
+static void boot_path_read(void)
+{
+	char buf[BOOT_PATH_MAX_LEN], *next, *path;
+	const char *list, *name;
+	ofnode chosen;
+	int i;
+
+	boot_path.count = 0;
+	boot_path.env_ready = gd->flags & GD_FLG_ENV_READY;
+
+	list = env_get("bootdevices");
+	if (list) {
+		if (!strcmp(list, "all"))
+			return;
+		strlcpy(buf, list, sizeof(buf));
+		next = buf;
+		while ((path = strsep(&next, " "))) {
+			if (*path)
+				boot_path_add(path);
+		}
+	} else {
+		chosen = ofnode_path("/chosen");
+		for (i = 0; !ofnode_read_string_index(chosen,
+						      "u-boot,boot-devices", i,
+						      &name); i++)
+			boot_path_add(name);
+	}
+	log_debug("Boot path of %d nodes\n", boot_path.count);
+}
+
+/* Tell if @node is on the boot path, or above or below a node on it */
+static bool boot_path_has(ofnode node)
+{
+	ofnode parent;
+	int i;
+
+	for (i = 0; i < boot_path.count; i++) {
+		for (parent = boot_path.node[i]; ofnode_valid(parent);
+		     parent = ofnode_get_parent(parent)) {
+			if (ofnode_equal(parent, node))
+				return true;
+		}
+		for (parent = ofnode_get_parent(node); ofnode_valid(parent);
+		     parent = ofnode_get_parent(parent)) {
+			if (ofnode_equal(parent, boot_path.node[i]))
+				return true;
+		}
+	}
+
+	return false;
+}
+
+void dm_boot_path_begin(void)
+{
+	boot_path.active = true;
+	boot_path_read();
+}
+
+void dm_boot_path_end(void)
+{
+	boot_path.active = false;
+}
+
+bool dm_probe_deferred(struct udevice *dev)
+{
+	if (!boot_path.active)
+		return false;
+	if (boot_path.env_ready != !!(gd->flags & GD_FLG_ENV_READY))
+		boot_path_read();
+	if (!boot_path.count || !dev_has_ofnode(dev) ||
+	    boot_path_has(dev_ofnode(dev)))
+		return false;
+	log_debug("Deferring the probe of %s\n", dev->name);
+
+	return true;
+}
@@ -0,0 +1,454 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * Carry the devices bound before relocation over to the new driver model
+ *
+ * After relocation, initr_dm() starts driver model again and binds every
+ * device, the ones board_init_f() bound included. Here these are copied to
+ * the new tree instead, with the driver and driver data worked out before
+ * relocation. The copies are not probed. The bind hooks of the parent and of
+ * the uclass run on each copy, since they fill in per-child data and bind
+ * the child nodes left out before relocation.
+ *
+ * Until dm_reloc_finish(), binding a node which was copied returns the copy,
+ * so that the scan which follows only binds the remaining nodes. The copy
+ * then moves to where binding it would have put it in the lists of its
+ * parent and uclass, and gets the sequence number binding would have given
+ * it: driver model ends up as with a full scan.
+ */
+
+#define LOG_CATEGORY LOGC_DM
+
+#include <common.h>
+#include <dm.h>
+#include <log.h>
+#include <malloc.h>
+#include <asm/global_data.h>
+#include <dm/device-internal.h>
+#include <dm/lists.h>
+#include <dm/of_access.h>
+#include <dm/root.h>
+#include <dm/uclass-internal.h>
+#include <linux/libfdt.h>
+
+DECLARE_GLOBAL_DATA_PTR;
+
+/* Longest path of a node copied to the live tree */
+#define RELOC_MAX_PATH	256
+
+/**
+ * struct dm_reloc - Copies waiting to be bound again
+ *
+ * @dev: copies which neither their parent nor the scan has bound yet
+ * @count: number of devices in @dev
+ * @copied: number of devices copied
+ * @copying: dm_reloc_devices() is running
+ */
+struct dm_reloc {
+	struct udevice **dev;
+	int count;
+	int copied;
+	bool copying;
+};
+
+static struct dm_reloc reloc;
+
+/* Find the driver at @addr, NULL if there is none */
+static struct driver *reloc_driver_at(ulong addr)
+{
+	struct driver *start = ll_entry_start(struct driver, driver);
+	const int n_ents = ll_entry_count(struct driver, driver);
+	ulong offset = addr - (ulong)start;
+
+	if (offset % sizeof(struct driver) ||
+	    offset / sizeof(struct driver) >= n_ents)
+		return NULL;
+
+	return start + offset / sizeof(struct driver);
+}
+
+/* Find where @drv is after relocation, NULL if it is not a driver */
+static struct driver *reloc_driver(const struct driver *drv)
+{
+	struct driver *entry;
+
+	/* Sandbox, for one, runs the same code before and after relocation */
+	entry = reloc_driver_at((ulong)drv);
+	if (!entry)
+		entry = reloc_driver_at((ulong)drv + gd->reloc_off);
+
+	return entry;
+}
+
+/*
+ * Find the node of @old, in the flat tree, in the tree used after relocation.
+ * Working out the path walks the flat tree from the start, so first look for
+ * it below the node of @parent, the copy of the parent of @old.
+ */
+static ofnode reloc_node(struct udevice *parent, struct udevice *old)
+{
+	const void *blob = gd->fdt_blob;
+	int offset = dev_ofnode(old).of_offset;
+	char path[RELOC_MAX_PATH];
+	const void *compat;
+	const char *name;
+	ofnode node;
+
+	/* Before relocation, driver model always uses the flat tree */
+	if (!of_live_active())
+		return dev_ofnode(old);
+
+	/* The live tree points to the property values in the flat tree */
+	compat = fdt_getprop(blob, offset, "compatible", NULL);
+	name = fdt_get_name(blob, offset, NULL);
+	if (compat && name && dev_has_ofnode(parent)) {
+		ofnode_for_each_subnode(node, dev_ofnode(parent)) {
+			if (!strcmp(name, ofnode_get_name(node)) &&
+			    ofnode_get_property(node, "compatible",
+						NULL) == compat)
+				return node;
+		}
+	}
+	if (fdt_get_path(blob, offset, path, sizeof(path)))
+		return ofnode_null();
+
+	return np_to_ofnode(of_find_node_by_path(path));
+}
+
+/*
+ * Work out the driver data lists_bind_fdt() gives @drv for @node. A device
+ * bound to another driver than its compatible string tells, or by name,
+ * has the driver data of the caller; it is copied only when this is 0.
+ */
+static int reloc_driver_data(struct udevice *old, struct driver *drv,
+			     ofnode node, ulong *datap)
+{
+	const struct udevice_id *id;
+	const char *compat;
+	struct driver *entry;
+	int i;
+
+	for (i = 0; !ofnode_read_string_index(node, "compatible", i, &compat);
+	     i++) {
+		entry = lists_driver_lookup_compat(compat, &id);
+		if (!entry)
+			continue;
+		if (entry == drv) {
+			*datap = id->data;
+			return 0;
+		}
+		break;
+	}
+	if (old->driver_data)
+		return -ENOENT;
+	*datap = 0;
+
+	return 0;
+}
+
+/*
+ * Tell if @old can be copied. The copy skips the bind() method of the
+ * driver and gets its data allocated afresh, so none must have been set
+ * up by anything but the bind hooks run again on the copy.
+ */
+static bool reloc_can_copy(struct udevice *old, struct driver *drv)
+{
+	u32 flags = dev_get_flags(old);
+
+	if (drv->bind)
+		return false;
+	if (dev_get_plat(old) && !(flags & DM_FLAG_ALLOC_PDATA))
+		return false;
+	if (dev_get_parent_plat(old) && !(flags & DM_FLAG_ALLOC_PARENT_PDATA))
+		return false;
+	if (dev_get_uclass_plat(old) && !(flags & DM_FLAG_ALLOC_UCLASS_PDATA))
+		return false;
+	if (!(flags & DM_FLAG_ACTIVATED) && dev_get_priv(old))
+		return false;
+
+	return true;
+}
+
+/* Allocate the data driver model allocates for @dev when binding it */
+static int reloc_alloc(struct udevice *dev, struct udevice *parent)
+{
+	int size;
+	void *ptr;
+
+	if (dev->driver->plat_auto) {
+		ptr = calloc(1, dev->driver->plat_auto);
+		if (!ptr)
+			return -ENOMEM;
+		dev_or_flags(dev, DM_FLAG_ALLOC_PDATA);
+		dev_set_plat(dev, ptr);
+	}
+
+	size = dev->uclass->uc_drv->per_device_plat_auto;
+	if (size) {
+		ptr = calloc(1, size);
+		if (!ptr)
+			return -ENOMEM;
+		dev_or_flags(dev, DM_FLAG_ALLOC_UCLASS_PDATA);
+		dev_set_uclass_plat(dev, ptr);
+	}
+
+	size = parent->driver->per_child_plat_auto;
+	if (!size)
+		size = parent->uclass->uc_drv->per_child_plat_auto;
+	if (size) {
+		ptr = calloc(1, size);
+		if (!ptr)
+			return -ENOMEM;
+		dev_or_flags(dev, DM_FLAG_ALLOC_PARENT_PDATA);
+		dev_set_parent_plat(dev, ptr);
+	}
+
+	return 0;
+}
+
+static void reloc_free(struct udevice *dev)
+{
+	u32 flags = dev_get_flags(dev);
+
+	if (flags & DM_FLAG_ALLOC_PDATA)
+		free(dev_get_plat(dev));
+	if (flags & DM_FLAG_ALLOC_UCLASS_PDATA)
+		free(dev_get_uclass_plat(dev));
+	if (flags & DM_FLAG_ALLOC_PARENT_PDATA)
+		free(dev_get_parent_plat(dev));
+	if (flags & DM_FLAG_NAME_ALLOCED)
+		free((char *)dev->name);
+	free(dev);
+}
+
+/* Copy @old and the devices below it under @parent */
+static int reloc_copy(struct udevice *parent, struct udevice *old)
+{
+	struct udevice *dev, *child;
+	struct driver *drv;
+	struct uclass *uc;
+	ofnode node;
+	ulong data;
+	int ret;
+
+	drv = reloc_driver(old->driver);
+	if (!drv || !dev_has_ofnode(old))
+		return 0;
+	node = reloc_node(parent, old);
+	if (!ofnode_valid(node) || !reloc_can_copy(old, drv) ||
+	    reloc_driver_data(old, drv, node, &data)) {
+		log_debug("Binding %s again\n", old->name);
+		return 0;
+	}
+	ret = uclass_get(drv->id, &uc);
+	if (ret)
+		return ret;
+
+	dev = calloc(1, sizeof(struct udevice));
+	if (!dev)
+		return -ENOMEM;
+	INIT_LIST_HEAD(&dev->sibling_node);
+	INIT_LIST_HEAD(&dev->child_head);
+	INIT_LIST_HEAD(&dev->uclass_node);
+#ifdef CONFIG_DEVRES
+	INIT_LIST_HEAD(&dev->devres_head);
+#endif
+	dev->driver_data = data;
+	dev_set_ofnode(dev, node);
+	dev->parent = parent;
+	dev->driver = drv;
+	dev->uclass = uc;
+	dev->seq_ = -1;
+
+	/* Names from the flat tree point into the blob before relocation */
+	if (!(dev_get_flags(old) & DM_FLAG_NAME_ALLOCED) &&
+	    !strcmp(old->name, ofnode_get_name(node))) {
+		dev->name = ofnode_get_name(node);
+	} else {
+		dev->name = strdup(old->name);
+		if (!dev->name) {
+			free(dev);
+			return -ENOMEM;
+		}
+		dev_or_flags(dev, DM_FLAG_NAME_ALLOCED);
+	}
+
+	ret = reloc_alloc(dev, parent);
+	if (ret) {
+		reloc_free(dev);
+		return ret;
+	}
+
+	list_add_tail(&dev->sibling_node, &parent->child_head);
+	ret = uclass_bind_device(dev);
+	if (ret) {
+		list_del(&dev->sibling_node);
+		reloc_free(dev);
+		return ret;
+	}
+	reloc.dev[reloc.count++] = dev;
+	reloc.copied++;
+
+	if (parent->driver->child_post_bind) {
+		ret = parent->driver->child_post_bind(dev);
+		if (ret)
+			goto err;
+	}
+	list_for_each_entry(child, &old->child_head, sibling_node) {
+		ret = reloc_copy(dev, child);
+		if (ret)
+			goto err;
+	}
+	if (uc->uc_drv->post_bind) {
+		ret = uc->uc_drv->post_bind(dev);
+		if (ret)
+			goto err;
+	}
+	dev_or_flags(dev, DM_FLAG_BOUND);
+	log_debug("Relocated %s\n", dev->name);
+
+	return 0;
+
+err:
+	/* Let the caller unbind it along with the other copies */
+	dev_or_flags(dev, DM_FLAG_BOUND);
+
+	return ret;
+}
+
+static int reloc_count_devices(struct udevice *parent)
+{
+	struct udevice *dev;
+	int count = 0;
+
+	list_for_each_entry(dev, &parent->child_head, sibling_node)
+		count += 1 + reloc_count_devices(dev);
+
+	return count;
+}
+
+/* Forget the sequence numbers of the devices below @parent */
+static void reloc_clear_seq(struct udevice *parent)
+{
+	struct udevice *dev;
+
+	list_for_each_entry(dev, &parent->child_head, sibling_node) {
+		dev->seq_ = -1;
+		reloc_clear_seq(dev);
+	}
+}
+
+int dm_reloc_devices(struct udevice *old_root)
+{
+	struct udevice *old;
+	int ret = 0;
+
+	reloc.count = 0;
+	reloc.copied = 0;
+	reloc.dev = calloc(reloc_count_devices(old_root) + 1,
+			   sizeof(struct udevice *));
+	if (!reloc.dev)
+		return -ENOMEM;
+
+	reloc.copying = true;
+	list_for_each_entry(old, &old_root->child_head, sibling_node) {
+		ret = reloc_copy(dm_root(), old);
+		if (ret) {
+			log_err("Cannot relocate %s (err=%d)\n", old->name,
+				ret);
+			break;
+		}
+	}
+	reloc.copying = false;
+	if (ret) {
+		free(reloc.dev);
+		reloc.dev = NULL;
+		reloc.count = 0;
+		return ret;
+	}
+
+	/* Devices are numbered when the scan binds them */
+	reloc_clear_seq(dm_root());
+
+	return reloc.copied;
+}
+
+/*
+ * Put @dev and the devices below it last in their uclass and number them,
+ * in the order binding them would
+ */
+static void reloc_move_last(struct udevice *dev)
+{
+	struct udevice *child;
+
+	list_move_tail(&dev->uclass_node, &dev->uclass->dev_head);
+	dev->seq_ = device_bind_seq(dev);
+	list_for_each_entry(child, &dev->child_head, sibling_node)
+		reloc_move_last(child);
+}
+
+struct udevice *device_reloc_claim(struct udevice *parent,
+				   const struct driver *drv, ofnode node)
+{
+	struct udevice *dev;
+	int i;
+
+	for (i = 0; i < reloc.count; i++) {
+		dev = reloc.dev[i];
+		if (dev->parent == parent && dev->driver == drv &&
+		    ofnode_equal(dev_ofnode(dev), node)) {
+			reloc.dev[i] = reloc.dev[--reloc.count];
+			list_move_tail(&dev->sibling_node, &parent->child_head);
+			if (!reloc.copying)
+				reloc_move_last(dev);
+			return dev;
+		}
+	}
+
+	return NULL;
+}
+
+/* Tell if a parent of @dev is still waiting to be bound again */
+static bool reloc_parent_waiting(struct udevice *dev)
+{
+	int i;
+
+	for (dev = dev->parent; dev; dev = dev->parent) {
+		for (i = 0; i < reloc.count; i++) {
+			if (reloc.dev[i] == dev)
+				return true;
+		}
+	}
+
+	return false;
+}
+
+void dm_reloc_finish(void)
+{
+	struct udevice *dev;
+	int i, count = 0;
+
+	/*
+	 * Nothing binds copies whose parent no longer binds their node, such
+	 * as devices bound by board code before relocation. Take them out to
+	 * end up with the devices a full scan gives. Unbinding a device takes
+	 * its children with it, so first keep only the copies with no parent
+	 * waiting: the others are freed with them. A copy dropped here still
+	 * has its top-most waiting parent kept, so the check holds for the
+	 * copies after it.
+	 */
+	for (i = 0; CONFIG_IS_ENABLED(DM_DEVICE_REMOVE) && i < reloc.count;
+	     i++) {
+		dev = reloc.dev[i];
+		if (!reloc_parent_waiting(dev))
+			reloc.dev[count++] = dev;
+	}
+	for (i = 0; i < count; i++) {
+		dev = reloc.dev[i];
+		log_debug("Unbinding %s, not bound after relocation\n",
+			  dev->name);
+		device_unbind(dev);
+	}
+	free(reloc.dev);
+	reloc.dev = NULL;
+	reloc.count = 0;
+}
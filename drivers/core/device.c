@@ -9,6 +9,7 @@
  */
 
 #include <common.h>
+#include <bootstage.h>
 #include <cpu_func.h>
 #include <log.h>
 #include <asm/global_data.h>
@@ -35,6 +36,33 @@
 
 DECLARE_GLOBAL_DATA_PTR;
 
+int device_bind_seq(struct udevice *dev)
+{
+	struct uclass *uc = dev->uclass;
+	int seq;
+
+	if (CONFIG_IS_ENABLED(DM_SEQ_ALIAS) &&
+	    (uc->uc_drv->flags & DM_UC_FLAG_SEQ_ALIAS)) {
+		/*
+		 * Some devices, such as a SPI bus, I2C bus and serial ports
+		 * are numbered using aliases.
+		 */
+		if (CONFIG_IS_ENABLED(OF_CONTROL) &&
+		    !CONFIG_IS_ENABLED(OF_PLATDATA)) {
+			if (uc->uc_drv->name && dev_has_ofnode(dev)) {
+				if (!dev_read_alias_seq(dev, &seq)) {
+					log_debug("   - seq=%d\n", seq);
+					return seq;
+				}
+			}
+		}
+	}
+	if (!(uc->uc_drv->flags & DM_UC_FLAG_NO_AUTO_SEQ))
+		return uclass_find_next_free_seq(uc);
+
+	return -1;
+}
+
 static int device_bind_common(struct udevice *parent, const struct driver *drv,
 			      const char *name, void *plat,
 			      ulong driver_data, ofnode node,
@@ -43,7 +71,6 @@ static int device_bind_common(struct udevice *parent, const struct driver *drv,
 	struct udevice *dev;
 	struct uclass *uc;
 	int size, ret = 0;
-	bool auto_seq = true;
 	void *ptr;
 
 	if (CONFIG_IS_ENABLED(OF_PLATDATA_NO_BIND))
@@ -54,6 +81,13 @@ static int device_bind_common(struct udevice *parent, const struct driver *drv,
 	if (!name)
 		return -EINVAL;
 
+	dev = device_reloc_claim(parent, drv, node);
+	if (dev) {
+		if (devp)
+			*devp = dev;
+		return 0;
+	}
+
 	ret = uclass_get(drv->id, &uc);
 	if (ret) {
 		debug("Missing uclass for driver %s\n", drv->name);
@@ -77,26 +111,7 @@ static int device_bind_common(struct udevice *parent, const struct driver *drv,
 	dev->parent = parent;
 	dev->driver = drv;
 	dev->uclass = uc;
-
-	dev->seq_ = -1;
-	if (CONFIG_IS_ENABLED(DM_SEQ_ALIAS) &&
-	    (uc->uc_drv->flags & DM_UC_FLAG_SEQ_ALIAS)) {
-		/*
-		 * Some devices, such as a SPI bus, I2C bus and serial ports
-		 * are numbered using aliases.
-		 */
-		if (CONFIG_IS_ENABLED(OF_CONTROL) &&
-		    !CONFIG_IS_ENABLED(OF_PLATDATA)) {
-			if (uc->uc_drv->name && ofnode_valid(node)) {
-				if (!dev_read_alias_seq(dev, &dev->seq_)) {
-					auto_seq = false;
-					log_debug("   - seq=%d\n", dev->seq_);
-					}
-			}
-		}
-	}
-	if (auto_seq && !(uc->uc_drv->flags & DM_UC_FLAG_NO_AUTO_SEQ))
-		dev->seq_ = uclass_find_next_free_seq(uc);
+	dev->seq_ = device_bind_seq(dev);
 
 	/* Check if we need to allocate plat */
 	if (drv->plat_auto) {
@@ -482,17 +497,12 @@ static int device_get_dma_constraints(struct udevice *dev)
 	return 0;
 }
 
-int device_probe(struct udevice *dev)
+/* Probe a device which is not active yet, along with its parents */
+static int device_probe_activate(struct udevice *dev)
 {
 	const struct driver *drv;
 	int ret;
 
-	if (!dev)
-		return -EINVAL;
-
-	if (dev_get_flags(dev) & DM_FLAG_ACTIVATED)
-		return 0;
-
 	drv = dev->driver;
 	assert(drv);
 
@@ -578,9 +588,38 @@ int device_probe(struct udevice *dev)
 
 	if (drv->probe) {
 		ret = drv->probe(dev);
-		if (ret)
-			goto fail;
+		if (!ret)
+			ret = device_probe_steps(dev);
+		if (ret == -EINPROGRESS)
+			return ret;
 	}
+fail:
+	return device_probe_finish(dev, ret);
+}
+
+int device_probe(struct udevice *dev)
+{
+	ulong start_us;
+	int ret;
+
+	if (!dev)
+		return -EINVAL;
+
+	/* The probe may still be waiting for the device, see probe-async.c */
+	if (dev_get_flags(dev) & DM_FLAG_ACTIVATED)
+		return device_probe_wait(dev);
+
+	start_us = bootstage_trace_start();
+	ret = device_probe_activate(dev);
+	bootstage_trace_add(BOOTSTAGE_TRACE_PROBE, dev->name, 0, start_us);
+
+	return ret;
+}
+
+int device_probe_finish(struct udevice *dev, int ret)
+{
+	if (ret)
+		goto fail;
 
 	ret = uclass_post_probe_device(dev);
 	if (ret)
@@ -788,6 +827,19 @@ int device_get_child_by_of_offset(const struct udevice *parent, int node,
 	return device_get_device_tail(dev, ret, devp);
 }
 
+#if CONFIG_IS_ENABLED(DM_NODE_INDEX)
+void dev_set_ofnode(struct udevice *dev, ofnode node)
+{
+	bool indexed;
+
+	indexed = uclass_node_index_del(dev) ||
+		  (dev_get_flags(dev) & DM_FLAG_BOUND);
+	dev->node_ = node;
+	if (indexed)
+		uclass_node_index_add(dev);
+}
+#endif
+
 static struct udevice *_device_find_global_by_ofnode(struct udevice *parent,
 						     ofnode ofnode)
 {
@@ -805,9 +857,27 @@ static struct udevice *_device_find_global_by_ofnode(struct udevice *parent,
 	return NULL;
 }
 
+static struct udevice *device_lookup_global_by_ofnode(ofnode ofnode)
+{
+	struct udevice *dev;
+	int ret;
+
+	/*
+	 * The index tells the first device bound, not the first one in the
+	 * tree, so walk the tree if there is more than one
+	 */
+	if (ofnode_valid(ofnode)) {
+		ret = uclass_node_index_find(UCLASS_INVALID, ofnode, &dev);
+		if (ret == 0 || ret == 1)
+			return dev;
+	}
+
+	return _device_find_global_by_ofnode(gd->dm_root, ofnode);
+}
+
 int device_find_global_by_ofnode(ofnode ofnode, struct udevice **devp)
 {
-	*devp = _device_find_global_by_ofnode(gd->dm_root, ofnode);
+	*devp = device_lookup_global_by_ofnode(ofnode);
 
 	return *devp ? 0 : -ENOENT;
 }
@@ -816,7 +886,7 @@ int device_get_global_by_ofnode(ofnode ofnode, struct udevice **devp)
 {
 	struct udevice *dev;
 
-	dev = _device_find_global_by_ofnode(gd->dm_root, ofnode);
+	dev = device_lookup_global_by_ofnode(ofnode);
 	return device_get_device_tail(dev, dev ? 0 : -ENOENT, devp);
 }
 
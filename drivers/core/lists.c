@@ -11,6 +11,9 @@
 #include <common.h>
 #include <errno.h>
 #include <log.h>
+#include <malloc.h>
+#include <sort.h>
+#include <asm/global_data.h>
 #include <dm/device.h>
 #include <dm/device-internal.h>
 #include <dm/lists.h>
@@ -19,6 +22,9 @@
 #include <dm/util.h>
 #include <fdtdec.h>
 #include <linux/compiler.h>
+#include <linux/err.h>
+
+DECLARE_GLOBAL_DATA_PTR;
 
 struct driver *lists_driver_lookup_name(const char *name)
 {
@@ -181,6 +187,134 @@ static int driver_check_compatible(const struct udevice_id *of_match,
 	return -ENOENT;
 }
 
+#if CONFIG_IS_ENABLED(DM_COMPAT_INDEX)
+/**
+ * struct dm_compat_index - Compatible strings of all drivers, sorted
+ *
+ * Each entry refers to one compatible string of a driver, with the number of
+ * the driver in the linker list in the upper 16 bits and the position of the
+ * string in its of_match table in the lower 16 bits. Entries are sorted by
+ * string, then by entry, so that among equal strings the first one found by
+ * a search in linker-list order comes first. Numbers rather than pointers
+ * keep the table valid whatever the relocation does to the driver list.
+ *
+ * @count: number of entries
+ * @entry: entries
+ */
+struct dm_compat_index {
+	uint count;
+	u32 entry[];
+};
+
+#define COMPAT_INDEX_MAX	0xffff
+
+static const struct udevice_id *compat_index_id(u32 entry)
+{
+	struct driver *driver = ll_entry_start(struct driver, driver);
+
+	return &driver[entry >> 16].of_match[entry & COMPAT_INDEX_MAX];
+}
+
+static int compat_index_cmp(const void *a, const void *b)
+{
+	u32 entry_a = *(const u32 *)a;
+	u32 entry_b = *(const u32 *)b;
+	int ret;
+
+	ret = strcmp(compat_index_id(entry_a)->compatible,
+		     compat_index_id(entry_b)->compatible);
+	if (ret)
+		return ret;
+
+	return entry_a < entry_b ? -1 : entry_a > entry_b;
+}
+
+static struct dm_compat_index *compat_index_build(void)
+{
+	struct driver *driver = ll_entry_start(struct driver, driver);
+	const int n_ents = ll_entry_count(struct driver, driver);
+	const struct udevice_id *of_match;
+	struct dm_compat_index *index;
+	uint count = 0;
+	int i, j;
+
+	if (n_ents > COMPAT_INDEX_MAX)
+		return ERR_PTR(-E2BIG);
+	for (i = 0; i < n_ents; i++) {
+		of_match = driver[i].of_match;
+		for (j = 0; of_match && of_match[j].compatible; j++)
+			;
+		if (j > COMPAT_INDEX_MAX)
+			return ERR_PTR(-E2BIG);
+		count += j;
+	}
+
+	index = malloc(sizeof(*index) + count * sizeof(index->entry[0]));
+	if (!index)
+		return ERR_PTR(-ENOMEM);
+	index->count = count;
+	count = 0;
+	for (i = 0; i < n_ents; i++) {
+		of_match = driver[i].of_match;
+		for (j = 0; of_match && of_match[j].compatible; j++)
+			index->entry[count++] = i << 16 | j;
+	}
+	qsort(index->entry, count, sizeof(index->entry[0]), compat_index_cmp);
+	log_debug("Indexed %u compatible strings\n", count);
+
+	return index;
+}
+
+static struct driver *compat_index_lookup(const struct dm_compat_index *index,
+					  const char *compat,
+					  const struct udevice_id **of_idp)
+{
+	struct driver *driver = ll_entry_start(struct driver, driver);
+	const struct udevice_id *id;
+	uint low = 0, high = index->count, mid;
+
+	/* Find the first entry not before @compat */
+	while (low < high) {
+		mid = (low + high) / 2;
+		if (strcmp(compat_index_id(index->entry[mid])->compatible,
+			   compat) < 0)
+			low = mid + 1;
+		else
+			high = mid;
+	}
+	if (low == index->count)
+		return NULL;
+	id = compat_index_id(index->entry[low]);
+	if (strcmp(id->compatible, compat))
+		return NULL;
+	*of_idp = id;
+
+	return &driver[index->entry[low] >> 16];
+}
+#endif
+
+struct driver *lists_driver_lookup_compat(const char *compat,
+					  const struct udevice_id **of_idp)
+{
+	struct driver *driver = ll_entry_start(struct driver, driver);
+	const int n_ents = ll_entry_count(struct driver, driver);
+	struct driver *entry;
+
+#if CONFIG_IS_ENABLED(DM_COMPAT_INDEX)
+	if (!gd->dm_compat_index)
+		gd->dm_compat_index = compat_index_build();
+	if (!IS_ERR(gd->dm_compat_index))
+		return compat_index_lookup(gd->dm_compat_index, compat,
+					   of_idp);
+#endif
+	for (entry = driver; entry != driver + n_ents; entry++) {
+		if (!driver_check_compatible(entry->of_match, of_idp, compat))
+			return entry;
+	}
+
+	return NULL;
+}
+
 int lists_bind_fdt(struct udevice *parent, ofnode node, struct udevice **devp,
 		   struct driver *drv, bool pre_reloc_only)
 {
@@ -222,16 +356,23 @@ int lists_bind_fdt(struct udevice *parent, ofnode node, struct udevice **devp,
 		log_debug("   - attempt to match compatible string '%s'\n",
 			  compat);
 
-		for (entry = driver; entry != driver + n_ents; entry++) {
-			ret = driver_check_compatible(entry->of_match, &id,
-						      compat);
-			if ((drv) && (drv == entry))
-				break;
-			if (!ret)
-				break;
+		if (drv) {
+			for (entry = driver; entry != driver + n_ents;
+			     entry++) {
+				ret = driver_check_compatible(entry->of_match,
+							      &id, compat);
+				if (drv == entry)
+					break;
+				if (!ret)
+					break;
+			}
+			if (entry == driver + n_ents)
+				continue;
+		} else {
+			entry = lists_driver_lookup_compat(compat, &id);
+			if (!entry)
+				continue;
 		}
-		if (entry == driver + n_ents)
-			continue;
 
 		if (pre_reloc_only) {
 			if (!ofnode_pre_reloc(node) &&
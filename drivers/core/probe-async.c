@@ -0,0 +1,184 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * Probe devices in parallel, overlapping their waits for the hardware
+ *
+ * A probe() method left a step with device_probe_yield() returns at once.
+ * device_probe_parallel() then goes on with the next device and polls the
+ * steps of all the devices in turn, so their waits add up no more. Nothing
+ * runs at the same time: drivers give the CPU back by returning -EAGAIN.
+ */
+
+#define LOG_CATEGORY LOGC_DM
+
+#include <common.h>
+#include <dm.h>
+#include <log.h>
+#include <malloc.h>
+#include <watchdog.h>
+#include <asm/global_data.h>
+#include <dm/device-internal.h>
+
+DECLARE_GLOBAL_DATA_PTR;
+
+/**
+ * struct probe_step - Device probed by device_probe_parallel()
+ *
+ * @dev: Device to probe
+ * @poll: Step left by the driver, to call until it stops returning -EAGAIN
+ * @pending: @poll is still to be called
+ * @yielded: the current call to @poll left another step
+ * @running: @poll is being called
+ */
+struct probe_step {
+	struct udevice *dev;
+	int (*poll)(struct udevice *dev);
+	bool pending;
+	bool yielded;
+	bool running;
+};
+
+/**
+ * struct probe_async - State of device_probe_parallel()
+ *
+ * @steps: Devices being probed, NULL if none
+ * @count: Number of devices in @steps
+ * @starting: Device whose probe is being started
+ */
+struct probe_async {
+	struct probe_step *steps;
+	int count;
+	struct udevice *starting;
+};
+
+static struct probe_async probe_async;
+
+static struct probe_step *probe_step_find(struct udevice *dev)
+{
+	int i;
+
+	for (i = 0; i < probe_async.count; i++) {
+		if (probe_async.steps[i].dev == dev)
+			return &probe_async.steps[i];
+	}
+
+	return NULL;
+}
+
+/* Call the step once, returning -EAGAIN while the probe is not over */
+static int probe_step_run(struct probe_step *step)
+{
+	int ret;
+
+	step->yielded = false;
+	step->running = true;
+	ret = step->poll(step->dev);
+	step->running = false;
+	if (ret == -EAGAIN || (!ret && step->yielded))
+		return -EAGAIN;
+	step->pending = false;
+
+	return ret;
+}
+
+static int probe_step_wait(struct probe_step *step)
+{
+	int ret;
+
+	while ((ret = probe_step_run(step)) == -EAGAIN)
+		WATCHDOG_RESET();
+
+	return ret;
+}
+
+int device_probe_yield(struct udevice *dev, int (*poll)(struct udevice *dev))
+{
+	struct probe_step *step;
+
+	step = probe_step_find(dev);
+	if (step && (step->running || probe_async.starting == dev)) {
+		step->poll = poll;
+		step->pending = true;
+		step->yielded = true;
+		return 0;
+	}
+	step = &(struct probe_step){ .dev = dev, .poll = poll };
+
+	return probe_step_wait(step);
+}
+
+int device_probe_steps(struct udevice *dev)
+{
+	struct probe_step *step = probe_step_find(dev);
+
+	return step && step->pending ? -EINPROGRESS : 0;
+}
+
+int device_probe_wait(struct udevice *dev)
+{
+	struct probe_step *step = probe_step_find(dev);
+
+	if (!step || !step->pending || step->running)
+		return 0;
+	log_debug("Waiting for %s\n", dev->name);
+
+	return device_probe_finish(dev, probe_step_wait(step));
+}
+
+int device_probe_parallel(struct udevice *const devs[], int count)
+{
+	struct probe_step *steps;
+	int i, ret, err = 0;
+	bool busy;
+
+	/* Probes started from a step are not overlapped with the others */
+	steps = NULL;
+	if (!probe_async.steps && (gd->flags & GD_FLG_RELOC))
+		steps = calloc(count, sizeof(*steps));
+	if (!steps) {
+		for (i = 0; i < count; i++) {
+			ret = device_probe(devs[i]);
+			if (ret && !err)
+				err = ret;
+		}
+		return err;
+	}
+
+	probe_async.steps = steps;
+	probe_async.count = count;
+	for (i = 0; i < count; i++)
+		steps[i].dev = devs[i];
+
+	for (i = 0; i < count; i++) {
+		probe_async.starting = devs[i];
+		ret = device_probe(devs[i]);
+		probe_async.starting = NULL;
+		if (ret == -EINPROGRESS)
+			continue;
+		/* The step of a probe() method failing is not called */
+		steps[i].pending = false;
+		if (ret && !err)
+			err = ret;
+	}
+
+	do {
+		busy = false;
+		for (i = 0; i < count; i++) {
+			if (!steps[i].pending)
+				continue;
+			busy = true;
+			ret = probe_step_run(&steps[i]);
+			if (ret == -EAGAIN)
+				continue;
+			ret = device_probe_finish(steps[i].dev, ret);
+			if (ret && !err)
+				err = ret;
+		}
+		WATCHDOG_RESET();
+	} while (busy);
+
+	probe_async.steps = NULL;
+	probe_async.count = 0;
+	free(steps);
+
+	return err;
+}
@@ -9,6 +9,7 @@
 #define LOG_CATEGORY UCLASS_ROOT
 
 #include <common.h>
+#include <bootstage.h>
 #include <errno.h>
 #include <fdtdec.h>
 #include <log.h>
@@ -26,6 +27,7 @@
 #include <dm/read.h>
 #include <dm/root.h>
 #include <dm/uclass.h>
+#include <dm/uclass-internal.h>
 #include <dm/util.h>
 #include <linux/list.h>
 
@@ -173,6 +175,7 @@ int dm_init(bool of_live)
 		gd->uclass_root = &DM_UCLASS_ROOT_S_NON_CONST;
 		INIT_LIST_HEAD(DM_UCLASS_ROOT_NON_CONST);
 	}
+	uclass_node_index_init();
 
 	if (IS_ENABLED(CONFIG_NEEDS_MANUAL_RELOC)) {
 		fix_drivers();
@@ -373,7 +376,13 @@ static int dm_scan(bool pre_reloc_only)
 	}
 
 	if (CONFIG_IS_ENABLED(OF_REAL)) {
+		enum bootstage_id id = pre_reloc_only ?
+			BOOTSTAGE_ID_ACCUM_DM_BIND_F :
+			BOOTSTAGE_ID_ACCUM_DM_BIND_R;
+
+		bootstage_start(id, pre_reloc_only ? "dm_bind_f" : "dm_bind_r");
 		ret = dm_extended_scan(pre_reloc_only);
+		bootstage_accum(id);
 		if (ret) {
 			debug("dm_extended_scan() failed: %d\n", ret);
 			return ret;
@@ -407,6 +416,42 @@ int dm_init_and_scan(bool pre_reloc_only)
 	return 0;
 }
 
+int dm_init_and_relocate(struct udevice *old_root)
+{
+	int ret;
+
+	ret = dm_init(CONFIG_IS_ENABLED(OF_LIVE));
+	if (ret) {
+		debug("dm_init() failed: %d\n", ret);
+		return ret;
+	}
+	ret = dm_reloc_devices(old_root);
+	if (ret < 0) {
+		struct uclass *uc, *next;
+
+		/* Drop the copies made so far and bind every device afresh */
+		log_warning("Cannot relocate devices (err=%d), binding them again\n",
+			    ret);
+		dm_uninit();
+		if (CONFIG_IS_ENABLED(DM_DEVICE_REMOVE)) {
+			list_for_each_entry_safe(uc, next, gd->uclass_root,
+						 sibling_node)
+				uclass_destroy(uc);
+		}
+
+		return dm_init_and_scan(false);
+	}
+	log_debug("%d devices relocated\n", ret);
+	ret = dm_scan(false);
+	dm_reloc_finish();
+	if (ret) {
+		log_debug("dm_scan() failed: %d\n", ret);
+		return ret;
+	}
+
+	return 0;
+}
+
 #ifdef CONFIG_ACPIGEN
 static int root_acpi_get_name(const struct udevice *dev, char *out_name)
 {
@@ -20,6 +20,7 @@
 #include <dm/uclass.h>
 #include <dm/uclass-internal.h>
 #include <dm/util.h>
+#include <linux/err.h>
 
 DECLARE_GLOBAL_DATA_PTR;
 
@@ -381,6 +382,13 @@ int uclass_find_device_by_ofnode(enum uclass_id id, ofnode node,
 	if (ret)
 		return ret;
 
+	ret = uclass_node_index_find(id, node, devp);
+	if (ret != -ENOSYS) {
+		ret = ret ? 0 : -ENODEV;
+		goto done;
+	}
+	ret = 0;
+
 	uclass_foreach_dev(dev, uc) {
 		log(LOGC_DM, LOGL_DEBUG_CONTENT, "      - checking %s\n",
 		    dev->name);
@@ -414,6 +422,12 @@ int uclass_find_device_by_phandle(enum uclass_id id, struct udevice *parent,
 	if (ret)
 		return ret;
 
+	ret = uclass_phandle_index_find(id, find_phandle, devp);
+	if (ret > 0)
+		return 0;
+	else if (ret != -ENOSYS)
+		return ret ? ret : -ENODEV;
+
 	uclass_foreach_dev(dev, uc) {
 		uint phandle;
 
@@ -535,6 +549,16 @@ int uclass_get_device_by_phandle_id(enum uclass_id id, uint phandle_id,
 	if (ret)
 		return ret;
 
+	/* Phandle 0 matches the devices with no phandle, not indexed */
+	if (phandle_id) {
+		ret = uclass_phandle_index_find(id, phandle_id, &dev);
+		if (ret > 0)
+			return uclass_get_device_tail(dev, 0, devp);
+		else if (!ret)
+			return -ENODEV;
+		ret = 0;
+	}
+
 	uclass_foreach_dev(dev, uc) {
 		uint phandle;
 
@@ -655,6 +679,155 @@ int uclass_first_device_drvdata(enum uclass_id id, ulong driver_data,
 	return -ENODEV;
 }
 
+#if CONFIG_IS_ENABLED(DM_NODE_INDEX)
+/* log2 of the number of buckets of each table, before and after relocation */
+#define NODE_INDEX_BITS_F	4
+#define NODE_INDEX_BITS		8
+
+/**
+ * struct dm_node_index - Bound devices hashed by node and phandle
+ *
+ * Each chain lists the newest device first, so the last match in a chain is
+ * the first one in the list of devices of its uclass.
+ *
+ * @bits: log2 of the number of buckets of each table
+ * @node_head: chains of devices, by device tree node
+ * @phandle_head: chains of devices, by the phandle of their node
+ */
+struct dm_node_index {
+	uint bits;
+	struct hlist_head *node_head;
+	struct hlist_head *phandle_head;
+};
+
+static uint node_index_hash(const struct dm_node_index *idx, ulong key)
+{
+	u32 val = (u32)key ^ (u32)((u64)key >> 32);
+
+	/* Multiplicative hashing, as hash_32() in Linux */
+	return (val * 0x61c88647) >> (32 - idx->bits);
+}
+
+/* Get the index of this phase, allocating it on the first bind if @alloc */
+static struct dm_node_index *node_index_get(bool alloc)
+{
+	struct dm_node_index *idx = gd->dm_node_index;
+	uint bits, size;
+
+	if (IS_ERR(idx))
+		return NULL;
+	if (idx || !alloc)
+		return idx;
+
+	bits = gd->flags & GD_FLG_RELOC ? NODE_INDEX_BITS : NODE_INDEX_BITS_F;
+	size = 1 << bits;
+	idx = calloc(1, sizeof(*idx) + 2 * size * sizeof(struct hlist_head));
+	if (!idx) {
+		log_debug("Cannot allocate the node index, lookups will scan\n");
+		gd->dm_node_index = ERR_PTR(-ENOMEM);
+		return NULL;
+	}
+	idx->bits = bits;
+	idx->node_head = (struct hlist_head *)(idx + 1);
+	idx->phandle_head = idx->node_head + size;
+	gd->dm_node_index = idx;
+
+	return idx;
+}
+
+void uclass_node_index_init(void)
+{
+	struct dm_node_index *idx = node_index_get(false);
+
+	if (idx)
+		memset(idx->node_head, '\0',
+		       2 * (1 << idx->bits) * sizeof(struct hlist_head));
+}
+
+void uclass_node_index_add(struct udevice *dev)
+{
+	ofnode node = dev_ofnode(dev);
+	struct dm_node_index *idx;
+	uint phandle;
+
+	if (!ofnode_valid(node))
+		return;
+	idx = node_index_get(true);
+	if (!idx)
+		return;
+
+	hlist_add_head(&dev->node_hash,
+		       &idx->node_head[node_index_hash(idx, node.of_offset)]);
+	phandle = dev_read_phandle(dev);
+	if (phandle)
+		hlist_add_head(&dev->phandle_hash,
+			       &idx->phandle_head[node_index_hash(idx, phandle)]);
+}
+
+bool uclass_node_index_del(struct udevice *dev)
+{
+	if (hlist_unhashed(&dev->node_hash))
+		return false;
+	hlist_del_init(&dev->node_hash);
+	hlist_del_init(&dev->phandle_hash);
+
+	return true;
+}
+
+int uclass_node_index_find(enum uclass_id id, ofnode node,
+			   struct udevice **devp)
+{
+	struct dm_node_index *idx = node_index_get(false);
+	struct hlist_node *pos;
+	struct udevice *dev;
+	int count = 0;
+
+	*devp = NULL;
+	if (!idx)
+		return -ENOSYS;
+
+	hlist_for_each_entry(dev, pos,
+			     &idx->node_head[node_index_hash(idx, node.of_offset)],
+			     node_hash) {
+		if (ofnode_equal(dev_ofnode(dev), node) &&
+		    (id == UCLASS_INVALID || dev->uclass->uc_drv->id == id)) {
+			*devp = dev;
+			count++;
+		}
+	}
+
+	return count;
+}
+
+int uclass_phandle_index_find(enum uclass_id id, uint phandle,
+			      struct udevice **devp)
+{
+	struct dm_node_index *idx = node_index_get(false);
+	struct hlist_node *pos;
+	struct udevice *dev;
+	int count = 0;
+
+	*devp = NULL;
+	if (!idx)
+		return -ENOSYS;
+	/* Every device without a phandle would match */
+	if (!phandle)
+		return -ENOENT;
+
+	hlist_for_each_entry(dev, pos,
+			     &idx->phandle_head[node_index_hash(idx, phandle)],
+			     phandle_hash) {
+		if (dev_read_phandle(dev) == phandle &&
+		    dev->uclass->uc_drv->id == id) {
+			*devp = dev;
+			count++;
+		}
+	}
+
+	return count;
+}
+#endif /* DM_NODE_INDEX */
+
 int uclass_bind_device(struct udevice *dev)
 {
 	struct uclass *uc;
@@ -672,6 +845,7 @@ int uclass_bind_device(struct udevice *dev)
 				goto err;
 		}
 	}
+	uclass_node_index_add(dev);
 
 	return 0;
 err:
@@ -695,6 +869,7 @@ int uclass_unbind_device(struct udevice *dev)
 	}
 
 	list_del(&dev->uclass_node);
+	uclass_node_index_del(dev);
 	return 0;
 }
 #endif
@@ -764,11 +939,41 @@ int uclass_pre_remove_device(struct udevice *dev)
 }
 #endif
 
+/* Probe the devices of the uclass with device_probe_parallel() */
+static int uclass_probe_all_parallel(enum uclass_id id)
+{
+	struct udevice *dev, **devs;
+	struct uclass *uc;
+	int count, ret;
+
+	ret = uclass_get(id, &uc);
+	if (ret)
+		return ret;
+	count = 0;
+	uclass_foreach_dev(dev, uc)
+		count++;
+	if (!count)
+		return 0;
+	devs = malloc(count * sizeof(*devs));
+	if (!devs)
+		return -ENOMEM;
+	count = 0;
+	uclass_foreach_dev(dev, uc)
+		devs[count++] = dev;
+	ret = device_probe_parallel(devs, count);
+	free(devs);
+
+	return ret;
+}
+
 int uclass_probe_all(enum uclass_id id)
 {
 	struct udevice *dev;
 	int ret;
 
+	if (CONFIG_IS_ENABLED(DM_PROBE_ASYNC))
+		return uclass_probe_all_parallel(id);
+
 	ret = uclass_first_device(id, &dev);
 	if (ret || !dev)
 		return ret;
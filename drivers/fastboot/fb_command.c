@@ -29,6 +29,30 @@ static u32 fastboot_bytes_received;
  */
 static u32 fastboot_bytes_expected;
 
+#if CONFIG_IS_ENABLED(FASTBOOT_FLASH_STREAM)
+/**
+ * fastboot_stream_dest - partition the last download was written to, taken
+ * from fastboot_stream_part when it started, else empty
+ */
+static char fastboot_stream_dest[PART_NAME_LEN];
+
+/**
+ * fastboot_streaming - the current download is written to fastboot_stream_dest
+ */
+static bool fastboot_streaming;
+
+/**
+ * fastboot_streamed - the last download was written to fastboot_stream_dest
+ */
+static bool fastboot_streamed;
+
+/**
+ * fastboot_stream_failed - FAIL response to the current download once writing
+ * it to fastboot_stream_dest has failed and the rest is dropped, else empty
+ */
+static char fastboot_stream_failed[FASTBOOT_RESPONSE_LEN];
+#endif
+
 static void okay(char *, char *);
 static void getvar(char *, char *);
 static void download(char *, char *);
@@ -48,6 +72,9 @@ static void oem_partconf(char *, char *);
 #if CONFIG_IS_ENABLED(FASTBOOT_CMD_OEM_BOOTBUS)
 static void oem_bootbus(char *, char *);
 #endif
+#if CONFIG_IS_ENABLED(FASTBOOT_FLASH_STREAM)
+static void oem_stream(char *, char *);
+#endif
 
 #if CONFIG_IS_ENABLED(FASTBOOT_UUU_SUPPORT)
 static void run_ucmd(char *, char *);
@@ -122,6 +149,12 @@ static const struct {
 		.dispatch = oem_bootbus,
 	},
 #endif
+#if CONFIG_IS_ENABLED(FASTBOOT_FLASH_STREAM)
+	[FASTBOOT_COMMAND_OEM_STREAM] = {
+		.command = "oem stream",
+		.dispatch = oem_stream,
+	},
+#endif
 #if CONFIG_IS_ENABLED(FASTBOOT_UUU_SUPPORT)
 	[FASTBOOT_COMMAND_UCMD] = {
 		.command = "UCmd",
@@ -213,6 +246,32 @@ static void download(char *cmd_parameter, char *response)
 		fastboot_fail("Expected nonzero image size", response);
 		return;
 	}
+#if CONFIG_IS_ENABLED(FASTBOOT_FLASH_STREAM)
+	fastboot_streaming = false;
+	fastboot_streamed = false;
+	fastboot_stream_failed[0] = '\0';
+	fastboot_stream_dest[0] = '\0';
+	if (fastboot_stream_part[0]) {
+		/* Streaming covers this download only */
+		strlcpy(fastboot_stream_dest, fastboot_stream_part,
+			PART_NAME_LEN);
+		fastboot_stream_part[0] = '\0';
+		/* Only a bounded part of the buffer is used, whatever the size */
+		if (fastboot_mmc_stream_begin(fastboot_stream_dest,
+					      fastboot_buf_addr,
+					      min_t(u32, fastboot_buf_size,
+						    CONFIG_FASTBOOT_FLASH_STREAM_BUF_SIZE),
+					      response)) {
+			fastboot_bytes_expected = 0;
+			return;
+		}
+		fastboot_streaming = true;
+		printf("Starting download of %d bytes to '%s'\n",
+		       fastboot_bytes_expected, fastboot_stream_dest);
+		fastboot_response("DATA", response, "%s", cmd_parameter);
+		return;
+	}
+#endif
 	/*
 	 * Nothing to download yet. Response is of the form:
 	 * [DATA|FAIL]$cmd_parameter
@@ -238,6 +297,31 @@ u32 fastboot_data_remaining(void)
 	return fastboot_bytes_expected - fastboot_bytes_received;
 }
 
+/**
+ * fastboot_store() - Keep received data in the buffer, or write it out
+ *
+ * @data: Pointer to received data
+ * @len: Length of received data
+ */
+static void fastboot_store(const void *data, unsigned int len)
+{
+#if CONFIG_IS_ENABLED(FASTBOOT_FLASH_STREAM)
+	if (fastboot_streaming) {
+		/*
+		 * Write it to the partition as it arrives. Once that fails the
+		 * host still sends the rest, which is dropped, and it is told
+		 * when the download ends.
+		 */
+		if (!fastboot_stream_failed[0])
+			fastboot_mmc_stream_write(data, len,
+						  fastboot_stream_failed);
+		return;
+	}
+#endif
+	/* Download data to fastboot_buf_addr */
+	memcpy(fastboot_buf_addr + fastboot_bytes_received, data, len);
+}
+
 /**
  * fastboot_data_download() - Copy image data to fastboot_buf_addr.
  *
@@ -266,9 +350,7 @@ void fastboot_data_download(const void *fastboot_data,
 			      response);
 		return;
 	}
-	/* Download data to fastboot_buf_addr */
-	memcpy(fastboot_buf_addr + fastboot_bytes_received,
-	       fastboot_data, fastboot_data_len);
+	fastboot_store(fastboot_data, fastboot_data_len);
 
 	pre_dot_num = fastboot_bytes_received / BYTES_PER_DOT;
 	fastboot_bytes_received += fastboot_data_len;
@@ -298,6 +380,20 @@ void fastboot_data_complete(char *response)
 	env_set_hex("filesize", image_size);
 	fastboot_bytes_expected = 0;
 	fastboot_bytes_received = 0;
+
+#if CONFIG_IS_ENABLED(FASTBOOT_FLASH_STREAM)
+	if (fastboot_streaming) {
+		/* Write the rest; there is nothing to boot in the buffer */
+		fastboot_streaming = false;
+		image_size = 0;
+		if (fastboot_stream_failed[0])
+			strlcpy(response, fastboot_stream_failed,
+				FASTBOOT_RESPONSE_LEN);
+		else if (!fastboot_mmc_stream_end(fastboot_stream_dest,
+						  response))
+			fastboot_streamed = true;
+	}
+#endif
 }
 
 #if CONFIG_IS_ENABLED(FASTBOOT_FLASH)
@@ -312,6 +408,24 @@ void fastboot_data_complete(char *response)
  */
 static void flash(char *cmd_parameter, char *response)
 {
+#if CONFIG_IS_ENABLED(FASTBOOT_FLASH_STREAM)
+	if (fastboot_stream_part[0] || fastboot_stream_dest[0]) {
+		/* The image was written as it was downloaded */
+		if (!fastboot_streamed)
+			fastboot_fail("no image streamed", response);
+		else if (!cmd_parameter ||
+			 strcmp(cmd_parameter, fastboot_stream_dest))
+			fastboot_fail("image streamed to another partition",
+				      response);
+		else
+			fastboot_okay(NULL, response);
+		/* Later downloads go to the buffer until armed again */
+		fastboot_streamed = false;
+		fastboot_stream_part[0] = '\0';
+		fastboot_stream_dest[0] = '\0';
+		return;
+	}
+#endif
 #if CONFIG_IS_ENABLED(FASTBOOT_FLASH_MMC)
 	fastboot_mmc_flash_write(cmd_parameter, fastboot_buf_addr, image_size,
 				 response);
@@ -514,3 +628,44 @@ static void oem_bootbus(char *cmd_parameter, char *response)
 		fastboot_okay(NULL, response);
 }
 #endif
+
+#if CONFIG_IS_ENABLED(FASTBOOT_FLASH_STREAM)
+/**
+ * oem_stream() - Write the next download to a partition as it arrives
+ *
+ * @cmd_parameter: Pointer to partition name, none to download to the buffer
+ * @response: Pointer to fastboot response buffer
+ *
+ * The next download is written to the partition while it is received,
+ * through a buffer of CONFIG_FASTBOOT_FLASH_STREAM_BUF_SIZE bytes, and the
+ * "flash" command that follows only reports how the writing went. Later
+ * downloads go to the buffer again. This keeps the host protocol unchanged:
+ *
+ *	fastboot oem stream:system
+ *	fastboot flash system system.img
+ */
+static void oem_stream(char *cmd_parameter, char *response)
+{
+	struct blk_desc *dev_desc;
+	struct disk_partition info;
+
+	fastboot_streamed = false;
+	fastboot_stream_dest[0] = '\0';
+	if (!cmd_parameter || !*cmd_parameter) {
+		fastboot_stream_part[0] = '\0';
+		fastboot_okay(NULL, response);
+		return;
+	}
+
+	if (strlen(cmd_parameter) >= PART_NAME_LEN) {
+		fastboot_fail("partition name too long", response);
+		return;
+	}
+	if (fastboot_mmc_get_part_info(cmd_parameter, &dev_desc, &info,
+				       response) < 0)
+		return;
+
+	strlcpy(fastboot_stream_part, cmd_parameter, PART_NAME_LEN);
+	fastboot_okay(NULL, response);
+}
+#endif
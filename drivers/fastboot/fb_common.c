@@ -15,6 +15,8 @@
 #include <command.h>
 #include <env.h>
 #include <fastboot.h>
+#include <fastboot-internal.h>
+#include <part.h>
 #include <net/fastboot.h>
 
 /**
@@ -27,6 +29,14 @@ void *fastboot_buf_addr;
  */
 u32 fastboot_buf_size;
 
+#if CONFIG_IS_ENABLED(FASTBOOT_FLASH_STREAM)
+/**
+ * fastboot_stream_part - partition the next download is written to as it
+ * arrives
+ */
+char fastboot_stream_part[PART_NAME_LEN];
+#endif
+
 /**
  * fastboot_progress_callback - callback executed during long operations
  */
@@ -182,4 +192,7 @@ void fastboot_init(void *buf_addr, u32 buf_size)
 				       (void *)CONFIG_FASTBOOT_BUF_ADDR;
 	fastboot_buf_size = buf_size ? buf_size : CONFIG_FASTBOOT_BUF_SIZE;
 	fastboot_set_progress_callback(NULL);
+#if CONFIG_IS_ENABLED(FASTBOOT_FLASH_STREAM)
+	fastboot_stream_part[0] = '\0';
+#endif
 }
@@ -137,6 +137,13 @@ static void getvar_version_bootloader(char *var_parameter, char *response)
 
 static void getvar_downloadsize(char *var_parameter, char *response)
 {
+#if CONFIG_IS_ENABLED(FASTBOOT_FLASH_STREAM)
+	/* Nothing is kept in the buffer, the partition sets the limit */
+	if (fastboot_stream_part[0]) {
+		fastboot_response("OKAY", response, "0x%08x", U32_MAX);
+		return;
+	}
+#endif
 	fastboot_response("OKAY", response, "0x%08x", fastboot_buf_size);
 }
 
@@ -638,6 +638,79 @@ void fastboot_mmc_flash_write(const char *cmd, void *download_buffer,
 	}
 }
 
+#if CONFIG_IS_ENABLED(FASTBOOT_FLASH_STREAM)
+static struct fb_mmc_sparse fb_mmc_stream_priv;
+static struct sparse_storage fb_mmc_stream_storage;
+static struct sparse_stream fb_mmc_stream;
+
+/**
+ * fastboot_mmc_stream_begin() - Start writing a download to eMMC
+ *
+ * @cmd: Named partition to write image to
+ * @buf: Pointer to buffer for the data on its way to the device
+ * @bufsize: Size of the buffer
+ * @response: Pointer to fastboot response buffer
+ */
+int fastboot_mmc_stream_begin(const char *cmd, void *buf, u32 bufsize,
+			      char *response)
+{
+	struct sparse_storage *sparse = &fb_mmc_stream_storage;
+	struct blk_desc *dev_desc;
+	struct disk_partition info;
+
+	if (fastboot_mmc_get_part_info(cmd, &dev_desc, &info, response) < 0)
+		return -ENOENT;
+
+	fb_mmc_stream_priv.dev_desc = dev_desc;
+	sparse->blksz = info.blksz;
+	sparse->start = info.start;
+	sparse->size = info.size;
+	sparse->write = fb_mmc_sparse_write;
+	sparse->reserve = fb_mmc_sparse_reserve;
+	sparse->mssg = fastboot_fail;
+	sparse->priv = &fb_mmc_stream_priv;
+
+	if (sparse_stream_init(&fb_mmc_stream, sparse, buf, bufsize)) {
+		fastboot_fail("buffer too small", response);
+		return -ENOMEM;
+	}
+	printf("Flashing image at offset " LBAFU " while downloading\n",
+	       sparse->start);
+
+	return 0;
+}
+
+/**
+ * fastboot_mmc_stream_write() - Write the next piece of a download to eMMC
+ *
+ * @data: Pointer to received data
+ * @len: Length of received data
+ * @response: Pointer to fastboot response buffer
+ */
+int fastboot_mmc_stream_write(const void *data, u32 len, char *response)
+{
+	if (sparse_stream_write(&fb_mmc_stream, data, len, response))
+		return -EIO;
+
+	return 0;
+}
+
+/**
+ * fastboot_mmc_stream_end() - Finish writing a download to eMMC
+ *
+ * @cmd: Named partition the image was written to
+ * @response: Pointer to fastboot response buffer
+ */
+int fastboot_mmc_stream_end(const char *cmd, char *response)
+{
+	if (sparse_stream_finish(&fb_mmc_stream, cmd, response))
+		return -EIO;
+
+	fastboot_okay(NULL, response);
+	return 0;
+}
+#endif
+
 /**
  * fastboot_mmc_flash_erase() - Erase eMMC for fastboot
  *
@@ -14,6 +14,7 @@
 #include <dm/device-internal.h>
 #include <dm/device_compat.h>
 #include <dm/lists.h>
+#include <dm/root.h>
 #include <linux/compat.h>
 #include "mmc_private.h"
 
@@ -354,14 +355,16 @@ void mmc_do_preinit(void)
 void print_mmc_devices(char separator)
 {
 	struct udevice *dev;
+	struct uclass *uc;
 	char *mmc_type;
 	bool first = true;
 
-	for (uclass_first_device(UCLASS_MMC, &dev);
-	     dev;
-	     uclass_next_device(&dev), first = false) {
-		struct mmc *m = mmc_get_mmc_dev(dev);
+	uclass_id_foreach_dev(UCLASS_MMC, dev, uc) {
+		struct mmc *m;
 
+		if (dm_probe_deferred(dev) || device_probe(dev))
+			continue;
+		m = mmc_get_mmc_dev(dev);
 		if (!first) {
 			printf("%c", separator);
 			if (separator != '\n')
@@ -375,6 +378,7 @@ void print_mmc_devices(char separator)
 		printf("%s: %d", m->cfg->name, mmc_get_blk_desc(m)->devnum);
 		if (mmc_type)
 			printf(" (%s)", mmc_type);
+		first = false;
 	}
 
 	printf("\n");
@@ -14,6 +14,8 @@
 #include <dm.h>
 #include <log.h>
 #include <dm/device-internal.h>
+#include <dm/root.h>
+#include <dm/uclass-internal.h>
 #include <errno.h>
 #include <mmc.h>
 #include <part.h>
@@ -3019,11 +3021,16 @@ static int mmc_probe(struct bd_info *bis)
 	 * So if we request 0, 1, 3 we will get 0, 1, 2.
 	 */
 	for (i = 0; ; i++) {
-		ret = uclass_get_device_by_seq(UCLASS_MMC, i, &dev);
+		ret = uclass_find_device_by_seq(UCLASS_MMC, i, &dev);
 		if (ret == -ENODEV)
 			break;
+		if (!dm_probe_deferred(dev))
+			device_probe(dev);
 	}
 	uclass_foreach_dev(dev, uc) {
+		/* Left for the first command using it */
+		if (dm_probe_deferred(dev))
+			continue;
 		ret = device_probe(dev);
 		if (ret)
 			pr_err("%s - probe failed: %d\n", dev->name, ret);
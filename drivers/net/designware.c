@@ -514,9 +514,10 @@ static int _dw_eth_send(struct dw_eth_dev *priv, void *packet, int length)
 	return 0;
 }
 
-static int _dw_eth_recv(struct dw_eth_dev *priv, uchar **packetp)
+static int _dw_eth_recv_desc(struct dw_eth_dev *priv, u32 desc_num,
+			     uchar **packetp)
 {
-	u32 status, desc_num = priv->rx_currdescnum;
+	u32 status;
 	struct dmamacdescr *desc_p = &priv->rx_mac_descrtable[desc_num];
 	int length = -EAGAIN;
 	ulong desc_start = (ulong)desc_p;
@@ -545,6 +546,11 @@ static int _dw_eth_recv(struct dw_eth_dev *priv, uchar **packetp)
 	return length;
 }
 
+static int _dw_eth_recv(struct dw_eth_dev *priv, uchar **packetp)
+{
+	return _dw_eth_recv_desc(priv, priv->rx_currdescnum, packetp);
+}
+
 static int _dw_free_pkt(struct dw_eth_dev *priv)
 {
 	u32 desc_num = priv->rx_currdescnum;
@@ -725,13 +731,50 @@ int designware_eth_send(struct udevice *dev, void *packet, int length)
 	return _dw_eth_send(priv, packet, length);
 }
 
+/* Number of frames dropped by the DMA since the last call */
+static uint _dw_eth_missed(struct dw_eth_dev *priv)
+{
+	u32 missed = readl(&priv->dma_regs_p->missedframes);
+
+	return (missed & MISSED_NODESC_MASK) +
+	       ((missed & MISSED_FIFO_MASK) >> MISSED_FIFO_SHIFT);
+}
+
 int designware_eth_recv(struct udevice *dev, int flags, uchar **packetp)
 {
 	struct dw_eth_dev *priv = dev_get_priv(dev);
 
+	if (flags & ETH_RECV_CHECK_DEVICE)
+		eth_count_rx_overruns(dev, _dw_eth_missed(priv));
+
 	return _dw_eth_recv(priv, packetp);
 }
 
+int designware_eth_recv_batch(struct udevice *dev, int flags, uchar **packets,
+			      int *lengths, int count)
+{
+	struct dw_eth_dev *priv = dev_get_priv(dev);
+	u32 desc_num = priv->rx_currdescnum;
+	int length;
+	int n;
+
+	if (flags & ETH_RECV_CHECK_DEVICE)
+		eth_count_rx_overruns(dev, _dw_eth_missed(priv));
+
+	/* Hand out the filled descriptors; they are freed in the same order */
+	count = min(count, CONFIG_RX_DESCR_NUM);
+	for (n = 0; n < count; n++) {
+		length = _dw_eth_recv_desc(priv, desc_num, &packets[n]);
+		if (length < 0)
+			break;
+		lengths[n] = length;
+		if (++desc_num >= CONFIG_RX_DESCR_NUM)
+			desc_num = 0;
+	}
+
+	return n;
+}
+
 int designware_eth_free_pkt(struct udevice *dev, uchar *packet, int length)
 {
 	struct dw_eth_dev *priv = dev_get_priv(dev);
@@ -746,6 +789,20 @@ void designware_eth_stop(struct udevice *dev)
 	return _dw_eth_halt(priv);
 }
 
+/* There is no per-group filtering: accept every multicast frame */
+int designware_eth_mcast(struct udevice *dev, const u8 *enetaddr, int join)
+{
+	struct dw_eth_dev *priv = dev_get_priv(dev);
+	struct eth_mac_regs *mac_p = priv->mac_regs_p;
+
+	if (join)
+		setbits_le32(&mac_p->framefilt, PASSALLMULTICAST);
+	else
+		clrbits_le32(&mac_p->framefilt, PASSALLMULTICAST);
+
+	return 0;
+}
+
 int designware_eth_write_hwaddr(struct udevice *dev)
 {
 	struct eth_pdata *pdata = dev_get_plat(dev);
@@ -902,8 +959,10 @@ const struct eth_ops designware_eth_ops = {
 	.start			= designware_eth_start,
 	.send			= designware_eth_send,
 	.recv			= designware_eth_recv,
+	.recv_batch		= designware_eth_recv_batch,
 	.free_pkt		= designware_eth_free_pkt,
 	.stop			= designware_eth_stop,
+	.mcast			= designware_eth_mcast,
 	.write_hwaddr		= designware_eth_write_hwaddr,
 };
 
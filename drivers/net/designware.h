@@ -15,7 +15,12 @@
 #endif
 
 #define CONFIG_TX_DESCR_NUM	16
+/* Give the DMA at least as many receive descriptors as the stack buffers */
+#if PKTBUFSRX > 16
+#define CONFIG_RX_DESCR_NUM	PKTBUFSRX
+#else
 #define CONFIG_RX_DESCR_NUM	16
+#endif
 #define CONFIG_ETH_BUFSIZE	2048
 #define TX_TOTAL_BUFSIZE	(CONFIG_ETH_BUFSIZE * CONFIG_TX_DESCR_NUM)
 #define RX_TOTAL_BUFSIZE	(CONFIG_ETH_BUFSIZE * CONFIG_RX_DESCR_NUM)
@@ -49,6 +54,9 @@ struct eth_mac_regs {
 #define RXENABLE		(1 << 2)
 #define TXENABLE		(1 << 3)
 
+/* MAC frame filter register definitions */
+#define PASSALLMULTICAST	(1 << 4)
+
 /* MII address register definitions */
 #define MII_BUSY		(1 << 0)
 #define MII_WRITE		(1 << 1)
@@ -74,7 +82,8 @@ struct eth_dma_regs {
 	u32 status;		/* 0x14 */
 	u32 opmode;		/* 0x18 */
 	u32 intenable;		/* 0x1c */
-	u32 reserved1[2];
+	u32 missedframes;	/* 0x20 */
+	u32 reserved1;
 	u32 axibus;		/* 0x28 */
 	u32 reserved2[7];
 	u32 currhosttxdesc;	/* 0x48 */
@@ -85,6 +94,11 @@ struct eth_dma_regs {
 
 #define DW_DMA_BASE_OFFSET	(0x1000)
 
+/* Missed frame counter register definitions (cleared on read) */
+#define MISSED_NODESC_MASK	0xffff
+#define MISSED_FIFO_SHIFT	17
+#define MISSED_FIFO_MASK	(0x7ff << MISSED_FIFO_SHIFT)
+
 /* Default DMA Burst length */
 #ifndef CONFIG_DW_GMAC_DEFAULT_DMA_PBL
 #define CONFIG_DW_GMAC_DEFAULT_DMA_PBL 8
@@ -264,9 +278,12 @@ int designware_eth_init(struct dw_eth_dev *priv, u8 *enetaddr);
 int designware_eth_enable(struct dw_eth_dev *priv);
 int designware_eth_send(struct udevice *dev, void *packet, int length);
 int designware_eth_recv(struct udevice *dev, int flags, uchar **packetp);
+int designware_eth_recv_batch(struct udevice *dev, int flags, uchar **packets,
+			      int *lengths, int count);
 int designware_eth_free_pkt(struct udevice *dev, uchar *packet,
 				   int length);
 int designware_eth_start(struct udevice *dev);
+int designware_eth_mcast(struct udevice *dev, const u8 *enetaddr, int join);
 void designware_eth_stop(struct udevice *dev);
 int designware_eth_write_hwaddr(struct udevice *dev);
 #endif
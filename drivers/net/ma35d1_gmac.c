@@ -159,8 +159,10 @@ const struct eth_ops gmac_ma35d1_eth_ops = {
 	.start			= designware_eth_start,
 	.send			= designware_eth_send,
 	.recv			= designware_eth_recv,
+	.recv_batch		= designware_eth_recv_batch,
 	.free_pkt		= designware_eth_free_pkt,
 	.stop			= designware_eth_stop,
+	.mcast			= designware_eth_mcast,
 	.write_hwaddr		= designware_eth_write_hwaddr,
 	.read_rom_hwaddr	= ma35d1_read_rom_hwaddr,
 };
@@ -74,8 +74,10 @@ int sandbox_eth_arp_req_to_reply(struct udevice *dev, void *packet,
 		return -EAGAIN;
 
 	/* Don't allow the buffer to overrun */
-	if (priv->recv_packets >= PKTBUFSRX)
+	if (priv->recv_packets >= PKTBUFSRX) {
+		eth_count_rx_overruns(dev, 1);
 		return 0;
+	}
 
 	/* store this as the assumed IP of the fake host */
 	priv->fake_host_ipaddr = net_read_ip(&arp->ar_tpa);
@@ -136,8 +138,10 @@ int sandbox_eth_ping_req_to_reply(struct udevice *dev, void *packet,
 		return -EAGAIN;
 
 	/* Don't allow the buffer to overrun */
-	if (priv->recv_packets >= PKTBUFSRX)
+	if (priv->recv_packets >= PKTBUFSRX) {
+		eth_count_rx_overruns(dev, 1);
 		return 0;
+	}
 
 	/* reply to the ping */
 	eth_recv = (void *)priv->recv_packet_buffer[priv->recv_packets];
@@ -176,8 +180,10 @@ int sandbox_eth_recv_arp_req(struct udevice *dev)
 	struct arp_hdr *arp_recv;
 
 	/* Don't allow the buffer to overrun */
-	if (priv->recv_packets >= PKTBUFSRX)
+	if (priv->recv_packets >= PKTBUFSRX) {
+		eth_count_rx_overruns(dev, 1);
 		return -EOVERFLOW;
+	}
 
 	/* Formulate a fake request */
 	eth_recv = (void *)priv->recv_packet_buffer[priv->recv_packets];
@@ -218,8 +224,10 @@ int sandbox_eth_recv_ping_req(struct udevice *dev)
 	struct icmp_hdr *icmpr;
 
 	/* Don't allow the buffer to overrun */
-	if (priv->recv_packets >= PKTBUFSRX)
+	if (priv->recv_packets >= PKTBUFSRX) {
+		eth_count_rx_overruns(dev, 1);
 		return -EOVERFLOW;
+	}
 
 	/* Formulate a fake ping */
 	eth_recv = (void *)priv->recv_packet_buffer[priv->recv_packets];
@@ -320,6 +328,55 @@ void sandbox_eth_set_priv(int index, void *priv)
 	dev_priv->priv = priv;
 }
 
+/*
+ * sandbox_eth_drop_rx()
+ *
+ * Drop received packets, as a lossy link would
+ *
+ * index - interface to drop packets on
+ * drop - numbers of the packets to drop, counted from this call, in
+ *	increasing order. If NULL, stop dropping packets
+ * count - number of entries in drop
+ */
+void sandbox_eth_drop_rx(int index, const uint *drop, int count)
+{
+	struct udevice *dev;
+	struct eth_sandbox_priv *priv;
+	int ret;
+
+	ret = uclass_get_device(UCLASS_ETH, index, &dev);
+	if (ret)
+		return;
+
+	priv = dev_get_priv(dev);
+	priv->rx_drop = drop;
+	priv->rx_drop_count = drop ? count : 0;
+	priv->rx_count = 0;
+	priv->rx_dropped = 0;
+}
+
+/*
+ * sandbox_eth_set_rx_generator()
+ *
+ * Fill the receive queue with packets from a traffic generator
+ *
+ * index - interface to receive on
+ * gen - traffic generator, NULL to stop
+ */
+void sandbox_eth_set_rx_generator(int index, sandbox_eth_rx_gen_f *gen)
+{
+	struct udevice *dev;
+	struct eth_sandbox_priv *priv;
+	int ret;
+
+	ret = uclass_get_device(UCLASS_ETH, index, &dev);
+	if (ret)
+		return;
+
+	priv = dev_get_priv(dev);
+	priv->rx_gen = gen;
+}
+
 static int sb_eth_start(struct udevice *dev)
 {
 	struct eth_sandbox_priv *priv = dev_get_priv(dev);
@@ -327,6 +384,7 @@ static int sb_eth_start(struct udevice *dev)
 	debug("eth_sandbox: Start\n");
 
 	priv->recv_packets = 0;
+	priv->recv_busy = 0;
 	for (int i = 0; i < PKTBUFSRX; i++) {
 		priv->recv_packet_buffer[i] = net_rx_packets[i];
 		priv->recv_packet_length[i] = 0;
@@ -347,24 +405,76 @@ static int sb_eth_send(struct udevice *dev, void *packet, int length)
 	return priv->tx_handler(dev, packet, length);
 }
 
-static int sb_eth_recv(struct udevice *dev, int flags, uchar **packetp)
+/* Release slot @i of the queue, keeping its buffer for a later packet */
+static void sb_eth_free_slot(struct eth_sandbox_priv *priv, int i)
+{
+	uchar *buf = priv->recv_packet_buffer[i];
+
+	--priv->recv_packets;
+	for (; i < priv->recv_packets; i++) {
+		priv->recv_packet_buffer[i] = priv->recv_packet_buffer[i + 1];
+		priv->recv_packet_length[i] = priv->recv_packet_length[i + 1];
+	}
+	priv->recv_packet_buffer[i] = buf;
+	priv->recv_packet_length[i] = 0;
+}
+
+static int sb_eth_recv_batch(struct udevice *dev, int flags, uchar **packets,
+			     int *lengths, int count)
 {
 	struct eth_sandbox_priv *priv = dev_get_priv(dev);
+	int n = 0;
 
 	if (skip_timeout) {
 		timer_test_add_offset(11000UL);
 		skip_timeout = false;
 	}
 
-	if (priv->recv_packets) {
-		int lcl_recv_packet_length = priv->recv_packet_length[0];
+	while (priv->rx_gen && priv->recv_packets < PKTBUFSRX) {
+		int len = priv->rx_gen(dev,
+				       priv->recv_packet_buffer[priv->recv_packets]);
+
+		if (!len) {
+			priv->rx_gen = NULL;
+			break;
+		}
+		priv->recv_packet_length[priv->recv_packets++] = len;
+	}
+
+	while (n < count && n < priv->recv_packets) {
+		int lcl_recv_packet_length = priv->recv_packet_length[n];
+
+		if (priv->rx_drop_count && *priv->rx_drop == priv->rx_count) {
+			debug("eth_sandbox: dropped packet[%d]\n",
+			      lcl_recv_packet_length);
+			priv->rx_count++;
+			priv->rx_drop++;
+			priv->rx_drop_count--;
+			priv->rx_dropped++;
+			sb_eth_free_slot(priv, n);
+			continue;
+		}
+		priv->rx_count++;
 
 		debug("eth_sandbox: received packet[%d], %d waiting\n",
-		      lcl_recv_packet_length, priv->recv_packets - 1);
-		*packetp = priv->recv_packet_buffer[0];
-		return lcl_recv_packet_length;
+		      lcl_recv_packet_length, priv->recv_packets - n - 1);
+		packets[n] = priv->recv_packet_buffer[n];
+		lengths[n] = lcl_recv_packet_length;
+		n++;
 	}
-	return 0;
+	priv->recv_busy = n;
+
+	return n;
+}
+
+static int sb_eth_recv(struct udevice *dev, int flags, uchar **packetp)
+{
+	int length;
+
+	if (sb_eth_recv_batch(dev, flags, packetp, &length, 1) != 1)
+		return 0;
+
+	return length;
 }
 
 static int sb_eth_free_pkt(struct udevice *dev, uchar *packet, int length)
@@ -375,14 +485,16 @@ static int sb_eth_free_pkt(struct udevice *dev, uchar *packet, int length)
 	if (!priv->recv_packets)
 		return 0;
 
-	--priv->recv_packets;
+	/* Packets may be freed in any order once handed out in a batch */
 	for (i = 0; i < priv->recv_packets; i++) {
-		priv->recv_packet_length[i] = priv->recv_packet_length[i + 1];
-		memcpy(priv->recv_packet_buffer[i],
-		       priv->recv_packet_buffer[i + 1],
-		       priv->recv_packet_length[i + 1]);
+		if (priv->recv_packet_buffer[i] == packet)
+			break;
 	}
-	priv->recv_packet_length[priv->recv_packets] = 0;
+	if (i == priv->recv_packets)
+		i = 0;
+	sb_eth_free_slot(priv, i);
+	if (priv->recv_busy)
+		priv->recv_busy--;
 
 	return 0;
 }
@@ -392,6 +504,17 @@ static void sb_eth_stop(struct udevice *dev)
 	debug("eth_sandbox: Stop\n");
 }
 
+/* Only record the group, nothing is filtered */
+static int sb_eth_mcast(struct udevice *dev, const u8 *enetaddr, int join)
+{
+	struct eth_sandbox_priv *priv = dev_get_priv(dev);
+
+	memcpy(priv->mcast_ethaddr, enetaddr, ARP_HLEN);
+	priv->mcast_joined = join;
+
+	return 0;
+}
+
 static int sb_eth_write_hwaddr(struct udevice *dev)
 {
 	struct eth_pdata *pdata = dev_get_plat(dev);
@@ -405,8 +528,10 @@ static const struct eth_ops sb_eth_ops = {
 	.start			= sb_eth_start,
 	.send			= sb_eth_send,
 	.recv			= sb_eth_recv,
+	.recv_batch		= sb_eth_recv_batch,
 	.free_pkt		= sb_eth_free_pkt,
 	.stop			= sb_eth_stop,
+	.mcast			= sb_eth_mcast,
 	.write_hwaddr		= sb_eth_write_hwaddr,
 };
 
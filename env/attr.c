@@ -11,6 +11,7 @@
 #else
 #include <common.h>
 #include <slre.h>
+#include <linux/ctype.h>
 #endif
 
 #include <env_attr.h>
@@ -18,6 +19,9 @@
 #include <linux/string.h>
 #include <malloc.h>
 
+/* Entries up to this long are copied on the stack rather than allocated */
+#define ENV_ATTR_WALK_BUF_LEN	64
+
 /*
  * Iterate through the whole list calling the callback for each found element.
  * "attr_list" takes the form:
@@ -31,6 +35,7 @@ int env_attr_walk(const char *attr_list,
 {
 	const char *entry, *entry_end;
 	char *name, *attributes;
+	char buf[ENV_ATTR_WALK_BUF_LEN];
 
 	if (!attr_list)
 		/* list not found */
@@ -39,42 +44,31 @@ int env_attr_walk(const char *attr_list,
 	entry = attr_list;
 	do {
 		char *entry_cpy = NULL;
+		int entry_len;
 
 		entry_end = strchr(entry, ENV_ATTR_LIST_DELIM);
 		/* check if this is the last entry in the list */
-		if (entry_end == NULL) {
-			int entry_len = strlen(entry);
-
-			if (entry_len) {
-				/*
-				 * allocate memory to copy the entry into since
-				 * we will need to inject '\0' chars and squash
-				 * white-space before calling the callback
-				 */
-				entry_cpy = malloc(entry_len + 1);
-				if (entry_cpy)
-					/* copy the rest of the list */
-					strcpy(entry_cpy, entry);
-				else
-					return -ENOMEM;
-			}
-		} else {
-			int entry_len = entry_end - entry;
-
-			if (entry_len) {
-				/*
-				 * allocate memory to copy the entry into since
-				 * we will need to inject '\0' chars and squash
-				 * white-space before calling the callback
-				 */
+		if (entry_end == NULL)
+			entry_len = strlen(entry);
+		else
+			entry_len = entry_end - entry;
+
+		if (entry_len) {
+			/*
+			 * copy the entry since we will need to inject '\0'
+			 * chars and squash white-space before calling the
+			 * callback; this runs each time a variable is created,
+			 * so only allocate memory for unusually long entries
+			 */
+			if (entry_len < sizeof(buf))
+				entry_cpy = buf;
+			else
 				entry_cpy = malloc(entry_len + 1);
-				if (entry_cpy) {
-					/* copy just this entry and null term */
-					strncpy(entry_cpy, entry, entry_len);
-					entry_cpy[entry_len] = '\0';
-				} else
-					return -ENOMEM;
-			}
+			if (!entry_cpy)
+				return -ENOMEM;
+			/* copy just this entry and null term */
+			memcpy(entry_cpy, entry, entry_len);
+			entry_cpy[entry_len] = '\0';
 		}
 
 		/* check if there is anything to process (e.g. not ",,,") */
@@ -96,13 +90,15 @@ int env_attr_walk(const char *attr_list,
 
 				retval = callback(name, attributes, priv);
 				if (retval) {
-					free(entry_cpy);
+					if (entry_cpy != buf)
+						free(entry_cpy);
 					return retval;
 				}
 			}
 		}
 
-		free(entry_cpy);
+		if (entry_cpy != buf)
+			free(entry_cpy);
 		entry = entry_end + 1;
 	} while (entry_end != NULL);
 
@@ -116,47 +112,96 @@ struct regex_callback_priv {
 	char *attributes;
 };
 
+/*
+ * Compare the literal characters at the start of a regex with a string, so
+ * that most strings are dealt with without compiling the regex. Return 0 if
+ * the string cannot match, 1 if the regex is just literal characters equal
+ * to the string, or -1 if the regex must be compiled to tell.
+ */
+static int regex_literal_cmp(const char *regex, const char *str)
+{
+	/* Alternatives can start differently */
+	if (strchr(regex, '|'))
+		return -1;
+
+	while (*regex) {
+		char ch = *regex;
+		int len = 1;
+
+		if (ch == '\\') {
+			/* Escaped letters and digits are classes such as \d */
+			if (!regex[1] || isalnum(regex[1]))
+				return -1;
+			ch = regex[1];
+			len = 2;
+		} else if (strchr("^$.[]()?*+{}", ch)) {
+			return -1;
+		}
+
+		/* A following quantifier makes this character optional */
+		if (regex[len] && strchr("?*+{", regex[len]))
+			return -1;
+		if (ch != *str)
+			return 0;
+		regex += len;
+		str++;
+	}
+
+	return !*str;
+}
+
 static int regex_callback(const char *name, const char *attributes, void *priv)
 {
 	int retval = 0;
 	struct regex_callback_priv *cbp = (struct regex_callback_priv *)priv;
-	struct slre slre;
 	char regex[strlen(name) + 3];
+	int match;
+
+	/*
+	 * This runs for each entry in the list every time a variable is
+	 * created, so avoid compiling the regex when possible
+	 */
+	match = regex_literal_cmp(name, cbp->searched_for);
+	if (match < 0) {
+		struct slre slre;
+
+		/* Require the whole string to be described by the regex */
+		sprintf(regex, "^%s$", name);
+		if (!slre_compile(&slre, regex)) {
+			printf("Error compiling regex: %s\n", slre.err_str);
+			return -EINVAL;
+		}
 
-	/* Require the whole string to be described by the regex */
-	sprintf(regex, "^%s$", name);
-	if (slre_compile(&slre, regex)) {
 		struct cap caps[slre.num_caps + 2];
 
-		if (slre_match(&slre, cbp->searched_for,
-			       strlen(cbp->searched_for), caps)) {
-			free(cbp->regex);
-			if (!attributes) {
-				retval = -EINVAL;
-				goto done;
-			}
-			cbp->regex = malloc(strlen(regex) + 1);
-			if (cbp->regex) {
-				strcpy(cbp->regex, regex);
-			} else {
-				retval = -ENOMEM;
-				goto done;
-			}
+		match = slre_match(&slre, cbp->searched_for,
+				   strlen(cbp->searched_for), caps);
+	}
 
-			free(cbp->attributes);
-			cbp->attributes = malloc(strlen(attributes) + 1);
-			if (cbp->attributes) {
-				strcpy(cbp->attributes, attributes);
-			} else {
-				retval = -ENOMEM;
-				free(cbp->regex);
-				cbp->regex = NULL;
-				goto done;
-			}
+	if (match) {
+		free(cbp->regex);
+		if (!attributes) {
+			retval = -EINVAL;
+			goto done;
+		}
+		cbp->regex = malloc(strlen(name) + 1);
+		if (cbp->regex) {
+			strcpy(cbp->regex, name);
+		} else {
+			retval = -ENOMEM;
+			goto done;
+		}
+
+		free(cbp->attributes);
+		cbp->attributes = malloc(strlen(attributes) + 1);
+		if (cbp->attributes) {
+			strcpy(cbp->attributes, attributes);
+		} else {
+			retval = -ENOMEM;
+			free(cbp->regex);
+			cbp->regex = NULL;
+			goto done;
 		}
-	} else {
-		printf("Error compiling regex: %s\n", slre.err_str);
-		retval = -EINVAL;
 	}
 done:
 	return retval;
@@ -0,0 +1,129 @@
+/* SPDX-License-Identifier: GPL-2.0+ */
+/*
+ * Region-based allocation, where everything is freed at once
+ */
+
+#ifndef __ARENA_H
+#define __ARENA_H
+
+#include <linux/sizes.h>
+#include <linux/types.h>
+
+/**
+ * struct arena_block - header of a block of memory used by an arena
+ *
+ * @next: Next block in the arena, or NULL if none
+ * @size: Number of bytes available after this header
+ * @used: Number of those bytes already allocated
+ */
+struct arena_block {
+	struct arena_block *next;
+	size_t size;
+	size_t used;
+};
+
+/* Default size of each block obtained from malloc() by an arena */
+#define ARENA_DEFAULT_BLOCK_SIZE	SZ_16K
+
+/**
+ * struct arena - region of memory from which allocations are freed together
+ *
+ * An arena suits code which makes many allocations during one phase of work
+ * (attaching a UBI device, mounting a filesystem, loading an EFI image) and
+ * then drops them all. Allocations are carved sequentially from large blocks
+ * obtained with malloc(), so they cost little and leave no small holes in the
+ * malloc() heap once the arena is reset.
+ *
+ * Individual allocations cannot be freed. Use arena_reset() at the end of
+ * each phase and arena_uninit() when the arena is no longer needed.
+ *
+ * Using memset() to zero all fields and then setting @block_size is
+ * equivalent to arena_init().
+ *
+ * @blocks: List of blocks, most recently used first
+ * @block_size: Size of each block to obtain from malloc()
+ * @size: Total bytes currently obtained from malloc() for this arena
+ * @used: Total bytes currently allocated from the arena, including padding
+ * @peak: Highest value @used has reached since arena_init()
+ */
+struct arena {
+	struct arena_block *blocks;
+	size_t block_size;
+	size_t size;
+	size_t used;
+	size_t peak;
+};
+
+/**
+ * arena_init() - set up a new, empty arena
+ *
+ * No memory is allocated until the first call to arena_alloc()
+ *
+ * @arena: Arena to set up
+ * @block_size: Size of each block to obtain from malloc(), or 0 to use
+ *	ARENA_DEFAULT_BLOCK_SIZE. Allocations larger than half of this get a
+ *	block to themselves.
+ */
+void arena_init(struct arena *arena, size_t block_size);
+
+/**
+ * arena_memalign() - allocate aligned memory from an arena
+ *
+ * @arena: Arena to allocate from
+ * @align: Required alignment in bytes, which must be a power of two
+ * @size: Number of bytes to allocate
+ * Return: pointer to the memory, or NULL if out of memory
+ */
+void *arena_memalign(struct arena *arena, size_t align, size_t size);
+
+/**
+ * arena_alloc() - allocate memory from an arena
+ *
+ * The memory is aligned suitably for any type, as with malloc()
+ *
+ * @arena: Arena to allocate from
+ * @size: Number of bytes to allocate
+ * Return: pointer to the memory, or NULL if out of memory
+ */
+void *arena_alloc(struct arena *arena, size_t size);
+
+/**
+ * arena_calloc() - allocate zeroed memory from an arena
+ *
+ * @arena: Arena to allocate from
+ * @size: Number of bytes to allocate
+ * Return: pointer to the memory, or NULL if out of memory
+ */
+void *arena_calloc(struct arena *arena, size_t size);
+
+/**
+ * arena_strdup() - copy a string into an arena
+ *
+ * @arena: Arena to allocate from
+ * @str: String to copy
+ * Return: pointer to the copy, or NULL if out of memory
+ */
+char *arena_strdup(struct arena *arena, const char *str);
+
+/**
+ * arena_reset() - free all allocations made from an arena
+ *
+ * All pointers returned by the arena become invalid. The first standard-sized
+ * block is kept so that the next phase can start allocating without going
+ * back to malloc(); all other blocks are freed.
+ *
+ * @arena: Arena to reset
+ */
+void arena_reset(struct arena *arena);
+
+/**
+ * arena_uninit() - free all memory held by an arena
+ *
+ * All pointers returned by the arena become invalid. The arena can be used
+ * again afterwards, with the same block size.
+ *
+ * @arena: Arena to free
+ */
+void arena_uninit(struct arena *arena);
+
+#endif
@@ -225,6 +225,22 @@ struct global_data {
 	 */
 	void *dm_priv_base;
 # endif
+# if CONFIG_IS_ENABLED(DM_COMPAT_INDEX)
+	/**
+	 * @dm_compat_index: drivers sorted by compatible string, built on the
+	 * first device tree bind of each phase, or an error pointer if it could
+	 * not be allocated
+	 */
+	struct dm_compat_index *dm_compat_index;
+# endif
+# if CONFIG_IS_ENABLED(DM_NODE_INDEX)
+	/**
+	 * @dm_node_index: bound devices hashed by device tree node and
+	 * phandle, allocated on the first bind of each phase, or an error
+	 * pointer if lookups must walk the devices
+	 */
+	struct dm_node_index *dm_node_index;
+# endif
 #endif
 #ifdef CONFIG_TIMER
 	/**
@@ -92,6 +92,20 @@ void arch_preboot_os(void);
  */
 void board_preboot_os(void);
 
+/**
+ * bootm_in_place_ok() - Check if a kernel can run from where its data is
+ *
+ * The memory used by the kernel, including its BSS, must be free and must
+ * not hold the ramdisk or FDT. Beyond the kernel data it must not hold the
+ * rest of the image blob either. This is exported for testing.
+ *
+ * @images: Images information
+ * @start: Address of the kernel data, os.image_start
+ * @size: Size of memory used by the kernel
+ * @return true if the kernel can run at @start
+ */
+bool bootm_in_place_ok(bootm_headers_t *images, ulong start, ulong size);
+
 /*
  * bootm_process_cmdline() - Process fix-ups for the command line
  *
@@ -11,7 +11,9 @@
 #ifndef _BOOTSTAGE_H
 #define _BOOTSTAGE_H
 
+#include <linux/errno.h>
 #include <linux/kconfig.h>
+#include <linux/types.h>
 
 /* Flags for each bootstage record */
 enum bootstage_flags {
@@ -207,6 +209,10 @@ enum bootstage_id {
 	BOOTSTAGE_ID_ACCUM_FSP_M,
 	BOOTSTAGE_ID_ACCUM_FSP_S,
 	BOOTSTAGE_ID_ACCUM_MMAP_SPI,
+	BOOTSTAGE_ID_ACCUM_DM_BIND_F,
+	BOOTSTAGE_ID_ACCUM_DM_BIND_R,
+	BOOTSTAGE_ID_ACCUM_MMC_INIT,
+	BOOTSTAGE_ID_ACCUM_ETH_INIT,
 
 	/* a few spare for the user, from here */
 	BOOTSTAGE_ID_USER,
@@ -238,6 +244,112 @@ void show_boot_progress(int val);
 #endif
 #endif
 
+#ifndef USE_HOSTCC
+/* Kinds of timings recorded with CONFIG_BOOTSTAGE_TRACE */
+enum bootstage_trace_type {
+	BOOTSTAGE_TRACE_INITCALL,	/* Function of an init sequence */
+	BOOTSTAGE_TRACE_PROBE,		/* Call to device_probe() */
+};
+
+enum {
+	BOOTSTAGE_TRACE_VERSION	= 0,
+	BOOTSTAGE_TRACE_NAME_LEN = 15,
+};
+
+/**
+ * struct bootstage_trace_rec - Timing of a device probe or init function
+ *
+ * This is also the format handed over to the OS in the bloblist.
+ *
+ * @addr: Address of the init function, as in u-boot.map; 0 for a probe
+ * @start_us: Time the call started, in microseconds since reset
+ * @duration_us: Time the call took, in microseconds
+ * @type: Kind of call (enum bootstage_trace_type)
+ * @name: Name of the device, truncated; empty for an init function
+ */
+struct bootstage_trace_rec {
+	u64 addr;
+	u32 start_us;
+	u32 duration_us;
+	u8 type;
+	char name[BOOTSTAGE_TRACE_NAME_LEN];
+};
+
+/**
+ * struct bootstage_trace_hdr - Header of the timings in the bloblist
+ *
+ * The records follow, oldest first.
+ *
+ * @version: BOOTSTAGE_TRACE_VERSION
+ * @count: Number of records
+ * @rec_size: Size of each record, in bytes
+ * @dropped: Number of records overwritten once the ring was full
+ */
+struct bootstage_trace_hdr {
+	u32 version;
+	u32 count;
+	u32 rec_size;
+	u32 dropped;
+};
+
+#if CONFIG_IS_ENABLED(BOOTSTAGE_TRACE)
+/**
+ * bootstage_trace_start() - Get the start time of a call to time
+ *
+ * @return time in microseconds, to pass to bootstage_trace_add()
+ */
+ulong bootstage_trace_start(void);
+
+/**
+ * bootstage_trace_add() - Record the timing of a call which is over
+ *
+ * This does nothing until bootstage is set up.
+ *
+ * @type: Kind of call
+ * @name: Name of the device probed, NULL for an init function
+ * @addr: Address of the init function, 0 for a device probe
+ * @start_us: Value returned by bootstage_trace_start() before the call
+ */
+void bootstage_trace_add(enum bootstage_trace_type type, const char *name,
+			 ulong addr, ulong start_us);
+
+/**
+ * bootstage_trace_json() - Write the timings as Chrome trace events
+ *
+ * The bootstage records are added as instant events.
+ *
+ * @buf: Buffer to write the JSON text to, nul-terminated
+ * @size: Size of @buf in bytes
+ * @return length of the whole text, which was truncated if it is @size or
+ *	more, like snprintf()
+ */
+int bootstage_trace_json(char *buf, int size);
+
+/**
+ * bootstage_trace_handoff() - Add the timings to the bloblist for the OS
+ *
+ * @return 0 if OK, -ENOSYS if there is no bloblist, other -ve on error
+ */
+int bootstage_trace_handoff(void);
+#else
+static inline ulong bootstage_trace_start(void)
+{
+	return 0;
+}
+
+static inline void bootstage_trace_add(enum bootstage_trace_type type,
+				       const char *name, ulong addr,
+				       ulong start_us)
+{
+}
+
+static inline int bootstage_trace_handoff(void)
+{
+	return -ENOSYS;
+}
+#endif
+#endif /* !USE_HOSTCC */
+
 #ifdef ENABLE_BOOTSTAGE
 
 /* This is the full bootstage implementation */
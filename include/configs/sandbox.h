@@ -54,6 +54,9 @@
 #define CONFIG_TIMESTAMP
 #define CONFIG_BOOTP_SERVERIP
 
+/* Room for the TFTP windows, NFS reads and TCP bursts of the test servers */
+#define CONFIG_SYS_RX_ETH_BUFFER	64
+
 #ifndef SANDBOX_NO_SDL
 #define CONFIG_SANDBOX_SDL
 #endif
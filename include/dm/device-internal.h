@@ -190,6 +190,84 @@ int device_of_to_plat(struct udevice *dev);
  */
 int device_probe(struct udevice *dev);
 
+/**
+ * device_probe_parallel() - Probe a list of devices, overlapping their waits
+ *
+ * Each device is probed in turn, as with device_probe(). When its probe()
+ * method leaves a step to be polled with device_probe_yield(), the next
+ * device is probed instead, and the steps of all the devices are then polled
+ * in turn until their probe is over. Devices needing one of the others to be
+ * probed wait for it to be.
+ *
+ * Without CONFIG_DM_PROBE_ASYNC, or if called again from a probe, this probes
+ * the devices one after the other.
+ *
+ * @devs: Devices to probe
+ * @count: Number of devices in @devs
+ * @return 0 if OK, else the first error a device returned. The other devices
+ *	are still probed
+ */
+#if CONFIG_IS_ENABLED(DM_PROBE_ASYNC)
+int device_probe_parallel(struct udevice *const devs[], int count);
+#else
+static inline int device_probe_parallel(struct udevice *const devs[],
+					int count)
+{
+	int i, ret, err = 0;
+
+	for (i = 0; i < count; i++) {
+		ret = device_probe(devs[i]);
+		if (ret && !err)
+			err = ret;
+	}
+
+	return err;
+}
+#endif
+
+/**
+ * device_probe_finish() - Finish the probe of a device
+ *
+ * This is the end of device_probe(), after the probe() method of the driver.
+ *
+ * @dev: Device being probed
+ * @ret: Result of the probe() method and the steps it left
+ * @return 0 if OK, -ve on error, in which case the device is not active
+ */
+int device_probe_finish(struct udevice *dev, int ret);
+
+#if CONFIG_IS_ENABLED(DM_PROBE_ASYNC)
+/**
+ * device_probe_steps() - Check for steps left by the probe() method
+ *
+ * @dev: Device whose probe() method returned 0
+ * @return -EINPROGRESS if device_probe_parallel() polls the steps left,
+ *	else 0
+ */
+int device_probe_steps(struct udevice *dev);
+
+/**
+ * device_probe_wait() - Wait for the probe of an active device to be over
+ *
+ * If device_probe_parallel() is still polling the steps of the device, this
+ * polls them until they are over and finishes its probe.
+ *
+ * @dev: Active device
+ * @return 0 if OK, -ve on error, in which case the device is not active
+ */
+int device_probe_wait(struct udevice *dev);
+#else
+static inline int device_probe_steps(struct udevice *dev)
+{
+	return 0;
+}
+
+static inline int device_probe_wait(struct udevice *dev)
+{
+	return 0;
+}
+#endif
+
 /**
  * device_remove() - Remove a device, de-activating it
  *
@@ -208,6 +286,42 @@ int device_remove(struct udevice *dev, uint flags);
 static inline int device_remove(struct udevice *dev, uint flags) { return 0; }
 #endif
 
+/**
+ * device_bind_seq() - Work out the sequence number of a device being bound
+ *
+ * This is the number in the aliases if the uclass uses them and there is
+ * one, else the next one free in the uclass, unless the uclass does not
+ * number its devices.
+ *
+ * @dev: Device being bound, not yet in the list of its uclass
+ * @return sequence number, or -1 for none
+ */
+int device_bind_seq(struct udevice *dev);
+
+/**
+ * device_reloc_claim() - Find the copy of a device bound before relocation
+ *
+ * Between dm_reloc_devices() and dm_reloc_finish(), binding a node which was
+ * copied from before relocation returns the copy instead of a new device.
+ * Each copy is returned once.
+ *
+ * @parent: parent the device is bound to
+ * @drv: driver the device is bound to
+ * @node: node the device is bound to
+ * @return copy of the device, or NULL if there is none
+ */
+#if CONFIG_IS_ENABLED(DM_RELOC_DEVICES)
+struct udevice *device_reloc_claim(struct udevice *parent,
+				   const struct driver *drv, ofnode node);
+#else
+static inline struct udevice *device_reloc_claim(struct udevice *parent,
+						 const struct driver *drv,
+						 ofnode node)
+{
+	return NULL;
+}
+#endif
+
 /**
  * device_unbind() - Unbind a device, destroying it
  *
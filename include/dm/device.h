@@ -14,6 +14,7 @@
 #include <dm/uclass-id.h>
 #include <fdtdec.h>
 #include <linker_lists.h>
+#include <linux/errno.h>
 #include <linux/kernel.h>
 #include <linux/list.h>
 #include <linux/printk.h>
@@ -161,6 +162,10 @@ enum {
  *		automatically when the device is removed / unbound
  * @dma_offset: Offset between the physical address space (CPU's) and the
  *		device's bus address space
+ * @node_hash: Links the device into the index of devices by device tree node
+ *		(CONFIG_DM_NODE_INDEX)
+ * @phandle_hash: Links the device into the index of devices by phandle
+ *		(CONFIG_DM_NODE_INDEX)
  */
 struct udevice {
 	const struct driver *driver;
@@ -190,6 +195,10 @@ struct udevice {
 #if CONFIG_IS_ENABLED(DM_DMA)
 	ulong dma_offset;
 #endif
+#if CONFIG_IS_ENABLED(DM_NODE_INDEX)
+	struct hlist_node node_hash;
+	struct hlist_node phandle_hash;
+#endif
 };
 
 /**
@@ -279,12 +288,25 @@ static inline bool dev_has_ofnode(const struct udevice *dev)
 #endif
 }
 
+#if CONFIG_IS_ENABLED(DM_NODE_INDEX)
+/**
+ * dev_set_ofnode() - Set the device tree node of a device
+ *
+ * A device already bound is moved to its place for @node in the index of
+ * devices by node and phandle.
+ *
+ * @dev: Device to update
+ * @node: New node of the device
+ */
+void dev_set_ofnode(struct udevice *dev, ofnode node);
+#else
 static inline void dev_set_ofnode(struct udevice *dev, ofnode node)
 {
 #if CONFIG_IS_ENABLED(OF_REAL)
 	dev->node_ = node;
 #endif
 }
+#endif
 
 static inline int dev_seq(const struct udevice *dev)
 {
@@ -449,6 +471,40 @@ struct driver {
  */
 #define DM_HEADER(_hdr)
 
+/**
+ * device_probe_yield() - Leave the rest of a probe to a step polled later
+ *
+ * A probe() method waiting for the hardware, e.g. for a reset to complete,
+ * can start the operation, call this and return its result. Once probe()
+ * has returned, @poll is called until it returns something else than
+ * -EAGAIN, and this result is that of the probe. @poll may itself call
+ * device_probe_yield() to leave another step.
+ *
+ * When device_probe_parallel() probes the device, it polls the steps of
+ * several devices in turn, so that their waits overlap. Otherwise, and
+ * without CONFIG_DM_PROBE_ASYNC, @poll is called straight away until the
+ * wait is over.
+ *
+ * @dev: Device being probed
+ * @poll: Function to call until it returns something else than -EAGAIN
+ * @return 0 if @poll is called later, else what @poll returned
+ */
+#if CONFIG_IS_ENABLED(DM_PROBE_ASYNC)
+int device_probe_yield(struct udevice *dev, int (*poll)(struct udevice *dev));
+#else
+static inline int device_probe_yield(struct udevice *dev,
+				     int (*poll)(struct udevice *dev))
+{
+	int ret;
+
+	do {
+		ret = poll(dev);
+	} while (ret == -EAGAIN);
+
+	return ret;
+}
+#endif
+
 /**
  * dev_get_plat() - Get the platform data for a device
  *
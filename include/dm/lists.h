@@ -12,6 +12,8 @@
 #include <dm/ofnode.h>
 #include <dm/uclass-id.h>
 
+struct udevice_id;
+
 /**
  * lists_driver_lookup_name() - Return u_boot_driver corresponding to name
  *
@@ -62,6 +64,20 @@ int lists_bind_drivers(struct udevice *parent, bool pre_reloc_only);
 int lists_bind_fdt(struct udevice *parent, ofnode node, struct udevice **devp,
 		   struct driver *drv, bool pre_reloc_only);
 
+/**
+ * lists_driver_lookup_compat() - Find the driver for a compatible string
+ *
+ * This is the driver lists_bind_fdt() binds to a node with the compatible
+ * string @compat: the first one in the linker list with a match. With
+ * CONFIG_DM_COMPAT_INDEX it is found through a sorted table of the strings.
+ *
+ * @compat: compatible string to look up
+ * @of_idp: returns the entry of the of_match table of the driver matching
+ * @return pointer to driver, or NULL if not found
+ */
+struct driver *lists_driver_lookup_compat(const char *compat,
+					  const struct udevice_id **of_idp);
+
 /**
  * device_bind_driver() - bind a device to a driver
  *
@@ -131,4 +131,87 @@ int dm_remove_devices_flags(uint flags);
 static inline int dm_remove_devices_flags(uint flags) { return 0; }
 #endif
 
+/**
+ * dm_init_and_relocate() - Start driver model again after relocation
+ *
+ * This is dm_init_and_scan(false), except that the devices bound before
+ * relocation are copied from @old_root where possible, instead of being
+ * bound again. See dm_reloc_devices(). If copying them fails, the copies
+ * are dropped and every device is bound again.
+ *
+ * @old_root: root device of driver model before relocation
+ * @return 0 if OK, -ve on error
+ */
+int dm_init_and_relocate(struct udevice *old_root);
+
+#if CONFIG_IS_ENABLED(DM_RELOC_DEVICES)
+/**
+ * dm_reloc_devices() - Copy the devices bound before relocation
+ *
+ * This copies the devices below @old_root to the current driver model,
+ * unprobed, and runs the bind hooks of their parent and uclass again. A
+ * device which cannot be copied, with the devices below it, is left to the
+ * scan which follows. Until dm_reloc_finish(), binding a copied device again
+ * returns the copy.
+ *
+ * @old_root: root device of driver model before relocation
+ * @return number of devices copied, or -ve on error
+ */
+int dm_reloc_devices(struct udevice *old_root);
+
+/**
+ * dm_reloc_finish() - Finish binding devices after dm_reloc_devices()
+ *
+ * This unbinds the copies nothing bound again since dm_reloc_devices(), so
+ * that driver model holds the devices a full scan gives.
+ */
+void dm_reloc_finish(void);
+#else
+static inline int dm_reloc_devices(struct udevice *old_root)
+{
+	return 0;
+}
+
+static inline void dm_reloc_finish(void) {}
+#endif
+
+#if CONFIG_IS_ENABLED(DM_BOOT_PATH)
+/**
+ * dm_boot_path_begin() - Start probing only the devices on the boot path
+ *
+ * The boot path is read from the 'bootdevices' environment variable, which
+ * holds device tree paths or aliases separated by spaces, or else from the
+ * u-boot,boot-devices string list of /chosen. It is read again once the
+ * environment is loaded. Without a boot path, or with 'bootdevices' set to
+ * 'all', no device is deferred.
+ */
+void dm_boot_path_begin(void);
+
+/**
+ * dm_boot_path_end() - Stop deferring the devices off the boot path
+ *
+ * From then on, init code probes all the devices again.
+ */
+void dm_boot_path_end(void);
+
+/**
+ * dm_probe_deferred() - Tell whether start-up should leave a device alone
+ *
+ * Code probing all the devices of a uclass during start-up calls this to
+ * skip the devices that booting does not need. The first command using such
+ * a device probes it, as usual with driver model.
+ *
+ * @dev: Device about to be probed
+ * @return true if @dev is off the boot path and must not be probed now
+ */
+bool dm_probe_deferred(struct udevice *dev);
+#else
+static inline void dm_boot_path_begin(void) {}
+static inline void dm_boot_path_end(void) {}
+static inline bool dm_probe_deferred(struct udevice *dev)
+{
+	return false;
+}
+#endif
+
 #endif
@@ -10,6 +10,7 @@
 #define _DM_UCLASS_INTERNAL_H
 
 #include <dm/ofnode.h>
+#include <linux/errno.h>
 
 /*
  * These next two macros DM_UCLASS_INST() and DM_UCLASS_REF() are only allowed
@@ -257,6 +258,78 @@ int uclass_unbind_device(struct udevice *dev);
 static inline int uclass_unbind_device(struct udevice *dev) { return 0; }
 #endif
 
+#if CONFIG_IS_ENABLED(DM_NODE_INDEX)
+/**
+ * uclass_node_index_init() - Empty the index of devices by node and phandle
+ *
+ * This is called by dm_init(), when the devices of any earlier driver model
+ * are dropped.
+ */
+void uclass_node_index_init(void);
+
+/**
+ * uclass_node_index_add() - Add a device to the index by node and phandle
+ *
+ * A device without a valid node is not added. Nor is a device without a
+ * phandle added to the index by phandle.
+ *
+ * @dev:	Device to add, bound to a uclass
+ */
+void uclass_node_index_add(struct udevice *dev);
+
+/**
+ * uclass_node_index_del() - Remove a device from the index by node and phandle
+ *
+ * @dev:	Device to remove, which need not be in the index
+ * @return true if the device was in the index by node
+ */
+bool uclass_node_index_del(struct udevice *dev);
+
+/**
+ * uclass_node_index_find() - Look up the devices of a node in the index
+ *
+ * @id:		ID of the uclass to look in, UCLASS_INVALID for any
+ * @node:	Device tree node to look up
+ * @devp:	Returns the first device bound to @node, NULL if none
+ * @return number of devices of the uclass bound to @node, or -ENOSYS if
+ *	there is no index and the caller must walk the devices
+ */
+int uclass_node_index_find(enum uclass_id id, ofnode node,
+			   struct udevice **devp);
+
+/**
+ * uclass_phandle_index_find() - Look up the devices of a phandle in the index
+ *
+ * @id:		ID of the uclass to look in
+ * @phandle:	Phandle to look up
+ * @devp:	Returns the first device whose node has @phandle, NULL if none
+ * @return number of devices of the uclass with @phandle, -ENOENT if @phandle
+ *	is 0, or -ENOSYS if there is no index and the caller must walk the
+ *	devices
+ */
+int uclass_phandle_index_find(enum uclass_id id, uint phandle,
+			      struct udevice **devp);
+#else
+static inline void uclass_node_index_init(void) {}
+static inline void uclass_node_index_add(struct udevice *dev) {}
+static inline bool uclass_node_index_del(struct udevice *dev)
+{
+	return false;
+}
+
+static inline int uclass_node_index_find(enum uclass_id id, ofnode node,
+					 struct udevice **devp)
+{
+	return -ENOSYS;
+}
+
+static inline int uclass_phandle_index_find(enum uclass_id id, uint phandle,
+					    struct udevice **devp)
+{
+	return -ENOSYS;
+}
+#endif
+
 /**
  * uclass_pre_probe_device() - Deal with a device that is about to be probed
  *
@@ -409,7 +409,9 @@ int uclass_first_device_drvdata(enum uclass_id id, ulong driver_data,
  * uclass_probe_all() - Probe all devices based on an uclass ID
  *
  * This function probes all devices associated with a uclass by
- * looking for its ID.
+ * looking for its ID. With CONFIG_DM_PROBE_ASYNC, this is done with
+ * device_probe_parallel(), so a device failing to probe does not stop the
+ * others from being probed.
  *
  * @id: uclass ID to look up
  * @return 0 if OK, other -ve on error
@@ -42,6 +42,12 @@
 #define DNS_CALLBACK
 #endif
 
+#ifdef CONFIG_NET_TFTP_VARS
+#define TFTP_CALLBACK "tftpwindowsize:tftpwindowsize,"
+#else
+#define TFTP_CALLBACK
+#endif
+
 #ifdef CONFIG_NET
 #define NET_CALLBACKS \
 	"bootfile:bootfile," \
@@ -52,6 +58,7 @@
 	"nvlan:nvlan," \
 	"vlan:vlan," \
 	DNS_CALLBACK \
+	TFTP_CALLBACK \
 	"eth" ETHADDR_WILDCARD "addr:ethaddr,"
 #else
 #define NET_CALLBACKS
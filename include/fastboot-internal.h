@@ -13,6 +13,12 @@ extern void *fastboot_buf_addr;
  */
 extern u32 fastboot_buf_size;
 
+/**
+ * fastboot_stream_part - partition the next download is written to as it
+ * arrives, set by "oem stream", empty to download to the buffer
+ */
+extern char fastboot_stream_part[];
+
 /**
  * fastboot_progress_callback - callback executed during long operations
  */
@@ -32,6 +32,41 @@ int fastboot_mmc_get_part_info(const char *part_name,
  */
 void fastboot_mmc_flash_write(const char *cmd, void *download_buffer,
 			      u32 download_bytes, char *response);
+
+/**
+ * fastboot_mmc_stream_begin() - Start writing a download to eMMC
+ *
+ * The image, sparse or not, is written as it is received, through a buffer
+ * of bounded size.
+ *
+ * @cmd: Named partition to write image to
+ * @buf: Pointer to buffer for the data on its way to the device
+ * @bufsize: Size of the buffer
+ * @response: Pointer to fastboot response buffer, set on error
+ * Return: 0 if OK, -ve on error
+ */
+int fastboot_mmc_stream_begin(const char *cmd, void *buf, u32 bufsize,
+			      char *response);
+
+/**
+ * fastboot_mmc_stream_write() - Write the next piece of a download to eMMC
+ *
+ * @data: Pointer to received data
+ * @len: Length of received data
+ * @response: Pointer to fastboot response buffer, set on error
+ * Return: 0 if OK, -ve on error
+ */
+int fastboot_mmc_stream_write(const void *data, u32 len, char *response);
+
+/**
+ * fastboot_mmc_stream_end() - Finish writing a download to eMMC
+ *
+ * @cmd: Named partition the image was written to
+ * @response: Pointer to fastboot response buffer, OKAY or FAIL
+ * Return: 0 if OK, -ve on error
+ */
+int fastboot_mmc_stream_end(const char *cmd, char *response);
+
 /**
  * fastboot_mmc_flash_erase() - Erase eMMC for fastboot
  *
@@ -9,6 +9,7 @@
 
 #if defined(CONFIG_OF_LIBFDT) && !defined(USE_HOSTCC)
 
+#include <arena.h>
 #include <asm/u-boot.h>
 #include <linux/libfdt.h>
 
@@ -349,7 +350,86 @@ int arch_fixup_memory_node(void *blob);
 int fdt_setup_simplefb_node(void *fdt, int node, u64 base_address, u32 width,
 			    u32 height, u32 stride, const char *format);
 
+/**
+ * struct fdt_overlay_label - Entry of the label table of an overlay cache
+ *
+ * @hash: Hash of @label
+ * @label: Label from /__symbols__ of the base tree, NULL if the entry is free
+ * @path: Path of the labelled node, NULL if it must be read from the tree
+ * @offset: Offset of the labelled node, -1 if it must be looked up
+ * @phandle: Phandle of the labelled node when @offset was found
+ * @full: true if @path gives the full name of each node, as fdt_get_path()
+ */
+struct fdt_overlay_label {
+	u32 hash;
+	const char *label;
+	const char *path;
+	int offset;
+	u32 phandle;
+	bool full;
+};
+
+/**
+ * struct fdt_overlay_cache - Label lookups for applying several overlays
+ *
+ * Applying an overlay searches /__symbols__ of the base tree for each label
+ * the overlay refers to, and scans the whole tree for the node behind each
+ * fragment target phandle. When several overlays are applied to the same
+ * base tree, the labels and their nodes are found once and kept in a hash
+ * table, and fragments which target a label are given its path instead, so
+ * that fdt_overlay_apply() has no phandle to search for.
+ *
+ * @label: Hash table of labels, or NULL to look each one up in the tree
+ * @slots: Number of entries in @label, a power of two
+ * @used: Number of entries of @label in use
+ * @symbols: Offset of /__symbols__ in the base tree, -1 if not known
+ * @arena: Holds copies of the labels and paths
+ */
+struct fdt_overlay_cache {
+	struct fdt_overlay_label *label;
+	int slots;
+	int used;
+	int symbols;
+	struct arena arena;
+};
+
+/**
+ * fdt_overlay_cache_init() - Set up an overlay cache for a base tree
+ *
+ * If there is not enough memory for the label table, the cache works
+ * without it and each overlay is applied as by fdt_overlay_apply().
+ *
+ * @fdt: Base device tree blob
+ * @cache: Cache to set up
+ * @return 0 if OK, or a negative libfdt error code
+ */
+int fdt_overlay_cache_init(const void *fdt, struct fdt_overlay_cache *cache);
+
+/**
+ * fdt_overlay_cache_uninit() - Free the memory used by an overlay cache
+ *
+ * @cache: Cache to free
+ */
+void fdt_overlay_cache_uninit(struct fdt_overlay_cache *cache);
+
+/**
+ * fdt_overlay_apply_cached() - Apply an overlay using an overlay cache
+ *
+ * This gives the same tree as fdt_overlay_apply(). Any change to the labels
+ * of @fdt between calls must go through this function, or the cache must be
+ * set up again.
+ *
+ * @fdt: Base device tree blob
+ * @fdto: Device tree overlay blob, damaged on return
+ * @cache: Cache set up for @fdt by fdt_overlay_cache_init()
+ * @return 0 if OK, or a negative libfdt error code as fdt_overlay_apply()
+ */
+int fdt_overlay_apply_cached(void *fdt, void *fdto,
+			     struct fdt_overlay_cache *cache);
+
 int fdt_overlay_apply_verbose(void *fdt, void *fdto);
+int fdt_overlay_apply_cached_verbose(void *fdt, void *fdto,
+				     struct fdt_overlay_cache *cache);
 
 int fdt_valid(struct fdt_header **blobp);
 
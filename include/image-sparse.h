@@ -40,3 +40,82 @@ static inline int is_sparse_image(void *buf)
 
 int write_sparse_image(struct sparse_storage *info, const char *part_name,
 		       void *data, char *response);
+
+/**
+ * struct sparse_stream - An image written as it is received
+ *
+ * The image is passed in pieces of any size to sparse_stream_write(). Raw
+ * data goes through a buffer of bounded size, written out whenever it is
+ * full and at the end of each chunk, so the image may be much larger than
+ * the buffer. An image which is not sparse is written as is.
+ *
+ * @info: storage to write to
+ * @buf: buffer for raw data, also filled with the value of FILL chunks
+ * @bufsize: size of @buf, a multiple of the block size of @info
+ * @buffered: bytes of raw data in @buf
+ * @blk: next block of @info to write
+ * @state: what the next bytes received are
+ * @sparse: header of a sparse image
+ * @chunk: header of the current chunk
+ * @hdr_len: bytes of @sparse, @chunk or the fill value received so far
+ * @skip: bytes to ignore before the next field
+ * @left: bytes of raw data left in the current chunk
+ * @fill: value of the current FILL chunk
+ * @chunks: chunks done
+ * @total_blocks: sparse blocks done
+ * @bytes_written: bytes written to @info
+ */
+struct sparse_stream {
+	struct sparse_storage *info;
+	void *buf;
+	u32 bufsize;
+	u32 buffered;
+	lbaint_t blk;
+	int state;
+	sparse_header_t sparse;
+	chunk_header_t chunk;
+	u32 hdr_len;
+	u32 skip;
+	u64 left;
+	u32 fill;
+	u32 chunks;
+	u32 total_blocks;
+	u64 bytes_written;
+};
+
+/**
+ * sparse_stream_init() - Start writing an image as it is received
+ *
+ * @ss: stream to set up
+ * @info: storage to write to, from block @info->start
+ * @buf: buffer for raw data
+ * @bufsize: size of @buf, rounded down to a multiple of @info->blksz
+ * @return 0 if OK, -1 if @buf cannot hold a single block
+ */
+int sparse_stream_init(struct sparse_stream *ss, struct sparse_storage *info,
+		       void *buf, u32 bufsize);
+
+/**
+ * sparse_stream_write() - Write the next piece of the image
+ *
+ * @ss: stream
+ * @data: next bytes of the image
+ * @len: number of bytes
+ * @response: response written through @ss->info->mssg on error
+ * @return 0 if OK, -1 on error
+ */
+int sparse_stream_write(struct sparse_stream *ss, const void *data, u32 len,
+			char *response);
+
+/**
+ * sparse_stream_finish() - Write what is left once the whole image came
+ *
+ * The last block of an image which is not sparse is padded with zeroes.
+ *
+ * @ss: stream
+ * @part_name: name of the partition, for messages
+ * @response: response written through @ss->info->mssg on error
+ * @return 0 if OK, -1 if the image is incomplete or on error
+ */
+int sparse_stream_finish(struct sparse_stream *ss, const char *part_name,
+			 char *response);
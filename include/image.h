@@ -284,6 +284,38 @@ typedef struct image_info {
 	uint8_t		arch;			/* CPU architecture */
 } image_info_t;
 
+#define FIT_PLAN_MAX_IMAGES	16
+
+/**
+ * struct fit_plan_image - An image referenced by a FIT configuration
+ *
+ * @noffset: Offset of the image node in the FIT
+ * @pos: Position of the image data relative to the start of the FIT
+ * @size: Size of the image data in bytes
+ * @verified: true once all hashes of the image have been checked
+ */
+struct fit_plan_image {
+	int noffset;
+	ulong pos;
+	ulong size;
+	bool verified;
+};
+
+/**
+ * struct fit_load_plan - Images of a FIT configuration in storage order
+ *
+ * @fit: FIT the plan was built for, NULL if none
+ * @cfg_noffset: Offset of the configuration node the plan was built for
+ * @count: Number of valid entries in @image
+ * @image: Images referenced by the configuration, sorted by @pos
+ */
+struct fit_load_plan {
+	const void *fit;
+	int cfg_noffset;
+	int count;
+	struct fit_plan_image image[FIT_PLAN_MAX_IMAGES];
+};
+
 /*
  * Legacy and FIT format headers used by do_bootm() and do_bootm_<os>()
  * routines.
@@ -321,6 +353,8 @@ typedef struct bootm_headers {
 	const char	*fit_uname_setup; /* x86 setup subimage node name */
 	int		fit_noffset_setup;/* x86 setup subimage node offset */
 
+	struct fit_load_plan fit_plan;	/* images verified up front */
+
 #ifndef USE_HOSTCC
 	image_info_t	os;		/* os image info */
 	ulong		ep;		/* entry point of OS */
@@ -1116,6 +1150,74 @@ int fit_conf_get_prop_node_index(const void *fit, int noffset,
 int fit_conf_get_prop_node(const void *fit, int noffset,
 		const char *prop_name);
 
+/**
+ * fit_conf_get_load_plan() - List the images of a configuration
+ * @fit:	FIT to check
+ * @cfg_noffset: Offset of the configuration node
+ * @plan:	Returns the images, sorted by the position of their data
+ *
+ * Collects every image referenced by the configuration (kernel, fdt,
+ * ramdisk, loadables, setup, fpga, firmware, standalone), once each, so
+ * that they can be verified or read in the order they are stored.
+ *
+ * Return: 0 if OK, -ENOSPC if there are more than FIT_PLAN_MAX_IMAGES
+ */
+int fit_conf_get_load_plan(const void *fit, int cfg_noffset,
+			   struct fit_load_plan *plan);
+
+/**
+ * fit_conf_verify_plan() - Check the hashes of all images in a plan
+ * @fit:	FIT containing the images
+ * @plan:	Plan from fit_conf_get_load_plan(), updated with the result
+ *
+ * Return: 0 if all images verified, -EACCES if a hash does not match
+ */
+int fit_conf_verify_plan(const void *fit, struct fit_load_plan *plan);
+
+/**
+ * fit_plan_image_verified() - Check if an image was verified by a plan
+ * @plan:	Plan to check
+ * @fit:	FIT containing the image
+ * @noffset:	Offset of the image node
+ *
+ * Return: true if @plan was built for @fit and has verified the image
+ */
+bool fit_plan_image_verified(const struct fit_load_plan *plan,
+			     const void *fit, int noffset);
+
+/**
+ * struct fit_ext_load - Storage to read a FIT with external data from
+ *
+ * @priv: Private data for @read
+ * @read: Read @size bytes at byte @offset of the FIT into @buf. Returns the
+ *	number of bytes read
+ */
+struct fit_ext_load {
+	void *priv;
+	ulong (*read)(struct fit_ext_load *ld, ulong offset, ulong size,
+		      void *buf);
+};
+
+/**
+ * fit_ext_load() - Load a configuration of a FIT directly from storage
+ * @ld:		Storage to read the FIT from
+ * @addr:	Address to load the FDT part of the FIT to
+ * @conf_uname:	Configuration to load, NULL for the default one
+ * @sizep:	Returns the number of bytes of image data read (may be NULL)
+ *
+ * Reads the FDT part of a FIT built with external data ('mkimage -E') and
+ * then only the images used by the configuration, in storage order. Images
+ * which are not compressed and have a load address are read straight to it;
+ * the others are placed after the FDT. Hashes are checked while reading.
+ *
+ * The FDT is updated with the 'data-position' of each image so that bootm
+ * can then be used on @addr as if the whole FIT had been loaded there.
+ *
+ * Return: 0 if OK, -EACCES if a hash does not match, other -ve on error
+ */
+int fit_ext_load(struct fit_ext_load *ld, ulong addr, const char *conf_uname,
+		 ulong *sizep);
+
 int fit_check_ramdisk(const void *fit, int os_noffset,
 		uint8_t arch, int verify);
 
@@ -983,6 +983,42 @@ extern ulong mem_malloc_brk;
 
 void mem_malloc_init(ulong start, ulong size);
 
+/**
+ * struct malloc_usage - snapshot of how the malloc() heap is being used
+ *
+ * @heap_size: Total size of the heap set up by mem_malloc_init()
+ * @peak: Highest amount of the heap ever obtained by the allocator. This is
+ *	an upper bound on the peak number of bytes in use.
+ * @in_use: Bytes currently allocated, including malloc() overhead
+ * @free: Bytes available for allocation, including space never yet used
+ * @largest_free: Size of the largest block which can be allocated without
+ *	having to wait for neighbouring blocks to be freed
+ * @free_chunks: Number of separate free chunks in the heap
+ */
+struct malloc_usage {
+	ulong heap_size;
+	ulong peak;
+	ulong in_use;
+	ulong free;
+	ulong largest_free;
+	uint free_chunks;
+};
+
+/**
+ * malloc_get_usage() - work out how the malloc() heap is being used
+ *
+ * This walks the free lists so takes time proportional to the number of
+ * free chunks. It is intended for diagnostics, not for use in a hot path.
+ *
+ * The ratio of @largest_free to @free shows how fragmented the heap is: when
+ * most of the free space is in one block, large allocations succeed; when it
+ * is spread across many small chunks they fail even though @free is high.
+ *
+ * @usage: Returns the usage information
+ * Return: 0 if OK, -ENOENT if the heap has not been set up yet
+ */
+int malloc_get_usage(struct malloc_usage *usage);
+
 #ifdef __cplusplus
 };  /* end of extern "C" */
 #endif
@@ -38,6 +38,8 @@ struct udevice;
 
 #ifdef CONFIG_SYS_RX_ETH_BUFFER
 # define PKTBUFSRX	CONFIG_SYS_RX_ETH_BUFFER
+#elif defined(CONFIG_NET_RX_BUFFERS)
+# define PKTBUFSRX	CONFIG_NET_RX_BUFFERS
 #else
 # define PKTBUFSRX	4
 #endif
@@ -143,6 +145,12 @@ enum eth_recv_flags {
  *	 indicate that the hardware receive FIFO is empty. If 0 is returned, the
  *	 network stack will not process the empty packet, but free_pkt() will be
  *	 called if supplied
+ * recv_batch: Return up to "count" received packets at once, oldest first,
+ *	       setting their buffers in "packets" and their lengths in
+ *	       "lengths". Return the number of packets, 0 if there is none, or
+ *	       an error. Each packet is processed then given to free_pkt() in
+ *	       turn before the next one is looked at, and recv() is not used -
+ *	       optional
  * free_pkt: Give the driver an opportunity to manage its packet buffer memory
  *	     when the network stack is finished processing it. This will only be
  *	     called when no error was returned from recv - optional
@@ -164,6 +172,8 @@ struct eth_ops {
 	int (*start)(struct udevice *dev);
 	int (*send)(struct udevice *dev, void *packet, int length);
 	int (*recv)(struct udevice *dev, int flags, uchar **packetp);
+	int (*recv_batch)(struct udevice *dev, int flags, uchar **packets,
+			  int *lengths, int count);
 	int (*free_pkt)(struct udevice *dev, uchar *packet, int length);
 	void (*stop)(struct udevice *dev);
 	int (*mcast)(struct udevice *dev, const u8 *enetaddr, int join);
@@ -182,6 +192,60 @@ struct udevice *eth_get_dev(void); /* get the current device */
 struct udevice *eth_get_dev_by_name(const char *devname);
 unsigned char *eth_get_ethaddr(void); /* get the current device MAC */
 
+/**
+ * struct eth_stats - Packet counters of an Ethernet device
+ *
+ * @rx_packets: packets received
+ * @rx_polls: polls of the driver which returned packets
+ * @rx_max_batch: largest number of packets returned by one poll
+ * @rx_overruns: packets lost because the receive ring was full
+ * @rx_errors: polls of the driver which failed
+ * @tx_packets: packets sent
+ * @tx_errors: packets the driver failed to send
+ * @rx_driver_ticks: timer ticks spent in the driver by the polls counted in
+ *	@rx_polls, only with CONFIG_CMD_NET_BENCH
+ * @rx_stack_ticks: timer ticks spent handling the received packets
+ * @tx_driver_ticks: timer ticks spent in the driver sending packets
+ */
+struct eth_stats {
+	ulong rx_packets;
+	ulong rx_polls;
+	uint rx_max_batch;
+	ulong rx_overruns;
+	ulong rx_errors;
+	ulong tx_packets;
+	ulong tx_errors;
+	u64 rx_driver_ticks;
+	u64 rx_stack_ticks;
+	u64 tx_driver_ticks;
+};
+
+/**
+ * eth_get_stats() - Get the packet counters of an Ethernet device
+ *
+ * @dev: Ethernet device
+ * @return the counters, since the device was probed or eth_reset_stats()
+ */
+const struct eth_stats *eth_get_stats(struct udevice *dev);
+
+/**
+ * eth_reset_stats() - Clear the packet counters of an Ethernet device
+ *
+ * @dev: Ethernet device
+ */
+void eth_reset_stats(struct udevice *dev);
+
+/**
+ * eth_count_rx_overruns() - Count packets lost because the ring was full
+ *
+ * For drivers, when the hardware reports frames it could not store or when
+ * their own receive queue is full.
+ *
+ * @dev: Ethernet device
+ * @count: number of packets lost
+ */
+void eth_count_rx_overruns(struct udevice *dev, uint count);
+
 /* Used only when NetConsole is enabled */
 int eth_is_active(struct udevice *dev); /* Test device for active state */
 int eth_init_state_only(void); /* Set active state */
@@ -310,6 +374,8 @@ int eth_rx(void);			/* Check for received packets */
 void eth_halt(void);			/* stop SCC */
 const char *eth_get_name(void);		/* get name of current device */
 int eth_mcast_join(struct in_addr mcast_addr, int join);
+/* Get the Ethernet address an IPv4 multicast group is sent to */
+void eth_mcast_ethaddr(struct in_addr mcast_addr, u8 *enetaddr);
 
 /**********************************************************************/
 /*
@@ -371,6 +437,8 @@ struct vlan_ethernet_hdr {
 #define PROT_NCSI	0x88f8		/* NC-SI control packets        */
 
 #define IPPROTO_ICMP	 1	/* Internet Control Message Protocol	*/
+#define IPPROTO_IGMP	 2	/* Internet Group Management Protocol	*/
+#define IPPROTO_TCP	 6	/* Transmission Control Protocol	*/
 #define IPPROTO_UDP	17	/* User Datagram Protocol		*/
 
 /*
@@ -546,6 +614,8 @@ extern u8		net_ethaddr[ARP_HLEN];		/* Our ethernet address */
 extern u8		net_server_ethaddr[ARP_HLEN];	/* Boot server enet address */
 extern struct in_addr	net_ip;		/* Our    IP addr (0 = unknown) */
 extern struct in_addr	net_server_ip;	/* Server IP addr (0 = unknown) */
+/* Multicast group accepted besides net_ip (0 = none) */
+extern struct in_addr	net_mcast_addr;
 extern uchar		*net_tx_packet;		/* THE transmit packet */
 extern uchar		*net_rx_packets[PKTBUFSRX]; /* Receive packets */
 extern uchar		*net_rx_packet;		/* Current receive packet */
@@ -562,7 +632,8 @@ extern int		net_restart_wrap;	/* Tried all network devices */
 
 enum proto_t {
 	BOOTP, RARP, ARP, TFTPGET, DHCP, PING, DNS, NFS, CDP, NETCONS, SNTP,
-	TFTPSRV, TFTPPUT, LINKLOCAL, FASTBOOT, WOL, UDP
+	TFTPSRV, TFTPPUT, LINKLOCAL, FASTBOOT, WOL, UDP, WGET, MCLOAD, BENCH,
+	TFTPMULTI
 };
 
 extern char	net_boot_file_name[1024];/* Boot File name */
@@ -662,6 +733,36 @@ bool arp_is_waiting(void);		/* Waiting for ARP reply? */
 void net_set_icmp_handler(rxhand_icmp_f *f); /* Set ICMP RX handler */
 void net_set_timeout_handler(ulong, thand_f *);/* Set timeout handler */
 
+/**
+ * net_server_ether_restore() - Reuse the server MAC address of a transfer
+ *
+ * Sets net_server_ethaddr to the address saved by net_server_ether_save() if
+ * it was for the same server, through the same interface and gateway, else
+ * clears it so that the next packet to the server does an ARP request.
+ *
+ * @server: IP address of the server
+ */
+void net_server_ether_restore(struct in_addr server);
+
+/**
+ * net_server_ether_save() - Keep net_server_ethaddr for the next transfer
+ *
+ * Called once the server answered, so that the next transfer from it can
+ * skip the ARP request. With CONFIG_DHCP_LEASE_CACHE the address is also
+ * recorded with the lease, for the next boot.
+ *
+ * @server: IP address of the server
+ */
+void net_server_ether_save(struct in_addr server);
+
+/**
+ * net_server_ether_forget() - Drop the address kept by net_server_ether_save()
+ *
+ * Called when the server does not answer, in case it got a new MAC address,
+ * and when the Ethernet device goes away.
+ */
+void net_server_ether_forget(void);
+
 /* Network loop state */
 enum net_loop_state {
 	NETLOOP_CONTINUE,
@@ -711,6 +812,35 @@ int net_send_udp_packet(uchar *ether, struct in_addr dest, int dport,
 /* Processes a received packet */
 void net_process_received_packet(uchar *in_packet, int len);
 
+/**
+ * struct net_defrag_stats - Counters of IP datagram reassembly
+ *
+ * @datagrams: datagrams reassembled
+ * @fragments: fragments received
+ * @timeouts: datagrams dropped because their fragments stopped coming
+ * @evicted: datagrams dropped to make room for a new one
+ * @dropped: fragments dropped, as duplicates or too large
+ */
+struct net_defrag_stats {
+	ulong datagrams;
+	ulong fragments;
+	ulong timeouts;
+	ulong evicted;
+	ulong dropped;
+};
+
+/**
+ * net_defrag_get_stats() - Get the counters of IP datagram reassembly
+ *
+ * @return pointer to the counters (only with CONFIG_IP_DEFRAG)
+ */
+const struct net_defrag_stats *net_defrag_get_stats(void);
+
+/**
+ * net_defrag_reset_stats() - Clear the counters of IP datagram reassembly
+ */
+void net_defrag_reset_stats(void);
+
 #if defined(CONFIG_NETCONSOLE) && !defined(CONFIG_SPL_BUILD)
 void nc_start(void);
 int nc_input_packet(uchar *pkt, struct in_addr src_ip, unsigned dest_port,
@@ -0,0 +1,90 @@
+/* SPDX-License-Identifier: GPL-2.0+ */
+/*
+ * Throughput benchmark of the network device and stack ('net bench')
+ *
+ * In sink mode the board counts the UDP packets sent to a port, in source
+ * mode it sends UDP packets to a host as fast as it can. The peer is
+ * tools/net-bench.py. Every packet starts with struct net_bench_hdr; the
+ * rest of the payload is not looked at.
+ *
+ * All fields are in network byte order.
+ */
+
+#ifndef __NET_BENCH_H__
+#define __NET_BENCH_H__
+
+#include <net.h>
+
+#define NET_BENCH_MAGIC		0x55424e43	/* "UBNC" */
+#define NET_BENCH_PORT		5001
+/* Packets with this flag close the stream; their seq is the packets sent */
+#define NET_BENCH_END		BIT(0)
+
+/**
+ * struct net_bench_hdr - Header of every packet
+ *
+ * @magic: NET_BENCH_MAGIC
+ * @seq: number of the packet, from 0, or packets sent for NET_BENCH_END
+ * @flags: NET_BENCH_END or 0
+ */
+struct net_bench_hdr {
+	__be32 magic;
+	__be32 seq;
+	__be32 flags;
+} __packed;
+
+/**
+ * struct net_bench_result - Outcome of the last run
+ *
+ * @packets: packets received (sink) or sent (source)
+ * @bytes: UDP payload bytes received or sent
+ * @lost: packets the source sent which did not arrive, sink only
+ * @us: microseconds from the first to the last packet
+ * @rx_driver_ns: nanoseconds spent in the driver per packet received
+ * @rx_stack_ns: nanoseconds spent in the stack per packet received
+ * @tx_driver_ns: nanoseconds spent in the driver per packet sent
+ * @cache_ns: nanoseconds to flush and invalidate the data cache over one
+ *	packet buffer, as a driver doing DMA does for each packet
+ */
+struct net_bench_result {
+	ulong packets;
+	u64 bytes;
+	ulong lost;
+	u64 us;
+	ulong rx_driver_ns;
+	ulong rx_stack_ns;
+	ulong tx_driver_ns;
+	ulong cache_ns;
+};
+
+/**
+ * net_bench_set_sink() - Count the packets sent to a port on the next run
+ *
+ * @port: UDP port to listen on
+ * @ms: length of the measurement from the first packet, also the time
+ *	waited for it
+ */
+void net_bench_set_sink(u16 port, ulong ms);
+
+/**
+ * net_bench_set_source() - Send packets to a host on the next run
+ *
+ * @dest: IP address of the host
+ * @port: UDP port of the host
+ * @ms: length of the measurement
+ * @size: UDP payload bytes per packet, at least sizeof(struct net_bench_hdr)
+ * @return 0 if OK, -EINVAL if @size is out of range
+ */
+int net_bench_set_source(struct in_addr dest, u16 port, ulong ms, uint size);
+
+/**
+ * net_bench_get_result() - Get the outcome of the last run
+ *
+ * @return pointer to the result
+ */
+const struct net_bench_result *net_bench_get_result(void);
+
+/* Called by net_loop() to start the run */
+void net_bench_start(void);
+
+#endif /* __NET_BENCH_H__ */
@@ -0,0 +1,126 @@
+/* SPDX-License-Identifier: GPL-2.0+ */
+/*
+ * Receiver of images sent to many boards at once over UDP multicast
+ *
+ * The sender (tools/mcload-send.py) sends every block of the image once to
+ * a multicast group, then resends the blocks the receivers report missing.
+ * Receivers never acknowledge data: they send a NAK listing ranges of missing
+ * blocks when they see the last block or when the stream goes quiet, and a
+ * DONE message once they have the whole image. A block lost by several
+ * boards is therefore sent again only once, to all of them.
+ *
+ * All fields are in network byte order.
+ */
+
+#ifndef __MCLOAD_H__
+#define __MCLOAD_H__
+
+#include <blk.h>
+#include <net.h>
+
+#define MCLOAD_MAGIC		0x554d434c	/* "UMCL" */
+#define MCLOAD_VERSION		1
+/* UDP port of the group, as commonly used for multicast TFTP */
+#define MCLOAD_DEFAULT_PORT	1758
+/* Largest number of ranges in a NAK */
+#define MCLOAD_NAK_RANGES	64
+
+enum mcload_type {
+	MCLOAD_DATA	= 1,	/* sender to group: one block of the image */
+	MCLOAD_NAK	= 2,	/* receiver to sender: ranges of missing blocks */
+	MCLOAD_DONE	= 3,	/* receiver to sender: the image is complete */
+};
+
+/**
+ * struct mcload_hdr - Header of every message
+ *
+ * @magic: MCLOAD_MAGIC
+ * @version: MCLOAD_VERSION
+ * @type: message type, see enum mcload_type
+ * @blksize: number of bytes in each block, except the last one
+ * @session: identifier of the image chosen by the sender, copied in replies
+ * @size: size of the image in bytes
+ * @block: block number for MCLOAD_DATA, number of struct mcload_range
+ *	following the header for MCLOAD_NAK, 0 for MCLOAD_DONE
+ */
+struct mcload_hdr {
+	__be32 magic;
+	u8 version;
+	u8 type;
+	__be16 blksize;
+	__be32 session;
+	__be32 size;
+	__be32 block;
+} __packed;
+
+/**
+ * struct mcload_range - Blocks a receiver is missing
+ *
+ * @first: first block missing
+ * @count: number of blocks missing from @first on
+ */
+struct mcload_range {
+	__be32 first;
+	__be32 count;
+} __packed;
+
+/**
+ * struct mcload_stats - Counters of the current or last transfer
+ *
+ * @blocks: distinct blocks stored
+ * @dup: blocks received again
+ * @discarded: blocks received too far ahead to be stored yet (UBI only)
+ * @naks: NAKs sent
+ * @timeouts: times the stream went quiet
+ */
+struct mcload_stats {
+	ulong blocks;
+	ulong dup;
+	ulong discarded;
+	ulong naks;
+	ulong timeouts;
+};
+
+/**
+ * mcload_set_group() - Set the group to receive the next image from
+ *
+ * @group: "<ip>[:<port>]", the port defaults to MCLOAD_DEFAULT_PORT
+ * @return 0 if OK, -EINVAL if @group is not a multicast address
+ */
+int mcload_set_group(const char *group);
+
+/**
+ * mcload_set_blk() - Write the next image to a block device
+ *
+ * Blocks are written as they arrive, in any order, so the block size of the
+ * sender must be a multiple of the one of the device.
+ *
+ * @desc: block device, NULL to load the image in memory at image_load_addr
+ * @start: first block to write
+ * @end: block after the end of the partition, the image must end before it
+ */
+void mcload_set_blk(struct blk_desc *desc, lbaint_t start, lbaint_t end);
+
+/**
+ * mcload_set_ubi() - Write the next image to a UBI volume
+ *
+ * A volume is written in order, so blocks received ahead of a missing one
+ * are kept in a window of CONFIG_MCLOAD_UBI_WINDOW blocks; those further
+ * ahead are dropped and asked for again later. The UBI partition must be
+ * attached already.
+ *
+ * @volume: name of the volume, NULL to load the image in memory
+ */
+void mcload_set_ubi(const char *volume);
+
+/**
+ * mcload_get_stats() - Get the counters of the current or last transfer
+ *
+ * @return pointer to the counters
+ */
+const struct mcload_stats *mcload_get_stats(void);
+
+/* Called by net_loop() to start the transfer */
+void mcload_start(void);
+
+#endif /* __MCLOAD_H__ */
@@ -0,0 +1,182 @@
+/* SPDX-License-Identifier: GPL-2.0+ */
+/*
+ * Minimal TCP client for the network loop
+ */
+
+#ifndef __TCP_H__
+#define __TCP_H__
+
+#include <net.h>
+
+/*
+ *	Internet Protocol (IP) + TCP header.
+ */
+struct ip_tcp_hdr {
+	u8		ip_hl_v;	/* header length and version	*/
+	u8		ip_tos;		/* type of service		*/
+	u16		ip_len;		/* total length			*/
+	u16		ip_id;		/* identification		*/
+	u16		ip_off;		/* fragment offset field	*/
+	u8		ip_ttl;		/* time to live			*/
+	u8		ip_p;		/* protocol			*/
+	u16		ip_sum;		/* checksum			*/
+	struct in_addr	ip_src;		/* Source IP address		*/
+	struct in_addr	ip_dst;		/* Destination IP address	*/
+	u16		tcp_src;	/* TCP source port		*/
+	u16		tcp_dst;	/* TCP destination port		*/
+	u32		tcp_seq;	/* Sequence number		*/
+	u32		tcp_ack;	/* Acknowledgment number	*/
+	u8		tcp_hlen;	/* Header length in upper nibble */
+	u8		tcp_flags;	/* Control flags		*/
+	u16		tcp_win;	/* Receive window		*/
+	u16		tcp_xsum;	/* Checksum			*/
+	u16		tcp_ugr;	/* Urgent pointer		*/
+} __attribute__((packed));
+
+#define IP_TCP_HDR_SIZE		(sizeof(struct ip_tcp_hdr))
+#define TCP_HDR_SIZE		(IP_TCP_HDR_SIZE - IP_HDR_SIZE)
+
+/* Control flags, passed as the action to net_send_ip_packet() */
+#define TCP_FIN		0x01
+#define TCP_SYN		0x02
+#define TCP_RST		0x04
+#define TCP_PUSH	0x08
+#define TCP_ACK		0x10
+
+/* Maximum segment size on Ethernet: 1500 byte MTU minus IP and TCP headers */
+#define TCP_MSS		1460
+
+enum tcp_state {
+	TCP_CLOSED,
+	TCP_SYN_SENT,
+	TCP_ESTABLISHED,
+	TCP_FIN_WAIT_1,
+	TCP_FIN_WAIT_2,
+	TCP_CLOSE_WAIT,
+	TCP_LAST_ACK,
+};
+
+/**
+ * struct tcp_ops - Callbacks of the user of a TCP connection
+ *
+ * All callbacks are called from the network loop.
+ *
+ * @connected: the three-way handshake completed
+ * @receive: new in-order data arrived; out-of-order segments are held back
+ *	until the gap before them is filled
+ * @room: optional, returns how many more bytes the user can take; the
+ *	receive window advertised to the peer is kept within it
+ * @closed: the connection ended; @err is 0 once both sides sent their FIN,
+ *	-ECONNRESET if the peer reset it or -ETIMEDOUT if it stopped answering
+ */
+struct tcp_ops {
+	void (*connected)(void);
+	void (*receive)(const uchar *data, unsigned int len);
+	ulong (*room)(void);
+	void (*closed)(int err);
+};
+
+/**
+ * struct tcp_stats - Counters of the current or last connection
+ *
+ * @rx_segs: data segments received
+ * @rx_bytes: in-order payload bytes delivered
+ * @rx_ooo: segments received ahead of a gap and queued
+ * @rx_dup: segments which carried only data already received
+ * @tx_dupacks: duplicate ACKs sent to trigger a fast retransmit by the peer
+ * @tx_rexmit: segments retransmitted after a timeout
+ * @tx_fast_rexmit: segments retransmitted after three duplicate ACKs
+ * @wscale: window scale shift applied to our receive window, -1 if the peer
+ *	does not do window scaling
+ */
+struct tcp_stats {
+	ulong rx_segs;
+	ulong rx_bytes;
+	ulong rx_ooo;
+	ulong rx_dup;
+	ulong tx_dupacks;
+	ulong tx_rexmit;
+	ulong tx_fast_rexmit;
+	int wscale;
+};
+
+/**
+ * tcp_connect() - Open a connection to a server
+ *
+ * This sends the SYN (after an ARP request if needed) and installs the TCP
+ * timer as the timeout handler of the network loop, so it must be called
+ * from the start function of a protocol. Any previous connection is dropped.
+ *
+ * @dest: IP address of the server
+ * @dport: TCP port of the server
+ * @ops: callbacks to use for this connection
+ */
+void tcp_connect(struct in_addr dest, u16 dport, const struct tcp_ops *ops);
+
+/**
+ * tcp_send() - Queue data to send
+ *
+ * @data: data to send
+ * @len: number of bytes
+ * @return 0 if OK, -ENOTCONN if not connected, -ENOSPC if the data does not
+ *	fit in the transmit buffer
+ */
+int tcp_send(const void *data, unsigned int len);
+
+/**
+ * tcp_close() - Close our side of the connection
+ *
+ * The FIN is sent once all queued data was sent. The closed callback is
+ * called when the connection is fully shut down.
+ */
+void tcp_close(void);
+
+/**
+ * tcp_abort() - Reset the connection
+ *
+ * This sends a RST to the peer. The closed callback is not called.
+ */
+void tcp_abort(void);
+
+/**
+ * tcp_get_state() - Get the state of the connection
+ *
+ * @return state of the connection
+ */
+enum tcp_state tcp_get_state(void);
+
+/**
+ * tcp_get_stats() - Get the counters of the current or last connection
+ *
+ * @return pointer to the counters
+ */
+const struct tcp_stats *tcp_get_stats(void);
+
+/**
+ * tcp_set_tcp_header() - Set the IP and TCP headers of a segment
+ *
+ * The payload always starts IP_TCP_HDR_SIZE bytes into @pkt. A SYN, which
+ * carries no payload, also gets the MSS and window scale options.
+ *
+ * @pkt: start of the IP header
+ * @dest: IP address of the peer
+ * @dport: TCP port of the peer
+ * @sport: our TCP port
+ * @payload_len: number of payload bytes
+ * @action: TCP control flags
+ * @seq: sequence number
+ * @ack: acknowledgment number
+ * @return size of the IP and TCP headers, including options
+ */
+int tcp_set_tcp_header(uchar *pkt, struct in_addr dest, int dport, int sport,
+		       int payload_len, u8 action, u32 seq, u32 ack);
+
+/**
+ * tcp_receive() - Handle a received TCP segment
+ *
+ * @ip: IP header of the segment
+ * @len: length of the IP datagram
+ */
+void tcp_receive(struct ip_tcp_hdr *ip, unsigned int len);
+
+#endif /* __TCP_H__ */
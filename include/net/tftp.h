@@ -10,6 +10,27 @@
 #ifndef __TFTP_H__
 #define __TFTP_H__
 
+/*
+ *	TFTP operations.
+ */
+#define TFTP_RRQ	1
+#define TFTP_WRQ	2
+#define TFTP_DATA	3
+#define TFTP_ACK	4
+#define TFTP_ERROR	5
+#define TFTP_OACK	6
+
+enum {
+	TFTP_ERR_UNDEFINED           = 0,
+	TFTP_ERR_FILE_NOT_FOUND      = 1,
+	TFTP_ERR_ACCESS_DENIED       = 2,
+	TFTP_ERR_DISK_FULL           = 3,
+	TFTP_ERR_UNEXPECTED_OPCODE   = 4,
+	TFTP_ERR_UNKNOWN_TRANSFER_ID  = 5,
+	TFTP_ERR_FILE_ALREADY_EXISTS = 6,
+	TFTP_ERR_OPTION_NEGOTIATION = 8,
+};
+
 /**********************************************************************/
 /*
  *	Global functions and variables.
@@ -25,6 +46,78 @@ void tftp_start_server(void);	/* Wait for incoming TFTP put */
 extern ulong tftp_timeout_ms;
 extern int tftp_timeout_count_max;
 
+/**
+ * struct tftp_stats - Counters of the current or last TFTP transfer
+ *
+ * @blocks: data packets received
+ * @ooo: blocks received ahead of a missing one and kept
+ * @dup: blocks received again, or again ahead of a missing one
+ * @nacks: ACKs sent to make the server resend from a missing block
+ * @timeouts: timeouts waiting for the server
+ * @windowsize: window size agreed with the server
+ * @next_windowsize: window size to ask for in the next transfer
+ */
+struct tftp_stats {
+	ulong blocks;
+	ulong ooo;
+	ulong dup;
+	ulong nacks;
+	ulong timeouts;
+	int windowsize;
+	int next_windowsize;
+};
+
+/**
+ * tftp_get_stats() - Get the counters of the current or last transfer
+ *
+ * @return pointer to the counters
+ */
+const struct tftp_stats *tftp_get_stats(void);
+
+/* tftp_multi.c */
+
+/* Most files fetched at once by tftp_fetch_files() */
+#define TFTP_MULTI_MAX	8
+
+/**
+ * struct tftp_fetch - A file fetched by tftp_fetch_files()
+ *
+ * @name: name of the file on the server
+ * @addr: address to load it to
+ * @size: bytes received
+ * @ms: milliseconds from the request to the last block
+ * @err: 0 if the file arrived whole, else -ve error: -ENOENT if the server
+ *	does not have it, -ENOSPC if it runs into reserved memory or into the
+ *	next file above @addr, -ETIMEDOUT if the server stopped answering
+ */
+struct tftp_fetch {
+	const char *name;
+	ulong addr;
+	ulong size;
+	ulong ms;
+	int err;
+};
+
+/**
+ * tftp_fetch_files() - Fetch several files from the server at once
+ *
+ * Each file gets a TFTP session of its own and all of them run together, so
+ * that the ARP request and the option negotiation are done once for all and
+ * the round trips of one transfer overlap with the data of the others. The
+ * server is $serverip; the block size, window size and timeout come from
+ * the same variables as for tftpboot, the window being shared by the
+ * sessions.
+ *
+ * @files: files to fetch, whose @size, @ms and @err are set
+ * @count: number of files, at most TFTP_MULTI_MAX
+ * @return 0 if all the files arrived, the first error of a file if not, or
+ *	other -ve error if the transfer could not run
+ */
+int tftp_fetch_files(struct tftp_fetch *files, int count);
+
+/* Called by net_loop() to start fetching the files */
+void tftp_multi_start(void);
+
 /**********************************************************************/
 
 #endif /* __TFTP_H__ */
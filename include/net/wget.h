@@ -0,0 +1,36 @@
+/* SPDX-License-Identifier: GPL-2.0+ */
+/*
+ * HTTP/1.1 client loading a file over TCP
+ */
+
+#ifndef __WGET_H__
+#define __WGET_H__
+
+#include <blk.h>
+
+/**
+ * wget_set_url() - Set the file for the next transfer
+ *
+ * The URL is either "http://<ip>[:<port>]/<path>" or "[<ip>:]<path>", in
+ * which case serverip and port 80 are used unless given. Host names are not
+ * resolved.
+ *
+ * @url: URL of the file
+ * @return 0 if OK, -EINVAL if the URL cannot be used
+ */
+int wget_set_url(const char *url);
+
+/**
+ * wget_set_blk() - Set where to store the file of the next transfer
+ *
+ * @desc: block device to write the file to, NULL to load it in memory at
+ *	image_load_addr
+ * @start: first block to write
+ * @end: block after the end of the partition, the file must end before it
+ */
+void wget_set_blk(struct blk_desc *desc, lbaint_t start, lbaint_t end);
+
+/* Called by net_loop() to start the transfer */
+void wget_start(void);
+
+#endif /* __WGET_H__ */
@@ -9,8 +9,58 @@
 #ifndef _OF_LIVE_H
 #define _OF_LIVE_H
 
+#include <linux/libfdt.h>
+
 struct device_node;
 
+#define OF_LIVE_IMAGE_MAGIC	0x4c495645	/* "LIVE" */
+#define OF_LIVE_IMAGE_VERSION	1
+
+/*
+ * Pointers in an image hold an offset shifted left by one, with this bit set
+ * when the offset is into the FDT rather than the image. 0 is NULL.
+ */
+#define OF_LIVE_IMAGE_FDT	1
+
+/**
+ * struct of_live_image - Header of a live tree image
+ *
+ * A live tree image holds the struct device_node and struct property records
+ * of_live_build() would create for a given FDT, laid out as on the target.
+ * It is created on the host by tools/mklivetree, so that U-Boot only has to
+ * turn the offsets held in the records back into pointers. Like in a tree
+ * built by of_live_build(), property names and values are in the FDT.
+ *
+ * All fields of the header and records are big-endian, like in the FDT.
+ *
+ * @magic: OF_LIVE_IMAGE_MAGIC
+ * @version: OF_LIVE_IMAGE_VERSION
+ * @totalsize: Size of the image in bytes, including this header
+ * @ptr_size: Size of a pointer on the target
+ * @node_size: Size of struct device_node on the target
+ * @prop_size: Size of struct property on the target
+ * @off_nodes: Offset of the node records, the first one being the root
+ * @num_nodes: Number of node records
+ * @off_props: Offset of the property records
+ * @num_props: Number of property records
+ * @fdt_size: Total size of the FDT the image was built from
+ * @fdt_crc: CRC32 of that FDT
+ */
+struct of_live_image {
+	fdt32_t magic;
+	fdt32_t version;
+	fdt32_t totalsize;
+	fdt32_t ptr_size;
+	fdt32_t node_size;
+	fdt32_t prop_size;
+	fdt32_t off_nodes;
+	fdt32_t num_nodes;
+	fdt32_t off_props;
+	fdt32_t num_props;
+	fdt32_t fdt_size;
+	fdt32_t fdt_crc;
+};
+
 /**
  * of_live_build() - build a live (hierarchical) tree from a flat DT
  *
@@ -20,4 +70,27 @@ struct device_node;
  */
 int of_live_build(const void *fdt_blob, struct device_node **rootp);
 
+/**
+ * of_live_map() - set up a live tree from an image built on the host
+ *
+ * This fixes up the pointers of the image in place, so it can only be done
+ * once. The image must have been built from @fdt_blob, as it is now.
+ *
+ * @image: Image created by tools/mklivetree, NULL if none
+ * @fdt_blob: Flat tree the image was built from
+ * @rootp: Returns live tree that was set up
+ * @return 0 if OK, -ENOENT if there is no image, -EINVAL if it is not valid
+ *	for this target, -ESTALE if it was built from another FDT
+ */
+int of_live_map(void *image, const void *fdt_blob, struct device_node **rootp);
+
+/**
+ * board_of_live_image() - get the live tree image of the control FDT
+ *
+ * By default this is the image linked into U-Boot with CONFIG_OF_EMBED.
+ *
+ * @return the image, or NULL if there is none
+ */
+void *board_of_live_image(void);
+
 #endif
@@ -462,6 +462,32 @@ int os_setup_signal_handlers(void);
  */
 void os_signal_action(int sig, unsigned long pc);
 
+/**
+ * os_profile_start() - sample the call stack at a fixed rate
+ *
+ * A SIGPROF handler calls os_profile_action() each time the process has
+ * used @period_us of CPU time.
+ *
+ * @period_us:	time between two samples, in microseconds
+ * Return:	0 for success, -1 on error
+ */
+int os_profile_start(unsigned long period_us);
+
+/**
+ * os_profile_stop() - stop sampling the call stack
+ */
+void os_profile_stop(void);
+
+/**
+ * os_profile_action() - record a sample of the call stack
+ *
+ * This is called from the SIGPROF handler.
+ *
+ * @pcs:	program counter then return addresses, innermost first
+ * @count:	number of addresses in @pcs
+ */
+void os_profile_action(unsigned long *pcs, int count);
+
 /**
  * os_get_time_offset() - get time offset
  *
@@ -75,9 +75,31 @@ struct pxe_menu {
 	struct list_head labels;
 };
 
+/* Most files fetched ahead for a label: initrd, kernel and device tree */
+#define PXE_MAX_PREFETCH	3
+
+/**
+ * struct pxe_file - A file of a label fetched ahead of time
+ *
+ * @path: Path to the file, with the boot directory; NULL once it was used
+ * @addr: Address the file is loaded to
+ * @size: Size of the file in bytes
+ * @ms: Time taken to fetch the file, in milliseconds
+ * @err: 0 if the file is at @addr, -ve on error
+ */
+struct pxe_file {
+	char *path;
+	ulong addr;
+	ulong size;
+	ulong ms;
+	int err;
+};
+
 struct pxe_context;
 typedef int (*pxe_getfile_func)(struct pxe_context *ctx, const char *file_path,
 				char *file_addr, ulong *filesizep);
+typedef int (*pxe_prefetch_func)(struct pxe_context *ctx,
+				 struct pxe_file *files, int count);
 
 /**
  * struct pxe_context - context information for PXE parsing
@@ -89,6 +111,8 @@ typedef int (*pxe_getfile_func)(struct pxe_context *ctx, const char *file_path,
  * @bootdir: Directory that files are loaded from ("" if no directory). This is
  *	allocated
  * @pxe_file_size: Size of the PXE file
+ * @prefetched: Files of the label being booted, fetched with @prefetch
+ * @num_prefetched: Number of entries in @prefetched
  */
 struct pxe_context {
 	struct cmd_tbl *cmdtp;
@@ -104,10 +128,25 @@ struct pxe_context {
 	 */
 	pxe_getfile_func getfile;
 
+	/**
+	 * prefetch() - read several files at once, optional
+	 *
+	 * Files which could not be read are read again with @getfile,
+	 * which reports the error.
+	 *
+	 * @ctx: PXE context
+	 * @files: Files to read, whose @size, @ms and @err are set
+	 * @count: Number of files
+	 * Return 0 if all the files were read, -ve on error
+	 */
+	pxe_prefetch_func prefetch;
+
 	void *userdata;
 	bool allow_abs_path;
 	char *bootdir;
 	ulong pxe_file_size;
+	struct pxe_file prefetched[PXE_MAX_PREFETCH];
+	int num_prefetched;
 };
 
 /**
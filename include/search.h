@@ -47,6 +47,12 @@ struct hsearch_data {
 	struct env_entry_node *table;
 	unsigned int size;
 	unsigned int filled;
+	/* Number of slots marked as deleted, which still slow down searches */
+	unsigned int deleted;
+	/* Non-zero while a variable callback runs; the table is not resized */
+	unsigned int busy;
+	/* Copies of imported environment text which entries point into */
+	struct env_blob *blobs;
 /*
  * Callback function which will check whether the given change for variable
  * "item" to "newval" may be applied or not, and possibly apply such change.
@@ -58,7 +64,10 @@ struct hsearch_data {
 			 enum env_op, int flag);
 };
 
-/* Create a new hash table which will contain at most "nel" elements.  */
+/*
+ * Create a new hash table with room for "nel" elements. It grows as needed
+ * when more are entered.
+ */
 int hcreate_r(size_t nel, struct hsearch_data *htab);
 
 /* Destroy current internal hash table.  */
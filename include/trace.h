@@ -28,6 +28,7 @@ enum {
 enum trace_chunk_type {
 	TRACE_CHUNK_FUNCS,
 	TRACE_CHUNK_CALLS,
+	TRACE_CHUNK_SAMPLES,
 };
 
 /* A trace record for a function, as written to the profile output file */
@@ -79,6 +80,58 @@ struct trace_call {
 
 int trace_list_calls(void *buff, size_t buff_size, size_t *needed);
 
+/*
+ * A sample of the call stack, as written to the profile output file, is a
+ * uint32_t frame count followed by the code offset of each frame, starting
+ * with the program counter. Frames outside U-Boot are left out, so the
+ * count may be 0.
+ */
+
+/**
+ * Dump the samples of the call stack into a buffer
+ *
+ * @param buff		Buffer in which to place data, or NULL to count size
+ * @param buff_size	Size of buffer
+ * @param needed	Returns number of bytes used / needed
+ * @return 0 if ok, -ENOSPC if space was exhausted
+ */
+int trace_list_samples(void *buff, size_t buff_size, size_t *needed);
+
+/**
+ * Start sampling the call stack
+ *
+ * Any samples taken before are discarded.
+ *
+ * @param period_us	Time between two samples, in microseconds
+ * @return 0 if ok, -ENOMEM if the buffer cannot be allocated, -ENOSYS if
+ *	the architecture cannot sample, other -ve on error
+ */
+int trace_sample_start(ulong period_us);
+
+/* Stop sampling the call stack */
+void trace_sample_stop(void);
+
+/**
+ * Record a sample of the call stack
+ *
+ * This is called by the architecture from its timer interrupt.
+ *
+ * @param pcs		Program counter then return addresses, innermost first
+ * @param count		Number of addresses in @pcs
+ */
+void trace_sample_add(const ulong *pcs, int count);
+
+/**
+ * Start the timer calling trace_sample_add() at a fixed rate
+ *
+ * @param period_us	Time between two calls, in microseconds
+ * @return 0 if ok, -ENOSYS if not supported, other -ve on error
+ */
+int arch_trace_sample_start(ulong period_us);
+
+/* Stop the timer started by arch_trace_sample_start() */
+void arch_trace_sample_stop(void);
+
 /**
  * Turn function tracing on and off
  *
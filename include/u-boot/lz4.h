@@ -21,4 +21,30 @@
  */
 int ulz4fn(const void *src, size_t srcn, void *dst, size_t *dstn);
 
+/**
+ * LZ4_decompress_safe() - Decompress a single raw LZ4 block
+ *
+ * This uses the fast-path decoder (wide copies, offset-specialised match
+ * copies) if CONFIG_LZ4_FAST_PATH is enabled, otherwise the reference one.
+ * It never writes outside @dest, even for malformed input.
+ *
+ * @source: Compressed block
+ * @dest: Destination for uncompressed data
+ * @input_size: Exact size of the compressed block
+ * @output_size: Size of the @dest buffer
+ * @return number of bytes written to @dest, or a negative value if the block
+ *	is malformed or does not fit in @dest
+ */
+int LZ4_decompress_safe(const char *source, char *dest, int input_size,
+			int output_size);
+
+/**
+ * LZ4_decompress_safe_ref() - Decompress a raw LZ4 block (reference decoder)
+ *
+ * Same as LZ4_decompress_safe() but always uses the original, byte-oriented
+ * decoder. This is mostly useful for checking the fast path against it.
+ */
+int LZ4_decompress_safe_ref(const char *source, char *dest, int input_size,
+			    int output_size);
+
 #endif
@@ -72,6 +72,9 @@ extern int ubi_init(void);
 extern void ubi_exit(void);
 extern int ubi_part(char *part_name, const char *vid_header_offset);
 extern int ubi_volume_write(char *volume, void *buf, size_t size);
+extern int ubi_volume_begin_write(char *volume, void *buf, size_t size,
+				  size_t full_size);
+extern int ubi_volume_continue_write(char *volume, void *buf, size_t size);
 extern int ubi_volume_read(char *volume, char *buf, size_t size);
 
 extern struct ubi_device *ubi_devices[];
@@ -0,0 +1,143 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * Region-based allocation, where everything is freed at once
+ *
+ * Each block obtained from malloc() starts with struct arena_block and is
+ * filled from the bottom up. Only the first block in the list is allocated
+ * from, except that a large allocation which does not fit there is given a
+ * block of its own, placed second so that the first block keeps serving
+ * small allocations.
+ */
+
+#include <common.h>
+#include <arena.h>
+#include <malloc.h>
+#include <linux/kernel.h>
+
+/* Alignment of arena_alloc(), the same as dlmalloc's MALLOC_ALIGNMENT */
+#define ARENA_ALIGN	(2 * sizeof(size_t))
+
+static void *block_alloc(struct arena *arena, struct arena_block *blk,
+			 size_t align, size_t size)
+{
+	ulong base = (ulong)(blk + 1);
+	ulong addr, end;
+
+	addr = ALIGN(base + blk->used, align);
+	end = addr + size - base;
+	if (end > blk->size || end < blk->used)
+		return NULL;
+	arena->used += end - blk->used;
+	arena->peak = max(arena->peak, arena->used);
+	blk->used = end;
+
+	return (void *)addr;
+}
+
+void arena_init(struct arena *arena, size_t block_size)
+{
+	memset(arena, '\0', sizeof(*arena));
+	arena->block_size = block_size;
+}
+
+void *arena_memalign(struct arena *arena, size_t align, size_t size)
+{
+	struct arena_block *blk = arena->blocks;
+	size_t block_size, need;
+	bool own;
+	void *ptr;
+
+	if (blk) {
+		ptr = block_alloc(arena, blk, align, size);
+		if (ptr)
+			return ptr;
+	}
+
+	/* Allow for the worst-case padding needed to align the start */
+	need = size + align - 1;
+	if (need < size)
+		return NULL;
+	block_size = arena->block_size ?: ARENA_DEFAULT_BLOCK_SIZE;
+	own = size > block_size / 2;
+	if (own || need > block_size)
+		block_size = need;
+	blk = malloc(sizeof(*blk) + block_size);
+	if (!blk)
+		return NULL;
+	blk->size = block_size;
+	blk->used = 0;
+	arena->size += sizeof(*blk) + block_size;
+
+	if (own && arena->blocks) {
+		blk->next = arena->blocks->next;
+		arena->blocks->next = blk;
+	} else {
+		blk->next = arena->blocks;
+		arena->blocks = blk;
+	}
+
+	return block_alloc(arena, blk, align, size);
+}
+
+void *arena_alloc(struct arena *arena, size_t size)
+{
+	return arena_memalign(arena, ARENA_ALIGN, size);
+}
+
+void *arena_calloc(struct arena *arena, size_t size)
+{
+	void *ptr;
+
+	ptr = arena_alloc(arena, size);
+	if (ptr)
+		memset(ptr, '\0', size);
+
+	return ptr;
+}
+
+char *arena_strdup(struct arena *arena, const char *str)
+{
+	size_t len = strlen(str) + 1;
+	char *ptr;
+
+	ptr = arena_memalign(arena, 1, len);
+	if (ptr)
+		memcpy(ptr, str, len);
+
+	return ptr;
+}
+
+void arena_reset(struct arena *arena)
+{
+	size_t block_size = arena->block_size ?: ARENA_DEFAULT_BLOCK_SIZE;
+	struct arena_block *blk, *next, *keep = NULL;
+
+	for (blk = arena->blocks; blk; blk = next) {
+		next = blk->next;
+		if (!keep && blk->size == block_size)
+			keep = blk;
+		else
+			free(blk);
+	}
+	arena->blocks = keep;
+	arena->size = 0;
+	arena->used = 0;
+	if (keep) {
+		keep->next = NULL;
+		keep->used = 0;
+		arena->size = sizeof(*keep) + keep->size;
+	}
+}
+
+void arena_uninit(struct arena *arena)
+{
+	struct arena_block *blk, *next;
+
+	for (blk = arena->blocks; blk; blk = next) {
+		next = blk->next;
+		free(blk);
+	}
+	arena->blocks = NULL;
+	arena->size = 0;
+	arena->used = 0;
+}
@@ -63,13 +63,45 @@
 
 struct env_entry_node {
 	int used;
+	unsigned int hash;
 	struct env_entry entry;
 };
 
+/*
+ * himport_r() parses one copy of the environment text in place and the
+ * entries it creates point into that copy, instead of each holding two
+ * strings made by strdup(). The copy is freed once no key or value points
+ * into it any more; @refs counts those, plus one held by himport_r() while
+ * it is parsing.
+ */
+struct env_blob {
+	struct env_blob *next;
+	size_t size;
+	unsigned int refs;
+	char data[];
+};
+
 
 static void _hdelete(const char *key, struct hsearch_data *htab,
 		     struct env_entry *ep, int idx);
 
+/* Free a key or value, which may point into an imported environment blob */
+static void hfree_str(struct hsearch_data *htab, const char *str)
+{
+	struct env_blob **bp, *blob;
+
+	for (bp = &htab->blobs; (blob = *bp); bp = &blob->next) {
+		if (str >= blob->data && str < blob->data + blob->size) {
+			if (!--blob->refs) {
+				*bp = blob->next;
+				free(blob);
+			}
+			return;
+		}
+	}
+	free((void *)str);
+}
+
 /*
  * hcreate()
  */
@@ -92,6 +124,16 @@ static int isprime(unsigned int number)
 	return number % div != 0;
 }
 
+static unsigned int hsize(size_t nel)
+{
+	/* Change nel to the first prime number not smaller as nel. */
+	nel |= 1;		/* make odd */
+	while (!isprime(nel))
+		nel += 2;
+
+	return nel;
+}
+
 /*
  * Before using the hash table we must allocate memory for it.
  * Test for an existing table are done. We allocate one element
@@ -115,13 +157,9 @@ int hcreate_r(size_t nel, struct hsearch_data *htab)
 		return 0;
 	}
 
-	/* Change nel to the first prime number not smaller as nel. */
-	nel |= 1;		/* make odd */
-	while (!isprime(nel))
-		nel += 2;
-
-	htab->size = nel;
+	htab->size = hsize(nel);
 	htab->filled = 0;
+	htab->deleted = 0;
 
 	/* allocate memory and zero out */
 	htab->table = (struct env_entry_node *)calloc(htab->size + 1,
@@ -160,8 +198,8 @@ void hdestroy_r(struct hsearch_data *htab)
 		if (htab->table[i].used > 0) {
 			struct env_entry *ep = &htab->table[i].entry;
 
-			free((void *)ep->key);
-			free(ep->data);
+			hfree_str(htab, ep->key);
+			hfree_str(htab, ep->data);
 		}
 	}
 	free(htab->table);
@@ -170,6 +208,68 @@ void hdestroy_r(struct hsearch_data *htab)
 	htab->table = NULL;
 }
 
+/*
+ * hresize()
+ */
+
+/* First index tried for a hash value: simply take the modul but prevent zero */
+static unsigned int hfirst(unsigned int hash, unsigned int size)
+{
+	unsigned int hval = hash % size;
+
+	return hval ? hval : 1;
+}
+
+/*
+ * Step to the next index tried. The second hash function is as suggested
+ * in [Knuth]; because the size is prime this visits every index.
+ */
+static unsigned int hnext(unsigned int idx, unsigned int hval,
+			  unsigned int size)
+{
+	unsigned int hval2 = 1 + hval % (size - 2);
+
+	if (idx <= hval2)
+		return size + idx - hval2;
+
+	return idx - hval2;
+}
+
+/*
+ * Move all entries to a new table with at least "nel" slots. This also
+ * drops the markers left by deleted entries, which lengthen searches.
+ * Pointers to entries of the old table are no longer valid afterwards.
+ */
+static int hresize(struct hsearch_data *htab, size_t nel)
+{
+	struct env_entry_node *old = htab->table, *table;
+	unsigned int size = hsize(nel);
+	unsigned int i, idx, hval;
+
+	debug("hresize: %u entries, %u -> %u\n", htab->filled, htab->size,
+	      size);
+	table = calloc(size + 1, sizeof(struct env_entry_node));
+	if (!table)
+		return -ENOMEM;
+
+	for (i = 1; i <= htab->size; ++i) {
+		if (old[i].used <= 0)
+			continue;
+		hval = hfirst(old[i].hash, size);
+		for (idx = hval; table[idx].used; idx = hnext(idx, hval, size))
+			;
+		table[idx] = old[i];
+		table[idx].used = hval;
+	}
+	free(old);
+
+	htab->table = table;
+	htab->size = size;
+	htab->deleted = 0;
+
+	return 0;
+}
+
 /*
  * hsearch()
  */
@@ -177,17 +277,24 @@ void hdestroy_r(struct hsearch_data *htab)
 /*
  * This is the search function. It uses double hashing with open addressing.
  * The argument item.key has to be a pointer to an zero terminated, most
- * probably strings of chars. The function for generating a number of the
- * strings is simple but fast. It can be replaced by a more complex function
- * like ajw (see [Aho,Sethi,Ullman]) if the needs are shown.
+ * probably strings of chars. The number for a string is computed from all
+ * of its characters (FNV-1a), since variable names often share a long
+ * prefix, such as a set of boot scripts for board variants.
  *
  * We use an trick to speed up the lookup. The table is created by hcreate
  * with one more element available. This enables us to use the index zero
  * special. This index will never be used because we store the first hash
  * index in the field used where zero means not used. Every other value
- * means used. The used field can be used as a first fast comparison for
- * equality of the stored and the parameter value. This helps to prevent
- * unnecessary expensive calls of strcmp.
+ * means used. The full hash value is kept alongside and is compared first,
+ * which avoids nearly all unnecessary expensive calls of strcmp. It also
+ * lets the table be resized without hashing the keys again.
+ *
+ * The table grows when it is three quarters full, counting the markers
+ * left by deleted entries, so it never fills up and searches stay short.
+ * Growing moves the entries, so a pointer returned by an earlier call is
+ * only valid until the next call with ENV_ENTER. The table is not resized
+ * while a variable callback runs, since the caller still uses the entry
+ * being changed.
  *
  * This implementation differs from the standard library version of
  * this function in a number of ways:
@@ -197,7 +304,8 @@ void hdestroy_r(struct hsearch_data *htab)
  *   works with NUL terminated strings only.
  * - Instead of storing just pointers to the original objects, we
  *   create local copies so the caller does not need to care about the
- *   data any more.
+ *   data any more. Only himport_r() stores pointers into its own copy
+ *   of the environment text.
  * - The standard implementation does not provide a way to update an
  *   existing entry.  This version will create a new entry or update an
  *   existing one when both "action == ENV_ENTER" and "item.data != NULL".
@@ -228,32 +336,56 @@ int hmatch_r(const char *match, int last_idx, struct env_entry **retval,
 }
 
 static int
-do_callback(const struct env_entry *e, const char *name, const char *value,
-	    enum env_op op, int flags)
+do_callback(struct hsearch_data *htab, const struct env_entry *e,
+	    const char *name, const char *value, enum env_op op, int flags)
 {
 #ifndef CONFIG_SPL_BUILD
-	if (e->callback)
-		return e->callback(name, value, op, flags);
+	int ret;
+
+	if (e->callback) {
+		/* The callback may set other variables; do not move entries */
+		htab->busy++;
+		ret = e->callback(name, value, op, flags);
+		htab->busy--;
+
+		return ret;
+	}
 #endif
 	return 0;
 }
 
+static unsigned int hhash(const char *key)
+{
+	unsigned int hash = 2166136261U;
+
+	while (*key) {
+		hash ^= (unsigned char)*key++;
+		hash *= 16777619;
+	}
+
+	return hash;
+}
+
 /*
  * Compare an existing entry with the desired key, and overwrite if the action
- * is ENV_ENTER.  This is simply a helper function for hsearch_r().
+ * is ENV_ENTER.  This is simply a helper function for _hsearch().
  */
 static inline int _compare_and_overwrite_entry(struct env_entry item,
 		enum env_action action, struct env_entry **retval,
-		struct hsearch_data *htab, int flag, unsigned int hval,
-		unsigned int idx)
+		struct hsearch_data *htab, int flag, unsigned int hash,
+		unsigned int idx, struct env_blob *blob)
 {
-	if (htab->table[idx].used == hval
-	    && strcmp(item.key, htab->table[idx].entry.key) == 0) {
+	struct env_entry_node *node = &htab->table[idx];
+
+	if (node->used > 0 && node->hash == hash &&
+	    strcmp(item.key, node->entry.key) == 0) {
 		/* Overwrite existing value? */
 		if (action == ENV_ENTER && item.data) {
+			char *old = node->entry.data;
+
 			/* check for permission */
 			if (htab->change_ok != NULL && htab->change_ok(
-			    &htab->table[idx].entry, item.data,
+			    &node->entry, item.data,
 			    env_op_overwrite, flag)) {
 				debug("change_ok() rejected setting variable "
 					"%s, skipping it!\n", item.key);
@@ -263,7 +395,7 @@ static inline int _compare_and_overwrite_entry(struct env_entry item,
 			}
 
 			/* If there is a callback, call it */
-			if (do_callback(&htab->table[idx].entry, item.key,
+			if (do_callback(htab, &node->entry, item.key,
 					item.data, env_op_overwrite, flag)) {
 				debug("callback() rejected setting variable "
 					"%s, skipping it!\n", item.key);
@@ -272,49 +404,54 @@ static inline int _compare_and_overwrite_entry(struct env_entry item,
 				return 0;
 			}
 
-			free(htab->table[idx].entry.data);
-			htab->table[idx].entry.data = strdup(item.data);
-			if (!htab->table[idx].entry.data) {
+			if (blob) {
+				node->entry.data = item.data;
+				blob->refs++;
+			} else {
+				node->entry.data = strdup(item.data);
+			}
+			/* Free after taking the new reference, which may share a blob */
+			hfree_str(htab, old);
+			if (!node->entry.data) {
 				__set_errno(ENOMEM);
 				*retval = NULL;
 				return 0;
 			}
 		}
 		/* return found entry */
-		*retval = &htab->table[idx].entry;
+		*retval = &node->entry;
 		return idx;
 	}
 	/* keep searching */
 	return -1;
 }
 
-int hsearch_r(struct env_entry item, enum env_action action,
-	      struct env_entry **retval, struct hsearch_data *htab, int flag)
+/*
+ * Search for or enter an item. If "blob" is not NULL, item.key and item.data
+ * point into it and are stored as they are, rather than copied.
+ */
+static int _hsearch(struct env_entry item, enum env_action action,
+		    struct env_entry **retval, struct hsearch_data *htab,
+		    int flag, struct env_blob *blob)
 {
+	unsigned int hash = hhash(item.key);
 	unsigned int hval;
-	unsigned int count;
-	unsigned int len = strlen(item.key);
 	unsigned int idx;
 	unsigned int first_deleted = 0;
 	int ret;
 
-	/* Compute an value for the given string. Perhaps use a better method. */
-	hval = len;
-	count = len;
-	while (count-- > 0) {
-		hval <<= 4;
-		hval += item.key[count];
-	}
-
 	/*
-	 * First hash function:
-	 * simply take the modul but prevent zero.
+	 * Grow the table before it gets crowded, or just rebuild it if it is
+	 * mostly markers left by deleted entries. If that fails, carry on
+	 * with the current table until it is full.
 	 */
-	hval %= htab->size;
-	if (hval == 0)
-		++hval;
+	if (action == ENV_ENTER && !htab->busy &&
+	    (htab->filled + htab->deleted + 1) * 4 > htab->size * 3)
+		hresize(htab, htab->filled * 2 < htab->size ?
+			htab->size : htab->size * 2);
 
 	/* The first index tried. */
+	hval = hfirst(hash, htab->size);
 	idx = hval;
 
 	if (htab->table[idx].used) {
@@ -322,31 +459,16 @@ int hsearch_r(struct env_entry item, enum env_action action,
 		 * Further action might be required according to the
 		 * action value.
 		 */
-		unsigned hval2;
-
 		if (htab->table[idx].used == USED_DELETED)
 			first_deleted = idx;
 
 		ret = _compare_and_overwrite_entry(item, action, retval, htab,
-			flag, hval, idx);
+			flag, hash, idx, blob);
 		if (ret != -1)
 			return ret;
 
-		/*
-		 * Second hash function:
-		 * as suggested in [Knuth]
-		 */
-		hval2 = 1 + hval % (htab->size - 2);
-
 		do {
-			/*
-			 * Because SIZE is prime this guarantees to
-			 * step through all available indices.
-			 */
-			if (idx <= hval2)
-				idx = htab->size + idx - hval2;
-			else
-				idx -= hval2;
+			idx = hnext(idx, hval, htab->size);
 
 			/*
 			 * If we visited all entries leave the loop
@@ -361,7 +483,7 @@ int hsearch_r(struct env_entry item, enum env_action action,
 
 			/* If entry is found use it. */
 			ret = _compare_and_overwrite_entry(item, action, retval,
-				htab, flag, hval, idx);
+				htab, flag, hash, idx, blob);
 			if (ret != -1)
 				return ret;
 		}
@@ -382,14 +504,24 @@ int hsearch_r(struct env_entry item, enum env_action action,
 
 		/*
 		 * Create new entry;
-		 * create copies of item.key and item.data
+		 * create copies of item.key and item.data, unless they are
+		 * in an imported blob
 		 */
-		if (first_deleted)
+		if (first_deleted) {
 			idx = first_deleted;
+			--htab->deleted;
+		}
 
 		htab->table[idx].used = hval;
-		htab->table[idx].entry.key = strdup(item.key);
-		htab->table[idx].entry.data = strdup(item.data);
+		htab->table[idx].hash = hash;
+		if (blob) {
+			htab->table[idx].entry.key = item.key;
+			htab->table[idx].entry.data = item.data;
+			blob->refs += 2;
+		} else {
+			htab->table[idx].entry.key = strdup(item.key);
+			htab->table[idx].entry.data = strdup(item.data);
+		}
 		if (!htab->table[idx].entry.key ||
 		    !htab->table[idx].entry.data) {
 			__set_errno(ENOMEM);
@@ -416,8 +548,8 @@ int hsearch_r(struct env_entry item, enum env_action action,
 		}
 
 		/* If there is a callback, call it */
-		if (do_callback(&htab->table[idx].entry, item.key, item.data,
-				env_op_create, flag)) {
+		if (do_callback(htab, &htab->table[idx].entry, item.key,
+				item.data, env_op_create, flag)) {
 			debug("callback() rejected setting variable "
 				"%s, skipping it!\n", item.key);
 			_hdelete(item.key, htab, &htab->table[idx].entry, idx);
@@ -436,6 +568,12 @@ int hsearch_r(struct env_entry item, enum env_action action,
 	return 0;
 }
 
+int hsearch_r(struct env_entry item, enum env_action action,
+	      struct env_entry **retval, struct hsearch_data *htab, int flag)
+{
+	return _hsearch(item, action, retval, htab, flag, NULL);
+}
+
 
 /*
  * hdelete()
@@ -452,12 +590,13 @@ static void _hdelete(const char *key, struct hsearch_data *htab,
 {
 	/* free used entry */
 	debug("hdelete: DELETING key \"%s\"\n", key);
-	free((void *)ep->key);
-	free(ep->data);
+	hfree_str(htab, ep->key);
+	hfree_str(htab, ep->data);
 	ep->flags = 0;
 	htab->table[idx].used = USED_DELETED;
 
 	--htab->filled;
+	++htab->deleted;
 }
 
 int hdelete_r(const char *key, struct hsearch_data *htab, int flag)
@@ -485,7 +624,7 @@ int hdelete_r(const char *key, struct hsearch_data *htab, int flag)
 	}
 
 	/* If there is a callback, call it */
-	if (do_callback(&htab->table[idx].entry, key, NULL,
+	if (do_callback(htab, &htab->table[idx].entry, key, NULL,
 			env_op_delete, flag)) {
 		debug("callback() rejected deleting variable "
 			"%s, skipping it!\n", key);
@@ -611,7 +750,7 @@ ssize_t hexport_r(struct hsearch_data *htab, const char sep, int flag,
 		 char **resp, size_t size,
 		 int argc, char *const argv[])
 {
-	struct env_entry *list[htab->size];
+	struct env_entry **list;
 	char *res, *p;
 	size_t totlen;
 	int i, n;
@@ -622,6 +761,13 @@ ssize_t hexport_r(struct hsearch_data *htab, const char sep, int flag,
 		return (-1);
 	}
 
+	/* The table can grow large, so do not put the list on the stack */
+	list = malloc(sizeof(*list) * (htab->filled + 1));
+	if (!list) {
+		__set_errno(ENOMEM);
+		return (-1);
+	}
+
 	debug("EXPORT  table = %p, htab.size = %d, htab.filled = %d, size = %lu\n",
 	      htab, htab->size, htab->filled, (ulong)size);
 	/*
@@ -679,6 +825,7 @@ ssize_t hexport_r(struct hsearch_data *htab, const char sep, int flag,
 		if (size < totlen + 1) {	/* provided buffer too small */
 			printf("Env export buffer too small: %lu, but need %lu\n",
 			       (ulong)size, (ulong)totlen + 1);
+			free(list);
 			__set_errno(ENOMEM);
 			return (-1);
 		}
@@ -695,6 +842,7 @@ ssize_t hexport_r(struct hsearch_data *htab, const char sep, int flag,
 		/* no, allocate and clear one */
 		*resp = res = calloc(1, size);
 		if (res == NULL) {
+			free(list);
 			__set_errno(ENOMEM);
 			return (-1);
 		}
@@ -721,6 +869,7 @@ ssize_t hexport_r(struct hsearch_data *htab, const char sep, int flag,
 		*p++ = sep;
 	}
 	*p = '\0';		/* terminate result */
+	free(list);
 
 	return size;
 }
@@ -759,6 +908,24 @@ static int drop_var_from_set(const char *name, int nvars, char * vars[])
 	return res;
 }
 
+/*
+ * Find the length of the data to import, so that only that much is copied,
+ * not the whole size of the environment storage. With '\0' as separator
+ * the data ends with an empty string, otherwise at the first '\0'.
+ */
+static size_t himport_len(const char *env, size_t size, const char sep)
+{
+	const char *p = env, *end = env + size;
+
+	if (sep != '\0')
+		return strnlen(env, size);
+
+	while (p < end && *p)
+		p += strnlen(p, end - p) + 1;
+
+	return p < end ? p - env : size;
+}
+
 /*
  * Import linearized data into hash table.
  *
@@ -795,6 +962,9 @@ static int drop_var_from_set(const char *name, int nvars, char * vars[])
  *
  * In theory, arbitrary separator characters can be used, but only
  * '\0' and '\n' have really been tested.
+ *
+ * The data is copied once and parsed in place; the new entries point into
+ * that copy rather than holding copies of their own.
  */
 
 int himport_r(struct hsearch_data *htab,
@@ -803,6 +973,8 @@ int himport_r(struct hsearch_data *htab,
 {
 	char *data, *sp, *dp, *name, *value;
 	char *localvars[nvars];
+	struct env_blob *blob;
+	size_t len;
 	int i;
 
 	/* Test for correct arguments.  */
@@ -811,14 +983,23 @@ int himport_r(struct hsearch_data *htab,
 		return 0;
 	}
 
-	/* we allocate new space to make sure we can write to the array */
-	if ((data = malloc(size + 1)) == NULL) {
-		debug("himport_r: can't malloc %lu bytes\n", (ulong)size + 1);
+	/*
+	 * we allocate new space to make sure we can write to the array; the
+	 * two terminators allow the parser to look one character ahead
+	 */
+	len = himport_len(env, size, sep);
+	blob = malloc(sizeof(*blob) + len + 2);
+	if (!blob) {
+		debug("himport_r: can't malloc %lu bytes\n", (ulong)len + 2);
 		__set_errno(ENOMEM);
 		return 0;
 	}
-	memcpy(data, env, size);
-	data[size] = '\0';
+	blob->size = len + 2;
+	blob->refs = 1;
+	data = blob->data;
+	memcpy(data, env, len);
+	data[len] = '\0';
+	data[len + 1] = '\0';
 	dp = data;
 
 	/* make a local copy of the list of variables */
@@ -852,7 +1033,8 @@ int himport_r(struct hsearch_data *htab,
 	 * environment size), so we clip it to a reasonable value.
 	 * On the other hand we need to add some more entries for free
 	 * space when importing very small buffers. Both boundaries can
-	 * be overwritten in the board config file if needed.
+	 * be overwritten in the board config file if needed. The table
+	 * grows later if more variables are entered.
 	 */
 
 	if (!htab->table) {
@@ -864,26 +1046,31 @@ int himport_r(struct hsearch_data *htab,
 		debug("Create Hash Table: N=%d\n", nent);
 
 		if (hcreate_r(nent, htab) == 0) {
-			free(data);
+			free(blob);
 			return 0;
 		}
 	}
 
 	if (!size) {
-		free(data);
+		free(blob);
 		return 1;		/* everything OK */
 	}
+	/* From now on the entries may point into the blob */
+	blob->next = htab->blobs;
+	htab->blobs = blob;
+
 	if(crlf_is_lf) {
 		/* Remove Carriage Returns in front of Line Feeds */
 		unsigned ignored_crs = 0;
-		for(;dp < data + size && *dp; ++dp) {
+		for(;dp < data + len && *dp; ++dp) {
 			if(*dp == '\r' &&
-			   dp < data + size - 1 && *(dp+1) == '\n')
+			   dp < data + len - 1 && *(dp+1) == '\n')
 				++ignored_crs;
 			else
 				*(dp-ignored_crs) = *dp;
 		}
-		size -= ignored_crs;
+		len -= ignored_crs;
+		data[len] = '\0';
 		dp = data;
 	}
 	/* Parse environment; allow for '\0' and 'sep' as separators */
@@ -936,7 +1123,7 @@ int himport_r(struct hsearch_data *htab,
 		if (*name == 0) {
 			debug("INSERT: unable to use an empty key\n");
 			__set_errno(EINVAL);
-			free(data);
+			hfree_str(htab, data);
 			return 0;
 		}
 
@@ -948,7 +1135,7 @@ int himport_r(struct hsearch_data *htab,
 		e.key = name;
 		e.data = value;
 
-		hsearch_r(e, ENV_ENTER, &rv, htab, flag);
+		_hsearch(e, ENV_ENTER, &rv, htab, flag, blob);
 #if !CONFIG_IS_ENABLED(ENV_WRITEABLE_LIST)
 		if (rv == NULL) {
 			printf("himport_r: can't insert \"%s=%s\" into hash table\n",
@@ -959,10 +1146,10 @@ int himport_r(struct hsearch_data *htab,
 		debug("INSERT: table %p, filled %d/%d rv %p ==> name=\"%s\" value=\"%s\"\n",
 			htab, htab->filled, htab->size,
 			rv, name, value);
-	} while ((dp < data + size) && *dp);	/* size check needed for text */
+	} while ((dp < data + len) && *dp);	/* size check needed for text */
 						/* without '\0' termination */
-	debug("INSERT: free(data = %p)\n", data);
-	free(data);
+	debug("INSERT: release(data = %p)\n", data);
+	hfree_str(htab, data);
 
 	if (flag & H_NOCLEAR)
 		goto end;
@@ -263,3 +263,354 @@ int write_sparse_image(struct sparse_storage *info,
 
 	return 0;
 }
+
+enum sparse_stream_state {
+	SPARSE_STREAM_HEADER,	/* file header, or the start of a raw image */
+	SPARSE_STREAM_CHUNK,	/* chunk header */
+	SPARSE_STREAM_RAW,	/* data of a RAW chunk */
+	SPARSE_STREAM_FILL,	/* value of a FILL chunk */
+	SPARSE_STREAM_DONE,	/* all chunks done, the rest is ignored */
+	SPARSE_STREAM_IMAGE,	/* data of an image which is not sparse */
+};
+
+int sparse_stream_init(struct sparse_stream *ss, struct sparse_storage *info,
+		       void *buf, u32 bufsize)
+{
+	memset(ss, '\0', sizeof(*ss));
+	ss->info = info;
+	ss->buf = buf;
+	ss->bufsize = bufsize - bufsize % info->blksz;
+	ss->blk = info->start;
+	ss->state = SPARSE_STREAM_HEADER;
+
+	if (!info->mssg)
+		info->mssg = default_log;
+
+	/* The start of a raw image is held there while telling it apart */
+	if (!ss->bufsize || ss->bufsize < sizeof(sparse_header_t))
+		return -1;
+
+	return 0;
+}
+
+/* Gather the bytes of a header, return true once it is complete */
+static bool sparse_stream_gather(struct sparse_stream *ss, void *hdr,
+				 u32 size, const u8 **data, u32 *len)
+{
+	u32 n = min(size - ss->hdr_len, *len);
+
+	memcpy(hdr + ss->hdr_len, *data, n);
+	ss->hdr_len += n;
+	*data += n;
+	*len -= n;
+
+	return ss->hdr_len == size;
+}
+
+/* Write the whole blocks in the buffer */
+static int sparse_stream_flush(struct sparse_stream *ss, char *response)
+{
+	struct sparse_storage *info = ss->info;
+	lbaint_t blkcnt = ss->buffered / info->blksz;
+	lbaint_t blks;
+
+	if (!blkcnt)
+		return 0;
+
+	if (ss->blk + blkcnt > info->start + info->size) {
+		printf("%s: Request would exceed partition size!\n", __func__);
+		info->mssg("Request would exceed partition size!", response);
+		return -1;
+	}
+
+	blks = info->write(info, ss->blk, blkcnt, ss->buf);
+	/* blks might be > blkcnt (eg. NAND bad-blocks) */
+	if (blks < blkcnt) {
+		printf("%s: %s" LBAFU " [" LBAFU "]\n", __func__,
+		       "Write failed, block #", ss->blk, blks);
+		info->mssg("flash write failure", response);
+		return -1;
+	}
+	ss->blk += blks;
+	ss->bytes_written += ((u64)blkcnt) * info->blksz;
+	ss->buffered = 0;
+
+	return 0;
+}
+
+/* Write a FILL chunk, from the buffer filled with its value */
+static int sparse_stream_fill(struct sparse_stream *ss, char *response)
+{
+	struct sparse_storage *info = ss->info;
+	u64 chunk_data_sz = ((u64)ss->sparse.blk_sz) * ss->chunk.chunk_sz;
+	lbaint_t blkcnt = DIV_ROUND_UP_ULL(chunk_data_sz, info->blksz);
+	lbaint_t bufblks = ss->bufsize / info->blksz;
+	u32 *fill_buf = ss->buf;
+	lbaint_t blks, j;
+	int i;
+
+	if (ss->blk + blkcnt > info->start + info->size) {
+		printf("%s: Request would exceed partition size!\n", __func__);
+		info->mssg("Request would exceed partition size!", response);
+		return -1;
+	}
+
+	for (i = 0; i < ss->bufsize / sizeof(ss->fill); i++)
+		fill_buf[i] = ss->fill;
+
+	while (blkcnt) {
+		j = min(blkcnt, bufblks);
+		blks = info->write(info, ss->blk, j, fill_buf);
+		/* blks might be > j (eg. NAND bad-blocks) */
+		if (blks < j) {
+			printf("%s: %s " LBAFU " [" LBAFU "]\n", __func__,
+			       "Write failed, block #", ss->blk, j);
+			info->mssg("flash write failure", response);
+			return -1;
+		}
+		ss->blk += blks;
+		ss->bytes_written += ((u64)j) * info->blksz;
+		blkcnt -= j;
+	}
+
+	return 0;
+}
+
+static void sparse_stream_next_chunk(struct sparse_stream *ss)
+{
+	ss->total_blocks += ss->chunk.chunk_sz;
+	ss->hdr_len = 0;
+	if (++ss->chunks < ss->sparse.total_chunks)
+		ss->state = SPARSE_STREAM_CHUNK;
+	else
+		ss->state = SPARSE_STREAM_DONE;
+}
+
+static int sparse_stream_header(struct sparse_stream *ss, char *response)
+{
+	struct sparse_storage *info = ss->info;
+	sparse_header_t *sparse_header = &ss->sparse;
+	unsigned int offset;
+
+	if (sparse_header->file_hdr_sz < sizeof(sparse_header_t) ||
+	    sparse_header->chunk_hdr_sz < sizeof(chunk_header_t)) {
+		info->mssg("Bogus sparse image header", response);
+		return -1;
+	}
+	/* Skip the remaining bytes of a header longer than we expected */
+	ss->skip = sparse_header->file_hdr_sz - sizeof(sparse_header_t);
+
+	div_u64_rem(sparse_header->blk_sz, info->blksz, &offset);
+	if (offset) {
+		printf("%s: Sparse image block size issue [%u]\n",
+		       __func__, sparse_header->blk_sz);
+		info->mssg("sparse image block size issue", response);
+		return -1;
+	}
+
+	puts("Flashing Sparse Image\n");
+	ss->hdr_len = 0;
+	if (sparse_header->total_chunks)
+		ss->state = SPARSE_STREAM_CHUNK;
+	else
+		ss->state = SPARSE_STREAM_DONE;
+
+	return 0;
+}
+
+static int sparse_stream_chunk(struct sparse_stream *ss, char *response)
+{
+	struct sparse_storage *info = ss->info;
+	chunk_header_t *chunk_header = &ss->chunk;
+	u32 chunk_hdr_sz = ss->sparse.chunk_hdr_sz;
+	u64 chunk_data_sz;
+	lbaint_t blkcnt;
+
+	/* Skip the remaining bytes of a header longer than we expected */
+	ss->skip = chunk_hdr_sz - sizeof(chunk_header_t);
+	ss->hdr_len = 0;
+
+	chunk_data_sz = ((u64)ss->sparse.blk_sz) * chunk_header->chunk_sz;
+	blkcnt = DIV_ROUND_UP_ULL(chunk_data_sz, info->blksz);
+	switch (chunk_header->chunk_type) {
+	case CHUNK_TYPE_RAW:
+		if (chunk_header->total_sz != (chunk_hdr_sz + chunk_data_sz)) {
+			info->mssg("Bogus chunk size for chunk type Raw",
+				   response);
+			return -1;
+		}
+		if (ss->blk + blkcnt > info->start + info->size) {
+			printf("%s: Request would exceed partition size!\n",
+			       __func__);
+			info->mssg("Request would exceed partition size!",
+				   response);
+			return -1;
+		}
+		ss->left = chunk_data_sz;
+		ss->state = SPARSE_STREAM_RAW;
+		if (!ss->left)
+			sparse_stream_next_chunk(ss);
+		break;
+
+	case CHUNK_TYPE_FILL:
+		if (chunk_header->total_sz !=
+		    (chunk_hdr_sz + sizeof(uint32_t))) {
+			info->mssg("Bogus chunk size for chunk type FILL",
+				   response);
+			return -1;
+		}
+		ss->state = SPARSE_STREAM_FILL;
+		break;
+
+	case CHUNK_TYPE_DONT_CARE:
+		ss->blk += info->reserve(info, ss->blk, blkcnt);
+		sparse_stream_next_chunk(ss);
+		break;
+
+	case CHUNK_TYPE_CRC32:
+		if (chunk_header->total_sz < chunk_hdr_sz) {
+			info->mssg("Bogus chunk size for chunk type CRC32",
+				   response);
+			return -1;
+		}
+		/* The checksum is not checked */
+		ss->skip += chunk_header->total_sz - chunk_hdr_sz;
+		sparse_stream_next_chunk(ss);
+		break;
+
+	default:
+		printf("%s: Unknown chunk type: %x\n", __func__,
+		       chunk_header->chunk_type);
+		info->mssg("Unknown chunk type", response);
+		return -1;
+	}
+
+	return 0;
+}
+
+int sparse_stream_write(struct sparse_stream *ss, const void *data, u32 len,
+			char *response)
+{
+	const u8 *p = data;
+	u32 n;
+
+	while (len) {
+		if (ss->skip) {
+			n = min(ss->skip, len);
+			ss->skip -= n;
+			p += n;
+			len -= n;
+			continue;
+		}
+
+		switch (ss->state) {
+		case SPARSE_STREAM_HEADER:
+			if (!sparse_stream_gather(ss, &ss->sparse,
+						  sizeof(ss->sparse), &p, &len))
+				break;
+			if (is_sparse_image(&ss->sparse)) {
+				if (sparse_stream_header(ss, response))
+					return -1;
+				break;
+			}
+			/* Not sparse: what came so far is data */
+			puts("Flashing Raw Image\n");
+			memcpy(ss->buf, &ss->sparse, ss->hdr_len);
+			ss->buffered = ss->hdr_len;
+			ss->state = SPARSE_STREAM_IMAGE;
+			break;
+
+		case SPARSE_STREAM_CHUNK:
+			if (!sparse_stream_gather(ss, &ss->chunk,
+						  sizeof(ss->chunk), &p, &len))
+				break;
+			if (sparse_stream_chunk(ss, response))
+				return -1;
+			break;
+
+		case SPARSE_STREAM_RAW:
+		case SPARSE_STREAM_IMAGE:
+			n = min(len, ss->bufsize - ss->buffered);
+			if (ss->state == SPARSE_STREAM_RAW)
+				n = min_t(u64, n, ss->left);
+			memcpy(ss->buf + ss->buffered, p, n);
+			ss->buffered += n;
+			p += n;
+			len -= n;
+			if (ss->state == SPARSE_STREAM_IMAGE) {
+				if (ss->buffered == ss->bufsize &&
+				    sparse_stream_flush(ss, response))
+					return -1;
+				break;
+			}
+			ss->left -= n;
+			if (ss->buffered == ss->bufsize || !ss->left) {
+				if (sparse_stream_flush(ss, response))
+					return -1;
+			}
+			if (!ss->left)
+				sparse_stream_next_chunk(ss);
+			break;
+
+		case SPARSE_STREAM_FILL:
+			if (!sparse_stream_gather(ss, &ss->fill,
+						  sizeof(ss->fill), &p, &len))
+				break;
+			if (sparse_stream_fill(ss, response))
+				return -1;
+			sparse_stream_next_chunk(ss);
+			break;
+
+		case SPARSE_STREAM_DONE:
+			/* Ignore what follows the last chunk */
+			return 0;
+		}
+	}
+
+	return 0;
+}
+
+int sparse_stream_finish(struct sparse_stream *ss, const char *part_name,
+			 char *response)
+{
+	struct sparse_storage *info = ss->info;
+	u32 pad;
+
+	switch (ss->state) {
+	case SPARSE_STREAM_HEADER:
+		/* An image shorter than a sparse header */
+		puts("Flashing Raw Image\n");
+		memcpy(ss->buf, &ss->sparse, ss->hdr_len);
+		ss->buffered = ss->hdr_len;
+		fallthrough;
+	case SPARSE_STREAM_IMAGE:
+		pad = ss->buffered % info->blksz;
+		if (pad) {
+			pad = info->blksz - pad;
+			memset(ss->buf + ss->buffered, '\0', pad);
+			ss->buffered += pad;
+		}
+		if (sparse_stream_flush(ss, response))
+			return -1;
+		printf("........ wrote %llu bytes to '%s'\n", ss->bytes_written,
+		       part_name);
+		return 0;
+	case SPARSE_STREAM_DONE:
+		break;
+	default:
+		info->mssg("sparse image truncated", response);
+		return -1;
+	}
+
+	debug("Wrote %d blocks, expected to write %d blocks\n",
+	      ss->total_blocks, ss->sparse.total_blks);
+	printf("........ wrote %llu bytes to '%s'\n", ss->bytes_written,
+	       part_name);
+
+	if (ss->total_blocks != ss->sparse.total_blks) {
+		info->mssg("sparse image write failure", response);
+		return -1;
+	}
+
+	return 0;
+}
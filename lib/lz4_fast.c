@@ -0,0 +1,309 @@
+// SPDX-License-Identifier: BSD-2-Clause
+/*
+ * Fast-path LZ4 block decoder
+ *
+ * Derived from LZ4_decompress_generic() in LZ4 v1.9, Copyright (C) 2011-2020,
+ * Yann Collet (https://github.com/lz4/lz4), reduced to the only instance
+ * U-Boot needs: safe decoding of a full block without an external dictionary.
+ *
+ * Compared with the reference decoder in lz4.c this:
+ *  - copies short literals and matches with fixed-size 16/18-byte moves,
+ *    avoiding the wild-copy loop entirely for the common short sequences;
+ *  - uses 32-byte wild copies for long literals and matches while far enough
+ *    from the end of the output buffer;
+ *  - specialises overlapping match copies on the offset (1, 2 and 4 become a
+ *    repeated 8-byte pattern, other small offsets use the offset tables).
+ *
+ * Like lz4.c this file is #included from lz4_wrapper.c, do not link it.
+ */
+
+#define LZ4_WILDCOPYLENGTH	8
+#define LZ4_MATCH_SAFEGUARD	((2 * LZ4_WILDCOPYLENGTH) - MINMATCH)
+#define LZ4_FASTLOOP_SAFE	64
+
+static const unsigned int lz4_inc32table[8] = {0, 1, 2, 1, 0, 4, 4, 4};
+static const int lz4_dec64table[8] = {0, 0, 0, -1, -4, 1, 2, 3};
+
+static inline void LZ4_copy16(void *dst, const void *src)
+{
+	__builtin_memcpy(dst, src, 16);
+}
+
+/* Copies 32 bytes at a time, may write up to 31 bytes beyond @dst_end */
+static inline void lz4_wild_copy32(BYTE *dst, const BYTE *src, BYTE *dst_end)
+{
+	do {
+		LZ4_copy16(dst, src);
+		LZ4_copy16(dst + 16, src + 16);
+		dst += 32;
+		src += 32;
+	} while (dst < dst_end);
+}
+
+/*
+ * Copy a match of distance @offset (< 16), which may overlap its source.
+ * May write up to 8 bytes beyond @dst_end.
+ */
+static inline void lz4_copy_using_offset(BYTE *dst, const BYTE *src,
+					 BYTE *dst_end, size_t offset)
+{
+	BYTE v[8];
+
+	switch (offset) {
+	case 1:
+		__builtin_memset(v, *src, 8);
+		break;
+	case 2:
+		__builtin_memcpy(v, src, 2);
+		__builtin_memcpy(&v[2], src, 2);
+		__builtin_memcpy(&v[4], v, 4);
+		break;
+	case 4:
+		__builtin_memcpy(v, src, 4);
+		__builtin_memcpy(&v[4], src, 4);
+		break;
+	default:
+		if (offset < 8) {
+			dst[0] = src[0];
+			dst[1] = src[1];
+			dst[2] = src[2];
+			dst[3] = src[3];
+			src += lz4_inc32table[offset];
+			LZ4_copy4(dst + 4, src);
+			src -= lz4_dec64table[offset];
+		} else {
+			LZ4_copy8(dst, src);
+			src += 8;
+		}
+		dst += 8;
+		LZ4_wildCopy(dst, src, dst_end);
+		return;
+	}
+
+	do {
+		__builtin_memcpy(dst, v, 8);
+		dst += 8;
+	} while (dst < dst_end);
+}
+
+/* Read the 255-continued length bytes; fails if @limit is reached */
+static inline int lz4_read_length(const BYTE **ip, const BYTE *limit,
+				  size_t *length)
+{
+	unsigned int s;
+
+	do {
+		if (unlikely(*ip >= limit))
+			return -1;
+		s = *(*ip)++;
+		*length += s;
+	} while (s == 255);
+
+	return 0;
+}
+
+static int lz4_decompress_fast_path(const char *source, char *dest,
+				    int input_size, int output_size)
+{
+	const BYTE *ip = (const BYTE *)source;
+	const BYTE *const iend = ip + input_size;
+	BYTE *op = (BYTE *)dest;
+	BYTE *const oend = op + output_size;
+	const BYTE *const low = op;
+	/* Bounds for the literal <= 14 / match <= 18 shortcut */
+	const BYTE *const shortiend = iend - 14 - 2;
+	const BYTE *const shortoend = oend - 14 - 18;
+	const BYTE *match;
+	size_t offset;
+	size_t length;
+	unsigned int token;
+	BYTE *cpy;
+
+	if (unlikely(!output_size))
+		return (input_size == 1 && *ip == 0) ? 0 : -1;
+	if (unlikely(!input_size))
+		return -1;
+
+	if (oend - op < LZ4_FASTLOOP_SAFE)
+		goto safe_decode;
+
+	/*
+	 * Fast loop: while at least LZ4_FASTLOOP_SAFE bytes remain in the
+	 * output, every copy may overshoot without bounds checks.
+	 */
+	while (1) {
+		token = *ip++;
+		length = token >> ML_BITS;
+
+		if (length == RUN_MASK) {
+			if (lz4_read_length(&ip, iend - RUN_MASK, &length))
+				goto _output_error;
+			if (unlikely((uintptr_t)op + length < (uintptr_t)op) ||
+			    unlikely((uintptr_t)ip + length < (uintptr_t)ip))
+				goto _output_error;
+			cpy = op + length;
+			if (cpy > oend - 32 || ip + length > iend - 32)
+				goto safe_literal_copy;
+			lz4_wild_copy32(op, ip, cpy);
+			ip += length;
+			op = cpy;
+		} else {
+			cpy = op + length;
+			if (ip > iend - (16 + 1))
+				goto safe_literal_copy;
+			/* Literals are at most 14 bytes here */
+			LZ4_copy16(op, ip);
+			ip += length;
+			op = cpy;
+		}
+
+		offset = LZ4_readLE16(ip);
+		ip += 2;
+		match = op - offset;
+
+		length = token & ML_MASK;
+		if (length == ML_MASK) {
+			if (lz4_read_length(&ip, iend - LASTLITERALS + 1,
+					    &length))
+				goto _output_error;
+			if (unlikely((uintptr_t)op + length < (uintptr_t)op))
+				goto _output_error;
+			length += MINMATCH;
+			if (op + length >= oend - LZ4_FASTLOOP_SAFE)
+				goto safe_match_copy;
+		} else {
+			length += MINMATCH;
+			if (op + length >= oend - LZ4_FASTLOOP_SAFE)
+				goto safe_match_copy;
+			/* Non-overlapping match of at most 18 bytes */
+			if (offset >= 8 && match >= low) {
+				LZ4_copy8(op, match);
+				LZ4_copy8(op + 8, match + 8);
+				__builtin_memcpy(op + 16, match + 16, 2);
+				op += length;
+				continue;
+			}
+		}
+
+		if (unlikely(match < low))
+			goto _output_error;
+
+		cpy = op + length;
+		if (unlikely(offset < 16))
+			lz4_copy_using_offset(op, match, cpy, offset);
+		else
+			lz4_wild_copy32(op, match, cpy);
+		op = cpy;
+	}
+
+safe_decode:
+	/* Tail loop: bounds-checked like the reference decoder */
+	while (1) {
+		token = *ip++;
+		length = token >> ML_BITS;
+
+		/* Shortcut for the common short literal + short match case */
+		if (length != RUN_MASK && likely(ip < shortiend && op <= shortoend)) {
+			LZ4_copy16(op, ip);
+			op += length;
+			ip += length;
+
+			length = token & ML_MASK;
+			offset = LZ4_readLE16(ip);
+			ip += 2;
+			match = op - offset;
+
+			if (length != ML_MASK && offset >= 8 && match >= low) {
+				LZ4_copy8(op, match);
+				LZ4_copy8(op + 8, match + 8);
+				__builtin_memcpy(op + 16, match + 16, 2);
+				op += length + MINMATCH;
+				continue;
+			}
+			goto copy_match;
+		}
+
+		if (length == RUN_MASK) {
+			if (lz4_read_length(&ip, iend - RUN_MASK, &length))
+				goto _output_error;
+			if (unlikely((uintptr_t)op + length < (uintptr_t)op) ||
+			    unlikely((uintptr_t)ip + length < (uintptr_t)ip))
+				goto _output_error;
+		}
+
+		cpy = op + length;
+safe_literal_copy:
+		if (cpy > oend - MFLIMIT ||
+		    ip + length > iend - (2 + 1 + LASTLITERALS)) {
+			/* Last sequence: must consume exactly all the input */
+			if (ip + length != iend || cpy > oend)
+				goto _output_error;
+			memmove(op, ip, length);
+			ip += length;
+			op += length;
+			break;
+		}
+		LZ4_wildCopy(op, ip, cpy);
+		ip += length;
+		op = cpy;
+
+		offset = LZ4_readLE16(ip);
+		ip += 2;
+		match = op - offset;
+		length = token & ML_MASK;
+
+copy_match:
+		if (length == ML_MASK) {
+			if (lz4_read_length(&ip, iend - LASTLITERALS + 1,
+					    &length))
+				goto _output_error;
+			if (unlikely((uintptr_t)op + length < (uintptr_t)op))
+				goto _output_error;
+		}
+		length += MINMATCH;
+
+safe_match_copy:
+		if (unlikely(match < low))
+			goto _output_error;
+		cpy = op + length;
+
+		if (unlikely(offset < 8)) {
+			op[0] = match[0];
+			op[1] = match[1];
+			op[2] = match[2];
+			op[3] = match[3];
+			match += lz4_inc32table[offset];
+			LZ4_copy4(op + 4, match);
+			match -= lz4_dec64table[offset];
+		} else {
+			LZ4_copy8(op, match);
+			match += 8;
+		}
+		op += 8;
+
+		if (unlikely(cpy > oend - LZ4_MATCH_SAFEGUARD)) {
+			BYTE *const copy_limit = oend - (LZ4_WILDCOPYLENGTH - 1);
+
+			/* The last LASTLITERALS bytes must be literals */
+			if (cpy > oend - LASTLITERALS)
+				goto _output_error;
+			if (op < copy_limit) {
+				LZ4_wildCopy(op, match, copy_limit);
+				match += copy_limit - op;
+				op = copy_limit;
+			}
+			while (op < cpy)
+				*op++ = *match++;
+		} else {
+			LZ4_copy8(op, match);
+			if (length > 16)
+				LZ4_wildCopy(op + 8, match + 8, cpy);
+		}
+		op = cpy;
+	}
+
+	return (int)((char *)op - dest);
+
+_output_error:
+	return (int)(-((const char *)ip - source)) - 1;
+}
@@ -34,6 +34,28 @@ typedef uint64_t U64;
 
 /* lz4.c is unaltered (except removing unrelated code) from github.com/Cyan4973/lz4. */
 #include "lz4.c"	/* #include for inlining, do not link! */
+#if CONFIG_IS_ENABLED(LZ4_FAST_PATH)
+#include "lz4_fast.c"	/* #include for inlining, do not link! */
+#endif
+
+int LZ4_decompress_safe_ref(const char *source, char *dest, int input_size,
+			    int output_size)
+{
+	/* constant folding essential, do not touch params! */
+	return LZ4_decompress_generic(source, dest, input_size, output_size,
+				      endOnInputSize, full, 0, noDict,
+				      (const BYTE *)dest, NULL, 0);
+}
+
+int LZ4_decompress_safe(const char *source, char *dest, int input_size,
+			int output_size)
+{
+#if CONFIG_IS_ENABLED(LZ4_FAST_PATH)
+	return lz4_decompress_fast_path(source, dest, input_size, output_size);
+#else
+	return LZ4_decompress_safe_ref(source, dest, input_size, output_size);
+#endif
+}
 
 #define LZ4F_BLOCKUNCOMPRESSED_FLAG 0x80000000U
 
@@ -109,10 +131,8 @@ int ulz4fn(const void *src, size_t srcn, void *dst, size_t *dstn)
 				break;
 			}
 		} else {
-			/* constant folding essential, do not touch params! */
-			ret = LZ4_decompress_generic(in, out, block_size,
-					end - out, endOnInputSize,
-					full, 0, noDict, out, NULL, 0);
+			ret = LZ4_decompress_safe(in, out, block_size,
+						  end - out);
 			if (ret < 0) {
 				ret = -EPROTO;	/* decompression error */
 				break;
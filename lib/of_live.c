@@ -13,9 +13,13 @@
 #include <linux/libfdt.h>
 #include <of_live.h>
 #include <malloc.h>
+#include <u-boot/crc.h>
 #include <dm/of_access.h>
 #include <linux/err.h>
 
+/* Live tree image linked in with CONFIG_OF_EMBED, see dts/Makefile */
+extern u8 __live_dt_begin[];
+
 static void *unflatten_dt_alloc(void **mem, unsigned long size,
 				unsigned long align)
 {
@@ -334,3 +338,79 @@ int of_live_build(const void *fdt_blob, struct device_node **rootp)
 
 	return ret;
 }
+
+/* Turn the offset held in the pointer at @ptrp into a pointer */
+static void *live_image_ptr(void *image, const void *fdt_blob,
+			    const void *ptrp)
+{
+	ulong val;
+
+	if (sizeof(void *) == sizeof(u64))
+		val = fdt64_to_cpu(*(const fdt64_t *)ptrp);
+	else
+		val = fdt32_to_cpu(*(const fdt32_t *)ptrp);
+	if (!val)
+		return NULL;
+	if (val & OF_LIVE_IMAGE_FDT)
+		return (void *)fdt_blob + (val >> 1);
+
+	return image + (val >> 1);
+}
+
+#define live_image_fix(field) \
+	((field) = live_image_ptr(image, fdt_blob, &(field)))
+
+int of_live_map(void *image, const void *fdt_blob, struct device_node **rootp)
+{
+	struct of_live_image *hdr = image;
+	struct device_node *np;
+	struct property *pp;
+	uint size, i;
+
+	if (!hdr)
+		return -ENOENT;
+	if (fdt32_to_cpu(hdr->magic) != OF_LIVE_IMAGE_MAGIC ||
+	    fdt32_to_cpu(hdr->version) != OF_LIVE_IMAGE_VERSION ||
+	    fdt32_to_cpu(hdr->ptr_size) != sizeof(void *) ||
+	    fdt32_to_cpu(hdr->node_size) != sizeof(struct device_node) ||
+	    fdt32_to_cpu(hdr->prop_size) != sizeof(struct property)) {
+		debug("Live tree image not valid for this build\n");
+		return -EINVAL;
+	}
+	size = fdt_totalsize(fdt_blob);
+	if (fdt32_to_cpu(hdr->fdt_size) != size ||
+	    fdt32_to_cpu(hdr->fdt_crc) != crc32(0, fdt_blob, size)) {
+		debug("Live tree image not built from this FDT\n");
+		return -ESTALE;
+	}
+
+	np = image + fdt32_to_cpu(hdr->off_nodes);
+	for (i = fdt32_to_cpu(hdr->num_nodes); i; i--, np++) {
+		live_image_fix(np->name);
+		live_image_fix(np->type);
+		np->phandle = fdt32_to_cpu(np->phandle);
+		live_image_fix(np->full_name);
+		live_image_fix(np->properties);
+		live_image_fix(np->parent);
+		live_image_fix(np->child);
+		live_image_fix(np->sibling);
+	}
+	pp = image + fdt32_to_cpu(hdr->off_props);
+	for (i = fdt32_to_cpu(hdr->num_props); i; i--, pp++) {
+		live_image_fix(pp->name);
+		pp->length = fdt32_to_cpu(pp->length);
+		live_image_fix(pp->value);
+		live_image_fix(pp->next);
+	}
+	*rootp = image + fdt32_to_cpu(hdr->off_nodes);
+
+	return of_alias_scan();
+}
+
+__weak void *board_of_live_image(void)
+{
+	if (IS_ENABLED(CONFIG_OF_EMBED) && IS_ENABLED(CONFIG_OF_LIVE_IMAGE))
+		return __live_dt_begin;
+
+	return NULL;
+}
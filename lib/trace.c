@@ -4,6 +4,7 @@
  */
 
 #include <common.h>
+#include <malloc.h>
 #include <mapmem.h>
 #include <time.h>
 #include <trace.h>
@@ -292,6 +293,174 @@ int trace_list_calls(void *buff, size_t buff_size, size_t *needed)
 	return 0;
 }
 
+#ifdef CONFIG_TRACE_SAMPLE
+/* The samples of the call stack, see trace_sample_start() */
+struct trace_sample_info {
+	uint32_t *buf;		/* Sample records, as output */
+	ulong size;		/* Number of words in buf */
+	ulong used;		/* Number of words written */
+	ulong count;		/* Number of samples written */
+	ulong dropped;		/* Number of samples dropped as buf was full */
+	ulong period_us;	/* Time between two samples, 0 if stopped */
+	ulong func_count;	/* Number of function sites in U-Boot */
+};
+
+static struct trace_sample_info sample;
+
+/**
+ * trace_list_samples() - produce a list of samples of the call stack
+ *
+ * The information is written into the supplied buffer - a header followed
+ * by the samples.
+ *
+ * @buff:	buffer to place list into
+ * @buff_size:	size of buffer
+ * @needed:	returns size of buffer needed, which may be
+ *		greater than buff_size if we ran out of space.
+ * Return:	0 if ok, -ENOSPC if space was exhausted
+ */
+int trace_list_samples(void *buff, size_t buff_size, size_t *needed)
+{
+	struct trace_output_hdr *output_hdr = NULL;
+	void *end, *ptr = buff;
+	ulong pos, used;
+	size_t upto;
+	uint i, depth;
+
+	end = buff ? buff + buff_size : NULL;
+
+	/* Place some header information */
+	if (ptr + sizeof(struct trace_output_hdr) < end)
+		output_hdr = ptr;
+	ptr += sizeof(struct trace_output_hdr);
+
+	/* Add each sample whole, with offsets in bytes */
+	used = sample.used;
+	for (pos = upto = 0; pos < used; pos += 1 + depth) {
+		depth = sample.buf[pos];
+		if (ptr + (1 + depth) * sizeof(uint32_t) <= end) {
+			uint32_t *out = ptr;
+
+			out[0] = depth;
+			for (i = 1; i <= depth; i++)
+				out[i] = sample.buf[pos + i] * FUNC_SITE_SIZE;
+			upto++;
+		}
+		ptr += (1 + depth) * sizeof(uint32_t);
+	}
+
+	/* Update the header */
+	if (output_hdr) {
+		output_hdr->rec_count = upto;
+		output_hdr->type = TRACE_CHUNK_SAMPLES;
+	}
+
+	/* Work out how must of the buffer we used */
+	*needed = ptr - buff;
+	if (ptr > end)
+		return -ENOSPC;
+
+	return 0;
+}
+
+/**
+ * trace_sample_add() - record a sample of the call stack
+ *
+ * This runs from the timer interrupt, so it only writes to the buffer.
+ *
+ * @pcs:	program counter then return addresses, innermost first
+ * @count:	number of addresses in @pcs
+ */
+void __attribute__((no_instrument_function)) trace_sample_add(
+		const ulong *pcs, int count)
+{
+	uint32_t *rec;
+	int i, depth;
+
+	if (!sample.period_us)
+		return;
+	count = min(count, CONFIG_TRACE_SAMPLE_DEPTH);
+	if (sample.used + 1 + count > sample.size) {
+		sample.dropped++;
+		return;
+	}
+
+	rec = &sample.buf[sample.used];
+	for (i = depth = 0; i < count; i++) {
+		uintptr_t func = func_ptr_to_num((void *)pcs[i]);
+
+		/* e.g. the C library on sandbox */
+		if (func < sample.func_count)
+			rec[1 + depth++] = func;
+	}
+	rec[0] = depth;
+	sample.used += 1 + depth;
+	sample.count++;
+}
+
+__weak int arch_trace_sample_start(ulong period_us)
+{
+	return -ENOSYS;
+}
+
+__weak void arch_trace_sample_stop(void)
+{
+}
+
+int trace_sample_start(ulong period_us)
+{
+	int ret;
+
+	trace_sample_stop();
+	if (!sample.buf) {
+		sample.buf = malloc(CONFIG_TRACE_SAMPLE_BUFFER_SIZE);
+		if (!sample.buf)
+			return -ENOMEM;
+		sample.size = CONFIG_TRACE_SAMPLE_BUFFER_SIZE /
+			sizeof(*sample.buf);
+	}
+	sample.used = 0;
+	sample.count = 0;
+	sample.dropped = 0;
+	sample.period_us = period_us;
+#ifdef CONFIG_SANDBOX
+	/* Sandbox leaves gd->mon_len at 0 */
+	sample.func_count = ((ulong)&_end - (ulong)&_init) / FUNC_SITE_SIZE;
+#else
+	sample.func_count = gd->mon_len / FUNC_SITE_SIZE;
+#endif
+
+	ret = arch_trace_sample_start(period_us);
+	if (ret) {
+		sample.period_us = 0;
+		return ret;
+	}
+
+	return 0;
+}
+
+void trace_sample_stop(void)
+{
+	if (!sample.period_us)
+		return;
+	arch_trace_sample_stop();
+	sample.period_us = 0;
+}
+
+static void trace_print_sample_stats(void)
+{
+	if (sample.period_us)
+		printf("%15lu us between samples\n", sample.period_us);
+	else
+		puts("     not sampling\n");
+	print_grouped_ull(sample.count, 10);
+	puts(" call stack samples");
+	if (sample.dropped)
+		printf(" (%lu dropped due to overflow)", sample.dropped);
+	puts("\n");
+}
+#endif
+
 /**
  * trace_print_stats() - print basic information about tracing
  */
@@ -325,6 +494,9 @@ void trace_print_stats(void)
 	printf("%15d call depth limit\n", hdr->depth_limit);
 	print_grouped_ull(hdr->ftrace_too_deep_count, 10);
 	puts(" calls not traced due to depth\n");
+#ifdef CONFIG_TRACE_SAMPLE
+	trace_print_sample_stats();
+#endif
 }
 
 void __attribute__((no_instrument_function)) trace_set_enabled(int enabled)
@@ -0,0 +1,285 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * Throughput benchmark of the network device and stack
+ *
+ * Nothing is stored or checked beyond a sequence number, so the packet rate
+ * measured is what the driver and the stack manage on their own, without the
+ * round trips and server behaviour timing a TFTP transfer mixes in. The
+ * Ethernet uclass tells the time spent in the driver from the time spent in
+ * the stack; see struct eth_stats.
+ */
+
+#include <common.h>
+#include <console.h>
+#include <cpu_func.h>
+#include <log.h>
+#include <malloc.h>
+#include <memalign.h>
+#include <net.h>
+#include <time.h>
+#include <watchdog.h>
+#include <net/bench.h>
+#include <linux/math64.h>
+
+/* Largest UDP payload fitting in one Ethernet frame */
+#define NET_BENCH_MAX_SIZE	(1500 - IP_UDP_HDR_SIZE)
+/* END packets sent by the source, in case some are lost */
+#define NET_BENCH_END_COPIES	3
+/* Packets sent between two polls of the device */
+#define NET_BENCH_TX_BATCH	32
+/* Cache operations timed to work out the cost for one packet */
+#define NET_BENCH_CACHE_LOOPS	256
+
+static bool bench_source;
+static u16 bench_port;
+static ulong bench_ms;
+static struct in_addr bench_dest;
+static uint bench_size;
+static uchar bench_ether[ARP_HLEN];
+
+static bool bench_started;
+static u32 bench_next_seq;
+static ulong bench_time_start;
+static u64 bench_us_start;
+static struct eth_stats bench_stats_start;
+static struct net_bench_result bench_result;
+
+void net_bench_set_sink(u16 port, ulong ms)
+{
+	bench_source = false;
+	bench_port = port;
+	bench_ms = ms;
+}
+
+int net_bench_set_source(struct in_addr dest, u16 port, ulong ms, uint size)
+{
+	if (size < sizeof(struct net_bench_hdr) || size > NET_BENCH_MAX_SIZE)
+		return -EINVAL;
+
+	bench_source = true;
+	bench_dest = dest;
+	bench_port = port;
+	bench_ms = ms;
+	bench_size = size;
+
+	return 0;
+}
+
+const struct net_bench_result *net_bench_get_result(void)
+{
+	return &bench_result;
+}
+
+/* Nanoseconds per packet for @ticks timer ticks spent on @packets */
+static ulong bench_ticks_to_ns(u64 ticks, ulong packets)
+{
+	ulong rate = get_tbclk();
+
+	if (!packets || !rate)
+		return 0;
+
+	/* Thousandths of a tick per packet keep the precision of slow timers */
+	return div_u64(div_u64(ticks * 1000, packets) * 1000000, rate);
+}
+
+/* Time the cache maintenance a driver doing DMA needs for each packet */
+static ulong bench_cache_ns(void)
+{
+	ulong start, end;
+	u64 ticks;
+	void *buf;
+	int i;
+
+	buf = memalign(ARCH_DMA_MINALIGN, PKTSIZE_ALIGN);
+	if (!buf)
+		return 0;
+	start = (ulong)buf;
+	end = start + PKTSIZE_ALIGN;
+
+	ticks = get_ticks();
+	for (i = 0; i < NET_BENCH_CACHE_LOOPS; i++) {
+		flush_dcache_range(start, end);
+		invalidate_dcache_range(start, end);
+	}
+	ticks = get_ticks() - ticks;
+	free(buf);
+
+	return bench_ticks_to_ns(ticks, NET_BENCH_CACHE_LOOPS);
+}
+
+static void bench_begin(void)
+{
+	struct udevice *dev = eth_get_dev();
+
+	bench_started = true;
+	bench_time_start = get_timer(0);
+	bench_us_start = timer_get_us();
+	if (dev)
+		bench_stats_start = *eth_get_stats(dev);
+}
+
+static void bench_report(void)
+{
+	struct net_bench_result *res = &bench_result;
+	struct udevice *dev = eth_get_dev();
+	const struct eth_stats *stats;
+	u64 rate;
+
+	res->us = timer_get_us() - bench_us_start;
+	if (dev) {
+		stats = eth_get_stats(dev);
+		res->rx_driver_ns = bench_ticks_to_ns(stats->rx_driver_ticks -
+					bench_stats_start.rx_driver_ticks,
+					stats->rx_packets -
+					bench_stats_start.rx_packets);
+		res->rx_stack_ns = bench_ticks_to_ns(stats->rx_stack_ticks -
+					bench_stats_start.rx_stack_ticks,
+					stats->rx_packets -
+					bench_stats_start.rx_packets);
+		res->tx_driver_ns = bench_ticks_to_ns(stats->tx_driver_ticks -
+					bench_stats_start.tx_driver_ticks,
+					stats->tx_packets -
+					bench_stats_start.tx_packets);
+	}
+	res->cache_ns = bench_cache_ns();
+
+	printf("%s: %lu packets, %llu bytes in %llu us", bench_source ?
+	       "Sent" : "Received", res->packets, res->bytes, res->us);
+	if (!bench_source)
+		printf(", %lu lost", res->lost);
+	putc('\n');
+	if (res->us) {
+		rate = div_u64((u64)res->packets * 1000000, res->us);
+		printf("Rate: %llu packets/s, ", rate);
+		print_size(div_u64(res->bytes * 1000000, res->us), "/s\n");
+	}
+	if (bench_source)
+		printf("Per packet: tx driver %lu ns", res->tx_driver_ns);
+	else
+		printf("Per packet: rx driver %lu ns, stack %lu ns",
+		       res->rx_driver_ns, res->rx_stack_ns);
+	printf(", cache maintenance %lu ns\n", res->cache_ns);
+}
+
+static void bench_sink_finish(u32 sent)
+{
+	if (sent > bench_result.packets)
+		bench_result.lost = sent - bench_result.packets;
+	bench_report();
+	net_set_state(NETLOOP_SUCCESS);
+}
+
+static void bench_sink_timeout(void)
+{
+	if (!bench_started) {
+		puts("No packets received\n");
+		net_set_state(NETLOOP_FAIL);
+		return;
+	}
+	/* Without the END packet, the highest number seen is all we know */
+	bench_sink_finish(bench_next_seq);
+}
+
+static void bench_sink_handler(uchar *pkt, unsigned int dport,
+			       struct in_addr sip, unsigned int sport,
+			       unsigned int len)
+{
+	const struct net_bench_hdr *hdr = (void *)pkt;
+	u32 seq;
+
+	if (dport != bench_port || len < sizeof(*hdr) ||
+	    ntohl(hdr->magic) != NET_BENCH_MAGIC)
+		return;
+
+	seq = ntohl(hdr->seq);
+	if (ntohl(hdr->flags) & NET_BENCH_END) {
+		if (bench_started)
+			bench_sink_finish(seq);
+		return;
+	}
+
+	if (!bench_started) {
+		printf("Receiving from %pI4:%u\n", &sip, sport);
+		bench_begin();
+		net_set_timeout_handler(bench_ms, bench_sink_timeout);
+	}
+	bench_result.packets++;
+	bench_result.bytes += len;
+	if (seq >= bench_next_seq)
+		bench_next_seq = seq + 1;
+}
+
+static int bench_send(u32 seq, u32 flags)
+{
+	struct net_bench_hdr *hdr;
+
+	hdr = (void *)net_tx_packet + net_eth_hdr_size() + IP_UDP_HDR_SIZE;
+	hdr->magic = htonl(NET_BENCH_MAGIC);
+	hdr->seq = htonl(seq);
+	hdr->flags = htonl(flags);
+
+	return net_send_udp_packet(bench_ether, bench_dest, bench_port,
+				   bench_port, bench_size);
+}
+
+/*
+ * Send in batches, polling the device in between so that ARP requests are
+ * still answered and the receive ring does not overflow
+ */
+static void bench_source_tx(void)
+{
+	int i;
+
+	if (arp_is_waiting()) {
+		net_set_timeout_handler(1, bench_source_tx);
+		return;
+	}
+	/* Packet 0 went out when the ARP reply came */
+	bench_begin();
+	bench_result.packets = 1;
+	bench_result.bytes = bench_size;
+
+	while (get_timer(bench_time_start) < bench_ms) {
+		for (i = 0; i < NET_BENCH_TX_BATCH; i++) {
+			bench_send(bench_result.packets, 0);
+			bench_result.packets++;
+			bench_result.bytes += bench_size;
+		}
+		eth_rx();
+		WATCHDOG_RESET();
+		if (ctrlc()) {
+			puts("\nInterrupted\n");
+			break;
+		}
+	}
+
+	bench_report();
+	for (i = 0; i < NET_BENCH_END_COPIES; i++)
+		bench_send(bench_result.packets, NET_BENCH_END);
+	net_set_state(NETLOOP_SUCCESS);
+}
+
+void net_bench_start(void)
+{
+	memset(&bench_result, '\0', sizeof(bench_result));
+	bench_started = false;
+	bench_next_seq = 0;
+
+	if (!bench_source) {
+		printf("Counting packets sent to port %u of %pI4\n",
+		       bench_port, &net_ip);
+		net_set_timeout_handler(bench_ms, bench_sink_timeout);
+		net_set_udp_handler(bench_sink_handler);
+		return;
+	}
+
+	printf("Sending %u-byte packets to %pI4:%u\n", bench_size,
+	       &bench_dest, bench_port);
+	memset(net_tx_packet + net_eth_hdr_size() + IP_UDP_HDR_SIZE, '\0',
+	       bench_size);
+	memset(bench_ether, '\0', sizeof(bench_ether));
+	/* This one waits for the ARP reply, if needed */
+	bench_send(0, 0);
+	net_set_timeout_handler(1, bench_source_tx);
+	net_set_udp_handler(NULL);
+}
@@ -78,6 +78,36 @@ static u8 dhcp_option_overload;
 static void dhcp_handler(uchar *pkt, unsigned dest, struct in_addr sip,
 			unsigned src, unsigned len);
 
+#if defined(CONFIG_DHCP_LEASE_CACHE)
+/*
+ * The lease cache is one environment variable holding, separated by spaces:
+ * our MAC address, the address leased, the gateway, the boot server and its
+ * MAC address (or the null address until it is known)
+ */
+#define DHCP_LEASE_VAR	"dhcplease"
+#define DHCP_LEASE_LEN	96
+
+/**
+ * struct dhcp_lease - Lease of an earlier boot
+ *
+ * @ethaddr: MAC address the lease was given to
+ * @ip: address leased
+ * @gateway: gateway given with the lease
+ * @server_ip: boot server
+ * @server_ethaddr: MAC address used to reach @server_ip, null if unknown
+ */
+struct dhcp_lease {
+	u8 ethaddr[ARP_HLEN];
+	struct in_addr ip;
+	struct in_addr gateway;
+	struct in_addr server_ip;
+	u8 server_ethaddr[ARP_HLEN];
+};
+
+/* Address bound by the last DHCP exchange, which the lease cache records */
+static struct in_addr dhcp_bound_ip;
+#endif
+
 /* For Debug */
 #if 0
 static char *dhcpmsg2str(int type)
@@ -711,6 +741,26 @@ static int bootp_extended(u8 *e)
 }
 #endif
 
+/* Pick the ID of a new request, in network byte order */
+static u32 bootp_new_id(void)
+{
+	u32 id;
+
+	/*
+	 *	Bootp ID is the lower 4 bytes of our ethernet address
+	 *	plus the current time in ms.
+	 */
+	id = ((u32)net_ethaddr[2] << 24)
+		| ((u32)net_ethaddr[3] << 16)
+		| ((u32)net_ethaddr[4] << 8)
+		| (u32)net_ethaddr[5];
+	id += get_timer(0);
+	id = htonl(id);
+	bootp_add_id(id);
+
+	return id;
+}
+
 void bootp_reset(void)
 {
 	bootp_num_ids = 0;
@@ -803,17 +853,7 @@ void bootp_request(void)
 	extlen = bootp_extended((u8 *)bp->bp_vend);
 #endif
 
-	/*
-	 *	Bootp ID is the lower 4 bytes of our ethernet address
-	 *	plus the current time in ms.
-	 */
-	bootp_id = ((u32)net_ethaddr[2] << 24)
-		| ((u32)net_ethaddr[3] << 16)
-		| ((u32)net_ethaddr[4] << 8)
-		| (u32)net_ethaddr[5];
-	bootp_id += get_timer(0);
-	bootp_id = htonl(bootp_id);
-	bootp_add_id(bootp_id);
+	bootp_id = bootp_new_id();
 	net_copy_u32(&bp->bp_id, &bootp_id);
 
 	/*
@@ -978,13 +1018,17 @@ static int dhcp_message_type(unsigned char *popt)
 	return -1;
 }
 
-static void dhcp_send_request_packet(struct bootp_hdr *bp_offer)
+/*
+ * Send a DHCPREQUEST for @requested_ip with transaction ID @id. Without a
+ * @server_ip, it is the INIT-REBOOT request for the address of a lease.
+ */
+static void dhcp_send_request_packet(u32 id, struct in_addr server_ip,
+				     struct in_addr requested_ip)
 {
 	uchar *pkt, *iphdr;
 	struct bootp_hdr *bp;
 	int pktlen, iplen, extlen;
 	int eth_hdr_size;
-	struct in_addr offered_ip;
 	struct in_addr zero_ip;
 	struct in_addr bcast_ip;
 
@@ -1017,20 +1061,10 @@ static void dhcp_send_request_packet(struct bootp_hdr *bp_offer)
 	memcpy(bp->bp_chaddr, net_ethaddr, 6);
 	copy_filename(bp->bp_file, net_boot_file_name, sizeof(bp->bp_file));
 
-	/*
-	 * ID is the id of the OFFER packet
-	 */
-
-	net_copy_u32(&bp->bp_id, &bp_offer->bp_id);
-
-	/*
-	 * Copy options from OFFER packet if present
-	 */
+	net_copy_u32(&bp->bp_id, &id);
 
-	/* Copy offered IP into the parameters request list */
-	net_copy_ip(&offered_ip, &bp_offer->bp_yiaddr);
 	extlen = dhcp_extended((u8 *)bp->bp_vend, DHCP_REQUEST,
-		dhcp_server_ip, offered_ip);
+		server_ip, requested_ip);
 
 	iplen = BOOTP_HDR_SIZE - OPT_FIELD_SIZE + extlen;
 	pktlen = eth_hdr_size + IP_UDP_HDR_SIZE + iplen;
@@ -1044,6 +1078,114 @@ static void dhcp_send_request_packet(struct bootp_hdr *bp_offer)
 	net_send_packet(net_tx_packet, pktlen);
 }
 
+#if defined(CONFIG_DHCP_LEASE_CACHE)
+/* Read the lease cache, which must be for our MAC address */
+static int dhcp_lease_load(struct dhcp_lease *lease)
+{
+	char buf[DHCP_LEASE_LEN];
+	char *field[5];
+	char *p;
+	int i;
+
+	p = env_get(DHCP_LEASE_VAR);
+	if (!p)
+		return -ENOENT;
+	strlcpy(buf, p, sizeof(buf));
+	p = buf;
+	for (i = 0; i < ARRAY_SIZE(field); i++) {
+		field[i] = strsep(&p, " ");
+		if (!field[i])
+			return -EINVAL;
+	}
+
+	string_to_enetaddr(field[0], lease->ethaddr);
+	lease->ip = string_to_ip(field[1]);
+	lease->gateway = string_to_ip(field[2]);
+	lease->server_ip = string_to_ip(field[3]);
+	string_to_enetaddr(field[4], lease->server_ethaddr);
+	if (!lease->ip.s_addr)
+		return -EINVAL;
+	if (memcmp(lease->ethaddr, net_ethaddr, ARP_HLEN))
+		return -ENOENT;
+
+	return 0;
+}
+
+void dhcp_lease_save(struct in_addr server, const uchar *server_ethaddr)
+{
+	char buf[DHCP_LEASE_LEN];
+	const char *old;
+
+	if (dhcp_state != BOUND || net_ip.s_addr != dhcp_bound_ip.s_addr ||
+	    server.s_addr != net_server_ip.s_addr)
+		return;
+	if (!server_ethaddr)
+		server_ethaddr = net_null_ethaddr;
+
+	snprintf(buf, sizeof(buf), "%pM %pI4 %pI4 %pI4 %pM", net_ethaddr,
+		 &net_ip, &net_gateway, &server, server_ethaddr);
+	old = env_get(DHCP_LEASE_VAR);
+	if (old && !strcmp(old, buf))
+		return;
+	env_set(DHCP_LEASE_VAR, buf);
+	if (IS_ENABLED(CONFIG_DHCP_LEASE_CACHE_SAVE))
+		env_save();
+}
+
+/*
+ * Record the new lease, reusing the MAC address of the boot server from the
+ * cache when the way to the server is the same
+ */
+static void dhcp_lease_bound(void)
+{
+	struct dhcp_lease lease;
+
+	dhcp_bound_ip = net_ip;
+	if (!dhcp_lease_load(&lease) &&
+	    lease.server_ip.s_addr == net_server_ip.s_addr &&
+	    lease.gateway.s_addr == net_gateway.s_addr &&
+	    is_valid_ethaddr(lease.server_ethaddr)) {
+		memcpy(net_server_ethaddr, lease.server_ethaddr, ARP_HLEN);
+		/* This records the lease as well */
+		net_server_ether_save(net_server_ip);
+		return;
+	}
+	dhcp_lease_save(net_server_ip, NULL);
+}
+
+static void dhcp_lease_timeout(void)
+{
+	puts("DHCP cached address not confirmed\n");
+	bootp_request();
+}
+
+/*
+ * Ask for the address of the cached lease straight away (INIT-REBOOT in
+ * RFC 2131), falling back to a DHCPDISCOVER if no server answers quickly
+ */
+static int dhcp_lease_request(void)
+{
+	struct dhcp_lease lease;
+	struct in_addr zero_ip;
+	int ret;
+
+	ret = dhcp_lease_load(&lease);
+	if (ret)
+		return ret;
+
+	bootstage_mark_name(BOOTSTAGE_ID_ALLOC, "dhcp_init_reboot");
+	printf("DHCP request for cached address %pI4\n", &lease.ip);
+	dhcp_state = REBOOTING;
+	zero_ip.s_addr = 0;
+	net_set_timeout_handler(CONFIG_DHCP_LEASE_CACHE_TIMEOUT,
+				dhcp_lease_timeout);
+	net_set_udp_handler(dhcp_handler);
+	dhcp_send_request_packet(bootp_new_id(), zero_ip, lease.ip);
+
+	return 0;
+}
+#endif
+
 /*
  *	Handle DHCP received packets.
  */
@@ -1051,6 +1193,7 @@ static void dhcp_handler(uchar *pkt, unsigned dest, struct in_addr sip,
 			 unsigned src, unsigned len)
 {
 	struct bootp_hdr *bp = (struct bootp_hdr *)pkt;
+	struct in_addr offered_ip;
 
 	debug("DHCPHandler: got packet: (src=%d, dst=%d, len=%d) state: %d\n",
 	      src, dest, len, dhcp_state);
@@ -1062,6 +1205,16 @@ static void dhcp_handler(uchar *pkt, unsigned dest, struct in_addr sip,
 	debug("DHCPHandler: got DHCP packet: (src=%d, dst=%d, len=%d) state: "
 	      "%d\n", src, dest, len, dhcp_state);
 
+#if defined(CONFIG_DHCP_LEASE_CACHE)
+	if (dhcp_state == REBOOTING &&
+	    dhcp_message_type((u8 *)bp->bp_vend) == DHCP_NAK) {
+		puts("DHCP cached address refused\n");
+		env_set(DHCP_LEASE_VAR, NULL);
+		bootp_request();
+		return;
+	}
+#endif
+
 	if (net_read_ip(&bp->bp_yiaddr).s_addr == 0) {
 #if defined(CONFIG_SERVERIP_FROM_PROXYDHCP)
 		store_bootp_params(bp);
@@ -1096,18 +1249,25 @@ static void dhcp_handler(uchar *pkt, unsigned dest, struct in_addr sip,
 			dhcp_state = REQUESTING;
 
 			net_set_timeout_handler(5000, bootp_timeout_handler);
-			dhcp_send_request_packet(bp);
+			net_copy_ip(&offered_ip, &bp->bp_yiaddr);
+			dhcp_send_request_packet(net_read_u32(&bp->bp_id),
+						 dhcp_server_ip, offered_ip);
 #ifdef CONFIG_SYS_BOOTFILE_PREFIX
 		}
 #endif	/* CONFIG_SYS_BOOTFILE_PREFIX */
 
 		return;
 		break;
+	case REBOOTING:
 	case REQUESTING:
-		debug("DHCP State: REQUESTING\n");
+		debug("DHCP State: %s\n", dhcp_state == REBOOTING ?
+		      "REBOOTING" : "REQUESTING");
 
 		if (dhcp_message_type((u8 *)bp->bp_vend) == DHCP_ACK) {
 			dhcp_packet_process_options(bp);
+			/* There was no OFFER to take this from */
+			if (dhcp_state == REBOOTING)
+				efi_net_set_dhcp_ack(pkt, len);
 			/* Store net params from reply */
 			store_net_params(bp);
 			dhcp_state = BOUND;
@@ -1116,6 +1276,9 @@ static void dhcp_handler(uchar *pkt, unsigned dest, struct in_addr sip,
 			net_set_timeout_handler(0, (thand_f *)0);
 			bootstage_mark_name(BOOTSTAGE_ID_BOOTP_STOP,
 					    "bootp_stop");
+#if defined(CONFIG_DHCP_LEASE_CACHE)
+			dhcp_lease_bound();
+#endif
 
 			net_auto_load();
 			return;
@@ -1132,6 +1295,10 @@ static void dhcp_handler(uchar *pkt, unsigned dest, struct in_addr sip,
 
 void dhcp_request(void)
 {
+#if defined(CONFIG_DHCP_LEASE_CACHE)
+	if (!dhcp_lease_request())
+		return;
+#endif
 	bootp_request();
 }
 #endif	/* CONFIG_CMD_DHCP */
@@ -70,6 +70,17 @@ void bootp_request(void);
 /****************** DHCP Support *********************/
 void dhcp_request(void);
 
+/**
+ * dhcp_lease_save() - Update the lease cache with the boot server
+ *
+ * Nothing is recorded unless the address in use is the one bound by the last
+ * DHCP exchange and @server is the server it gave.
+ *
+ * @server: IP address of the boot server
+ * @server_ethaddr: MAC address to reach @server with, NULL if not known
+ */
+void dhcp_lease_save(struct in_addr server, const uchar *server_ethaddr);
+
 /* DHCP States */
 typedef enum { INIT,
 	       INIT_REBOOT,
@@ -13,8 +13,10 @@
 #include <env.h>
 #include <log.h>
 #include <net.h>
+#include <time.h>
 #include <asm/global_data.h>
 #include <dm/device-internal.h>
+#include <dm/root.h>
 #include <dm/uclass-internal.h>
 #include <net/pcap.h>
 #include "eth_internal.h"
@@ -26,10 +28,12 @@ DECLARE_GLOBAL_DATA_PTR;
  * struct eth_device_priv - private structure for each Ethernet device
  *
  * @state: The state of the Ethernet MAC driver (defined by enum eth_state_t)
+ * @stats: Packet counters
  */
 struct eth_device_priv {
 	enum eth_state_t state;
 	bool running;
+	struct eth_stats stats;
 };
 
 /**
@@ -41,6 +45,12 @@ struct eth_uclass_priv {
 	struct udevice *current;
 };
 
+/* Timer ticks, to tell the driver's share of the time from the stack's */
+static inline u64 eth_ticks(void)
+{
+	return IS_ENABLED(CONFIG_CMD_NET_BENCH) ? get_ticks() : 0;
+}
+
 /* eth_errno - This stores the most recent failure code from DM functions */
 static int eth_errno;
 
@@ -356,7 +366,9 @@ int eth_is_active(struct udevice *dev)
 
 int eth_send(void *packet, int length)
 {
+	struct eth_device_priv *priv;
 	struct udevice *current;
+	u64 start;
 	int ret;
 
 	current = eth_get_dev();
@@ -366,10 +378,16 @@ int eth_send(void *packet, int length)
 	if (!eth_is_active(current))
 		return -EINVAL;
 
+	priv = dev_get_uclass_priv(current);
+	start = eth_ticks();
 	ret = eth_get_ops(current)->send(current, packet, length);
+	priv->stats.tx_driver_ticks += eth_ticks() - start;
 	if (ret < 0) {
 		/* We cannot completely return the error at present */
 		debug("%s: send() returned error %d\n", __func__, ret);
+		priv->stats.tx_errors++;
+	} else {
+		priv->stats.tx_packets++;
 	}
 #if defined(CONFIG_CMD_PCAP)
 	if (ret >= 0)
@@ -378,10 +396,38 @@ int eth_send(void *packet, int length)
 	return ret;
 }
 
+/* Process the packets the driver has ready, all returned by a single call */
+static int eth_rx_batch(struct udevice *current, u64 *stack)
+{
+	struct eth_ops *ops = eth_get_ops(current);
+	uchar *packets[ETH_PACKETS_BATCH_RECV];
+	int lengths[ETH_PACKETS_BATCH_RECV];
+	u64 start;
+	int ret;
+	int i;
+
+	ret = ops->recv_batch(current, ETH_RECV_CHECK_DEVICE, packets, lengths,
+			      ETH_PACKETS_BATCH_RECV);
+	for (i = 0; i < ret; i++) {
+		if (lengths[i] > 0) {
+			start = eth_ticks();
+			net_process_received_packet(packets[i], lengths[i]);
+			*stack += eth_ticks() - start;
+		}
+		if (ops->free_pkt)
+			ops->free_pkt(current, packets[i], lengths[i]);
+	}
+
+	return ret;
+}
+
 int eth_rx(void)
 {
+	struct eth_device_priv *priv;
 	struct udevice *current;
+	u64 start, stack = 0;
 	uchar *packet;
+	int count = 0;
 	int flags;
 	int ret;
 	int i;
@@ -393,27 +439,99 @@ int eth_rx(void)
 	if (!eth_is_active(current))
 		return -EINVAL;
 
-	/* Process up to 32 packets at one time */
-	flags = ETH_RECV_CHECK_DEVICE;
-	for (i = 0; i < ETH_PACKETS_BATCH_RECV; i++) {
-		ret = eth_get_ops(current)->recv(current, flags, &packet);
-		flags = 0;
+	priv = dev_get_uclass_priv(current);
+	start = eth_ticks();
+	if (eth_get_ops(current)->recv_batch) {
+		ret = eth_rx_batch(current, &stack);
 		if (ret > 0)
-			net_process_received_packet(packet, ret);
-		if (ret >= 0 && eth_get_ops(current)->free_pkt)
-			eth_get_ops(current)->free_pkt(current, packet, ret);
-		if (ret <= 0)
-			break;
+			count = ret;
+	} else {
+		/* Process up to 32 packets at one time */
+		flags = ETH_RECV_CHECK_DEVICE;
+		for (i = 0; i < ETH_PACKETS_BATCH_RECV; i++) {
+			ret = eth_get_ops(current)->recv(current, flags,
+							 &packet);
+			flags = 0;
+			if (ret > 0) {
+				u64 t = eth_ticks();
+
+				net_process_received_packet(packet, ret);
+				stack += eth_ticks() - t;
+				count++;
+			}
+			if (ret >= 0 && eth_get_ops(current)->free_pkt)
+				eth_get_ops(current)->free_pkt(current, packet,
+							       ret);
+			if (ret <= 0)
+				break;
+		}
+	}
+	if (count) {
+		/* Empty polls are left out, they are no cost per packet */
+		priv->stats.rx_driver_ticks += eth_ticks() - start - stack;
+		priv->stats.rx_stack_ticks += stack;
+		priv->stats.rx_packets += count;
+		priv->stats.rx_polls++;
+		priv->stats.rx_max_batch = max_t(uint, count,
+						 priv->stats.rx_max_batch);
 	}
 	if (ret == -EAGAIN)
 		ret = 0;
 	if (ret < 0) {
 		/* We cannot completely return the error at present */
 		debug("%s: recv() returned error %d\n", __func__, ret);
+		priv->stats.rx_errors++;
 	}
 	return ret;
 }
 
+int eth_mcast_join(struct in_addr mcast_ip, int join)
+{
+	struct udevice *current = eth_get_dev();
+	u8 mcast_mac[ARP_HLEN];
+
+	if (!current || !eth_get_ops(current)->mcast)
+		return -ENOSYS;
+
+	eth_mcast_ethaddr(mcast_ip, mcast_mac);
+
+	return eth_get_ops(current)->mcast(current, mcast_mac, join);
+}
+
+const struct eth_stats *eth_get_stats(struct udevice *dev)
+{
+	struct eth_device_priv *priv = dev_get_uclass_priv(dev);
+
+	return &priv->stats;
+}
+
+void eth_reset_stats(struct udevice *dev)
+{
+	struct eth_device_priv *priv = dev_get_uclass_priv(dev);
+
+	memset(&priv->stats, '\0', sizeof(priv->stats));
+}
+
+void eth_count_rx_overruns(struct udevice *dev, uint count)
+{
+	struct eth_device_priv *priv = dev_get_uclass_priv(dev);
+
+	priv->stats.rx_overruns += count;
+}
+
+/*
+ * Tell if start-up may leave a device off the boot path alone. Linux reads
+ * the MAC address of some devices from their registers, so those whose
+ * driver writes it there are probed anyway, unless told to skip that.
+ */
+static bool eth_probe_deferred(struct udevice *dev)
+{
+	if (eth_get_ops(dev)->write_hwaddr && !eth_mac_skip(dev_seq(dev)))
+		return false;
+
+	return dm_probe_deferred(dev);
+}
+
 int eth_initialize(void)
 {
 	int num_devices = 0;
@@ -427,7 +545,7 @@ int eth_initialize(void)
 	 * This is accomplished by attempting to probe each device and calling
 	 * their write_hwaddr() operation.
 	 */
-	uclass_first_device_check(UCLASS_ETH, &dev);
+	uclass_find_first_device(UCLASS_ETH, &dev);
 	if (!dev) {
 		log_err("No ethernet found.\n");
 		bootstage_error(BOOTSTAGE_ID_NET_ETH_START);
@@ -446,6 +564,9 @@ int eth_initialize(void)
 
 		bootstage_mark(BOOTSTAGE_ID_NET_ETH_INIT);
 		do {
+			/* Left for the first command using it */
+			if (!eth_probe_deferred(dev))
+				device_probe(dev);
 			if (device_active(dev)) {
 				if (num_devices)
 					printf(", ");
@@ -460,7 +581,7 @@ int eth_initialize(void)
 
 			if (device_active(dev))
 				num_devices++;
-			uclass_next_device_check(&dev);
+			uclass_find_next_device(&dev);
 		} while (dev);
 
 		if (!num_devices)
@@ -533,6 +654,8 @@ static int eth_post_probe(struct udevice *dev)
 			ops->send += gd->reloc_off;
 		if (ops->recv)
 			ops->recv += gd->reloc_off;
+		if (ops->recv_batch)
+			ops->recv_batch += gd->reloc_off;
 		if (ops->free_pkt)
 			ops->free_pkt += gd->reloc_off;
 		if (ops->stop)
@@ -603,6 +726,8 @@ static int eth_pre_remove(struct udevice *dev)
 
 	/* clear the MAC address */
 	memset(pdata->enetaddr, 0, ARP_HLEN);
+	/* and what we learnt through it */
+	net_server_ether_forget();
 
 	return 0;
 }
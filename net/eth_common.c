@@ -53,6 +53,19 @@ int eth_mac_skip(int index)
 	return skip_state != NULL;
 }
 
+/* 01:00:5e followed by the low 23 bits of the group (RFC 1112) */
+void eth_mcast_ethaddr(struct in_addr mcast_ip, u8 *enetaddr)
+{
+	u32 ip = ntohl(mcast_ip.s_addr);
+
+	enetaddr[0] = 0x01;
+	enetaddr[1] = 0x00;
+	enetaddr[2] = 0x5e;
+	enetaddr[3] = (ip >> 16) & 0x7f;
+	enetaddr[4] = (ip >> 8) & 0xff;
+	enetaddr[5] = ip & 0xff;
+}
+
 void eth_current_changed(void)
 {
 	char *act = env_get("ethact");
@@ -306,12 +306,7 @@ int eth_mcast_join(struct in_addr mcast_ip, int join)
 	u8 mcast_mac[ARP_HLEN];
 	if (!eth_current || !eth_current->mcast)
 		return -1;
-	mcast_mac[5] = htonl(mcast_ip.s_addr) & 0xff;
-	mcast_mac[4] = (htonl(mcast_ip.s_addr)>>8) & 0xff;
-	mcast_mac[3] = (htonl(mcast_ip.s_addr)>>16) & 0x7f;
-	mcast_mac[2] = 0x5e;
-	mcast_mac[1] = 0x0;
-	mcast_mac[0] = 0x1;
+	eth_mcast_ethaddr(mcast_ip, mcast_mac);
 	return eth_current->mcast(eth_current, mcast_mac, join);
 }
 
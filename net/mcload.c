@@ -0,0 +1,563 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * Receiver of images sent to many boards at once over UDP multicast
+ *
+ * Each block of the image has a fixed place in the destination, so blocks
+ * are stored as they arrive, in any order, and a bitmap records which ones
+ * are there. Memory and block devices are written directly; a UBI volume
+ * must be written in order, so blocks ahead of the first missing one wait in
+ * a bounded window. See include/net/mcload.h for the protocol.
+ */
+
+#include <common.h>
+#include <blk.h>
+#include <image.h>
+#include <lmb.h>
+#include <log.h>
+#include <malloc.h>
+#include <mapmem.h>
+#include <memalign.h>
+#include <net.h>
+#include <rand.h>
+#include <asm/global_data.h>
+#include <net/mcload.h>
+#include <linux/bitops.h>
+#include <linux/math64.h>
+#include <linux/sizes.h>
+#if IS_ENABLED(CONFIG_CMD_UBI)
+#include <ubi_uboot.h>
+#endif
+#include "net_rand.h"
+
+DECLARE_GLOBAL_DATA_PTR;
+
+/* Quiet time after which the missing blocks are reported */
+#define MCLOAD_NAK_MS		250
+/* Random delay added, so that boards do not all send their NAK at once */
+#define MCLOAD_NAK_JITTER_MS	100
+/* Quiet periods in a row, without any new block, before giving up */
+#define MCLOAD_IDLE_MAX		40
+/* Time waiting for the stream to start, announcing the group every second */
+#define MCLOAD_WAIT_MS		1000
+#define MCLOAD_WAIT_MAX		60
+/* Bytes per "loading" hash */
+#define MCLOAD_HASH_BYTES	SZ_64K
+/* Number of "loading" hashes per line */
+#define HASHES_PER_LINE		65
+
+#define IGMP_V2_REPORT		0x16
+
+#if IS_ENABLED(CONFIG_CMD_UBI)
+#define MCLOAD_UBI_WINDOW	CONFIG_MCLOAD_UBI_WINDOW
+#else
+#define MCLOAD_UBI_WINDOW	1
+#endif
+
+static struct in_addr mcload_group;
+static u16 mcload_port;
+static struct blk_desc *mcload_blk_desc;
+static lbaint_t mcload_blk_start;
+static lbaint_t mcload_blk_end;
+static char mcload_ubi_vol[128];
+
+static bool mcload_started;
+static struct in_addr mcload_sender_ip;
+static u16 mcload_sender_port;
+static u8 mcload_sender_ethaddr[ARP_HLEN];
+static u32 mcload_session;
+static ulong mcload_size;
+static uint mcload_blksize;
+static u32 mcload_blocks;
+static ulong *mcload_bitmap;
+/* All blocks before this one are stored (written, for UBI) */
+static u32 mcload_next;
+static uchar *mcload_buf;
+static ulong mcload_load_size;
+static int mcload_idle;
+static ulong mcload_hashes;
+static ulong mcload_time_start;
+static struct mcload_stats mcload_stats;
+
+int mcload_set_group(const char *group)
+{
+	const char *colon = strchr(group, ':');
+	char ip[16];
+
+	if (colon) {
+		if (colon - group >= sizeof(ip))
+			return -EINVAL;
+		strlcpy(ip, group, colon - group + 1);
+		mcload_port = dectoul(colon + 1, NULL);
+	} else {
+		strlcpy(ip, group, sizeof(ip));
+		mcload_port = MCLOAD_DEFAULT_PORT;
+	}
+	mcload_group = string_to_ip(ip);
+
+	/* 224.0.0.0/4 */
+	if ((ntohl(mcload_group.s_addr) >> 28) != 0xe || !mcload_port)
+		return -EINVAL;
+
+	return 0;
+}
+
+void mcload_set_blk(struct blk_desc *desc, lbaint_t start, lbaint_t end)
+{
+	mcload_blk_desc = desc;
+	mcload_blk_start = start;
+	mcload_blk_end = end;
+}
+
+void mcload_set_ubi(const char *volume)
+{
+	strlcpy(mcload_ubi_vol, volume ?: "", sizeof(mcload_ubi_vol));
+}
+
+const struct mcload_stats *mcload_get_stats(void)
+{
+	return &mcload_stats;
+}
+
+static bool mcload_test(u32 block)
+{
+	return mcload_bitmap[block / BITS_PER_LONG] & BIT(block % BITS_PER_LONG);
+}
+
+static void mcload_mark(u32 block)
+{
+	mcload_bitmap[block / BITS_PER_LONG] |= BIT(block % BITS_PER_LONG);
+}
+
+static uint mcload_block_len(u32 block)
+{
+	if (block == mcload_blocks - 1)
+		return mcload_size - (ulong)block * mcload_blksize;
+
+	return mcload_blksize;
+}
+
+/* Blocks which may be stored now: all of them, except for UBI */
+static u32 mcload_limit(void)
+{
+	if (mcload_ubi_vol[0])
+		return min_t(u32, mcload_blocks,
+			     mcload_next + MCLOAD_UBI_WINDOW);
+
+	return mcload_blocks;
+}
+
+/* Announce the group, so that switches snooping IGMP forward it to us */
+static void mcload_send_report(void)
+{
+	uchar *pkt = net_tx_packet;
+	struct ip_hdr *ip;
+	u8 mac[ARP_HLEN];
+	uchar *igmp;
+	int eth_len;
+
+	eth_mcast_ethaddr(mcload_group, mac);
+	eth_len = net_set_ether(pkt, mac, PROT_IP);
+	ip = (struct ip_hdr *)(pkt + eth_len);
+	net_set_ip_header((uchar *)ip, mcload_group, net_ip, IP_HDR_SIZE + 8,
+			  IPPROTO_IGMP);
+	ip->ip_ttl = 1;
+	ip->ip_sum = 0;
+	ip->ip_sum = compute_ip_checksum(ip, IP_HDR_SIZE);
+
+	igmp = (uchar *)ip + IP_HDR_SIZE;
+	igmp[0] = IGMP_V2_REPORT;
+	igmp[1] = 0;
+	*(u16 *)(igmp + 2) = 0;
+	net_copy_ip(igmp + 4, &mcload_group);
+	*(u16 *)(igmp + 2) = compute_ip_checksum(igmp, 8);
+
+	eth_send(pkt, eth_len + IP_HDR_SIZE + 8);
+}
+
+static void mcload_send(enum mcload_type type, uint nranges)
+{
+	struct mcload_hdr *hdr;
+
+	hdr = (void *)net_tx_packet + net_eth_hdr_size() + IP_UDP_HDR_SIZE;
+	hdr->magic = htonl(MCLOAD_MAGIC);
+	hdr->version = MCLOAD_VERSION;
+	hdr->type = type;
+	hdr->blksize = htons(mcload_blksize);
+	hdr->session = htonl(mcload_session);
+	hdr->size = htonl(mcload_size);
+	hdr->block = htonl(nranges);
+
+	net_send_udp_packet(mcload_sender_ethaddr, mcload_sender_ip,
+			    mcload_sender_port, mcload_port,
+			    sizeof(*hdr) +
+			    nranges * sizeof(struct mcload_range));
+}
+
+/* Report the first ranges of missing blocks which may be stored now */
+static void mcload_send_nak(void)
+{
+	struct mcload_range *range;
+	u32 limit = mcload_limit();
+	uint nranges = 0;
+	u32 block, first;
+
+	range = (void *)net_tx_packet + net_eth_hdr_size() + IP_UDP_HDR_SIZE +
+		sizeof(struct mcload_hdr);
+	block = mcload_next;
+	while (block < limit && nranges < MCLOAD_NAK_RANGES) {
+		if (mcload_test(block)) {
+			block++;
+			continue;
+		}
+		first = block;
+		while (block < limit && !mcload_test(block))
+			block++;
+		range[nranges].first = htonl(first);
+		range[nranges].count = htonl(block - first);
+		nranges++;
+	}
+	if (!nranges)
+		return;
+
+	mcload_send(MCLOAD_NAK, nranges);
+	mcload_stats.naks++;
+}
+
+static void mcload_cleanup(void)
+{
+	eth_mcast_join(mcload_group, 0);
+	net_mcast_addr.s_addr = 0;
+	free(mcload_bitmap);
+	mcload_bitmap = NULL;
+	free(mcload_buf);
+	mcload_buf = NULL;
+}
+
+static void mcload_fail(const char *msg, int err)
+{
+	printf("\nmcload: %s (err=%d)\n", msg, err);
+	mcload_cleanup();
+	net_set_state(NETLOOP_FAIL);
+}
+
+static void mcload_show_progress(void)
+{
+	ulong done = mcload_stats.blocks * mcload_blksize;
+
+	while (mcload_hashes < done / MCLOAD_HASH_BYTES) {
+		putc('#');
+		if (!(++mcload_hashes % HASHES_PER_LINE))
+			puts("\n\t ");
+	}
+}
+
+static int mcload_write_blk(u32 block, const uchar *data, uint len)
+{
+	struct blk_desc *desc = mcload_blk_desc;
+	lbaint_t count = DIV_ROUND_UP(len, desc->blksz);
+
+	memcpy(mcload_buf, data, len);
+	memset(mcload_buf + len, '\0', count * desc->blksz - len);
+	if (blk_dwrite(desc, mcload_blk_start +
+		       (lbaint_t)block * (mcload_blksize / desc->blksz),
+		       count, mcload_buf) != count)
+		return -EIO;
+
+	return 0;
+}
+
+/* Write the blocks which follow the last one written, wrapping the window */
+static int mcload_write_ubi(void)
+{
+#if IS_ENABLED(CONFIG_CMD_UBI)
+	u32 slot, run;
+	ulong len;
+	uchar *buf;
+	int ret;
+
+	while (mcload_next < mcload_blocks && mcload_test(mcload_next)) {
+		slot = mcload_next % MCLOAD_UBI_WINDOW;
+		for (run = 1; mcload_next + run < mcload_blocks &&
+		     slot + run < MCLOAD_UBI_WINDOW &&
+		     mcload_test(mcload_next + run); run++)
+			;
+		len = (ulong)(run - 1) * mcload_blksize +
+		      mcload_block_len(mcload_next + run - 1);
+		buf = mcload_buf + slot * mcload_blksize;
+		if (!mcload_next)
+			ret = ubi_volume_begin_write(mcload_ubi_vol, buf, len,
+						     mcload_size);
+		else
+			ret = ubi_volume_continue_write(mcload_ubi_vol, buf,
+							len);
+		if (ret)
+			return -EIO;
+		mcload_next += run;
+	}
+#endif
+	return 0;
+}
+
+static int mcload_store(u32 block, const uchar *data, uint len)
+{
+	ulong offset = (ulong)block * mcload_blksize;
+	void *ptr;
+	int ret;
+
+	if (block >= mcload_limit()) {
+		mcload_stats.discarded++;
+		return 0;
+	}
+
+	if (mcload_ubi_vol[0]) {
+		memcpy(mcload_buf + (block % MCLOAD_UBI_WINDOW) *
+		       mcload_blksize, data, len);
+		mcload_mark(block);
+		mcload_stats.blocks++;
+		return mcload_write_ubi();
+	}
+
+	if (mcload_blk_desc) {
+		ret = mcload_write_blk(block, data, len);
+		if (ret)
+			return ret;
+	} else {
+		ptr = map_sysmem(image_load_addr + offset, len);
+		memcpy(ptr, data, len);
+		unmap_sysmem(ptr);
+	}
+	mcload_mark(block);
+	mcload_stats.blocks++;
+	while (mcload_next < mcload_blocks && mcload_test(mcload_next))
+		mcload_next++;
+
+	return 0;
+}
+
+/* Set up the transfer from the first block received */
+static int mcload_begin(const struct mcload_hdr *hdr, struct in_addr sip,
+			unsigned int sport)
+{
+	struct blk_desc *desc = mcload_blk_desc;
+	uint bufsize;
+
+	mcload_session = ntohl(hdr->session);
+	mcload_size = ntohl(hdr->size);
+	mcload_blksize = ntohs(hdr->blksize);
+	if (!mcload_size || !mcload_blksize) {
+		mcload_fail("Invalid stream", -EINVAL);
+		return -EINVAL;
+	}
+	mcload_blocks = DIV_ROUND_UP(mcload_size, mcload_blksize);
+
+	bufsize = mcload_blksize;
+	if (mcload_ubi_vol[0]) {
+		bufsize = MCLOAD_UBI_WINDOW * mcload_blksize;
+	} else if (desc) {
+		if (mcload_blksize % desc->blksz ||
+		    mcload_blk_start +
+		    DIV_ROUND_UP(mcload_size, desc->blksz) > mcload_blk_end) {
+			mcload_fail("Block size or image size does not fit the partition",
+				    -EINVAL);
+			return -EINVAL;
+		}
+	} else {
+		bufsize = 0;
+		if (mcload_load_size && mcload_size > mcload_load_size) {
+			mcload_fail("Image too large for the memory", -E2BIG);
+			return -E2BIG;
+		}
+	}
+	mcload_bitmap = calloc(BITS_TO_LONGS(mcload_blocks), sizeof(ulong));
+	if (bufsize)
+		mcload_buf = malloc_cache_aligned(bufsize);
+	if (!mcload_bitmap || (bufsize && !mcload_buf)) {
+		mcload_fail("Out of memory", -ENOMEM);
+		return -ENOMEM;
+	}
+
+	mcload_sender_ip = sip;
+	mcload_sender_port = sport;
+	/* Reply through whoever sent the stream, the sender or a router */
+	memcpy(mcload_sender_ethaddr,
+	       ((struct ethernet_hdr *)net_rx_packet)->et_src, ARP_HLEN);
+	mcload_started = true;
+	mcload_time_start = get_timer(0);
+	printf("Image of %lu bytes in blocks of %u from %pI4:%u\n",
+	       mcload_size, mcload_blksize, &sip, sport);
+	puts("Loading: *\b");
+
+	return 0;
+}
+
+static void mcload_complete(void)
+{
+	ulong time;
+
+	time = get_timer(mcload_time_start);
+	if (time > 0) {
+		puts("\n\t ");	/* Line up with "Loading: " */
+		print_size(div_u64((u64)mcload_size * 1000, time), "/s");
+	}
+	puts("\ndone\n");
+	printf("Multicast: %lu blocks, %lu duplicate, %lu discarded, %lu NAKs, %lu timeouts\n",
+	       mcload_stats.blocks, mcload_stats.dup, mcload_stats.discarded,
+	       mcload_stats.naks, mcload_stats.timeouts);
+
+	mcload_send(MCLOAD_DONE, 0);
+	mcload_cleanup();
+	net_boot_file_size = mcload_size;
+	net_set_state(NETLOOP_SUCCESS);
+}
+
+static void mcload_timeout(void)
+{
+	if (!mcload_started) {
+		if (++mcload_idle >= MCLOAD_WAIT_MAX) {
+			mcload_fail("No stream received", -ETIMEDOUT);
+			return;
+		}
+		mcload_send_report();
+		net_set_timeout_handler(MCLOAD_WAIT_MS, mcload_timeout);
+		return;
+	}
+
+	mcload_stats.timeouts++;
+	if (++mcload_idle >= MCLOAD_IDLE_MAX) {
+		mcload_fail("Stream stopped", -ETIMEDOUT);
+		return;
+	}
+	mcload_send_nak();
+	net_set_timeout_handler(MCLOAD_NAK_MS + rand() % MCLOAD_NAK_JITTER_MS,
+				mcload_timeout);
+}
+
+static void mcload_pass_nak(void)
+{
+	mcload_send_nak();
+	net_set_timeout_handler(MCLOAD_NAK_MS + rand() % MCLOAD_NAK_JITTER_MS,
+				mcload_timeout);
+}
+
+/*
+ * After the last block, report what is missing without waiting long. All the
+ * boards see that block at once, so each still waits a random delay.
+ */
+static void mcload_pass_end(void)
+{
+	net_set_timeout_handler(1 + rand() % MCLOAD_NAK_JITTER_MS,
+				mcload_pass_nak);
+}
+
+static void mcload_handler(uchar *pkt, unsigned int dport,
+			   struct in_addr sip, unsigned int sport,
+			   unsigned int len)
+{
+	const struct mcload_hdr *hdr = (void *)pkt;
+	u32 block;
+	int ret;
+
+	if (dport != mcload_port || len < sizeof(*hdr) ||
+	    ntohl(hdr->magic) != MCLOAD_MAGIC ||
+	    hdr->version != MCLOAD_VERSION || hdr->type != MCLOAD_DATA)
+		return;
+
+	if (!mcload_started) {
+		if (mcload_begin(hdr, sip, sport))
+			return;
+	} else if (ntohl(hdr->session) != mcload_session) {
+		/* Another image sent to the same group */
+		return;
+	}
+
+	block = ntohl(hdr->block);
+	len -= sizeof(*hdr);
+	if (block >= mcload_blocks || len != mcload_block_len(block))
+		return;
+
+	if (mcload_test(block)) {
+		mcload_stats.dup++;
+	} else {
+		ret = mcload_store(block, pkt + sizeof(*hdr), len);
+		if (ret) {
+			mcload_fail("Write failed", ret);
+			return;
+		}
+		if (mcload_test(block))
+			mcload_idle = 0;
+		mcload_show_progress();
+	}
+
+	if (mcload_next == mcload_blocks) {
+		mcload_complete();
+		return;
+	}
+
+	if (block == mcload_blocks - 1)
+		mcload_pass_end();
+	else
+		net_set_timeout_handler(MCLOAD_NAK_MS +
+					rand() % MCLOAD_NAK_JITTER_MS,
+					mcload_timeout);
+}
+
+static int mcload_init_load_size(void)
+{
+#ifdef CONFIG_LMB
+	struct lmb lmb;
+
+	lmb_init_and_reserve(&lmb, gd->bd, (void *)gd->fdt_blob);
+	mcload_load_size = lmb_get_free_size(&lmb, image_load_addr);
+	if (!mcload_load_size)
+		return -ENOMEM;
+#else
+	mcload_load_size = 0;
+#endif
+
+	return 0;
+}
+
+void mcload_start(void)
+{
+	/* In case the last transfer was interrupted */
+	free(mcload_bitmap);
+	mcload_bitmap = NULL;
+	free(mcload_buf);
+	mcload_buf = NULL;
+
+	memset(&mcload_stats, '\0', sizeof(mcload_stats));
+	mcload_started = false;
+	mcload_next = 0;
+	mcload_idle = 0;
+	mcload_hashes = 0;
+
+	printf("Multicast group %pI4:%u; our IP address is %pI4\n",
+	       &mcload_group, mcload_port, &net_ip);
+	if (mcload_ubi_vol[0]) {
+		if (!IS_ENABLED(CONFIG_CMD_UBI)) {
+			mcload_fail("UBI is not supported", -ENOSYS);
+			return;
+		}
+		printf("Writing to UBI volume %s\n", mcload_ubi_vol);
+	} else if (mcload_blk_desc) {
+		printf("Writing to %s %d from block 0x" LBAF "\n",
+		       blk_get_if_type_name(mcload_blk_desc->if_type),
+		       mcload_blk_desc->devnum, mcload_blk_start);
+	} else {
+		if (mcload_init_load_size()) {
+			mcload_fail("Cannot load to this address", -ENOMEM);
+			return;
+		}
+		printf("Load address: 0x%lx\n", image_load_addr);
+	}
+
+	/* Boards started together still send their NAKs at different times */
+	srand_mac();
+	net_mcast_addr = mcload_group;
+	if (eth_mcast_join(mcload_group, 1))
+		debug("mcload: the device does not filter multicast\n");
+	mcload_send_report();
+
+	net_set_timeout_handler(MCLOAD_WAIT_MS, mcload_timeout);
+	net_set_udp_handler(mcload_handler);
+}
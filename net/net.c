@@ -78,6 +78,37 @@
  *	Prerequisites:	- own ethernet address
  *	We want:	- magic packet or timeout
  *	Next step:	none
+ *
+ * WGET:
+ *
+ *	Prerequisites:	- own ethernet address
+ *			- own IP address
+ *			- HTTP server IP address
+ *	We want:	- load the file over a TCP connection
+ *	Next step:	none
+ *
+ * MCLOAD:
+ *
+ *	Prerequisites:	- own ethernet address
+ *			- own IP address
+ *			- multicast group of the image
+ *	We want:	- receive the image sent to the group
+ *	Next step:	none
+ *
+ * BENCH:
+ *
+ *	Prerequisites:	- own ethernet address
+ *			- own IP address
+ *	We want:	- count the packets sent to us, or send packets
+ *	Next step:	none
+ *
+ * TFTPMULTI:
+ *
+ *	Prerequisites:	- own ethernet address
+ *			- own IP address
+ *			- TFTP server IP address
+ *	We want:	- load several files at once
+ *	Next step:	none
  */
 
 
@@ -92,11 +123,15 @@
 #include <log.h>
 #include <net.h>
 #include <net/fastboot.h>
+#include <net/bench.h>
+#include <net/mcload.h>
 #include <net/tftp.h>
 #if defined(CONFIG_CMD_PCAP)
 #include <net/pcap.h>
 #endif
+#include <net/tcp.h>
 #include <net/udp.h>
+#include <net/wget.h>
 #if defined(CONFIG_LED_STATUS)
 #include <miiphy.h>
 #include <status_led.h>
@@ -136,10 +171,17 @@ struct in_addr net_dns_server2;
 u8 net_ethaddr[6];
 /* Boot server enet address */
 u8 net_server_ethaddr[6];
+/* Server enet address kept from the last transfer, and what it was for */
+static u8 net_known_server_ethaddr[ARP_HLEN];
+static struct in_addr net_known_server_ip;
+static struct in_addr net_known_gateway;
+static u8 net_known_ethaddr[ARP_HLEN];
 /* Our IP addr (0 = unknown) */
 struct in_addr	net_ip;
 /* Server IP addr (0 = unknown) */
 struct in_addr	net_server_ip;
+/* Multicast group accepted besides net_ip (0 = none) */
+struct in_addr	net_mcast_addr;
 /* Current receive packet */
 uchar *net_rx_packet;
 /* Current rx packet length */
@@ -526,6 +568,26 @@ restart:
 		case WOL:
 			wol_start();
 			break;
+#endif
+#if defined(CONFIG_CMD_WGET)
+		case WGET:
+			wget_start();
+			break;
+#endif
+#if defined(CONFIG_CMD_MCLOAD)
+		case MCLOAD:
+			mcload_start();
+			break;
+#endif
+#if defined(CONFIG_CMD_NET_BENCH)
+		case BENCH:
+			net_bench_start();
+			break;
+#endif
+#if defined(CONFIG_TFTP_MULTI)
+		case TFTPMULTI:
+			tftp_multi_start();
+			break;
 #endif
 		default:
 			break;
@@ -801,6 +863,36 @@ void net_set_timeout_handler(ulong iv, thand_f *f)
 	}
 }
 
+void net_server_ether_restore(struct in_addr server)
+{
+	if (is_valid_ethaddr(net_known_server_ethaddr) &&
+	    server.s_addr == net_known_server_ip.s_addr &&
+	    net_gateway.s_addr == net_known_gateway.s_addr &&
+	    !memcmp(net_ethaddr, net_known_ethaddr, ARP_HLEN))
+		memcpy(net_server_ethaddr, net_known_server_ethaddr, ARP_HLEN);
+	else
+		memset(net_server_ethaddr, '\0', ARP_HLEN);
+}
+
+void net_server_ether_save(struct in_addr server)
+{
+	if (!is_valid_ethaddr(net_server_ethaddr))
+		return;
+
+	memcpy(net_known_server_ethaddr, net_server_ethaddr, ARP_HLEN);
+	net_known_server_ip = server;
+	net_known_gateway = net_gateway;
+	memcpy(net_known_ethaddr, net_ethaddr, ARP_HLEN);
+#if defined(CONFIG_DHCP_LEASE_CACHE)
+	dhcp_lease_save(server, net_server_ethaddr);
+#endif
+}
+
+void net_server_ether_forget(void)
+{
+	memset(net_known_server_ethaddr, '\0', ARP_HLEN);
+}
+
 uchar *net_get_async_tx_pkt_buf(void)
 {
 	if (arp_is_waiting())
@@ -847,6 +939,14 @@ int net_send_ip_packet(uchar *ether, struct in_addr dest, int dport, int sport,
 				   payload_len);
 		pkt_hdr_size = eth_hdr_size + IP_UDP_HDR_SIZE;
 		break;
+#if defined(CONFIG_PROT_TCP)
+	case IPPROTO_TCP:
+		pkt_hdr_size = eth_hdr_size +
+			tcp_set_tcp_header(pkt + eth_hdr_size, dest, dport,
+					   sport, payload_len, action,
+					   tcp_seq_num, tcp_ack_num);
+		break;
+#endif
 	default:
 		return -EINVAL;
 	}
@@ -880,6 +980,12 @@ int net_send_ip_packet(uchar *ether, struct in_addr dest, int dport, int sport,
  * This function collects fragments in a single packet, according
  * to the algorithm in RFC815. It returns NULL or the pointer to
  * a complete packet, in static storage
+ *
+ * Up to CONFIG_NET_DEFRAG_SLOTS datagrams are reassembled at once, so that
+ * the fragments of several large replies (a TFTP window, NFS READs in
+ * flight) may come interleaved. A datagram whose fragments stopped coming
+ * is dropped after CONFIG_NET_DEFRAG_TIMEOUT ms, or earlier when its slot
+ * is the oldest one and a new datagram needs it.
  */
 #define IP_PKTSIZE (CONFIG_NET_MAXDEFRAG)
 
@@ -897,37 +1003,120 @@ struct hole {
 	u16 unused;
 };
 
+/**
+ * struct ip_defrag - A datagram being reassembled
+ *
+ * @pkt_buff: IP header of the first fragment received, then the payload,
+ *	whose holes hold the hole list
+ * @first_hole: index of the first hole in the payload, in 8-byte units
+ * @total_len: length of the payload, 0xffff until the last fragment came
+ * @in_use: the slot holds a datagram being reassembled
+ * @time: get_timer() value when the last fragment came
+ */
+struct ip_defrag {
+	uchar pkt_buff[IP_PKTSIZE] __aligned(PKTALIGN);
+	u16 first_hole;
+	u16 total_len;
+	bool in_use;
+	ulong time;
+};
+
+static struct ip_defrag ip_defrag[CONFIG_NET_DEFRAG_SLOTS];
+static struct net_defrag_stats ip_defrag_stats;
+
+const struct net_defrag_stats *net_defrag_get_stats(void)
+{
+	return &ip_defrag_stats;
+}
+
+void net_defrag_reset_stats(void)
+{
+	memset(&ip_defrag_stats, '\0', sizeof(ip_defrag_stats));
+}
+
+/* Fragments belong to the same datagram if these match (RFC 791) */
+static bool ip_defrag_match(struct ip_udp_hdr *a, struct ip_udp_hdr *b)
+{
+	return a->ip_id == b->ip_id && a->ip_p == b->ip_p &&
+	       !memcmp(&a->ip_src, &b->ip_src, sizeof(a->ip_src)) &&
+	       !memcmp(&a->ip_dst, &b->ip_dst, sizeof(a->ip_dst));
+}
+
+/* Find the datagram of this fragment, or set up a slot for it */
+static struct ip_defrag *ip_defrag_get(struct ip_udp_hdr *ip)
+{
+	struct ip_defrag *slot, *free = NULL, *oldest = NULL;
+	ulong now = get_timer(0);
+	struct hole *payload;
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(ip_defrag); i++) {
+		slot = &ip_defrag[i];
+		if (slot->in_use &&
+		    now - slot->time > CONFIG_NET_DEFRAG_TIMEOUT) {
+			slot->in_use = false;
+			ip_defrag_stats.timeouts++;
+		}
+		if (!slot->in_use) {
+			if (!free)
+				free = slot;
+			continue;
+		}
+		if (ip_defrag_match((struct ip_udp_hdr *)slot->pkt_buff, ip)) {
+			slot->time = now;
+			return slot;
+		}
+		if (!oldest || slot->time < oldest->time)
+			oldest = slot;
+	}
+
+	slot = free;
+	if (!slot) {
+		slot = oldest;
+		ip_defrag_stats.evicted++;
+	}
+
+	/* new packet, reset structs */
+	payload = (struct hole *)(slot->pkt_buff + IP_HDR_SIZE);
+	slot->total_len = 0xffff;
+	payload[0].last_byte = ~0;
+	payload[0].next_hole = 0;
+	payload[0].prev_hole = 0;
+	slot->first_hole = 0;
+	/* any IP header will work, copy the first we received */
+	memcpy(slot->pkt_buff, ip, IP_HDR_SIZE);
+	slot->in_use = true;
+	slot->time = now;
+
+	return slot;
+}
+
 static struct ip_udp_hdr *__net_defragment(struct ip_udp_hdr *ip, int *lenp)
 {
-	static uchar pkt_buff[IP_PKTSIZE] __aligned(PKTALIGN);
-	static u16 first_hole, total_len;
 	struct hole *payload, *thisfrag, *h, *newh;
-	struct ip_udp_hdr *localip = (struct ip_udp_hdr *)pkt_buff;
+	struct ip_udp_hdr *localip;
+	struct ip_defrag *slot;
 	uchar *indata = (uchar *)ip;
 	int offset8, start, len, done = 0;
+	bool first;
 	u16 ip_off = ntohs(ip->ip_off);
 
-	/* payload starts after IP header, this fragment is in there */
-	payload = (struct hole *)(pkt_buff + IP_HDR_SIZE);
+	ip_defrag_stats.fragments++;
 	offset8 =  (ip_off & IP_OFFS);
-	thisfrag = payload + offset8;
 	start = offset8 * 8;
 	len = ntohs(ip->ip_len) - IP_HDR_SIZE;
 
-	if (start + len > IP_MAXUDP) /* fragment extends too far */
+	if (start + len > IP_MAXUDP) { /* fragment extends too far */
+		ip_defrag_stats.dropped++;
 		return NULL;
-
-	if (!total_len || localip->ip_id != ip->ip_id) {
-		/* new (or different) packet, reset structs */
-		total_len = 0xffff;
-		payload[0].last_byte = ~0;
-		payload[0].next_hole = 0;
-		payload[0].prev_hole = 0;
-		first_hole = 0;
-		/* any IP header will work, copy the first we received */
-		memcpy(localip, ip, IP_HDR_SIZE);
 	}
 
+	slot = ip_defrag_get(ip);
+	localip = (struct ip_udp_hdr *)slot->pkt_buff;
+	/* payload starts after IP header, this fragment is in there */
+	payload = (struct hole *)(slot->pkt_buff + IP_HDR_SIZE);
+	thisfrag = payload + offset8;
+
 	/*
 	 * What follows is the reassembly algorithm. We use the payload
 	 * array as a linked list of hole descriptors, as each hole starts
@@ -935,24 +1124,31 @@ static struct ip_udp_hdr *__net_defragment(struct ip_udp_hdr *ip, int *lenp)
 	 * so it is represented as byte count, not as 8-byte blocks.
 	 */
 
-	h = payload + first_hole;
+	h = payload + slot->first_hole;
 	while (h->last_byte < start) {
 		if (!h->next_hole) {
 			/* no hole that far away */
+			ip_defrag_stats.dropped++;
 			return NULL;
 		}
 		h = payload + h->next_hole;
 	}
+	/*
+	 * A prev_hole of 0 may also point to a hole at the start of the
+	 * payload, so rather tell the first hole by its index
+	 */
+	first = h - payload == slot->first_hole;
 
 	/* last fragment may be 1..7 bytes, the "+7" forces acceptance */
 	if (offset8 + ((len + 7) / 8) <= h - payload) {
 		/* no overlap with holes (dup fragment?) */
+		ip_defrag_stats.dropped++;
 		return NULL;
 	}
 
 	if (!(ip_off & IP_FLAGS_MFRAG)) {
 		/* no more fragmentss: truncate this (last) hole */
-		total_len = start + len;
+		slot->total_len = start + len;
 		h->last_byte = start + len;
 	}
 
@@ -964,12 +1160,12 @@ static struct ip_udp_hdr *__net_defragment(struct ip_udp_hdr *ip, int *lenp)
 
 	if ((h >= thisfrag) && (h->last_byte <= start + len)) {
 		/* complete overlap with hole: remove hole */
-		if (!h->prev_hole && !h->next_hole) {
+		if (first && !h->next_hole) {
 			/* last remaining hole */
 			done = 1;
-		} else if (!h->prev_hole) {
+		} else if (first) {
 			/* first hole */
-			first_hole = h->next_hole;
+			slot->first_hole = h->next_hole;
 			payload[h->next_hole].prev_hole = 0;
 		} else if (!h->next_hole) {
 			/* last hole */
@@ -991,10 +1187,10 @@ static struct ip_udp_hdr *__net_defragment(struct ip_udp_hdr *ip, int *lenp)
 		h = newh;
 		if (h->next_hole)
 			payload[h->next_hole].prev_hole = (h - payload);
-		if (h->prev_hole)
+		if (!first)
 			payload[h->prev_hole].next_hole = (h - payload);
 		else
-			first_hole = (h - payload);
+			slot->first_hole = (h - payload);
 
 	} else {
 		/* fragment sits in the middle: split the hole */
@@ -1012,8 +1208,14 @@ static struct ip_udp_hdr *__net_defragment(struct ip_udp_hdr *ip, int *lenp)
 	if (!done)
 		return NULL;
 
-	localip->ip_len = htons(total_len);
-	*lenp = total_len + IP_HDR_SIZE;
+	localip->ip_len = htons(slot->total_len);
+	*lenp = slot->total_len + IP_HDR_SIZE;
+	/*
+	 * A later datagram reusing this ID must not be merged into this one;
+	 * the data stays there until a new datagram needs the slot.
+	 */
+	slot->in_use = false;
+	ip_defrag_stats.datagrams++;
 	return localip;
 }
 
@@ -1216,7 +1418,9 @@ void net_process_received_packet(uchar *in_packet, int len)
 		/* If it is not for us, ignore it */
 		dst_ip = net_read_ip(&ip->ip_dst);
 		if (net_ip.s_addr && dst_ip.s_addr != net_ip.s_addr &&
-		    dst_ip.s_addr != 0xFFFFFFFF) {
+		    dst_ip.s_addr != 0xFFFFFFFF &&
+		    (!net_mcast_addr.s_addr ||
+		     dst_ip.s_addr != net_mcast_addr.s_addr)) {
 				return;
 		}
 		/* Read source IP address for later use */
@@ -1253,6 +1457,11 @@ void net_process_received_packet(uchar *in_packet, int len)
 		if (ip->ip_p == IPPROTO_ICMP) {
 			receive_icmp(ip, len, src_ip, et);
 			return;
+#if defined(CONFIG_PROT_TCP)
+		} else if (ip->ip_p == IPPROTO_TCP) {
+			tcp_receive((struct ip_tcp_hdr *)ip, len);
+			return;
+#endif
 		} else if (ip->ip_p != IPPROTO_UDP) {	/* Only UDP packets */
 			return;
 		}
@@ -1359,6 +1568,7 @@ static int net_check_prereq(enum proto_t protocol)
 		/* Fall through */
 	case TFTPGET:
 	case TFTPPUT:
+	case TFTPMULTI:
 		if (net_server_ip.s_addr == 0 && !is_serverip_in_cmd()) {
 			puts("*** ERROR: `serverip' not set\n");
 			return 1;
@@ -1372,6 +1582,9 @@ common:
 	case NETCONS:
 	case FASTBOOT:
 	case TFTPSRV:
+	case WGET:
+	case MCLOAD:
+	case BENCH:
 		if (net_ip.s_addr == 0) {
 			puts("*** ERROR: `ipaddr' not set\n");
 			return 1;
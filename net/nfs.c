@@ -37,6 +37,7 @@
 #include "nfs.h"
 #include "bootp.h"
 #include <time.h>
+#include <linux/log2.h>
 
 #define HASHES_PER_LINE 65	/* Number of "loading" hashes per line	*/
 #define NFS_RETRY_COUNT 30
@@ -49,12 +50,41 @@
 #define NFS_RPC_ERR	1
 #define NFS_RPC_DROP	124
 
+/* Largest READ whose reply fits in a datagram, reassembled if need be */
+#ifdef CONFIG_IP_DEFRAG
+#define NFS_READ_MAX	max_t(uint, NFS_READ_SIZE, CONFIG_NET_MAXDEFRAG - \
+			      IP_UDP_HDR_SIZE - NFS_READ_HDR_SIZE)
+#else
+#define NFS_READ_MAX	NFS_READ_SIZE
+#endif
+
+/* Bytes loaded per '#' of the progress bar */
+#define NFS_HASH_BYTES	(NFS_READ_SIZE / 2 * 10)
+
+/**
+ * struct nfs_read - READ request in flight
+ *
+ * @xid: transaction ID the reply carries, 0 if the slot is free
+ * @offset: offset of the data asked for in the file
+ * @len: number of bytes asked for
+ */
+struct nfs_read {
+	ulong xid;
+	uint offset;
+	uint len;
+};
+
 static int fs_mounted;
 static unsigned long rpc_id;
-static int nfs_offset = -1;
-static int nfs_len;
 static ulong nfs_timeout = NFS_TIMEOUT;
 
+static struct nfs_read nfs_reads[CONFIG_NFS_READ_WINDOW];
+static uint nfs_read_size;	/* bytes asked for by each READ */
+static uint nfs_read_next;	/* offset of the next READ to issue */
+static uint nfs_read_end;	/* size of the file, UINT_MAX until known */
+static ulong nfs_read_bytes;	/* bytes loaded, for the progress bar */
+static ulong nfs_hashes;
+
 static char dirfh[NFS_FHSIZE];	/* NFSv2 / NFSv3 file handle of directory */
 static char filefh[NFS3_FHSIZE]; /* NFSv2 / NFSv3 file handle */
 static int filefh3_length;	/* (variable) length of filefh when NFSv3 */
@@ -73,6 +103,7 @@ static int nfs_state;
 #define STATE_LOOKUP_REQ		5
 #define STATE_READ_REQ			6
 #define STATE_READLINK_REQ		7
+#define STATE_FSINFO_REQ		8
 
 static char *nfs_filename;
 static char *nfs_path;
@@ -175,15 +206,14 @@ static uint32_t *rpc_add_credentials(uint32_t *p)
 /**************************************************************************
 RPC_LOOKUP - Lookup RPC Port numbers
 **************************************************************************/
-static void rpc_req(int rpc_prog, int rpc_proc, uint32_t *data, int datalen)
+static void rpc_send_call(unsigned long id, int rpc_prog, int rpc_proc,
+			  uint32_t *data, int datalen)
 {
 	struct rpc_t rpc_pkt;
-	unsigned long id;
 	uint32_t *p;
 	int pktlen;
 	int sport;
 
-	id = ++rpc_id;
 	rpc_pkt.u.call.id = htonl(id);
 	rpc_pkt.u.call.type = htonl(MSG_CALL);
 	rpc_pkt.u.call.rpcvers = htonl(2);	/* use RPC version 2 */
@@ -222,6 +252,11 @@ static void rpc_req(int rpc_prog, int rpc_proc, uint32_t *data, int datalen)
 			    nfs_our_port, pktlen);
 }
 
+static void rpc_req(int rpc_prog, int rpc_proc, uint32_t *data, int datalen)
+{
+	rpc_send_call(++rpc_id, rpc_prog, rpc_proc, data, datalen);
+}
+
 /**************************************************************************
 RPC_LOOKUP - Lookup RPC Port numbers
 **************************************************************************/
@@ -358,10 +393,31 @@ static void nfs_lookup_req(char *fname)
 	}
 }
 
+/**************************************************************************
+NFS3_FSINFO - Get the largest READ the server accepts
+**************************************************************************/
+static void nfs3_fsinfo_req(void)
+{
+	uint32_t data[1024];
+	uint32_t *p;
+	int len;
+
+	p = &(data[0]);
+	p = rpc_add_credentials(p);
+
+	*p++ = htonl(filefh3_length);
+	memcpy(p, filefh, filefh3_length);
+	p += (filefh3_length / 4);
+
+	len = (uint32_t *)p - (uint32_t *)&(data[0]);
+
+	rpc_req(PROG_NFS, NFS3PROC_FSINFO, data, len);
+}
+
 /**************************************************************************
 NFS_READ - Read File on NFS Server
 **************************************************************************/
-static void nfs_read_req(int offset, int readlen)
+static void nfs_read_req(struct nfs_read *rd)
 {
 	uint32_t data[1024];
 	uint32_t *p;
@@ -373,22 +429,119 @@ static void nfs_read_req(int offset, int readlen)
 	if (supported_nfs_versions & NFSV2_FLAG) {
 		memcpy(p, filefh, NFS_FHSIZE);
 		p += (NFS_FHSIZE / 4);
-		*p++ = htonl(offset);
-		*p++ = htonl(readlen);
+		*p++ = htonl(rd->offset);
+		*p++ = htonl(rd->len);
 		*p++ = 0;
 	} else { /* NFSV3_FLAG */
 		*p++ = htonl(filefh3_length);
 		memcpy(p, filefh, filefh3_length);
 		p += (filefh3_length / 4);
 		*p++ = htonl(0); /* offset is 64-bit long, so fill with 0 */
-		*p++ = htonl(offset);
-		*p++ = htonl(readlen);
+		*p++ = htonl(rd->offset);
+		*p++ = htonl(rd->len);
 		*p++ = 0;
 	}
 
 	len = (uint32_t *)p - (uint32_t *)&(data[0]);
 
-	rpc_req(PROG_NFS, NFS_READ, data, len);
+	/* A retransmission keeps its XID, so a late reply still matches */
+	rpc_send_call(rd->xid, PROG_NFS, NFS_READ, data, len);
+}
+
+static void nfs_read_issue(struct nfs_read *rd, uint offset, uint len)
+{
+	rd->xid = ++rpc_id;
+	rd->offset = offset;
+	rd->len = len;
+	nfs_read_req(rd);
+}
+
+/* Keep the window full of READs until the end of the file is reached */
+static int nfs_read_fill(void)
+{
+	int busy = 0;
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(nfs_reads); i++) {
+		struct nfs_read *rd = &nfs_reads[i];
+
+		if (!rd->xid && nfs_read_next < nfs_read_end) {
+			nfs_read_issue(rd, nfs_read_next, nfs_read_size);
+			nfs_read_next += nfs_read_size;
+		}
+		if (rd->xid)
+			busy++;
+	}
+
+	return busy;
+}
+
+static void nfs_read_resend(void)
+{
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(nfs_reads); i++) {
+		if (nfs_reads[i].xid)
+			nfs_read_req(&nfs_reads[i]);
+	}
+}
+
+static void nfs_read_start(uint size)
+{
+	memset(nfs_reads, 0, sizeof(nfs_reads));
+	nfs_read_size = size;
+	nfs_read_next = 0;
+	nfs_read_end = UINT_MAX;
+	nfs_read_bytes = 0;
+	nfs_hashes = 0;
+	debug("NFS: reading by %u bytes, %d in flight\n", size,
+	      CONFIG_NFS_READ_WINDOW);
+
+	nfs_state = STATE_READ_REQ;
+	nfs_read_fill();
+}
+
+/* Largest power of two we can read, when the server reads up to @max */
+static uint nfs_read_size_max(uint max)
+{
+	return rounddown_pow_of_two(min_t(uint, max, NFS_READ_MAX));
+}
+
+static struct nfs_read *nfs_read_find(ulong xid)
+{
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(nfs_reads); i++) {
+		if (nfs_reads[i].xid && nfs_reads[i].xid == xid)
+			return &nfs_reads[i];
+	}
+
+	return NULL;
+}
+
+/* The file ends at @end: forget about the READs beyond */
+static void nfs_read_set_end(uint end)
+{
+	int i;
+
+	if (end >= nfs_read_end)
+		return;
+	nfs_read_end = end;
+	for (i = 0; i < ARRAY_SIZE(nfs_reads); i++) {
+		if (nfs_reads[i].offset >= end)
+			nfs_reads[i].xid = 0;
+	}
+}
+
+static void nfs_show_progress(uint len)
+{
+	nfs_read_bytes += len;
+	while (nfs_hashes < nfs_read_bytes / NFS_HASH_BYTES) {
+		if (nfs_hashes && !(nfs_hashes % HASHES_PER_LINE))
+			puts("\n\t ");
+		putc('#');
+		nfs_hashes++;
+	}
 }
 
 /**************************************************************************
@@ -421,11 +574,14 @@ static void nfs_send(void)
 		nfs_lookup_req(nfs_filename);
 		break;
 	case STATE_READ_REQ:
-		nfs_read_req(nfs_offset, nfs_len);
+		nfs_read_resend();
 		break;
 	case STATE_READLINK_REQ:
 		nfs_readlink_req();
 		break;
+	case STATE_FSINFO_REQ:
+		nfs3_fsinfo_req();
+		break;
 	}
 }
 
@@ -664,21 +820,53 @@ static int nfs_readlink_reply(uchar *pkt, unsigned len)
 	return 0;
 }
 
-static int nfs_read_reply(uchar *pkt, unsigned len)
+static int nfs3_fsinfo_reply(uchar *pkt, unsigned len)
 {
 	struct rpc_t rpc_pkt;
-	int rlen;
-	uchar *data_ptr;
+	int nfsv3_data_offset;
 
 	debug("%s\n", __func__);
 
-	memcpy(&rpc_pkt.u.data[0], pkt, sizeof(rpc_pkt.u.reply));
+	memcpy(&rpc_pkt.u.data[0], pkt, len);
 
 	if (ntohl(rpc_pkt.u.reply.id) > rpc_id)
 		return -NFS_RPC_ERR;
 	else if (ntohl(rpc_pkt.u.reply.id) < rpc_id)
 		return -NFS_RPC_DROP;
 
+	if (rpc_pkt.u.reply.rstatus  ||
+	    rpc_pkt.u.reply.verifier ||
+	    rpc_pkt.u.reply.astatus  ||
+	    rpc_pkt.u.reply.data[0])
+		return -1;
+
+	nfsv3_data_offset = nfs3_get_attributes_offset(rpc_pkt.u.reply.data);
+
+	/* rtmax */
+	return ntohl(rpc_pkt.u.reply.data[1 + nfsv3_data_offset]);
+}
+
+/*
+ * Replies are matched to their READ by XID and stored at the offset it asked
+ * for, so they may come back in any order. Only the RPC and NFS headers are
+ * copied out of the packet: the data is stored straight from it.
+ */
+static int nfs_read_reply(uchar *pkt, unsigned len)
+{
+	struct rpc_t rpc_pkt;
+	struct nfs_read *rd;
+	bool eof = false;
+	int rlen;
+	int data_offset;
+
+	debug("%s\n", __func__);
+
+	memcpy(&rpc_pkt.u.data[0], pkt, min_t(uint, len, sizeof(rpc_pkt)));
+
+	rd = nfs_read_find(ntohl(rpc_pkt.u.reply.id));
+	if (!rd)
+		return -NFS_RPC_DROP;
+
 	if (rpc_pkt.u.reply.rstatus  ||
 	    rpc_pkt.u.reply.verifier ||
 	    rpc_pkt.u.reply.astatus  ||
@@ -690,34 +878,43 @@ static int nfs_read_reply(uchar *pkt, unsigned len)
 		return -ntohl(rpc_pkt.u.reply.data[0]);
 	}
 
-	if ((nfs_offset != 0) && !((nfs_offset) %
-			(NFS_READ_SIZE / 2 * 10 * HASHES_PER_LINE)))
-		puts("\n\t ");
-	if (!(nfs_offset % ((NFS_READ_SIZE / 2) * 10)))
-		putc('#');
-
 	if (supported_nfs_versions & NFSV2_FLAG) {
+		/* file size from the attributes */
+		nfs_read_set_end(ntohl(rpc_pkt.u.reply.data[6]));
 		rlen = ntohl(rpc_pkt.u.reply.data[18]);
-		data_ptr = (uchar *)&(rpc_pkt.u.reply.data[19]);
+		data_offset = (uchar *)&(rpc_pkt.u.reply.data[19]) -
+			      (uchar *)&rpc_pkt;
 	} else {  /* NFSV3_FLAG */
 		int nfsv3_data_offset =
 			nfs3_get_attributes_offset(rpc_pkt.u.reply.data);
 
 		/* count value */
 		rlen = ntohl(rpc_pkt.u.reply.data[1 + nfsv3_data_offset]);
+		eof = rpc_pkt.u.reply.data[2 + nfsv3_data_offset];
 		/* Skip unused values :
-			EOF:		32 bits value,
 			data_size:	32 bits value,
 		*/
-		data_ptr = (uchar *)
-			&(rpc_pkt.u.reply.data[4 + nfsv3_data_offset]);
+		data_offset = (uchar *)
+			&(rpc_pkt.u.reply.data[4 + nfsv3_data_offset]) -
+			(uchar *)&rpc_pkt;
 	}
 
-	if (((uchar *)&(rpc_pkt.u.reply.data[0]) - (uchar *)(&rpc_pkt) + rlen) > len)
-			return -9999;
+	if (rlen > rd->len || data_offset + rlen > len)
+		return -9999;
 
-	if (store_block(data_ptr, nfs_offset, rlen))
-			return -9999;
+	if (store_block(pkt + data_offset, rd->offset, rlen))
+		return -9999;
+	nfs_show_progress(rlen);
+
+	if (eof || !rlen)
+		nfs_read_set_end(rd->offset + rlen);
+
+	/* Ask again for the rest of a short read before the end of file */
+	if (rd->xid && rlen &&
+	    rd->offset + rlen < min(rd->offset + rd->len, nfs_read_end))
+		nfs_read_issue(rd, rd->offset + rlen, rd->len - rlen);
+	else
+		rd->xid = 0;
 
 	return rlen;
 }
@@ -747,7 +944,10 @@ static void nfs_handler(uchar *pkt, unsigned dest, struct in_addr sip,
 
 	debug("%s\n", __func__);
 
-	if (len > sizeof(struct rpc_t))
+	/* READ replies only have their headers copied to a struct rpc_t */
+	if (len > sizeof(struct rpc_t) &&
+	    (nfs_state != STATE_READ_REQ ||
+	     len > NFS_READ_HDR_SIZE + nfs_read_size))
 		return;
 
 	if (dest != nfs_our_port)
@@ -812,14 +1012,26 @@ static void nfs_handler(uchar *pkt, unsigned dest, struct in_addr sip,
 			/* And retry with another supported version */
 			nfs_state = STATE_PRCLOOKUP_PROG_MOUNT_REQ;
 			nfs_send();
-		} else {
-			nfs_state = STATE_READ_REQ;
-			nfs_offset = 0;
-			nfs_len = NFS_READ_SIZE;
+		} else if (supported_nfs_versions & NFSV2_FLAG) {
+			nfs_read_start(nfs_read_size_max(NFS_MAXDATA));
+		} else if (NFS_READ_MAX > NFS_READ_SIZE) {
+			/* See how much larger than the default reads can be */
+			nfs_state = STATE_FSINFO_REQ;
 			nfs_send();
+		} else {
+			nfs_read_start(NFS_READ_SIZE);
 		}
 		break;
 
+	case STATE_FSINFO_REQ:
+		reply = nfs3_fsinfo_reply(pkt, len);
+		if (reply == -NFS_RPC_DROP)
+			break;
+		/* Keep the default if the server cannot tell */
+		nfs_read_start(reply > 0 ? nfs_read_size_max(reply) :
+			       NFS_READ_SIZE);
+		break;
+
 	case STATE_READLINK_REQ:
 		reply = nfs_readlink_reply(pkt, len);
 		if (reply == -NFS_RPC_DROP) {
@@ -843,18 +1055,18 @@ static void nfs_handler(uchar *pkt, unsigned dest, struct in_addr sip,
 		if (rlen == -NFS_RPC_DROP)
 			break;
 		net_set_timeout_handler(nfs_timeout, nfs_timeout_handler);
-		if (rlen > 0) {
-			nfs_offset += rlen;
+		if (rlen >= 0) {
+			if (nfs_read_fill())
+				break;
+			nfs_download_state = NETLOOP_SUCCESS;
+			nfs_state = STATE_UMOUNT_REQ;
 			nfs_send();
 		} else if ((rlen == -NFSERR_ISDIR) || (rlen == -NFSERR_INVAL)) {
 			/* symbolic link */
 			nfs_state = STATE_READLINK_REQ;
 			nfs_send();
 		} else {
-			if (!rlen)
-				nfs_download_state = NETLOOP_SUCCESS;
-			if (rlen < 0)
-				debug("NFS READ error (%d)\n", rlen);
+			debug("NFS READ error (%d)\n", rlen);
 			nfs_state = STATE_UMOUNT_REQ;
 			nfs_send();
 		}
@@ -25,6 +25,7 @@
 #define NFS_READ        6
 
 #define NFS3PROC_LOOKUP 3
+#define NFS3PROC_FSINFO 19
 
 #define NFS_FHSIZE      32
 #define NFS3_FHSIZE     64
@@ -43,6 +44,10 @@
  */
 #define NFS_READ_SIZE	1024	/* biggest power of two that fits Ether frame */
 #define NFS_MAX_ATTRS	26
+#define NFS_MAXDATA	8192	/* largest NFSv2 READ */
+
+/* RPC and NFS headers of a READ reply, in front of the data */
+#define NFS_READ_HDR_SIZE	((6 + NFS_MAX_ATTRS) * sizeof(uint32_t))
 
 /* Values for Accept State flag on RPC answers (See: rfc1831) */
 enum rpc_accept_stat {
@@ -0,0 +1,707 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * Minimal TCP client for the network loop
+ *
+ * There is one connection at a time, opened by a protocol such as wget from
+ * its start function. Received data is handed to the user as soon as it is in
+ * order, so the receive window stays open at its configured size and, with
+ * window scaling, a server can keep a whole bandwidth-delay product in flight.
+ * Only near the end of the room the user has left does the window close.
+ *
+ * There is no SACK. Segments arriving after a gap are queued and answered
+ * straight away with duplicate ACKs so that the server does a fast retransmit
+ * of the missing segment instead of waiting for its retransmission timeout;
+ * the queued data is then delivered at once. Our own (small) amount of data
+ * is retransmitted after three duplicate ACKs or on the RFC 6298 timer.
+ */
+
+#include <common.h>
+#include <log.h>
+#include <malloc.h>
+#include <net.h>
+#include <time.h>
+#include <net/tcp.h>
+
+/* Period of the TCP timer, which also bounds the delay of an ACK */
+#define TCP_TICK_MS		20
+/* Initial, minimum and maximum retransmission timeout in ms */
+#define TCP_RTO_INIT		1000
+#define TCP_RTO_MIN		200
+#define TCP_RTO_MAX		8000
+/* Retransmissions of a segment before giving up */
+#define TCP_MAX_RETRIES		8
+/* Time in ms without any segment from the peer before giving up */
+#define TCP_IDLE_TIMEOUT	30000
+/* Time in ms to wait for the FIN of the peer once ours was acknowledged */
+#define TCP_FIN_TIMEOUT		1000
+/* Duplicate ACKs which trigger a fast retransmit (RFC 5681) */
+#define TCP_DUPACK_THRESH	3
+/* Data segments received before an ACK is sent (RFC 1122) */
+#define TCP_DELACK_SEGS		2
+/* Room for data queued by tcp_send() and not yet acknowledged */
+#define TCP_TX_BUF_SIZE		2048
+
+#define TCP_OPT_EOL		0
+#define TCP_OPT_NOP		1
+#define TCP_OPT_MSS		2
+#define TCP_OPT_WS		3
+#define TCP_SYN_OPT_LEN		8
+#define TCP_WSCALE_MAX		14
+
+#define seq_lt(a, b)		((s32)((a) - (b)) < 0)
+#define seq_le(a, b)		((s32)((a) - (b)) <= 0)
+
+/**
+ * struct tcp_ooo_seg - Segment received after a gap
+ *
+ * @seq: sequence number of the first byte
+ * @len: number of bytes, 0 if the slot is free
+ * @fin: the segment carried a FIN
+ */
+struct tcp_ooo_seg {
+	u32 seq;
+	u16 len;
+	bool fin;
+};
+
+static enum tcp_state tcp_state;
+static const struct tcp_ops *tcp_ops;
+static struct tcp_stats tcp_stats;
+static struct in_addr tcp_remote_ip;
+static u8 tcp_remote_ethaddr[ARP_HLEN];
+static u16 tcp_remote_port;
+static u16 tcp_our_port;
+
+/* Send side; the transmit buffer holds the data from tcp_snd_una onwards */
+static u32 tcp_snd_una;
+static u32 tcp_snd_nxt;
+static u32 tcp_snd_wnd;
+static u8 tcp_snd_wscale;
+static u16 tcp_snd_mss;
+static uchar tcp_tx_buf[TCP_TX_BUF_SIZE];
+static unsigned int tcp_tx_len;
+static bool tcp_fin_queued;
+static bool tcp_fin_sent;
+static int tcp_dupacks;
+
+/* Receive side */
+static u32 tcp_rcv_nxt;
+static u32 tcp_rcv_wnd;
+static u8 tcp_rcv_wscale;
+static int tcp_ack_pending;
+static struct tcp_ooo_seg *tcp_ooo;
+static uchar *tcp_ooo_buf;
+static int tcp_ooo_slots;
+static int tcp_ooo_used;
+
+/* Timers, all in ms */
+static ulong tcp_rto;
+static ulong tcp_srtt;
+static ulong tcp_rttvar;
+static ulong tcp_rtx_start;
+static int tcp_retries;
+static bool tcp_rtt_active;
+static u32 tcp_rtt_seq;
+static ulong tcp_rtt_start;
+static ulong tcp_last_rx;
+
+static void tcp_timer(void);
+
+static u16 tcp_checksum(struct in_addr src, struct in_addr dest,
+			const void *seg, unsigned int len)
+{
+	struct {
+		struct in_addr src;
+		struct in_addr dest;
+		u8 zero;
+		u8 proto;
+		u16 len;
+	} __packed ph;
+	uint sum;
+
+	net_copy_ip(&ph.src, &src);
+	net_copy_ip(&ph.dest, &dest);
+	ph.zero = 0;
+	ph.proto = IPPROTO_TCP;
+	ph.len = htons(len);
+	sum = compute_ip_checksum(&ph, sizeof(ph));
+
+	return add_ip_checksums(sizeof(ph), sum,
+				compute_ip_checksum(seg, len));
+}
+
+/* Window to advertise: no more than the user can still take */
+static u32 tcp_rcv_space(void)
+{
+	if (!tcp_ops || !tcp_ops->room)
+		return tcp_rcv_wnd;
+
+	return min_t(ulong, tcp_ops->room(), tcp_rcv_wnd);
+}
+
+int tcp_set_tcp_header(uchar *pkt, struct in_addr dest, int dport, int sport,
+		       int payload_len, u8 action, u32 seq, u32 ack)
+{
+	struct ip_tcp_hdr *ip = (struct ip_tcp_hdr *)pkt;
+	uchar *opt = pkt + IP_TCP_HDR_SIZE;
+	int hlen = TCP_HDR_SIZE;
+	u32 space = tcp_rcv_space();
+	u32 win;
+
+	if (action & TCP_SYN) {
+		/* The window of a SYN is never scaled */
+		win = space;
+		opt[0] = TCP_OPT_MSS;
+		opt[1] = 4;
+		opt[2] = TCP_MSS >> 8;
+		opt[3] = TCP_MSS & 0xff;
+		opt[4] = TCP_OPT_NOP;
+		opt[5] = TCP_OPT_WS;
+		opt[6] = 3;
+		opt[7] = tcp_rcv_wscale;
+		hlen += TCP_SYN_OPT_LEN;
+	} else {
+		/* Rounded up, so that the last few bytes can still come */
+		win = DIV_ROUND_UP(space, 1U << tcp_rcv_wscale);
+	}
+
+	net_set_ip_header(pkt, dest, net_ip, IP_HDR_SIZE + hlen + payload_len,
+			  IPPROTO_TCP);
+	ip->tcp_src = htons(sport);
+	ip->tcp_dst = htons(dport);
+	ip->tcp_seq = htonl(seq);
+	ip->tcp_ack = htonl(action & TCP_ACK ? ack : 0);
+	ip->tcp_hlen = (hlen / 4) << 4;
+	ip->tcp_flags = action;
+	ip->tcp_win = htons(min_t(u32, win, 0xffff));
+	ip->tcp_xsum = 0;
+	ip->tcp_ugr = 0;
+	ip->tcp_xsum = tcp_checksum(net_ip, dest, pkt + IP_HDR_SIZE,
+				    hlen + payload_len);
+
+	return IP_HDR_SIZE + hlen;
+}
+
+static void tcp_send_segment(u8 flags, u32 seq, const uchar *data,
+			     unsigned int len)
+{
+	uchar *payload = net_tx_packet + net_eth_hdr_size() + IP_TCP_HDR_SIZE;
+
+	if (len)
+		memcpy(payload, data, len);
+	net_send_ip_packet(tcp_remote_ethaddr, tcp_remote_ip, tcp_remote_port,
+			   tcp_our_port, len, IPPROTO_TCP, flags, seq,
+			   tcp_rcv_nxt);
+	if (flags & TCP_ACK)
+		tcp_ack_pending = 0;
+}
+
+static void tcp_send_ack(void)
+{
+	tcp_send_segment(TCP_ACK, tcp_snd_nxt, NULL, 0);
+}
+
+static void tcp_free_ooo(void)
+{
+	free(tcp_ooo);
+	free(tcp_ooo_buf);
+	tcp_ooo = NULL;
+	tcp_ooo_buf = NULL;
+	tcp_ooo_slots = 0;
+	tcp_ooo_used = 0;
+}
+
+static void tcp_finish(int err)
+{
+	tcp_state = TCP_CLOSED;
+	net_set_timeout_handler(0, NULL);
+	tcp_free_ooo();
+	debug("TCP: closed (err=%d)\n", err);
+	if (tcp_ops->closed)
+		tcp_ops->closed(err);
+}
+
+static void tcp_update_rto(ulong rtt)
+{
+	ulong delta;
+
+	if (!tcp_srtt) {
+		tcp_srtt = rtt;
+		tcp_rttvar = rtt / 2;
+	} else {
+		delta = tcp_srtt > rtt ? tcp_srtt - rtt : rtt - tcp_srtt;
+		tcp_rttvar = (3 * tcp_rttvar + delta) / 4;
+		tcp_srtt = (7 * tcp_srtt + rtt) / 8;
+	}
+	tcp_rto = tcp_srtt + max_t(ulong, TCP_TICK_MS, 4 * tcp_rttvar);
+	tcp_rto = clamp_t(ulong, tcp_rto, TCP_RTO_MIN, TCP_RTO_MAX);
+}
+
+/* Send whatever the window of the peer allows, then the FIN if queued */
+static void tcp_output(void)
+{
+	u32 end = tcp_snd_una + tcp_tx_len;
+	unsigned int len;
+	s32 usable;
+	u8 flags;
+
+	if (tcp_state != TCP_ESTABLISHED && tcp_state != TCP_CLOSE_WAIT)
+		return;
+
+	while (seq_lt(tcp_snd_nxt, end)) {
+		usable = tcp_snd_una + tcp_snd_wnd - tcp_snd_nxt;
+		if (usable <= 0)
+			break;
+		len = min3((u32)(end - tcp_snd_nxt), (u32)tcp_snd_mss,
+			   (u32)usable);
+		flags = TCP_ACK;
+		if (tcp_snd_nxt + len == end)
+			flags |= TCP_PUSH;
+		if (tcp_snd_una == tcp_snd_nxt)
+			tcp_rtx_start = get_timer(0);
+		if (!tcp_rtt_active) {
+			tcp_rtt_active = true;
+			tcp_rtt_seq = tcp_snd_nxt + len;
+			tcp_rtt_start = get_timer(0);
+		}
+		tcp_send_segment(flags, tcp_snd_nxt,
+				 tcp_tx_buf + (tcp_snd_nxt - tcp_snd_una), len);
+		tcp_snd_nxt += len;
+	}
+
+	if (tcp_fin_queued && !tcp_fin_sent && tcp_snd_nxt == end) {
+		if (tcp_snd_una == tcp_snd_nxt)
+			tcp_rtx_start = get_timer(0);
+		tcp_send_segment(TCP_FIN | TCP_ACK, tcp_snd_nxt, NULL, 0);
+		tcp_snd_nxt++;
+		tcp_fin_sent = true;
+		tcp_state = tcp_state == TCP_CLOSE_WAIT ? TCP_LAST_ACK :
+			    TCP_FIN_WAIT_1;
+	}
+}
+
+/* Send again the oldest segment which was not acknowledged */
+static void tcp_retransmit(void)
+{
+	tcp_rtt_active = false;
+	if (tcp_state == TCP_SYN_SENT)
+		tcp_send_segment(TCP_SYN, tcp_snd_una, NULL, 0);
+	else if (tcp_tx_len)
+		tcp_send_segment(TCP_ACK | TCP_PUSH, tcp_snd_una, tcp_tx_buf,
+				 min_t(unsigned int, tcp_tx_len, tcp_snd_mss));
+	else if (tcp_fin_sent)
+		tcp_send_segment(TCP_FIN | TCP_ACK, tcp_snd_una, NULL, 0);
+}
+
+static void tcp_timer(void)
+{
+	ulong idle;
+
+	if (tcp_state == TCP_CLOSED)
+		return;
+
+	if (tcp_ack_pending)
+		tcp_send_ack();
+
+	idle = tcp_state == TCP_FIN_WAIT_2 ? TCP_FIN_TIMEOUT : TCP_IDLE_TIMEOUT;
+	if (tcp_snd_una != tcp_snd_nxt &&
+	    get_timer(tcp_rtx_start) >= tcp_rto) {
+		if (++tcp_retries > TCP_MAX_RETRIES) {
+			tcp_finish(-ETIMEDOUT);
+			return;
+		}
+		debug("TCP: retransmission timeout (rto=%lu)\n", tcp_rto);
+		tcp_rto = min_t(ulong, tcp_rto * 2, TCP_RTO_MAX);
+		tcp_stats.tx_rexmit++;
+		tcp_retransmit();
+		tcp_rtx_start = get_timer(0);
+	} else if (get_timer(tcp_last_rx) >= idle) {
+		tcp_finish(-ETIMEDOUT);
+		return;
+	}
+
+	net_set_timeout_handler(TCP_TICK_MS, tcp_timer);
+}
+
+static void tcp_parse_syn_options(const uchar *opt, int len)
+{
+	bool wscale = false;
+	int olen;
+
+	while (len > 0) {
+		if (opt[0] == TCP_OPT_EOL)
+			break;
+		if (opt[0] == TCP_OPT_NOP) {
+			opt++;
+			len--;
+			continue;
+		}
+		olen = len > 1 ? opt[1] : 0;
+		if (olen < 2 || olen > len)
+			break;
+		if (opt[0] == TCP_OPT_MSS && olen == 4)
+			tcp_snd_mss = min(tcp_snd_mss,
+					  (u16)(opt[2] << 8 | opt[3]));
+		else if (opt[0] == TCP_OPT_WS && olen == 3) {
+			tcp_snd_wscale = min_t(u8, opt[2], TCP_WSCALE_MAX);
+			wscale = true;
+		}
+		opt += olen;
+		len -= olen;
+	}
+
+	/* Window scaling is only used if both sides offer it (RFC 7323) */
+	if (wscale) {
+		tcp_stats.wscale = tcp_rcv_wscale;
+	} else {
+		tcp_snd_wscale = 0;
+		tcp_rcv_wscale = 0;
+		tcp_rcv_wnd = min_t(u32, tcp_rcv_wnd, 0xffff);
+		tcp_stats.wscale = -1;
+	}
+}
+
+static void tcp_ack(u32 ack, u32 win, bool dup_candidate)
+{
+	unsigned int acked;
+
+	if (seq_lt(tcp_snd_una, ack) && seq_le(ack, tcp_snd_nxt)) {
+		/* A SYN or FIN takes a sequence number but no buffer space */
+		acked = min_t(u32, ack - tcp_snd_una, tcp_tx_len);
+		memmove(tcp_tx_buf, tcp_tx_buf + acked, tcp_tx_len - acked);
+		tcp_tx_len -= acked;
+		tcp_snd_una = ack;
+		tcp_dupacks = 0;
+		tcp_retries = 0;
+		if (tcp_rtt_active && seq_le(tcp_rtt_seq, ack)) {
+			tcp_update_rto(get_timer(tcp_rtt_start));
+			tcp_rtt_active = false;
+		}
+		tcp_rtx_start = get_timer(0);
+	} else if (dup_candidate && ack == tcp_snd_una &&
+		   tcp_snd_una != tcp_snd_nxt && win == tcp_snd_wnd) {
+		if (++tcp_dupacks == TCP_DUPACK_THRESH) {
+			debug("TCP: fast retransmit of %u\n", tcp_snd_una);
+			tcp_stats.tx_fast_rexmit++;
+			tcp_retransmit();
+			tcp_rtx_start = get_timer(0);
+		}
+	}
+	tcp_snd_wnd = win;
+
+	if (tcp_fin_sent && tcp_snd_una == tcp_snd_nxt) {
+		if (tcp_state == TCP_FIN_WAIT_1)
+			tcp_state = TCP_FIN_WAIT_2;
+		else if (tcp_state == TCP_LAST_ACK)
+			tcp_finish(0);
+	}
+}
+
+static void tcp_deliver(const uchar *data, unsigned int len)
+{
+	tcp_rcv_nxt += len;
+	tcp_stats.rx_bytes += len;
+	if (len)
+		tcp_ops->receive(data, len);
+}
+
+static void tcp_ooo_add(u32 seq, const uchar *data, unsigned int len,
+			bool fin)
+{
+	struct tcp_ooo_seg *free_seg = NULL;
+	int i;
+
+	if (!len || len > TCP_MSS)
+		return;
+	for (i = 0; i < tcp_ooo_slots; i++) {
+		if (!tcp_ooo[i].len) {
+			if (!free_seg)
+				free_seg = &tcp_ooo[i];
+		} else if (tcp_ooo[i].seq == seq) {
+			return;
+		}
+	}
+	if (!free_seg)
+		return;
+
+	i = free_seg - tcp_ooo;
+	memcpy(tcp_ooo_buf + i * TCP_MSS, data, len);
+	free_seg->seq = seq;
+	free_seg->len = len;
+	free_seg->fin = fin;
+	tcp_ooo_used++;
+}
+
+/* Deliver queued segments which the last one made contiguous */
+static bool tcp_ooo_drain(bool *fin)
+{
+	struct tcp_ooo_seg *seg;
+	bool progress, found = false;
+	unsigned int skip, len;
+	int i;
+
+	do {
+		progress = false;
+		for (i = 0; tcp_ooo_used && i < tcp_ooo_slots; i++) {
+			seg = &tcp_ooo[i];
+			if (!seg->len || seq_lt(tcp_rcv_nxt, seg->seq))
+				continue;
+			skip = tcp_rcv_nxt - seg->seq;
+			len = seg->len;
+			seg->len = 0;
+			tcp_ooo_used--;
+			if (skip > len || (skip == len && !seg->fin))
+				continue;	/* all of it was received again */
+			*fin |= seg->fin;
+			progress = true;
+			found = true;
+			tcp_deliver(tcp_ooo_buf + i * TCP_MSS + skip, len - skip);
+			if (tcp_state == TCP_CLOSED)
+				return found;
+		}
+	} while (progress);
+
+	return found;
+}
+
+static void tcp_data(u32 seq, const uchar *data, unsigned int len, bool fin)
+{
+	u32 end = seq + len;
+	bool filled = false;
+	unsigned int skip;
+
+	if (len)
+		tcp_stats.rx_segs++;
+
+	/* Anything after the FIN of the peer is ignored */
+	if (tcp_state != TCP_ESTABLISHED && tcp_state != TCP_FIN_WAIT_1 &&
+	    tcp_state != TCP_FIN_WAIT_2) {
+		tcp_send_ack();
+		return;
+	}
+
+	if (seq_lt(end, tcp_rcv_nxt) || (end == tcp_rcv_nxt && !fin)) {
+		/* Already received; our ACK was probably lost */
+		if (len)
+			tcp_stats.rx_dup++;
+		tcp_send_ack();
+		return;
+	}
+
+	if (seq_lt(tcp_rcv_nxt + tcp_rcv_wnd, end)) {
+		/* Beyond the window we advertised */
+		tcp_send_ack();
+		return;
+	}
+
+	if (seq_lt(tcp_rcv_nxt, seq)) {
+		/* After a gap: ask for the missing data with a duplicate ACK */
+		tcp_ooo_add(seq, data, len, fin);
+		tcp_stats.rx_ooo++;
+		tcp_stats.tx_dupacks++;
+		tcp_send_ack();
+		return;
+	}
+
+	skip = tcp_rcv_nxt - seq;
+	tcp_deliver(data + skip, len - skip);
+	if (tcp_ooo_used)
+		filled = tcp_ooo_drain(&fin);
+	if (tcp_state == TCP_CLOSED)
+		return;
+
+	if (fin) {
+		tcp_rcv_nxt++;
+		tcp_send_ack();
+		switch (tcp_state) {
+		case TCP_ESTABLISHED:
+			/* Nothing more to receive, so close our side too */
+			tcp_state = TCP_CLOSE_WAIT;
+			tcp_fin_queued = true;
+			break;
+		case TCP_FIN_WAIT_1:
+			/* Simultaneous close: wait for the ACK of our FIN */
+			tcp_state = TCP_LAST_ACK;
+			break;
+		default:
+			tcp_finish(0);
+			break;
+		}
+		return;
+	}
+
+	if (filled || ++tcp_ack_pending >= TCP_DELACK_SEGS)
+		tcp_send_ack();
+}
+
+void tcp_receive(struct ip_tcp_hdr *ip, unsigned int len)
+{
+	unsigned int hlen, dlen;
+	u32 seq, ack;
+	u8 flags;
+	u32 win;
+
+	if (tcp_state == TCP_CLOSED || len < IP_TCP_HDR_SIZE)
+		return;
+	if (net_read_ip(&ip->ip_src).s_addr != tcp_remote_ip.s_addr ||
+	    ntohs(ip->tcp_src) != tcp_remote_port ||
+	    ntohs(ip->tcp_dst) != tcp_our_port)
+		return;
+	hlen = (ip->tcp_hlen >> 4) * 4;
+	if (hlen < TCP_HDR_SIZE || IP_HDR_SIZE + hlen > len)
+		return;
+	if (tcp_checksum(net_read_ip(&ip->ip_src), net_read_ip(&ip->ip_dst),
+			 (uchar *)ip + IP_HDR_SIZE, len - IP_HDR_SIZE)) {
+		debug("TCP: bad checksum\n");
+		return;
+	}
+
+	seq = ntohl(ip->tcp_seq);
+	ack = ntohl(ip->tcp_ack);
+	flags = ip->tcp_flags;
+	dlen = len - IP_HDR_SIZE - hlen;
+	tcp_last_rx = get_timer(0);
+
+	if (flags & TCP_RST) {
+		if (tcp_state == TCP_SYN_SENT ? ack == tcp_snd_nxt :
+		    !seq_lt(seq, tcp_rcv_nxt) &&
+		    seq_lt(seq, tcp_rcv_nxt + tcp_rcv_wnd))
+			tcp_finish(-ECONNRESET);
+		return;
+	}
+
+	if (tcp_state == TCP_SYN_SENT) {
+		if ((flags & (TCP_SYN | TCP_ACK)) != (TCP_SYN | TCP_ACK) ||
+		    ack != tcp_snd_nxt)
+			return;
+		tcp_parse_syn_options((uchar *)ip + IP_TCP_HDR_SIZE,
+				      hlen - TCP_HDR_SIZE);
+		tcp_rcv_nxt = seq + 1;
+		tcp_ack(ack, ntohs(ip->tcp_win), false);
+		tcp_state = TCP_ESTABLISHED;
+		tcp_send_ack();
+		if (tcp_ops->connected)
+			tcp_ops->connected();
+		return;
+	}
+
+	if (flags & TCP_SYN) {
+		/* The SYN-ACK again, so our ACK of it was lost */
+		tcp_send_ack();
+		return;
+	}
+
+	if (flags & TCP_ACK) {
+		win = ntohs(ip->tcp_win) << tcp_snd_wscale;
+		tcp_ack(ack, win, !dlen && !(flags & TCP_FIN));
+		if (tcp_state == TCP_CLOSED)
+			return;
+	}
+	if (dlen || (flags & TCP_FIN))
+		tcp_data(seq, (uchar *)ip + IP_HDR_SIZE + hlen, dlen,
+			 flags & TCP_FIN);
+	tcp_output();
+}
+
+void tcp_connect(struct in_addr dest, u16 dport, const struct tcp_ops *ops)
+{
+	u32 iss;
+
+	tcp_free_ooo();
+	memset(&tcp_stats, '\0', sizeof(tcp_stats));
+	tcp_ops = ops;
+	tcp_remote_ip = dest;
+	tcp_remote_port = dport;
+	memset(tcp_remote_ethaddr, '\0', ARP_HLEN);
+	tcp_our_port = 1024 + (get_timer(0) % 3072);
+
+	tcp_rcv_wnd = CONFIG_NET_TCP_WINDOW;
+	for (tcp_rcv_wscale = 0; (tcp_rcv_wnd >> tcp_rcv_wscale) > 0xffff;)
+		tcp_rcv_wscale++;
+	tcp_stats.wscale = tcp_rcv_wscale;
+	tcp_ack_pending = 0;
+
+	/* Room to queue a whole window of segments after a loss */
+	tcp_ooo_slots = tcp_rcv_wnd / TCP_MSS;
+	tcp_ooo = calloc(tcp_ooo_slots, sizeof(*tcp_ooo));
+	tcp_ooo_buf = malloc(tcp_ooo_slots * TCP_MSS);
+	if (!tcp_ooo || !tcp_ooo_buf) {
+		log_warning("TCP: no memory for out-of-order segments\n");
+		tcp_free_ooo();
+	}
+
+	/* A clock ticking every 4us, as suggested by RFC 793 */
+	iss = timer_get_us() / 4;
+	tcp_snd_una = iss;
+	tcp_snd_nxt = iss + 1;
+	tcp_snd_wnd = 0;
+	tcp_snd_wscale = 0;
+	tcp_snd_mss = TCP_MSS;
+	tcp_tx_len = 0;
+	tcp_fin_queued = false;
+	tcp_fin_sent = false;
+	tcp_dupacks = 0;
+
+	tcp_rto = TCP_RTO_INIT;
+	tcp_srtt = 0;
+	tcp_rttvar = 0;
+	tcp_retries = 0;
+	tcp_rtt_active = true;
+	tcp_rtt_seq = tcp_snd_nxt;
+	tcp_rtt_start = get_timer(0);
+	tcp_rtx_start = tcp_rtt_start;
+	tcp_last_rx = tcp_rtt_start;
+
+	tcp_state = TCP_SYN_SENT;
+	debug("TCP: connecting to %pI4:%u from port %u\n", &dest, dport,
+	      tcp_our_port);
+	tcp_send_segment(TCP_SYN, iss, NULL, 0);
+	net_set_timeout_handler(TCP_TICK_MS, tcp_timer);
+}
+
+int tcp_send(const void *data, unsigned int len)
+{
+	if (tcp_state != TCP_ESTABLISHED && tcp_state != TCP_CLOSE_WAIT)
+		return -ENOTCONN;
+	if (tcp_fin_queued)
+		return -EPIPE;
+	if (tcp_tx_len + len > TCP_TX_BUF_SIZE)
+		return -ENOSPC;
+
+	memcpy(tcp_tx_buf + tcp_tx_len, data, len);
+	tcp_tx_len += len;
+	tcp_output();
+
+	return 0;
+}
+
+void tcp_close(void)
+{
+	if (tcp_state == TCP_SYN_SENT) {
+		tcp_abort();
+		return;
+	}
+	tcp_fin_queued = true;
+	tcp_output();
+}
+
+void tcp_abort(void)
+{
+	if (tcp_state == TCP_CLOSED)
+		return;
+	if (tcp_state != TCP_SYN_SENT)
+		tcp_send_segment(TCP_RST | TCP_ACK, tcp_snd_nxt, NULL, 0);
+	tcp_state = TCP_CLOSED;
+	net_set_timeout_handler(0, NULL);
+	tcp_free_ooo();
+}
+
+enum tcp_state tcp_get_state(void)
+{
+	return tcp_state;
+}
+
+const struct tcp_stats *tcp_get_stats(void)
+{
+	return &tcp_stats;
+}
@@ -35,16 +35,10 @@ DECLARE_GLOBAL_DATA_PTR;
 #endif
 /* Number of "loading" hashes per line (for checking the image size) */
 #define HASHES_PER_LINE	65
-
-/*
- *	TFTP operations.
- */
-#define TFTP_RRQ	1
-#define TFTP_WRQ	2
-#define TFTP_DATA	3
-#define TFTP_ACK	4
-#define TFTP_ERROR	5
-#define TFTP_OACK	6
+/* Number of blocks which can be kept ahead of a missing one */
+#define TFTP_OOO_BLOCKS	1024
+/* Blocks kept ahead of a missing one before asking for it again */
+#define TFTP_NACK_THRESH	3
 
 static ulong timeout_ms = TIMEOUT;
 static int timeout_count_max = TIMEOUT_COUNT;
@@ -62,17 +56,6 @@ static ulong time_start;   /* Record time we started tftp */
 ulong tftp_timeout_ms = TIMEOUT;
 int tftp_timeout_count_max = TIMEOUT_COUNT;
 
-enum {
-	TFTP_ERR_UNDEFINED           = 0,
-	TFTP_ERR_FILE_NOT_FOUND      = 1,
-	TFTP_ERR_ACCESS_DENIED       = 2,
-	TFTP_ERR_DISK_FULL           = 3,
-	TFTP_ERR_UNEXPECTED_OPCODE   = 4,
-	TFTP_ERR_UNKNOWN_TRANSFER_ID  = 5,
-	TFTP_ERR_FILE_ALREADY_EXISTS = 6,
-	TFTP_ERR_OPTION_NEGOTIATION = 8,
-};
-
 static struct in_addr tftp_remote_ip;
 /* The UDP port at their end */
 static int	tftp_remote_port;
@@ -104,6 +87,23 @@ static ushort	tftp_windowsize;
 static ushort	tftp_next_ack;
 /* Last nack block we send */
 static ushort	tftp_last_nack;
+/* Blocks received ahead of a missing one, indexed modulo TFTP_OOO_BLOCKS */
+static u32	tftp_ooo_map[TFTP_OOO_BLOCKS / 32];
+/* Number of blocks set in tftp_ooo_map */
+static ushort	tftp_ooo_count;
+/* 1 if we asked the server to resend the missing block */
+static int	tftp_gap_nacked;
+/* 1 if the last block of the file was received out of order */
+static int	tftp_final_seen;
+/* Number of that last block */
+static ushort	tftp_final_block;
+/* Window size to ask for, adapted to the losses of the last transfers */
+static ushort	tftp_window_size_adapt;
+/* The window size option tftp_window_size_adapt was derived from */
+static ushort	tftp_window_size_base;
+/* 1 if the window size is adapted after this transfer */
+static int	tftp_window_adapt;
+static struct tftp_stats tftp_stats;
 #ifdef CONFIG_CMD_TFTPPUT
 /* 1 if writing, else 0 */
 static int	tftp_put_active;
@@ -124,6 +124,11 @@ static int	tftp_put_final_block_sent;
 
 /* default TFTP block size */
 #define TFTP_BLOCK_SIZE		512
+#ifdef CONFIG_IP_DEFRAG
+/* largest block in a reassembled datagram, and by RFC 2348 */
+#define TFTP_MAX_BLOCK_SIZE	min_t(int, 65464, CONFIG_NET_MAXDEFRAG - \
+					  IP_UDP_HDR_SIZE - 4)
+#endif
 /* sequence number is 16 bit */
 #define TFTP_SEQUENCE_SIZE	((ulong)(1<<16))
 
@@ -218,6 +223,10 @@ static void new_transfer(void)
 	tftp_prev_block = 0;
 	tftp_block_wrap = 0;
 	tftp_block_wrap_offset = 0;
+	memset(tftp_ooo_map, '\0', sizeof(tftp_ooo_map));
+	tftp_ooo_count = 0;
+	tftp_gap_nacked = 0;
+	tftp_final_seen = 0;
 #ifdef CONFIG_CMD_TFTPPUT
 	tftp_put_final_block_sent = 0;
 #endif
@@ -311,6 +320,28 @@ static void update_block_number(void)
 	show_block_marker();
 }
 
+/*
+ * Adapt the window size asked for in the next transfer to the losses seen in
+ * this one: halve it if more than 1% of the windows needed a resend, grow it
+ * back towards the configured size after a transfer without losses.
+ */
+static void tftp_adapt_window(void)
+{
+	ulong windows = tftp_stats.blocks / tftp_windowsize + 1;
+	ulong losses = tftp_stats.nacks + tftp_stats.timeouts;
+
+	if (losses * 100 > windows)
+		tftp_window_size_adapt = max(tftp_window_size_adapt / 2, 1);
+	else if (!losses)
+		tftp_window_size_adapt = min(tftp_window_size_adapt * 2,
+					     (int)tftp_window_size_base);
+}
+
+const struct tftp_stats *tftp_get_stats(void)
+{
+	return &tftp_stats;
+}
+
 /* The TFTP get or put is complete */
 static void tftp_complete(void)
 {
@@ -330,6 +361,17 @@ static void tftp_complete(void)
 			time_start * 1000, "/s");
 	}
 	puts("\ndone\n");
+	net_server_ether_save(tftp_remote_ip);
+	if (!tftp_put_active) {
+		if (tftp_window_adapt)
+			tftp_adapt_window();
+		tftp_stats.windowsize = tftp_windowsize;
+		tftp_stats.next_windowsize = tftp_window_size_adapt;
+		printf("TFTP: %lu blocks, %lu out of order, %lu duplicate, %lu resend requests, %lu timeouts, window %d (next %d)\n",
+		       tftp_stats.blocks, tftp_stats.ooo, tftp_stats.dup,
+		       tftp_stats.nacks, tftp_stats.timeouts,
+		       tftp_stats.windowsize, tftp_stats.next_windowsize);
+	}
 	if (IS_ENABLED(CONFIG_CMD_BOOTEFI)) {
 		if (!tftp_put_active)
 			efi_set_bootdev("Net", "", tftp_filename,
@@ -386,9 +428,9 @@ static void tftp_send(void)
 		 * Implemented only for tftp get.
 		 * Don't bother sending if it's 1
 		 */
-		if (tftp_state == STATE_SEND_RRQ && tftp_window_size_option > 1)
+		if (tftp_state == STATE_SEND_RRQ && tftp_window_size_adapt > 1)
 			pkt += sprintf((char *)pkt, "windowsize%c%d%c",
-					0, tftp_window_size_option, 0);
+					0, tftp_window_size_adapt, 0);
 		len = pkt - xp;
 		break;
 
@@ -472,6 +514,85 @@ static void icmp_handler(unsigned type, unsigned code, unsigned dest,
 }
 #endif
 
+static bool tftp_ooo_test(ushort block)
+{
+	block %= TFTP_OOO_BLOCKS;
+
+	return tftp_ooo_map[block / 32] & BIT(block % 32);
+}
+
+static void tftp_ooo_mark(ushort block, bool set)
+{
+	block %= TFTP_OOO_BLOCKS;
+
+	if (set)
+		tftp_ooo_map[block / 32] |= BIT(block % 32);
+	else
+		tftp_ooo_map[block / 32] &= ~BIT(block % 32);
+}
+
+/* Ask the server to send again from the block after tftp_cur_block */
+static void tftp_send_nack(void)
+{
+	tftp_send();
+	tftp_last_nack = tftp_cur_block;
+	tftp_next_ack = (ushort)(tftp_cur_block + tftp_windowsize);
+	tftp_gap_nacked = 1;
+	tftp_stats.nacks++;
+}
+
+/*
+ * Keep a block received ahead of a missing one. It is stored in place right
+ * away, so only the fact that it arrived needs to be remembered.
+ */
+static int tftp_data_ahead(ushort block, ushort ahead, uchar *src,
+			   unsigned int len)
+{
+	if (tftp_ooo_test(block)) {
+		tftp_stats.dup++;
+	} else {
+		if (store_block(tftp_cur_block + ahead, src, len))
+			return -1;
+		tftp_ooo_mark(block, true);
+		tftp_ooo_count++;
+		tftp_stats.ooo++;
+		if (len < tftp_block_size) {
+			tftp_final_block = block;
+			tftp_final_seen = 1;
+		}
+	}
+
+	/*
+	 * Put up with some reordering, but once the server reached the end of
+	 * its window or several blocks went past the gap, ask it to resend
+	 * from the gap. The blocks kept are skipped once the gap is filled.
+	 */
+	if (block == tftp_next_ack ||
+	    (tftp_final_seen && block == tftp_final_block) ||
+	    (tftp_ooo_count >= TFTP_NACK_THRESH &&
+	     tftp_last_nack != (ushort)tftp_cur_block))
+		tftp_send_nack();
+
+	return 0;
+}
+
+/* Move over the blocks kept after the one just received */
+static bool tftp_ooo_drain(void)
+{
+	bool drained = false;
+
+	while (tftp_ooo_count && tftp_ooo_test(tftp_cur_block + 1)) {
+		tftp_ooo_mark(tftp_cur_block + 1, false);
+		tftp_ooo_count--;
+		tftp_cur_block = (tftp_cur_block + 1) % TFTP_SEQUENCE_SIZE;
+		update_block_number();
+		tftp_prev_block = tftp_cur_block;
+		drained = true;
+	}
+
+	return drained;
+}
+
 static void tftp_handler(uchar *pkt, unsigned dest, struct in_addr sip,
 			 unsigned src, unsigned len)
 {
@@ -479,6 +600,8 @@ static void tftp_handler(uchar *pkt, unsigned dest, struct in_addr sip,
 	__be16 *s;
 	int i;
 	u16 timeout_val_rcvd;
+	ushort block, ahead;
+	bool drained;
 
 	if (dest != tftp_our_port) {
 			return;
@@ -605,11 +728,40 @@ static void tftp_handler(uchar *pkt, unsigned dest, struct in_addr sip,
 		if (len < 2)
 			return;
 		len -= 2;
+		tftp_stats.blocks++;
+
+		block = ntohs(*(__be16 *)pkt);
+		ahead = (ushort)(block - tftp_cur_block);
+		if (ahead > 1 && ahead <= min_t(ushort, tftp_windowsize,
+						TFTP_OOO_BLOCKS) &&
+		    (tftp_state == STATE_DATA || tftp_state == STATE_OACK)) {
+			if (tftp_state == STATE_OACK) {
+				/* first block received, but not block 1 */
+				tftp_state = STATE_DATA;
+				tftp_remote_port = src;
+				new_transfer();
+			}
+			if (tftp_data_ahead(block, ahead, pkt + 2, len)) {
+				eth_halt();
+				net_set_state(NETLOOP_FAIL);
+			}
+			break;
+		}
 
-		if (ntohs(*(__be16 *)pkt) != (ushort)(tftp_cur_block + 1)) {
+		if (block != (ushort)(tftp_cur_block + 1)) {
 			debug("Received unexpected block: %d, expected: %d\n",
-			      ntohs(*(__be16 *)pkt),
-			      (ushort)(tftp_cur_block + 1));
+			      block, (ushort)(tftp_cur_block + 1));
+			if (ahead == 0 || ahead > TFTP_SEQUENCE_SIZE / 2) {
+				tftp_stats.dup++;
+				/*
+				 * With a window this is most likely what is
+				 * left of a window sent again, and we already
+				 * acknowledged the blocks after it.
+				 */
+				if (tftp_windowsize > 1 &&
+				    tftp_state == STATE_DATA)
+					break;
+			}
 			/*
 			 * If one packet is dropped most likely
 			 * all other buffers in the window
@@ -667,6 +819,11 @@ static void tftp_handler(uchar *pkt, unsigned dest, struct in_addr sip,
 		}
 
 		if (len < tftp_block_size) {
+			tftp_final_block = tftp_cur_block;
+			tftp_final_seen = 1;
+		}
+		drained = tftp_ooo_drain();
+		if (tftp_final_seen && tftp_cur_block == tftp_final_block) {
 			tftp_send();
 			tftp_complete();
 			break;
@@ -674,11 +831,16 @@ static void tftp_handler(uchar *pkt, unsigned dest, struct in_addr sip,
 
 		/*
 		 *	Acknowledge the block just received, which will prompt
-		 *	the remote for the next one.
+		 *	the remote for the next one. Once a resend filled a gap
+		 *	do it straight away, so that the remote skips the blocks
+		 *	we kept.
 		 */
-		if (tftp_cur_block == tftp_next_ack) {
+		if ((s16)(tftp_cur_block - tftp_next_ack) >= 0 ||
+		    (drained && tftp_gap_nacked)) {
 			tftp_send();
-			tftp_next_ack += tftp_windowsize;
+			tftp_next_ack = (ushort)(tftp_cur_block +
+						 tftp_windowsize);
+			tftp_gap_nacked = 0;
 		}
 		break;
 
@@ -710,16 +872,41 @@ static void tftp_handler(uchar *pkt, unsigned dest, struct in_addr sip,
 
 static void tftp_timeout_handler(void)
 {
+	tftp_stats.timeouts++;
 	if (++timeout_count > timeout_count_max) {
+		tftp_window_size_adapt = max(tftp_window_size_adapt / 2, 1);
 		restart("Retry count exceeded");
 	} else {
 		puts("T ");
 		net_set_timeout_handler(timeout_ms, tftp_timeout_handler);
+		if (tftp_state == STATE_SEND_RRQ) {
+			/* The server may have a new MAC address: ask again */
+			net_server_ether_forget();
+			memset(net_server_ethaddr, 0, 6);
+		}
+		if (tftp_state == STATE_DATA && !tftp_put_active) {
+			/* The remote sends a new window after our ACK */
+			tftp_next_ack = (ushort)(tftp_cur_block +
+						 tftp_windowsize);
+			tftp_gap_nacked = tftp_ooo_count != 0;
+		}
 		if (tftp_state != STATE_RECV_WRQ)
 			tftp_send();
 	}
 }
 
+#ifdef CONFIG_NET_TFTP_VARS
+static int on_tftpwindowsize(const char *name, const char *value,
+			     enum env_op op, int flags)
+{
+	/* Adapt the window size again from the new value */
+	tftp_window_size_base = 0;
+
+	return 0;
+}
+U_BOOT_ENV_CALLBACK(tftpwindowsize, on_tftpwindowsize);
+#endif
+
 /* Initialize tftp_load_addr and tftp_load_size from image_load_addr and lmb */
 static int tftp_init_load_addr(void)
 {
@@ -778,8 +965,22 @@ void tftp_start(enum proto_t protocol)
 	}
 #endif
 
+#ifdef CONFIG_IP_DEFRAG
+	if (tftp_block_size_option > TFTP_MAX_BLOCK_SIZE) {
+		printf("TFTP block size %d too large, set to %d\n",
+		       tftp_block_size_option, TFTP_MAX_BLOCK_SIZE);
+		tftp_block_size_option = TFTP_MAX_BLOCK_SIZE;
+	}
+#endif
+
+	/* Start again from the window size option if it was changed */
+	if (tftp_window_size_option != tftp_window_size_base) {
+		tftp_window_size_base = tftp_window_size_option;
+		tftp_window_size_adapt = tftp_window_size_option;
+	}
+
 	debug("TFTP blocksize = %i, TFTP windowsize = %d timeout = %ld ms\n",
-	      tftp_block_size_option, tftp_window_size_option, timeout_ms);
+	      tftp_block_size_option, tftp_window_size_adapt, timeout_ms);
 
 	tftp_remote_ip = net_server_ip;
 	if (!net_parse_bootfile(&tftp_remote_ip, tftp_filename, MAX_LEN)) {
@@ -848,6 +1049,7 @@ void tftp_start(enum proto_t protocol)
 		printf("Load address: 0x%lx\n", tftp_load_addr);
 		puts("Loading: *\b");
 		tftp_state = STATE_SEND_RRQ;
+		tftp_window_adapt = 1;
 	}
 
 	time_start = get_timer(0);
@@ -874,8 +1076,9 @@ void tftp_start(enum proto_t protocol)
 	tftp_cur_block = 0;
 	tftp_windowsize = 1;
 	tftp_last_nack = 0;
-	/* zero out server ether in case the server ip has changed */
-	memset(net_server_ethaddr, 0, 6);
+	memset(&tftp_stats, '\0', sizeof(tftp_stats));
+	/* Skip the ARP request if we talked to this server last time */
+	net_server_ether_restore(tftp_remote_ip);
 	/* Revert tftp_block_size to dflt */
 	tftp_block_size = TFTP_BLOCK_SIZE;
 #ifdef CONFIG_TFTP_TSIZE
@@ -911,7 +1114,10 @@ void tftp_start_server(void)
 	/* Revert tftp_block_size to dflt */
 	tftp_block_size = TFTP_BLOCK_SIZE;
 	tftp_cur_block = 0;
+	tftp_windowsize = 1;
+	tftp_window_adapt = 0;
 	tftp_our_port = WELL_KNOWN_PORT;
+	memset(&tftp_stats, '\0', sizeof(tftp_stats));
 
 #ifdef CONFIG_TFTP_TSIZE
 	tftp_tsize = 0;
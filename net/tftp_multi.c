@@ -0,0 +1,449 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * Fetch several files over TFTP at once
+ *
+ * Each file has a session of its own, told apart by its local UDP port, and
+ * all of them are driven by one UDP handler and one periodic timeout
+ * handler from net_loop(). A transfer spends much of its time waiting for
+ * the server between two windows: with several sessions, the data of one
+ * fills the round trips of the others, and the ARP request and the option
+ * negotiation happen once for all the files.
+ *
+ * This is a reader only, without the tsize option, the progress bar or the
+ * adaptive window of tftp.c. Blocks after a missing one are dropped and the
+ * server asked for the window again from the gap.
+ */
+
+#include <common.h>
+#include <env.h>
+#include <lmb.h>
+#include <log.h>
+#include <mapmem.h>
+#include <net.h>
+#include <asm/global_data.h>
+#include <net/tftp.h>
+
+DECLARE_GLOBAL_DATA_PTR;
+
+/* Well known TFTP port # */
+#define WELL_KNOWN_PORT		69
+/* Millisecs to timeout for lost pkt */
+#define TIMEOUT			5000UL
+/* Period of the timeout handler, which also starts the waiting sessions */
+#define TFTP_MULTI_TICK_MS	10
+/* Default block size of the protocol, without the blksize option */
+#define TFTP_BLOCK_SIZE		512
+#ifdef CONFIG_IP_DEFRAG
+/* largest block in a reassembled datagram, and by RFC 2348 */
+#define TFTP_MULTI_MAX_BLKSIZE	min_t(int, 65464, CONFIG_NET_MAXDEFRAG - \
+					      IP_UDP_HDR_SIZE - 4)
+#else
+/* largest block in a single Ethernet frame */
+#define TFTP_MULTI_MAX_BLKSIZE	(PKTSIZE - ETHER_HDR_SIZE - \
+				 IP_UDP_HDR_SIZE - 4)
+#endif
+/* Longest file name, leaving room for the options in the RRQ */
+#define TFTP_MULTI_NAME_MAX	(TFTP_MULTI_MAX_BLKSIZE - 64)
+
+enum tftp_multi_state {
+	TFTP_MULTI_WAIT,	/* RRQ not sent yet, waiting for ARP */
+	TFTP_MULTI_RRQ,		/* RRQ sent, waiting for the server */
+	TFTP_MULTI_DATA,	/* receiving */
+	TFTP_MULTI_DONE,
+};
+
+/**
+ * struct tftp_session - Transfer of one file
+ *
+ * @file: file being fetched
+ * @state: state of the transfer
+ * @our_port: local UDP port
+ * @remote_port: UDP port of the server, which picks one for each transfer
+ *	in its first answer
+ * @blksize: block size agreed with the server
+ * @windowsize: window size agreed with the server
+ * @block: last block received in order, wrapping at 16 bits as on the wire
+ * @unacked: blocks received in order since the last ACK
+ * @nacked: the server was asked to send again from a gap, and nothing came
+ *	in order since
+ * @limit: bytes which may be written at the load address
+ * @start: time the first RRQ was sent
+ * @last: time of the last packet sent, or received in order
+ * @retries: timeouts since the server last answered
+ */
+struct tftp_session {
+	struct tftp_fetch *file;
+	enum tftp_multi_state state;
+	u16 our_port;
+	u16 remote_port;
+	uint blksize;
+	uint windowsize;
+	u16 block;
+	uint unacked;
+	bool nacked;
+	ulong limit;
+	ulong start;
+	ulong last;
+	int retries;
+};
+
+static struct tftp_fetch *multi_files;
+static int multi_count;
+static struct tftp_session multi_sessions[TFTP_MULTI_MAX];
+static struct in_addr multi_server;
+static u16 multi_server_port;
+static uint multi_blksize;
+static uint multi_windowsize;
+static ulong multi_timeout_ms;
+/* The server answered, so its MAC address is right */
+static bool multi_answered;
+
+static void tftp_multi_send(struct tftp_session *s, int len)
+{
+	net_send_udp_packet(net_server_ethaddr, multi_server, s->remote_port,
+			    s->our_port, len);
+	s->last = get_timer(0);
+}
+
+static void tftp_multi_rrq(struct tftp_session *s)
+{
+	uchar *pkt = net_tx_packet + net_eth_hdr_size() + IP_UDP_HDR_SIZE;
+	uchar *p = pkt;
+
+	*(__be16 *)p = htons(TFTP_RRQ);
+	p += 2;
+	p += sprintf((char *)p, "%s%coctet%ctimeout%c%lu%cblksize%c%u%c",
+		     s->file->name, 0, 0, 0, multi_timeout_ms / 1000, 0, 0,
+		     multi_blksize, 0);
+	if (multi_windowsize > 1)
+		p += sprintf((char *)p, "windowsize%c%u%c", 0,
+			     multi_windowsize, 0);
+
+	if (s->state == TFTP_MULTI_WAIT && !s->retries)
+		s->start = get_timer(0);
+	s->state = TFTP_MULTI_RRQ;
+	s->remote_port = multi_server_port;
+	tftp_multi_send(s, p - pkt);
+}
+
+static void tftp_multi_ack(struct tftp_session *s)
+{
+	__be16 *pkt = (void *)net_tx_packet + net_eth_hdr_size() +
+		IP_UDP_HDR_SIZE;
+
+	pkt[0] = htons(TFTP_ACK);
+	pkt[1] = htons(s->block);
+	s->unacked = 0;
+	tftp_multi_send(s, 4);
+}
+
+static void tftp_multi_error(struct tftp_session *s, int code,
+			     const char *msg)
+{
+	uchar *pkt = net_tx_packet + net_eth_hdr_size() + IP_UDP_HDR_SIZE;
+
+	((__be16 *)pkt)[0] = htons(TFTP_ERROR);
+	((__be16 *)pkt)[1] = htons(code);
+	strcpy((char *)pkt + 4, msg);
+	tftp_multi_send(s, 4 + strlen(msg) + 1);
+}
+
+static void tftp_multi_done(struct tftp_session *s, int err)
+{
+	struct tftp_fetch *file = s->file;
+	int i;
+
+	s->state = TFTP_MULTI_DONE;
+	file->err = err;
+	file->ms = get_timer(s->start);
+	if (err) {
+		printf("TFTP: %s: error %d\n", file->name, err);
+	} else {
+		printf("TFTP: %s: %lu bytes in %lu ms", file->name, file->size,
+		       file->ms);
+		if (file->ms) {
+			puts(", ");
+			print_size(file->size / file->ms * 1000, "/s");
+		}
+		putc('\n');
+	}
+
+	for (i = 0; i < multi_count; i++) {
+		if (multi_sessions[i].state != TFTP_MULTI_DONE)
+			return;
+	}
+	if (multi_answered)
+		net_server_ether_save(multi_server);
+	net_set_state(NETLOOP_SUCCESS);
+}
+
+/* Take the options the server agreed to; those it left out have defaults */
+static int tftp_multi_oack(struct tftp_session *s, char *opt, uint len)
+{
+	char *end = opt + len;
+	char *val;
+
+	s->blksize = TFTP_BLOCK_SIZE;
+	s->windowsize = 1;
+	while (opt < end) {
+		val = opt + strnlen(opt, end - opt) + 1;
+		if (val >= end)
+			break;
+		if (!strcasecmp(opt, "blksize"))
+			s->blksize = dectoul(val, NULL);
+		else if (!strcasecmp(opt, "windowsize"))
+			s->windowsize = dectoul(val, NULL);
+		opt = val + strnlen(val, end - val) + 1;
+	}
+
+	if (!s->blksize || s->blksize > multi_blksize || !s->windowsize ||
+	    s->windowsize > max(multi_windowsize, 1U))
+		return -EPROTO;
+
+	return 0;
+}
+
+static void tftp_multi_data(struct tftp_session *s, u16 block, uchar *data,
+			   uint len)
+{
+	void *ptr;
+
+	if (s->state == TFTP_MULTI_RRQ) {
+		/* Data without an OACK: the server knows no options */
+		s->blksize = TFTP_BLOCK_SIZE;
+		s->windowsize = 1;
+		s->state = TFTP_MULTI_DATA;
+	}
+
+	if (block != (u16)(s->block + 1)) {
+		/* Ask once for the window again from a gap, ignore old blocks */
+		if ((u16)(block - s->block) < 0x8000 && block != s->block &&
+		    !s->nacked) {
+			s->nacked = true;
+			tftp_multi_ack(s);
+		}
+		return;
+	}
+	if (len > s->blksize)
+		return;
+
+	if (s->file->size + len > s->limit) {
+		tftp_multi_error(s, TFTP_ERR_DISK_FULL, "File too large");
+		tftp_multi_done(s, -ENOSPC);
+		return;
+	}
+	ptr = map_sysmem(s->file->addr + s->file->size, len);
+	memcpy(ptr, data, len);
+	unmap_sysmem(ptr);
+	s->file->size += len;
+
+	s->block = block;
+	s->nacked = false;
+	s->retries = 0;
+	s->last = get_timer(0);
+	if (len < s->blksize) {
+		tftp_multi_ack(s);
+		tftp_multi_done(s, 0);
+	} else if (++s->unacked >= s->windowsize) {
+		tftp_multi_ack(s);
+	}
+}
+
+static struct tftp_session *tftp_multi_find(uint port)
+{
+	int i;
+
+	for (i = 0; i < multi_count; i++) {
+		if (multi_sessions[i].our_port == port)
+			return &multi_sessions[i];
+	}
+
+	return NULL;
+}
+
+/* Send the RRQs held back while the ARP request was going on */
+static void tftp_multi_kick(void)
+{
+	int i;
+
+	for (i = 0; i < multi_count && !arp_is_waiting(); i++) {
+		if (multi_sessions[i].state == TFTP_MULTI_WAIT)
+			tftp_multi_rrq(&multi_sessions[i]);
+	}
+}
+
+static void tftp_multi_handler(uchar *pkt, unsigned int dest,
+			       struct in_addr sip, unsigned int src,
+			       unsigned int len)
+{
+	struct tftp_session *s = tftp_multi_find(dest);
+	u16 op;
+
+	if (!s || sip.s_addr != multi_server.s_addr || len < 4)
+		return;
+	if (s->state == TFTP_MULTI_RRQ)
+		s->remote_port = src;
+	else if (s->state != TFTP_MULTI_DATA || src != s->remote_port)
+		return;
+
+	multi_answered = true;
+	tftp_multi_kick();
+	op = ntohs(*(__be16 *)pkt);
+	pkt += 2;
+	len -= 2;
+	switch (op) {
+	case TFTP_OACK:
+		if (s->state == TFTP_MULTI_RRQ) {
+			if (tftp_multi_oack(s, (char *)pkt, len)) {
+				tftp_multi_error(s, TFTP_ERR_OPTION_NEGOTIATION,
+						 "Option Negotiation Failed");
+				tftp_multi_done(s, -EPROTO);
+				return;
+			}
+			s->state = TFTP_MULTI_DATA;
+			s->retries = 0;
+		}
+		/* ACK 0 starts the transfer, again if the first one got lost */
+		if (!s->block && !s->file->size)
+			tftp_multi_ack(s);
+		break;
+	case TFTP_DATA:
+		tftp_multi_data(s, ntohs(*(__be16 *)pkt), pkt + 2, len - 2);
+		break;
+	case TFTP_ERROR:
+		printf("TFTP error: '%.*s' (%d)\n", len - 2, pkt + 2,
+		       ntohs(*(__be16 *)pkt));
+		tftp_multi_done(s, ntohs(*(__be16 *)pkt) ==
+				TFTP_ERR_FILE_NOT_FOUND ? -ENOENT : -EIO);
+		break;
+	}
+}
+
+static void tftp_multi_timeout(void)
+{
+	struct tftp_session *s;
+	int i;
+
+	for (i = 0; i < multi_count; i++) {
+		s = &multi_sessions[i];
+		if (s->state == TFTP_MULTI_DONE || s->state == TFTP_MULTI_WAIT ||
+		    get_timer(s->last) < multi_timeout_ms)
+			continue;
+
+		if (++s->retries > tftp_timeout_count_max) {
+			tftp_multi_done(s, -ETIMEDOUT);
+		} else if (s->state == TFTP_MULTI_DATA) {
+			tftp_multi_ack(s);
+		} else if (!multi_answered) {
+			/* The server may have a new MAC address: ask again */
+			net_server_ether_forget();
+			memset(net_server_ethaddr, 0, ARP_HLEN);
+			s->state = TFTP_MULTI_WAIT;
+		} else {
+			tftp_multi_rrq(s);
+		}
+	}
+	/* Only one packet can wait for the ARP reply, the others go later */
+	tftp_multi_kick();
+
+	net_set_timeout_handler(TFTP_MULTI_TICK_MS, tftp_multi_timeout);
+}
+
+/* Bytes which may be loaded for file @idx */
+static ulong tftp_multi_limit(struct lmb *lmb, int idx)
+{
+	ulong addr = multi_files[idx].addr;
+	ulong limit = ULONG_MAX;
+	int i;
+
+#ifdef CONFIG_LMB
+	limit = lmb_get_free_size(lmb, addr);
+#endif
+	for (i = 0; i < multi_count; i++) {
+		if (multi_files[i].addr > addr)
+			limit = min(limit, multi_files[i].addr - addr);
+	}
+
+	return limit;
+}
+
+void tftp_multi_start(void)
+{
+	struct tftp_session *s;
+	struct lmb lmb;
+	u16 port;
+	int i;
+
+	multi_server = net_server_ip;
+	multi_server_port = WELL_KNOWN_PORT;
+	multi_blksize = CONFIG_TFTP_BLOCKSIZE;
+	multi_windowsize = CONFIG_TFTP_WINDOWSIZE;
+	multi_timeout_ms = TIMEOUT;
+#if CONFIG_NET_TFTP_VARS
+	multi_blksize = env_get_ulong("tftpblocksize", 10, multi_blksize);
+	multi_windowsize = env_get_ulong("tftpwindowsize", 10,
+					 multi_windowsize);
+	multi_timeout_ms = max(env_get_ulong("tftptimeout", 10,
+					     multi_timeout_ms), 1000UL);
+#endif
+#ifdef CONFIG_TFTP_PORT
+	multi_server_port = env_get_ulong("tftpdstp", 10, multi_server_port);
+#endif
+	multi_blksize = clamp_t(uint, multi_blksize, 8,
+				TFTP_MULTI_MAX_BLKSIZE);
+	/* Keep as many blocks in flight as a single transfer does */
+	multi_windowsize = max(multi_windowsize / multi_count, 1U);
+	multi_answered = false;
+
+	printf("Using %s device\n", eth_get_name());
+	printf("TFTP from server %pI4; our IP address is %pI4\n",
+	       &multi_server, &net_ip);
+
+#ifdef CONFIG_LMB
+	lmb_init_and_reserve(&lmb, gd->bd, (void *)gd->fdt_blob);
+#endif
+	port = 1024 + (get_timer(0) % 3072);
+	memset(multi_sessions, '\0', sizeof(multi_sessions));
+	for (i = 0; i < multi_count; i++) {
+		s = &multi_sessions[i];
+		s->file = &multi_files[i];
+		s->file->size = 0;
+		s->file->ms = 0;
+		s->our_port = port + i;
+		s->limit = tftp_multi_limit(&lmb, i);
+		printf("Loading '%s' to 0x%lx\n", s->file->name, s->file->addr);
+		if (!s->limit || strlen(s->file->name) > TFTP_MULTI_NAME_MAX) {
+			tftp_multi_done(s, s->limit ? -ENAMETOOLONG : -ENOSPC);
+			continue;
+		}
+		s->state = TFTP_MULTI_WAIT;
+	}
+
+	net_server_ether_restore(multi_server);
+	net_set_udp_handler(tftp_multi_handler);
+	tftp_multi_timeout();
+}
+
+int tftp_fetch_files(struct tftp_fetch *files, int count)
+{
+	int ret, i;
+
+	if (count < 1 || count > TFTP_MULTI_MAX)
+		return -EINVAL;
+
+	for (i = 0; i < count; i++)
+		files[i].err = -EINPROGRESS;
+	multi_files = files;
+	multi_count = count;
+	ret = net_loop(TFTPMULTI);
+	multi_count = 0;
+	if (ret < 0)
+		return ret;
+
+	for (i = 0; i < count; i++) {
+		if (files[i].err)
+			return files[i].err;
+	}
+
+	return 0;
+}
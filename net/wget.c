@@ -0,0 +1,537 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * HTTP/1.1 client loading a file over TCP
+ *
+ * The body of the response is stored as it arrives, in memory at
+ * image_load_addr or, through a bounce buffer, on a block device, so a file
+ * written to storage never needs to fit in memory. Both plain and chunked
+ * bodies are handled. The TCP receive window is kept within the room left at
+ * the destination, and the transfer fails as soon as the body goes beyond it.
+ */
+
+#include <common.h>
+#include <blk.h>
+#include <image.h>
+#include <lmb.h>
+#include <log.h>
+#include <malloc.h>
+#include <mapmem.h>
+#include <memalign.h>
+#include <net.h>
+#include <asm/global_data.h>
+#include <net/tcp.h>
+#include <net/wget.h>
+#include <linux/ctype.h>
+#include <linux/math64.h>
+#include <linux/sizes.h>
+
+DECLARE_GLOBAL_DATA_PTR;
+
+#define WGET_DEFAULT_PORT	80
+/* Largest response header accepted */
+#define WGET_HDR_SIZE		2048
+/* Data written to a block device at once */
+#define WGET_BLK_BUF_SIZE	SZ_256K
+/* Bytes per "loading" hash */
+#define WGET_HASH_BYTES		SZ_64K
+/* Bytes of chunk framing, or beyond the room left, which the window allows */
+#define WGET_ROOM_SLACK		SZ_4K
+/* Memory left free below the stack of U-Boot, without LMB */
+#define WGET_STACK_ROOM		SZ_1M
+/* Number of "loading" hashes per line */
+#define HASHES_PER_LINE		65
+
+enum wget_state {
+	WGET_HEADER,		/* status line and header fields */
+	WGET_BODY,		/* body of known or unknown length */
+	WGET_CHUNK_SIZE,	/* size line of a chunk */
+	WGET_CHUNK_DATA,	/* data of a chunk */
+	WGET_CHUNK_END,		/* line end after the data of a chunk */
+	WGET_TRAILER,		/* trailer after the last chunk */
+	WGET_DONE,
+};
+
+static struct in_addr wget_server_ip;
+static u16 wget_server_port;
+static char wget_path[1024];
+static struct blk_desc *wget_blk_desc;
+static lbaint_t wget_blk_start;
+static lbaint_t wget_blk_end;
+
+static enum wget_state wget_state;
+static char wget_hdr[WGET_HDR_SIZE];
+static unsigned int wget_hdr_len;
+static bool wget_has_len;
+static ulong wget_content_len;
+static ulong wget_chunk_left;
+static bool wget_chunk_ext;
+static unsigned int wget_line_len;
+
+/* Bytes which fit in memory or in the partition */
+static ulong wget_max_size;
+static ulong wget_done;
+static ulong wget_hashes;
+static ulong wget_time_start;
+static uchar *wget_blk_buf;
+static unsigned int wget_blk_fill;
+static lbaint_t wget_blk_next;
+
+int wget_set_url(const char *url)
+{
+	const char *path, *colon;
+	ulong port = WGET_DEFAULT_PORT;
+	struct in_addr ip;
+	char host[16];
+	size_t len = 0;
+	char *end;
+
+	if (!strncmp(url, "http://", 7)) {
+		url += 7;
+		path = strchrnul(url, '/');
+		colon = memchr(url, ':', path - url);
+		len = (colon ?: path) - url;
+		if (colon) {
+			port = simple_strtoul(colon + 1, &end, 10);
+			if (end != path || !port || port > 0xffff)
+				return -EINVAL;
+		}
+	} else {
+		path = url;
+		colon = strchr(url, ':');
+		if (colon) {
+			len = colon - url;
+			path = colon + 1;
+		}
+	}
+
+	if (len) {
+		if (len >= sizeof(host))
+			return -EINVAL;
+		memcpy(host, url, len);
+		host[len] = '\0';
+		ip = string_to_ip(host);
+	} else {
+		ip = net_server_ip;
+	}
+	if (!ip.s_addr)
+		return -EINVAL;
+
+	if (snprintf(wget_path, sizeof(wget_path), "%s%s",
+		     *path == '/' ? "" : "/", path) >= sizeof(wget_path))
+		return -EINVAL;
+	wget_server_ip = ip;
+	wget_server_port = port;
+
+	return 0;
+}
+
+void wget_set_blk(struct blk_desc *desc, lbaint_t start, lbaint_t end)
+{
+	wget_blk_desc = desc;
+	wget_blk_start = start;
+	wget_blk_end = end;
+}
+
+static int wget_blk_flush(void)
+{
+	struct blk_desc *desc = wget_blk_desc;
+	lbaint_t count;
+
+	if (!wget_blk_fill)
+		return 0;
+
+	count = DIV_ROUND_UP(wget_blk_fill, desc->blksz);
+	memset(wget_blk_buf + wget_blk_fill, '\0',
+	       count * desc->blksz - wget_blk_fill);
+	if (wget_blk_next + count > wget_blk_end)
+		return -ENOSPC;
+	if (blk_dwrite(desc, wget_blk_next, count, wget_blk_buf) != count)
+		return -EIO;
+	wget_blk_next += count;
+	wget_blk_fill = 0;
+
+	return 0;
+}
+
+static int wget_store(const uchar *data, ulong len)
+{
+	unsigned int chunk;
+	void *ptr;
+	int ret;
+
+	if (wget_done + len > wget_max_size)
+		return -ENOSPC;
+
+	if (wget_blk_desc) {
+		while (len) {
+			chunk = min_t(ulong, len,
+				      WGET_BLK_BUF_SIZE - wget_blk_fill);
+			memcpy(wget_blk_buf + wget_blk_fill, data, chunk);
+			wget_blk_fill += chunk;
+			if (wget_blk_fill == WGET_BLK_BUF_SIZE) {
+				ret = wget_blk_flush();
+				if (ret)
+					return ret;
+			}
+			wget_done += chunk;
+			data += chunk;
+			len -= chunk;
+		}
+	} else {
+		ptr = map_sysmem(image_load_addr + wget_done, len);
+		memcpy(ptr, data, len);
+		unmap_sysmem(ptr);
+		wget_done += len;
+	}
+
+	while (wget_hashes < wget_done / WGET_HASH_BYTES) {
+		putc('#');
+		if (!(++wget_hashes % HASHES_PER_LINE))
+			puts("\n\t ");
+	}
+
+	return 0;
+}
+
+static void wget_fail(const char *msg, int err)
+{
+	printf("\nwget: %s (err=%d)\n", msg, err);
+	tcp_abort();
+	free(wget_blk_buf);
+	wget_blk_buf = NULL;
+	net_set_state(NETLOOP_FAIL);
+}
+
+static int wget_parse_header(void)
+{
+	char *line = wget_hdr;
+	char *eol, *val;
+	ulong status;
+
+	if (strncmp(line, "HTTP/1.", 7))
+		return -EPROTO;
+	eol = strstr(line, "\r\n");
+	*eol = '\0';
+	val = strchr(line, ' ');
+	status = val ? simple_strtoul(val + 1, NULL, 10) : 0;
+	if (status != 200) {
+		printf("\nHTTP error: %s\n", line);
+		return -ENOENT;
+	}
+
+	wget_state = WGET_BODY;
+	for (line = eol + 2; *line; line = eol + 2) {
+		eol = strstr(line, "\r\n");
+		*eol = '\0';
+		val = strchr(line, ':');
+		if (!val)
+			continue;
+		for (val++; *val == ' ' || *val == '\t'; val++)
+			;
+		if (!strncasecmp(line, "Content-Length:", 15)) {
+			wget_content_len = simple_strtoul(val, NULL, 10);
+			wget_has_len = true;
+		} else if (!strncasecmp(line, "Transfer-Encoding:", 18) &&
+			   strstr(val, "chunked")) {
+			wget_state = WGET_CHUNK_SIZE;
+		}
+	}
+
+	/* A chunked body has no length, even if the server gives one */
+	if (wget_state == WGET_CHUNK_SIZE) {
+		wget_has_len = false;
+		wget_chunk_left = 0;
+		wget_chunk_ext = false;
+	} else if (wget_has_len) {
+		if (wget_content_len > wget_max_size)
+			return -ENOSPC;
+		if (!wget_content_len)
+			wget_state = WGET_DONE;
+	}
+
+	return 0;
+}
+
+/* Consume header bytes, returning how many were used */
+static int wget_header(const uchar *data, unsigned int len)
+{
+	unsigned int i;
+	int ret;
+
+	for (i = 0; i < len; i++) {
+		if (wget_hdr_len == WGET_HDR_SIZE - 1)
+			return -E2BIG;
+		wget_hdr[wget_hdr_len++] = data[i];
+		if (wget_hdr_len >= 4 &&
+		    !memcmp(wget_hdr + wget_hdr_len - 4, "\r\n\r\n", 4)) {
+			/* Keep the CRLF ending the last header line */
+			wget_hdr[wget_hdr_len - 2] = '\0';
+			ret = wget_parse_header();
+			if (ret)
+				return ret;
+			return i + 1;
+		}
+	}
+
+	return len;
+}
+
+/* Consume chunk framing bytes, returning how many were used */
+static int wget_chunk_framing(const uchar *data, unsigned int len)
+{
+	unsigned int i;
+	uchar c;
+
+	for (i = 0; i < len && wget_state != WGET_CHUNK_DATA &&
+	     wget_state != WGET_DONE; i++) {
+		c = data[i];
+		switch (wget_state) {
+		case WGET_CHUNK_SIZE:
+			if (c == '\n') {
+				wget_state = wget_chunk_left ? WGET_CHUNK_DATA :
+					     WGET_TRAILER;
+				wget_line_len = 0;
+			} else if (!wget_chunk_ext && isxdigit(c)) {
+				if (wget_chunk_left > (ULONG_MAX >> 4))
+					return -EPROTO;
+				wget_chunk_left = wget_chunk_left << 4 |
+					(isdigit(c) ? c - '0' :
+					 tolower(c) - 'a' + 10);
+			} else {
+				/* Chunk extensions are ignored */
+				wget_chunk_ext = true;
+			}
+			break;
+		case WGET_CHUNK_END:
+			if (c == '\n') {
+				wget_state = WGET_CHUNK_SIZE;
+				wget_chunk_left = 0;
+				wget_chunk_ext = false;
+			}
+			break;
+		case WGET_TRAILER:
+			if (c == '\n') {
+				if (!wget_line_len)
+					wget_state = WGET_DONE;
+				wget_line_len = 0;
+			} else if (c != '\r') {
+				wget_line_len++;
+			}
+			break;
+		default:
+			break;
+		}
+	}
+
+	return i;
+}
+
+static void wget_receive(const uchar *data, unsigned int len)
+{
+	ulong chunk;
+	int ret = 0;
+
+	while (len && wget_state != WGET_DONE) {
+		switch (wget_state) {
+		case WGET_HEADER:
+			ret = wget_header(data, len);
+			chunk = ret;
+			break;
+		case WGET_BODY:
+			chunk = len;
+			if (wget_has_len)
+				chunk = min(chunk, wget_content_len - wget_done);
+			ret = wget_store(data, chunk);
+			if (wget_has_len && wget_done == wget_content_len)
+				wget_state = WGET_DONE;
+			break;
+		case WGET_CHUNK_DATA:
+			chunk = min_t(ulong, len, wget_chunk_left);
+			ret = wget_store(data, chunk);
+			wget_chunk_left -= chunk;
+			if (!wget_chunk_left)
+				wget_state = WGET_CHUNK_END;
+			break;
+		default:
+			ret = wget_chunk_framing(data, len);
+			chunk = ret;
+			break;
+		}
+		if (ret < 0) {
+			wget_fail(ret == -ENOSPC ? "File too large" :
+				  wget_state == WGET_HEADER ? "Bad response" :
+				  "Transfer failed", ret);
+			return;
+		}
+		data += chunk;
+		len -= chunk;
+	}
+
+	if (wget_state == WGET_DONE && tcp_get_state() == TCP_ESTABLISHED)
+		tcp_close();
+}
+
+/*
+ * Bytes the server may still send. The header and the framing of a chunked
+ * body are not stored, so some slack is left for them; anything sent within
+ * that slack which is part of the body shows that the file is too large.
+ */
+static ulong wget_room(void)
+{
+	ulong left = wget_max_size - wget_done;
+	ulong slack = WGET_ROOM_SLACK;
+
+	/* The header made sure that the body fits */
+	if (wget_state != WGET_HEADER && wget_has_len)
+		return wget_content_len - wget_done;
+	if (wget_state == WGET_HEADER)
+		slack += WGET_HDR_SIZE;
+
+	return left > ULONG_MAX - slack ? ULONG_MAX : left + slack;
+}
+
+static void wget_connected(void)
+{
+	char req[sizeof(wget_path) + 128];
+	char port[8] = "";
+	int len;
+
+	if (wget_server_port != WGET_DEFAULT_PORT)
+		snprintf(port, sizeof(port), ":%u", wget_server_port);
+	len = snprintf(req, sizeof(req),
+		       "GET %s HTTP/1.1\r\n"
+		       "Host: %pI4%s\r\n"
+		       "User-Agent: U-Boot\r\n"
+		       "Accept: */*\r\n"
+		       "Connection: close\r\n\r\n",
+		       wget_path, &wget_server_ip, port);
+	if (tcp_send(req, len))
+		wget_fail("Cannot send request", -ENOSPC);
+}
+
+static void wget_complete(void)
+{
+	const struct tcp_stats *stats = tcp_get_stats();
+	ulong time;
+
+	time = get_timer(wget_time_start);
+	if (time > 0) {
+		puts("\n\t ");	/* Line up with "Loading: " */
+		print_size(div_u64((u64)wget_done * 1000, time), "/s");
+	}
+	puts("\ndone\n");
+	printf("TCP: %lu segments, %lu out of order, %lu duplicate, %lu retransmitted, window scale %d\n",
+	       stats->rx_segs, stats->rx_ooo, stats->rx_dup,
+	       stats->tx_rexmit + stats->tx_fast_rexmit, stats->wscale);
+
+	net_boot_file_size = wget_done;
+	net_set_state(NETLOOP_SUCCESS);
+}
+
+static void wget_closed(int err)
+{
+	int ret;
+
+	/* Without a length the body ends when the server closes */
+	if (wget_state == WGET_BODY && !wget_has_len && !err)
+		wget_state = WGET_DONE;
+
+	if (wget_state != WGET_DONE) {
+		wget_fail(err == -ECONNRESET ? "Connection reset" :
+			  err == -ETIMEDOUT ? "Connection timed out" :
+			  "Connection closed early", err ?: -EPIPE);
+		return;
+	}
+
+	if (wget_blk_desc) {
+		ret = wget_blk_flush();
+		free(wget_blk_buf);
+		wget_blk_buf = NULL;
+		if (ret) {
+			wget_fail("Write failed", ret);
+			return;
+		}
+	}
+	wget_complete();
+}
+
+static const struct tcp_ops wget_tcp_ops = {
+	.connected	= wget_connected,
+	.receive	= wget_receive,
+	.room		= wget_room,
+	.closed		= wget_closed,
+};
+
+static int wget_init_load_size(void)
+{
+#ifdef CONFIG_LMB
+	struct lmb lmb;
+
+	lmb_init_and_reserve(&lmb, gd->bd, (void *)gd->fdt_blob);
+	wget_max_size = lmb_get_free_size(&lmb, image_load_addr);
+#else
+	ulong addr = image_load_addr;
+	ulong stack = gd->start_addr_sp - WGET_STACK_ROOM;
+	int i;
+
+	/* The rest of the bank, but U-Boot sits above its stack */
+	wget_max_size = 0;
+	if (addr >= stack && addr < gd->ram_top)
+		return -ENOMEM;
+	for (i = 0; i < CONFIG_NR_DRAM_BANKS; i++) {
+		if (addr >= gd->bd->bi_dram[i].start &&
+		    addr - gd->bd->bi_dram[i].start < gd->bd->bi_dram[i].size)
+			wget_max_size = gd->bd->bi_dram[i].size -
+					(addr - gd->bd->bi_dram[i].start);
+	}
+	if (addr < stack)
+		wget_max_size = min(wget_max_size, stack - addr);
+#endif
+	if (!wget_max_size)
+		return -ENOMEM;
+
+	return 0;
+}
+
+void wget_start(void)
+{
+	wget_state = WGET_HEADER;
+	wget_hdr_len = 0;
+	wget_has_len = false;
+	wget_content_len = 0;
+	wget_done = 0;
+	wget_hashes = 0;
+	wget_blk_fill = 0;
+	wget_blk_next = wget_blk_start;
+
+	printf("HTTP from server %pI4:%u; our IP address is %pI4\n",
+	       &wget_server_ip, wget_server_port, &net_ip);
+	printf("Filename '%s'.\n", wget_path);
+	if (wget_blk_desc) {
+		printf("Writing to %s %d from block 0x" LBAF "\n",
+		       blk_get_if_type_name(wget_blk_desc->if_type),
+		       wget_blk_desc->devnum, wget_blk_start);
+		if (wget_blk_start >= wget_blk_end) {
+			wget_fail("No room in the partition", -ENOSPC);
+			return;
+		}
+		wget_max_size = min_t(u64, (u64)(wget_blk_end - wget_blk_start) *
+				      wget_blk_desc->blksz, ULONG_MAX);
+		free(wget_blk_buf);
+		wget_blk_buf = malloc_cache_aligned(WGET_BLK_BUF_SIZE);
+		if (!wget_blk_buf) {
+			wget_fail("Out of memory", -ENOMEM);
+			return;
+		}
+	} else {
+		if (wget_init_load_size()) {
+			wget_fail("Cannot load to this address", -ENOMEM);
+			return;
+		}
+		printf("Load address: 0x%lx\n", image_load_addr);
+	}
+	puts("Loading: *\b");
+
+	wget_time_start = get_timer(0);
+	tcp_connect(wget_server_ip, wget_server_port, &wget_tcp_ops);
+}
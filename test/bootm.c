@@ -7,6 +7,8 @@
 
 #include <common.h>
 #include <bootm.h>
+#include <lmb.h>
+#include <mapmem.h>
 #include <asm/global_data.h>
 #include <test/suites.h>
 #include <test/test.h>
@@ -238,6 +240,53 @@ static int bootm_test_subst_both(struct unit_test_state *uts)
 }
 BOOTM_TEST(bootm_test_subst_both, 0);
 
+/* Test where a kernel is allowed to run from where its data is */
+static int bootm_test_in_place(struct unit_test_state *uts)
+{
+	bootm_headers_t images;
+	image_info_t *os = &images.os;
+	ulong start = 0x101000;
+
+	memset(&images, '\0', sizeof(images));
+	lmb_init(&images.lmb);
+	ut_assert(lmb_add(&images.lmb, 0x100000, 0x100000) >= 0);
+
+	/* The kernel data ends the blob, its BSS goes beyond */
+	os->start = 0x100000;
+	os->image_start = start;
+	os->image_len = 0x10000;
+	os->end = start + 0x10000;
+	ut_assert(bootm_in_place_ok(&images, start, 0x40000));
+
+	/* Loadables after the kernel data would be overwritten by the BSS */
+	os->end = start + 0x18000;
+	ut_assert(!bootm_in_place_ok(&images, start, 0x40000));
+	ut_assert(bootm_in_place_ok(&images, start, 0x10000));
+	os->end = start + 0x10000;
+
+	/* Nor may it overwrite the ramdisk or the FDT */
+	images.rd_start = start + 0x30000;
+	images.rd_end = start + 0x38000;
+	ut_assert(!bootm_in_place_ok(&images, start, 0x40000));
+	ut_assert(bootm_in_place_ok(&images, start, 0x30000));
+	images.rd_start = 0;
+	images.rd_end = 0;
+
+	images.ft_addr = map_sysmem(start + 0x3f000, 0);
+	images.ft_len = 0x1000;
+	ut_assert(!bootm_in_place_ok(&images, start, 0x40000));
+	images.ft_addr = NULL;
+	images.ft_len = 0;
+
+	/* The memory must be free */
+	ut_assert(lmb_reserve(&images.lmb, start + 0x20000, 0x1000) >= 0);
+	ut_assert(!bootm_in_place_ok(&images, start, 0x40000));
+	ut_assert(bootm_in_place_ok(&images, start, 0x20000));
+
+	return 0;
+}
+BOOTM_TEST(bootm_test_in_place, 0);
+
 int do_ut_bootm(struct cmd_tbl *cmdtp, int flag, int argc, char *const argv[])
 {
 	struct unit_test *tests = UNIT_TEST_SUITE_START(bootm_test);
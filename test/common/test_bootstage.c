@@ -0,0 +1,272 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * Unit tests for the timings of device probes and init functions
+ */
+
+#include <common.h>
+#include <bloblist.h>
+#include <bootstage.h>
+#include <command.h>
+#include <env.h>
+#include <malloc.h>
+#include <mapmem.h>
+#include <asm/global_data.h>
+#include <test/common.h>
+#include <test/test.h>
+#include <test/ut.h>
+
+DECLARE_GLOBAL_DATA_PTR;
+
+#define TRACE_TEST_BLOBLIST_SIZE	0x1000
+#define TRACE_TEST_EXTRA		5
+
+/*
+ * Check that @str is a single JSON object: brackets match, strings end and
+ * only escape '"' and '\', and no comma comes before a closing bracket
+ */
+static int trace_check_json(struct unit_test_state *uts, const char *str)
+{
+	char stack[4], prev = '\0';
+	bool in_str = false;
+	int depth = 0;
+
+	ut_asserteq('{', *str);
+	for (; *str; str++) {
+		if (in_str) {
+			ut_assert((u8)*str >= ' ');
+			if (*str == '\\') {
+				str++;
+				ut_assert(*str == '"' || *str == '\\');
+			} else if (*str == '"') {
+				in_str = false;
+			}
+			continue;
+		}
+		switch (*str) {
+		case '"':
+			in_str = true;
+			break;
+		case '{':
+		case '[':
+			ut_assert(depth < sizeof(stack));
+			stack[depth++] = *str;
+			break;
+		case '}':
+		case ']':
+			ut_assert(depth);
+			ut_asserteq(*str == '}' ? '{' : '[', stack[--depth]);
+			ut_assert(prev != ',');
+			break;
+		}
+		if (*str != ' ' && *str != '\n')
+			prev = *str;
+		if (!depth)
+			break;
+	}
+	ut_assert(!in_str);
+	ut_asserteq(0, depth);
+	ut_asserteq_str("}\n", str);
+
+	return 0;
+}
+
+/* Get the JSON text of the timings, allocated */
+static char *trace_get_json(void)
+{
+	int len = bootstage_trace_json(NULL, 0);
+	char *buf;
+
+	buf = malloc(len + 1);
+	if (buf)
+		bootstage_trace_json(buf, len + 1);
+
+	return buf;
+}
+
+/* Test the JSON text: escaping, init functions, marks and truncation */
+static int bootstage_test_trace_json(struct unit_test_state *uts)
+{
+	struct bootstage_data *old = gd->bootstage;
+	char *json, buf[20];
+	int len;
+
+	/* Start afresh, with only the "reset" mark */
+	ut_assertok(bootstage_init(true));
+	bootstage_trace_add(BOOTSTAGE_TRACE_PROBE, "a\"b\\c\td", 0, 1000);
+	bootstage_trace_add(BOOTSTAGE_TRACE_PROBE, "a-very-long-device", 0,
+			    2000);
+	bootstage_trace_add(BOOTSTAGE_TRACE_INITCALL, NULL, 0x1234, 3000);
+
+	/* Nothing is recorded without a start time */
+	bootstage_trace_add(BOOTSTAGE_TRACE_PROBE, "none", 0, 0);
+
+	json = trace_get_json();
+	ut_assertnonnull(json);
+	ut_assertok(trace_check_json(uts, json));
+	ut_assertnonnull(strstr(json,
+		"{\"name\":\"a\\\"b\\\\cd\",\"cat\":\"probe\",\"ph\":\"X\",\"ts\":1000,\"dur\":"));
+	ut_assertnonnull(strstr(json,
+		"{\"name\":\"a-very-long-de\",\"cat\":\"probe\","));
+	ut_assertnonnull(strstr(json,
+		"{\"name\":\"0x1234\",\"cat\":\"initcall\",\"ph\":\"X\",\"ts\":3000,"));
+	ut_assertnonnull(strstr(json,
+		"{\"name\":\"reset\",\"cat\":\"bootstage\",\"ph\":\"i\",\"s\":\"g\",\"ts\":0,"));
+	ut_assertnull(strstr(json, "none"));
+
+	/* Like snprintf(), the length of the whole text comes back */
+	len = strlen(json);
+	ut_asserteq(len, bootstage_trace_json(NULL, 0));
+	ut_asserteq(len, bootstage_trace_json(buf, sizeof(buf)));
+	ut_asserteq(sizeof(buf) - 1, strlen(buf));
+	ut_asserteq_mem(json, buf, sizeof(buf) - 1);
+	ut_asserteq(len, bootstage_trace_json(buf, 1));
+	ut_asserteq_str("", buf);
+
+	free(json);
+	free(gd->bootstage);
+	gd->bootstage = old;
+
+	return 0;
+}
+COMMON_TEST(bootstage_test_trace_json, 0);
+
+/* Add more timings than the ring holds */
+static void trace_fill_ring(void)
+{
+	char name[BOOTSTAGE_TRACE_NAME_LEN];
+	int i;
+
+	for (i = 0; i < CONFIG_BOOTSTAGE_TRACE_COUNT + TRACE_TEST_EXTRA; i++) {
+		snprintf(name, sizeof(name), "dev%d", i);
+		bootstage_trace_add(BOOTSTAGE_TRACE_PROBE, name, 0, 1000 + i);
+	}
+}
+
+/* Test that the oldest timings are dropped once the ring is full */
+static int bootstage_test_trace_ring(struct unit_test_state *uts)
+{
+	struct bootstage_data *old = gd->bootstage;
+	char name[BOOTSTAGE_TRACE_NAME_LEN], *json;
+
+	ut_assertok(bootstage_init(true));
+	trace_fill_ring();
+	json = trace_get_json();
+	ut_assertnonnull(json);
+	ut_assertok(trace_check_json(uts, json));
+	snprintf(name, sizeof(name), "\"dev%d\"", TRACE_TEST_EXTRA - 1);
+	ut_assertnull(strstr(json, name));
+	snprintf(name, sizeof(name), "\"dev%d\"", TRACE_TEST_EXTRA);
+	ut_assertnonnull(strstr(json, name));
+	snprintf(name, sizeof(name), "\"dev%d\"",
+		 CONFIG_BOOTSTAGE_TRACE_COUNT + TRACE_TEST_EXTRA - 1);
+	ut_assertnonnull(strstr(json, name));
+
+	free(json);
+	free(gd->bootstage);
+	gd->bootstage = old;
+
+	return 0;
+}
+COMMON_TEST(bootstage_test_trace_ring, 0);
+
+#if CONFIG_IS_ENABLED(BLOBLIST)
+/* Test handing the timings over to the OS in the bloblist */
+static int bootstage_test_trace_handoff(struct unit_test_state *uts)
+{
+	struct bootstage_data *old = gd->bootstage;
+	struct bloblist_hdr *old_bloblist = gd->bloblist;
+	char name[BOOTSTAGE_TRACE_NAME_LEN], *bloblist;
+	struct bootstage_trace_rec *recs;
+	struct bootstage_trace_hdr *hdr;
+	int i, size;
+
+	bloblist = memalign(BLOBLIST_ALIGN, TRACE_TEST_BLOBLIST_SIZE);
+	ut_assertnonnull(bloblist);
+	ut_assertok(bloblist_new(map_to_sysmem(bloblist),
+				 TRACE_TEST_BLOBLIST_SIZE, 0));
+
+	/* The OS gets the timings left, oldest first, and how many were lost */
+	ut_assertok(bootstage_init(true));
+	trace_fill_ring();
+	ut_assertok(bootstage_trace_handoff());
+	size = sizeof(*hdr) + CONFIG_BOOTSTAGE_TRACE_COUNT * sizeof(*recs);
+	hdr = bloblist_find(BLOBLISTT_BOOTSTAGE_TRACE, size);
+	ut_assertnonnull(hdr);
+	ut_asserteq(BOOTSTAGE_TRACE_VERSION, hdr->version);
+	ut_asserteq(CONFIG_BOOTSTAGE_TRACE_COUNT, hdr->count);
+	ut_asserteq(sizeof(*recs), hdr->rec_size);
+	ut_asserteq(TRACE_TEST_EXTRA, hdr->dropped);
+	recs = (struct bootstage_trace_rec *)(hdr + 1);
+	for (i = 0; i < hdr->count; i++) {
+		snprintf(name, sizeof(name), "dev%d", i + TRACE_TEST_EXTRA);
+		ut_asserteq_str(name, recs[i].name);
+		ut_asserteq(BOOTSTAGE_TRACE_PROBE, recs[i].type);
+		ut_asserteq(1000 + i + TRACE_TEST_EXTRA, recs[i].start_us);
+	}
+	ut_assertok(bloblist_check(map_to_sysmem(bloblist),
+				   TRACE_TEST_BLOBLIST_SIZE));
+
+	/* Handing over again, with fewer timings, updates the same record */
+	free(gd->bootstage);
+	ut_assertok(bootstage_init(true));
+	bootstage_trace_add(BOOTSTAGE_TRACE_INITCALL, NULL, 0x1234, 1000);
+	ut_assertok(bootstage_trace_handoff());
+	hdr = bloblist_find(BLOBLISTT_BOOTSTAGE_TRACE,
+			    sizeof(*hdr) + sizeof(*recs));
+	ut_assertnonnull(hdr);
+	ut_asserteq(1, hdr->count);
+	ut_asserteq(0, hdr->dropped);
+	recs = (struct bootstage_trace_rec *)(hdr + 1);
+	ut_asserteq(BOOTSTAGE_TRACE_INITCALL, recs->type);
+	ut_asserteq(0x1234, recs->addr);
+	ut_asserteq_str("", recs->name);
+	ut_assertok(bloblist_check(map_to_sysmem(bloblist),
+				   TRACE_TEST_BLOBLIST_SIZE));
+
+	gd->bloblist = old_bloblist;
+	free(bloblist);
+	free(gd->bootstage);
+	gd->bootstage = old;
+
+	return 0;
+}
+COMMON_TEST(bootstage_test_trace_handoff, 0);
+#endif
+
+/* Test the 'bootstage trace' command */
+static int bootstage_test_trace_cmd(struct unit_test_state *uts)
+{
+	struct bootstage_data *old = gd->bootstage;
+	char *json, *buf, cmd[40];
+	ulong addr;
+	int len;
+
+	ut_assertok(bootstage_init(true));
+	bootstage_trace_add(BOOTSTAGE_TRACE_PROBE, "dev", 0, 1000);
+	json = trace_get_json();
+	ut_assertnonnull(json);
+	len = strlen(json);
+	buf = malloc(len + 1);
+	ut_assertnonnull(buf);
+	addr = map_to_sysmem(buf);
+
+	console_record_reset_enable();
+	snprintf(cmd, sizeof(cmd), "bootstage trace %lx %x", addr, len);
+	ut_assert(run_command(cmd, 0));
+	ut_assert_nextline("Trace needs %x bytes", len + 1);
+	ut_assert_console_end();
+
+	snprintf(cmd, sizeof(cmd), "bootstage trace %lx", addr);
+	ut_assertok(run_command(cmd, 0));
+	ut_assert_console_end();
+	ut_asserteq(len, env_get_hex("filesize", 0));
+	ut_asserteq_str(json, buf);
+
+	free(buf);
+	free(json);
+	free(gd->bootstage);
+	gd->bootstage = old;
+
+	return 0;
+}
+COMMON_TEST(bootstage_test_trace_cmd, UT_TESTF_CONSOLE_REC);
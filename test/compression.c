@@ -12,6 +12,7 @@
 #include <malloc.h>
 #include <mapmem.h>
 #include <asm/io.h>
+#include <asm/unaligned.h>
 
 #include <u-boot/lz4.h>
 #include <u-boot/zlib.h>
@@ -440,6 +441,177 @@ static int compression_test_lz4(struct unit_test_state *uts)
 }
 COMPRESSION_TEST(compression_test_lz4, 0);
 
+#define LZ4_TEST_HASH_BITS	12
+#define LZ4_TEST_CORPUS_SIZE	0x8000
+
+/*
+ * lz4_test_compress_block() - Minimal greedy LZ4 block compressor
+ *
+ * There is no lz4 compression in u-boot, but the decoders must be checked on
+ * more than one fixed stream, so produce valid (if not very tight) blocks.
+ * Return: compressed size, or -1 if @dst_max is too small
+ */
+static int lz4_test_compress_block(const u8 *src, int src_size, u8 *dst,
+				   int dst_max)
+{
+	int table[1 << LZ4_TEST_HASH_BITS];
+	const int match_limit = src_size - 12;	/* MFLIMIT */
+	const int last_literals = src_size - 5;	/* LASTLITERALS */
+	int anchor = 0, ip = 0, op = 0;
+	int lit, len, i;
+
+	for (i = 0; i < ARRAY_SIZE(table); i++)
+		table[i] = -1;
+
+	while (1) {
+		int ref = -1;
+
+		while (ip < match_limit) {
+			u32 seq = get_unaligned_le32(src + ip);
+			u32 h = (seq * 2654435761U) >> (32 - LZ4_TEST_HASH_BITS);
+
+			ref = table[h];
+			table[h] = ip;
+			if (ref >= 0 && ip - ref <= 0xffff &&
+			    get_unaligned_le32(src + ref) == seq)
+				break;
+			ip++;
+		}
+		if (ip >= match_limit)
+			break;
+
+		for (len = 4; ip + len < last_literals &&
+		     src[ref + len] == src[ip + len]; len++)
+			;
+
+		lit = ip - anchor;
+		if (op + 1 + lit / 255 + 1 + lit + 2 + len / 255 + 1 > dst_max)
+			return -1;
+		dst[op++] = (min(lit, 15) << 4) | min(len - 4, 15);
+		if (lit >= 15) {
+			for (i = lit - 15; i >= 255; i -= 255)
+				dst[op++] = 255;
+			dst[op++] = i;
+		}
+		memcpy(dst + op, src + anchor, lit);
+		op += lit;
+		put_unaligned_le16(ip - ref, dst + op);
+		op += 2;
+		if (len - 4 >= 15) {
+			for (i = len - 4 - 15; i >= 255; i -= 255)
+				dst[op++] = 255;
+			dst[op++] = i;
+		}
+		ip += len;
+		anchor = ip;
+	}
+
+	lit = src_size - anchor;
+	if (op + 1 + lit / 255 + 1 + lit > dst_max)
+		return -1;
+	dst[op++] = min(lit, 15) << 4;
+	if (lit >= 15) {
+		for (i = lit - 15; i >= 255; i -= 255)
+			dst[op++] = 255;
+		dst[op++] = i;
+	}
+	memcpy(dst + op, src + anchor, lit);
+
+	return op + lit;
+}
+
+/*
+ * Fill @buf with a mix of text, incompressible runs and repeating patterns of
+ * every period from 1 to 40, so that all overlap-copy cases are exercised
+ */
+static void lz4_test_fill_corpus(u8 *buf, int size)
+{
+	u32 seed = 0x1234567;
+	int pos = 0, period = 1;
+
+	while (pos < size) {
+		int len, i;
+
+		seed = seed * 1103515245 + 12345;
+		len = min(size - pos, (int)(seed >> 16) % 700 + 1);
+		switch ((seed >> 8) % 3) {
+		case 0:
+			for (i = 0; i < len; i++)
+				buf[pos + i] = plain[(pos + i) % strlen(plain)];
+			break;
+		case 1:
+			for (i = 0; i < len; i++) {
+				seed = seed * 1103515245 + 12345;
+				buf[pos + i] = seed >> 16;
+			}
+			break;
+		default:
+			for (i = 0; i < len; i++)
+				buf[pos + i] = i < period ? 'a' + i % 26 :
+					buf[pos + i - period];
+			period = period % 40 + 1;
+			break;
+		}
+		pos += len;
+	}
+}
+
+static int compression_test_lz4_fast_path(struct unit_test_state *uts)
+{
+	const int size = LZ4_TEST_CORPUS_SIZE;
+	u8 *orig, *comp, *out_ref, *out;
+	int comp_size, n;
+
+	orig = malloc(size);
+	comp = malloc(size * 2);
+	out_ref = malloc(size + 1);
+	out = malloc(size + 1);
+	ut_assertnonnull(orig);
+	ut_assertnonnull(comp);
+	ut_assertnonnull(out_ref);
+	ut_assertnonnull(out);
+	lz4_test_fill_corpus(orig, size);
+
+	for (n = 1; n <= size; n = n < 200 ? n + 1 : n * 5 / 4 + 7) {
+		comp_size = lz4_test_compress_block(orig, n, comp, size * 2);
+		ut_assert(comp_size > 0);
+
+		/* Both decoders agree with the original data */
+		ut_asserteq(n, LZ4_decompress_safe_ref((char *)comp,
+						       (char *)out_ref,
+						       comp_size, n));
+		ut_asserteq_mem(orig, out_ref, n);
+		memset(out, 'A', n + 1);
+		ut_asserteq(n, LZ4_decompress_safe((char *)comp, (char *)out,
+						   comp_size, n));
+		ut_asserteq_mem(out_ref, out, n);
+		ut_asserteq('A', out[n]);
+
+		/* Neither may overrun a short output buffer */
+		if (n > 1) {
+			memset(out, 'A', n);
+			ut_assert(LZ4_decompress_safe((char *)comp, (char *)out,
+						      comp_size, n - 1) < 0);
+			ut_asserteq('A', out[n - 1]);
+			ut_assert(LZ4_decompress_safe_ref((char *)comp,
+							  (char *)out_ref,
+							  comp_size, n - 1) < 0);
+		}
+
+		/* Truncated input is rejected */
+		ut_assert(LZ4_decompress_safe((char *)comp, (char *)out,
+					      comp_size - 1, n) < 0);
+	}
+
+	free(out);
+	free(out_ref);
+	free(comp);
+	free(orig);
+
+	return 0;
+}
+COMPRESSION_TEST(compression_test_lz4_fast_path, 0);
+
 static int compress_using_none(struct unit_test_state *uts,
 			       void *in, unsigned long in_size,
 			       void *out, unsigned long out_max,
@@ -0,0 +1,82 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * Test probing only the devices on the boot path during start-up
+ */
+
+#include <common.h>
+#include <blk.h>
+#include <dm.h>
+#include <env.h>
+#include <mmc.h>
+#include <net.h>
+#include <dm/root.h>
+#include <dm/test.h>
+#include <dm/uclass-internal.h>
+#include <test/test.h>
+#include <test/ut.h>
+
+/* Test that start-up code leaves the devices off the boot path alone */
+static int dm_test_boot_path(struct unit_test_state *uts)
+{
+	struct udevice *mmc0, *mmc1, *eth0, *eth4, *eth5, *dev;
+	struct blk_desc *desc;
+
+	ut_assertok(uclass_find_device_by_name(UCLASS_MMC, "mmc0", &mmc0));
+	ut_assertok(uclass_find_device_by_name(UCLASS_MMC, "mmc1", &mmc1));
+	ut_assertok(uclass_find_device_by_name(UCLASS_ETH, "eth@10002000",
+					       &eth0));
+	ut_assertok(uclass_find_device_by_name(UCLASS_ETH, "eth@10004000",
+					       &eth4));
+	ut_assertok(uclass_find_device_by_name(UCLASS_ETH, "eth@10003000",
+					       &eth5));
+
+	/* Nothing is deferred outside start-up, or without a boot path */
+	ut_assert(!dm_probe_deferred(mmc0));
+	env_set("bootdevices", NULL);
+	dm_boot_path_begin();
+	ut_assert(!dm_probe_deferred(mmc0));
+
+	/* An alias and a path; buses above them are on the path too */
+	env_set("bootdevices", "mmc1  /eth@10004000");
+	dm_boot_path_begin();
+	ut_assert(dm_probe_deferred(mmc0));
+	ut_assert(!dm_probe_deferred(mmc1));
+	ut_assert(dm_probe_deferred(eth0));
+	ut_assert(!dm_probe_deferred(eth4));
+	ut_assert(!dm_probe_deferred(dm_root()));
+
+	/* Start-up probes only the devices on the path */
+	print_mmc_devices(',');
+	ut_assert(!device_active(mmc0));
+	ut_assert(device_active(mmc1));
+
+	/* and the Ethernet devices whose MAC address must be written */
+	env_set("eth5macskip", "1");
+	ut_asserteq(4, eth_initialize());
+	ut_assert(device_active(eth0));
+	ut_assert(device_active(eth4));
+	ut_assert(!device_active(eth5));
+	env_set("eth5macskip", NULL);
+
+	/* A command needing another device probes it */
+	dm_boot_path_end();
+	ut_assertok(blk_get_device_by_str("mmc", "0", &desc));
+	ut_assert(device_active(mmc0));
+	ut_assertok(uclass_get_device_by_name(UCLASS_ETH, "eth@10003000",
+					      &dev));
+	ut_asserteq_ptr(eth5, dev);
+	ut_assert(device_active(eth5));
+
+	/* 'all' probes everything */
+	env_set("bootdevices", "all");
+	dm_boot_path_begin();
+	ut_assert(!dm_probe_deferred(mmc0));
+	env_set("bootdevices", "/no-such-node");
+	dm_boot_path_begin();
+	ut_assert(!dm_probe_deferred(mmc0));
+	dm_boot_path_end();
+	env_set("bootdevices", NULL);
+
+	return 0;
+}
+DM_TEST(dm_test_boot_path, UT_TESTF_SCAN_FDT);
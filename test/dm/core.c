@@ -11,12 +11,15 @@
 #include <fdtdec.h>
 #include <log.h>
 #include <malloc.h>
+#include <time.h>
 #include <asm/global_data.h>
 #include <dm/device-internal.h>
+#include <dm/lists.h>
 #include <dm/root.h>
 #include <dm/util.h>
 #include <dm/test.h>
 #include <dm/uclass-internal.h>
+#include <linux/err.h>
 #include <test/test.h>
 #include <test/ut.h>
 
@@ -1217,3 +1220,532 @@ static int dm_test_dma_offset(struct unit_test_state *uts)
 }
 DM_TEST(dm_test_dma_offset, UT_TESTF_SCAN_PDATA | UT_TESTF_SCAN_FDT);
 #endif
+
+#if CONFIG_IS_ENABLED(DM_COMPAT_INDEX)
+#define COMPAT_TEST_MAX_DEVS	1024
+
+/**
+ * struct compat_test_dev - A device bound from the device tree
+ *
+ * @node: node of the device
+ * @drv: driver of the device
+ */
+struct compat_test_dev {
+	ofnode node;
+	const struct driver *drv;
+};
+
+/* Record the devices under @parent, depth first, returning the new count */
+static int compat_test_record(struct udevice *parent,
+			      struct compat_test_dev *devs, int count)
+{
+	struct udevice *dev;
+
+	device_foreach_child(dev, parent) {
+		if (count < COMPAT_TEST_MAX_DEVS) {
+			devs[count].node = dev_ofnode(dev);
+			devs[count].drv = dev->driver;
+		}
+		count = compat_test_record(dev, devs, count + 1);
+	}
+
+	return count;
+}
+
+/* Check the lookup of every compatible string under @parent both ways */
+static int compat_test_lookup(struct unit_test_state *uts, ofnode parent,
+			      struct dm_compat_index *index, int *countp)
+{
+	const struct udevice_id *id, *lin_id;
+	struct driver *drv, *lin_drv;
+	const char *compat;
+	ofnode node;
+	int i;
+
+	ofnode_for_each_subnode(node, parent) {
+		for (i = 0; !ofnode_read_string_index(node, "compatible", i,
+						      &compat); i++) {
+			gd->dm_compat_index = index;
+			drv = lists_driver_lookup_compat(compat, &id);
+			gd->dm_compat_index = ERR_PTR(-ENOSYS);
+			lin_drv = lists_driver_lookup_compat(compat, &lin_id);
+			ut_asserteq_ptr(lin_drv, drv);
+			if (drv)
+				ut_asserteq_ptr(lin_id, id);
+			(*countp)++;
+		}
+		ut_assertok(compat_test_lookup(uts, node, index, countp));
+	}
+
+	return 0;
+}
+
+/* Test that binding through the index gives the same devices as without */
+static int dm_test_compat_index(struct unit_test_state *uts)
+{
+	struct compat_test_dev *devs, *lin_devs;
+	struct dm_compat_index *index;
+	int count, lin_count, i;
+
+	devs = calloc(COMPAT_TEST_MAX_DEVS, sizeof(*devs));
+	lin_devs = calloc(COMPAT_TEST_MAX_DEVS, sizeof(*lin_devs));
+	ut_assertnonnull(devs);
+	ut_assertnonnull(lin_devs);
+
+	/* Bind the tree through the index, built on the way if needed */
+	ut_assertok(dm_extended_scan(false));
+	index = gd->dm_compat_index;
+	ut_assert(!IS_ERR_OR_NULL(index));
+	count = compat_test_record(dm_root(), devs, 0);
+	ut_assert(count > 100);
+	ut_assert(count <= COMPAT_TEST_MAX_DEVS);
+
+	/* And again with the plain search */
+	ut_assertok(dm_uninit());
+	ut_assertok(dm_init(uts->of_live));
+	gd->dm_compat_index = ERR_PTR(-ENOSYS);
+	ut_assertok(dm_extended_scan(false));
+	lin_count = compat_test_record(dm_root(), lin_devs, 0);
+	ut_asserteq(count, lin_count);
+	for (i = 0; i < count; i++) {
+		ut_assert(ofnode_equal(devs[i].node, lin_devs[i].node));
+		ut_asserteq_ptr(devs[i].drv, lin_devs[i].drv);
+	}
+
+	/* Every compatible string, bound or not, finds the same driver */
+	count = 0;
+	ut_assertok(compat_test_lookup(uts, ofnode_root(), index, &count));
+	ut_assert(count > 100);
+	ut_assertnull(lists_driver_lookup_compat("sandbox,no-such-driver",
+						 NULL));
+	gd->dm_compat_index = index;
+	ut_assertnull(lists_driver_lookup_compat("sandbox,no-such-driver",
+						 NULL));
+	ut_assertnull(lists_driver_lookup_compat("", NULL));
+	ut_assertnull(lists_driver_lookup_compat("~", NULL));
+
+	free(devs);
+	free(lin_devs);
+
+	return 0;
+}
+DM_TEST(dm_test_compat_index, 0);
+#endif
+
+#if CONFIG_IS_ENABLED(DM_NODE_INDEX)
+#define NODE_TEST_ROUNDS	20
+
+/* Find the first device of uclass @id with @phandle the way uclass.c did */
+static struct udevice *node_test_scan_phandle(enum uclass_id id, uint phandle)
+{
+	struct udevice *dev;
+	struct uclass *uc;
+
+	if (uclass_get(id, &uc))
+		return NULL;
+	uclass_foreach_dev(dev, uc) {
+		if (dev_read_phandle(dev) == phandle)
+			return dev;
+	}
+
+	return NULL;
+}
+
+/* Look up the devices under @parent by node and phandle, returning a count */
+static int node_test_lookup(struct udevice *parent, int count)
+{
+	struct udevice *dev, *found;
+	uint phandle;
+
+	device_foreach_child(dev, parent) {
+		if (ofnode_valid(dev_ofnode(dev))) {
+			uclass_find_device_by_ofnode(device_get_uclass_id(dev),
+						     dev_ofnode(dev), &found);
+			device_find_global_by_ofnode(dev_ofnode(dev), &found);
+			phandle = dev_read_phandle(dev);
+			if (phandle &&
+			    uclass_phandle_index_find(device_get_uclass_id(dev),
+						      phandle, &found) < 0)
+				node_test_scan_phandle(device_get_uclass_id(dev),
+						       phandle);
+			count++;
+		}
+		count = node_test_lookup(dev, count);
+	}
+
+	return count;
+}
+
+/* Check the lookups of each device under @parent with and without @index */
+static int node_test_check(struct unit_test_state *uts, struct udevice *parent,
+			   struct dm_node_index *index)
+{
+	struct udevice *dev, *found, *lin_found;
+	enum uclass_id id;
+	ofnode node;
+	uint phandle;
+
+	device_foreach_child(dev, parent) {
+		node = dev_ofnode(dev);
+		id = device_get_uclass_id(dev);
+		if (ofnode_valid(node)) {
+			gd->dm_node_index = index;
+			ut_assertok(uclass_find_device_by_ofnode(id, node,
+								 &found));
+			gd->dm_node_index = ERR_PTR(-ENOSYS);
+			ut_assertok(uclass_find_device_by_ofnode(id, node,
+								 &lin_found));
+			ut_asserteq_ptr(lin_found, found);
+
+			gd->dm_node_index = index;
+			ut_assertok(device_find_global_by_ofnode(node, &found));
+			gd->dm_node_index = ERR_PTR(-ENOSYS);
+			ut_assertok(device_find_global_by_ofnode(node,
+								 &lin_found));
+			ut_asserteq_ptr(lin_found, found);
+
+			phandle = dev_read_phandle(dev);
+			gd->dm_node_index = index;
+			if (phandle) {
+				ut_assert(uclass_phandle_index_find(id, phandle,
+								    &found) > 0);
+				ut_asserteq_ptr(node_test_scan_phandle(id,
+								       phandle),
+						found);
+			} else {
+				ut_assert(hlist_unhashed(&dev->phandle_hash));
+			}
+		}
+		ut_assertok(node_test_check(uts, dev, index));
+	}
+
+	return 0;
+}
+
+/* Test finding devices by node and phandle, and time it with and without */
+static int dm_test_node_index(struct unit_test_state *uts)
+{
+	struct dm_node_index *index = gd->dm_node_index;
+	struct udevice *dev, *found;
+	ulong start, with_us, without_us;
+	ofnode node, other;
+	int count = 0, i;
+
+	ut_assert(!IS_ERR_OR_NULL(index));
+	ut_assertok(node_test_check(uts, dm_root(), index));
+	gd->dm_node_index = index;
+
+	/* An invalid node, a node with no device of the uclass, a phandle */
+	node = ofnode_path("/node-index-test-missing");
+	ut_assert(!ofnode_valid(node));
+	ut_asserteq(-ENODEV, uclass_find_device_by_ofnode(UCLASS_TEST_FDT,
+							  node, &found));
+	node = ofnode_path("/some-bus/c-test@0");
+	ut_assert(ofnode_valid(node));
+	ut_asserteq(-ENODEV, uclass_find_device_by_ofnode(UCLASS_I2C, node,
+							  &found));
+	ut_assertok(uclass_phandle_index_find(UCLASS_TEST_FDT, 0xfff0, &found));
+	ut_assertnull(found);
+
+	/* Phandle 0 does not match the devices whose node has no phandle */
+	ut_asserteq(-ENOENT, uclass_phandle_index_find(UCLASS_TEST_FDT, 0,
+						       &found));
+	ut_assertnull(found);
+	ut_assertok(uclass_find_device_by_name(UCLASS_TEST_FDT, "a-test",
+					       &dev));
+	ut_asserteq(-ENOENT, uclass_find_device_by_phandle(UCLASS_TEST_FDT, dev,
+							   "ping-expect",
+							   &found));
+
+	/* A device moved to another node is found there */
+	ut_assertok(uclass_find_device_by_name(UCLASS_TEST_FDT, "a-test",
+					       &dev));
+	node = dev_ofnode(dev);
+	other = ofnode_path("/b-test");
+	ut_assertok(device_find_global_by_ofnode(other, &found));
+	dev_set_ofnode(dev, other);
+	ut_assertok(uclass_node_index_find(UCLASS_TEST_FDT, node, &found));
+	ut_assertnull(found);
+	ut_asserteq(2, uclass_node_index_find(UCLASS_TEST_FDT, other, &found));
+	dev_set_ofnode(dev, node);
+	ut_assertok(uclass_find_device_by_ofnode(UCLASS_TEST_FDT, node,
+						 &found));
+	ut_asserteq_ptr(dev, found);
+
+	/* Unbinding drops the device */
+	ut_assertok(device_unbind(dev));
+	ut_asserteq(-ENODEV, uclass_find_device_by_ofnode(UCLASS_TEST_FDT,
+							  node, &found));
+	ut_asserteq(-ENOENT, device_find_global_by_ofnode(node, &found));
+
+	/* Time the lookups of all the devices, with and without the index */
+	start = timer_get_us();
+	for (i = 0; i < NODE_TEST_ROUNDS; i++)
+		count = node_test_lookup(dm_root(), 0);
+	with_us = timer_get_us() - start;
+
+	gd->dm_node_index = ERR_PTR(-ENOSYS);
+	start = timer_get_us();
+	for (i = 0; i < NODE_TEST_ROUNDS; i++)
+		node_test_lookup(dm_root(), 0);
+	without_us = timer_get_us() - start;
+	gd->dm_node_index = index;
+
+	log_debug("%d devices, %d rounds: %lu us indexed, %lu us scanning\n",
+		  count, NODE_TEST_ROUNDS, with_us, without_us);
+	ut_assert(count > 100);
+
+	return 0;
+}
+DM_TEST(dm_test_node_index, UT_TESTF_SCAN_FDT);
+#endif
+
+#if CONFIG_IS_ENABLED(DM_RELOC_DEVICES)
+#define RELOC_TEST_MAX_DEVS	1024
+#define RELOC_TEST_ROUNDS	20
+
+/**
+ * struct reloc_test_dev - A device bound from the device tree
+ *
+ * @node: node of the device
+ * @parent: node of its parent
+ * @drv: driver of the device
+ * @driver_data: driver data of the device
+ * @seq: sequence number of the device
+ */
+struct reloc_test_dev {
+	ofnode node;
+	ofnode parent;
+	const struct driver *drv;
+	ulong driver_data;
+	int seq;
+};
+
+/* Record the devices under @parent, returning the new count */
+static int reloc_test_record(struct udevice *parent,
+			     struct reloc_test_dev *devs, int count)
+{
+	struct udevice *dev;
+
+	device_foreach_child(dev, parent) {
+		if (count < RELOC_TEST_MAX_DEVS) {
+			devs[count].node = dev_ofnode(dev);
+			devs[count].parent = dev_ofnode(parent);
+			devs[count].drv = dev->driver;
+			devs[count].driver_data = dev->driver_data;
+			devs[count].seq = dev_seq(dev);
+		}
+		count = reloc_test_record(dev, devs, count + 1);
+	}
+
+	return count;
+}
+
+static bool reloc_test_find(const struct reloc_test_dev *devs, int count,
+			    const struct reloc_test_dev *want)
+{
+	int i;
+
+	for (i = 0; i < count; i++) {
+		if (ofnode_equal(devs[i].node, want->node) &&
+		    ofnode_equal(devs[i].parent, want->parent) &&
+		    devs[i].drv == want->drv &&
+		    devs[i].driver_data == want->driver_data &&
+		    devs[i].seq == want->seq)
+			return true;
+	}
+
+	return false;
+}
+
+/* Make the copies of the children fail, as when memory runs out */
+static bool reloc_test_fail;
+
+static int reloc_test_child_post_bind(struct udevice *dev)
+{
+	return reloc_test_fail ? -ENOMEM : 0;
+}
+
+U_BOOT_DRIVER(reloc_test_drv) = {
+	.name	= "reloc_test_drv",
+	.id	= UCLASS_TEST_FDT_MANUAL,
+	.child_post_bind	= reloc_test_child_post_bind,
+};
+
+/* Unbind all the devices and free the uclasses of driver model */
+static void reloc_test_uninit(void)
+{
+	struct uclass *uc, *next;
+
+	dm_uninit();
+	list_for_each_entry_safe(uc, next, gd->uclass_root, sibling_node)
+		uclass_destroy(uc);
+}
+
+/* Test copying the devices bound before relocation to a new driver model */
+static int dm_test_reloc_devices(struct unit_test_state *uts)
+{
+	struct reloc_test_dev *devs, *full_devs;
+	struct udevice *old_root, *old, *dev;
+	int copied, count, full_count, i, ret;
+	ulong start, reloc_us, full_us;
+	struct list_head old_uclasses;
+	ofnode node;
+
+	devs = calloc(RELOC_TEST_MAX_DEVS, sizeof(*devs));
+	full_devs = calloc(RELOC_TEST_MAX_DEVS, sizeof(*full_devs));
+	ut_assertnonnull(devs);
+	ut_assertnonnull(full_devs);
+
+	/* Bind the devices board_init_f() does and probe one */
+	gd->flags &= ~GD_FLG_RELOC;
+	ret = dm_extended_scan(true);
+	gd->flags |= GD_FLG_RELOC;
+	ut_assertok(ret);
+	ut_assertok(uclass_get_device_by_name(UCLASS_TEST_FDT, "a-test", &old));
+	old_root = dm_root();
+
+	/*
+	 * Board code binds a device below it, with children, which nothing
+	 * binds there after relocation
+	 */
+	node = ofnode_path("/testfdtm0");
+	ut_assertok(device_bind_driver_to_node(old, "testfdtm_drv", "board",
+					       node, &dev));
+	node = ofnode_path("/testfdtm1");
+	ut_assertok(device_bind_driver_to_node(dev, "testfdtm_drv",
+					       "board-child1", node, NULL));
+	node = ofnode_path("/testfdtm2");
+	ut_assertok(device_bind_driver_to_node(dev, "testfdtm_drv",
+					       "board-child2", node, NULL));
+
+	/* Start again, as initr_dm() does, copying them */
+	gd->dm_root = NULL;
+	list_replace_init(gd->uclass_root, &old_uclasses);
+	ut_assertok(dm_init(false));
+	copied = dm_reloc_devices(old_root);
+	ut_assert(copied > 0);
+	ut_assertok(uclass_find_device_by_name(UCLASS_TEST_FDT, "a-test",
+					       &dev));
+	ut_assert(dev != old);
+	ut_assert(!device_active(dev));
+	ut_assertok(uclass_find_device_by_name(UCLASS_TEST_FDT_MANUAL,
+					       "board-child2", &dev));
+	ut_assertok(dm_extended_scan(false));
+	dm_reloc_finish();
+	ut_asserteq(-ENODEV, uclass_find_device_by_name(UCLASS_TEST_FDT_MANUAL,
+							"board", &dev));
+	count = reloc_test_record(dm_root(), devs, 0);
+	ut_assert(count > copied);
+	ut_assert(count <= RELOC_TEST_MAX_DEVS);
+
+	/* The copy is bound once and works like the others */
+	ut_assertok(uclass_get_device_by_name(UCLASS_TEST_FDT, "a-test",
+					      &dev));
+	ut_assert(dev != old);
+	ut_assert(device_active(dev));
+
+	/* Binding all the devices afresh gives the same ones */
+	reloc_test_uninit();
+	ut_assertok(dm_init(false));
+	ut_assertok(dm_extended_scan(false));
+	full_count = reloc_test_record(dm_root(), full_devs, 0);
+	ut_asserteq(full_count, count);
+	for (i = 0; i < count; i++)
+		ut_assert(reloc_test_find(devs, count, &full_devs[i]));
+
+	start = timer_get_us();
+	for (i = 0; i < RELOC_TEST_ROUNDS; i++) {
+		reloc_test_uninit();
+		ut_assertok(dm_init(false));
+		ut_asserteq(copied, dm_reloc_devices(old_root));
+		ut_assertok(dm_extended_scan(false));
+		dm_reloc_finish();
+	}
+	reloc_us = timer_get_us() - start;
+	start = timer_get_us();
+	for (i = 0; i < RELOC_TEST_ROUNDS; i++) {
+		reloc_test_uninit();
+		ut_assertok(dm_init(false));
+		ut_assertok(dm_extended_scan(false));
+	}
+	full_us = timer_get_us() - start;
+	log_debug("%d of %d devices copied, %d rounds: %lu us, %lu us binding all\n",
+		  copied, count, RELOC_TEST_ROUNDS, reloc_us, full_us);
+
+	/* Free the devices bound before relocation too */
+	reloc_test_uninit();
+	gd->dm_root = old_root;
+	list_replace(&old_uclasses, gd->uclass_root);
+	reloc_test_uninit();
+
+	free(devs);
+	free(full_devs);
+
+	return 0;
+}
+DM_TEST(dm_test_reloc_devices, UT_TESTF_FLAT_TREE);
+
+/* Test that all the devices are bound again when copying them fails */
+static int dm_test_reloc_devices_fail(struct unit_test_state *uts)
+{
+	struct reloc_test_dev *devs, *full_devs;
+	struct udevice *old_root, *old, *dev;
+	struct list_head old_uclasses;
+	int count, full_count, i, ret;
+	ofnode node;
+
+	devs = calloc(RELOC_TEST_MAX_DEVS, sizeof(*devs));
+	full_devs = calloc(RELOC_TEST_MAX_DEVS, sizeof(*full_devs));
+	ut_assertnonnull(devs);
+	ut_assertnonnull(full_devs);
+
+	gd->flags &= ~GD_FLG_RELOC;
+	ret = dm_extended_scan(true);
+	gd->flags |= GD_FLG_RELOC;
+	ut_assertok(ret);
+	ut_assertok(uclass_find_device_by_name(UCLASS_TEST_FDT, "a-test",
+					       &old));
+	old_root = dm_root();
+
+	/* Copying the child fails once its parent and others are copied */
+	node = ofnode_path("/testfdtm0");
+	ut_assertok(device_bind_driver_to_node(old, "reloc_test_drv", "board",
+					       node, &dev));
+	node = ofnode_path("/testfdtm1");
+	ut_assertok(device_bind_driver_to_node(dev, "testfdtm_drv",
+					       "board-child", node, NULL));
+
+	gd->dm_root = NULL;
+	list_replace_init(gd->uclass_root, &old_uclasses);
+	reloc_test_fail = true;
+	ret = dm_init_and_relocate(old_root);
+	reloc_test_fail = false;
+	ut_assertok(ret);
+	ut_asserteq(-ENODEV, uclass_find_device_by_name(UCLASS_TEST_FDT_MANUAL,
+							"board", &dev));
+	ut_asserteq(-ENODEV, uclass_find_device_by_name(UCLASS_TEST_FDT_MANUAL,
+							"board-child", &dev));
+	count = reloc_test_record(dm_root(), devs, 0);
+	ut_assert(count <= RELOC_TEST_MAX_DEVS);
+
+	/* The devices are the ones binding them afresh gives */
+	reloc_test_uninit();
+	ut_assertok(dm_init_and_scan(false));
+	full_count = reloc_test_record(dm_root(), full_devs, 0);
+	ut_asserteq(full_count, count);
+	for (i = 0; i < count; i++)
+		ut_assert(reloc_test_find(devs, count, &full_devs[i]));
+
+	reloc_test_uninit();
+	gd->dm_root = old_root;
+	list_replace(&old_uclasses, gd->uclass_root);
+	reloc_test_uninit();
+
+	free(devs);
+	free(full_devs);
+
+	return 0;
+}
+DM_TEST(dm_test_reloc_devices_fail, UT_TESTF_FLAT_TREE);
+#endif
@@ -0,0 +1,289 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * Test the DHCP lease cache against a DHCP server emulated by the sandbox
+ * Ethernet driver
+ */
+
+#include <common.h>
+#include <command.h>
+#include <dm.h>
+#include <env.h>
+#include <net.h>
+#include <asm/eth.h>
+#include <dm/test.h>
+#include <test/test.h>
+#include <test/ut.h>
+#include "../../net/bootp.h"
+
+#define DHCP_TEST_PORT_SERVER	67
+#define DHCP_TEST_PORT_CLIENT	68
+#define DHCP_TEST_IP		"1.2.3.4"
+#define DHCP_TEST_SERVER	"1.2.3.1"
+#define DHCP_TEST_GATEWAY	"1.2.3.254"
+#define DHCP_TEST_LEASE		3600
+#define DHCP_TEST_MAGIC		0x63825363
+
+/**
+ * struct dhcp_test_server - State of the emulated DHCP server
+ *
+ * @uts: test state, for the ut_assert macros in the handler
+ * @nak: refuse INIT-REBOOT requests
+ * @silent: do not answer INIT-REBOOT requests
+ * @discovers: DHCPDISCOVER received
+ * @requests: DHCPREQUEST received after an offer
+ * @reboots: DHCPREQUEST received without an offer (INIT-REBOOT)
+ * @arps: ARP requests received
+ */
+struct dhcp_test_server {
+	struct unit_test_state *uts;
+	bool nak;
+	bool silent;
+	uint discovers;
+	uint requests;
+	uint reboots;
+	uint arps;
+};
+
+static struct dhcp_test_server srv;
+
+/* Find option @code of a DHCP message, NULL if absent */
+static const u8 *sb_dhcp_option(const struct bootp_hdr *bp, int code)
+{
+	const u8 *p = (const u8 *)bp->bp_vend + 4;
+	const u8 *end = (const u8 *)bp->bp_vend + sizeof(bp->bp_vend);
+
+	while (p < end && *p != 0xff) {
+		if (*p == code)
+			return p;
+		p += *p ? p[1] + 2 : 1;
+	}
+
+	return NULL;
+}
+
+static u8 *sb_dhcp_put_ip(u8 *p, int code, const char *ip)
+{
+	struct in_addr addr = string_to_ip(ip);
+
+	*p++ = code;
+	*p++ = 4;
+	memcpy(p, &addr, 4);
+
+	return p + 4;
+}
+
+/* Queue the answer of the server to @req */
+static void sb_dhcp_reply(struct udevice *dev, const struct bootp_hdr *req,
+			  int type)
+{
+	struct eth_sandbox_priv *priv = dev_get_priv(dev);
+	struct ethernet_hdr *eth;
+	struct ip_udp_hdr *ip;
+	struct bootp_hdr *bp;
+	__be32 lease = htonl(DHCP_TEST_LEASE);
+	u8 *p;
+
+	eth = (void *)priv->recv_packet_buffer[priv->recv_packets];
+	ip = (void *)eth + ETHER_HDR_SIZE;
+	bp = (void *)ip + IP_UDP_HDR_SIZE;
+	memset(eth, '\0', ETHER_HDR_SIZE + IP_UDP_HDR_SIZE + sizeof(*bp));
+
+	memcpy(eth->et_dest, net_bcast_ethaddr, ARP_HLEN);
+	memcpy(eth->et_src, priv->fake_host_hwaddr, ARP_HLEN);
+	eth->et_protlen = htons(PROT_IP);
+
+	net_set_ip_header((uchar *)ip, string_to_ip("255.255.255.255"),
+			  string_to_ip(DHCP_TEST_SERVER),
+			  IP_UDP_HDR_SIZE + sizeof(*bp), IPPROTO_UDP);
+	ip->udp_src = htons(DHCP_TEST_PORT_SERVER);
+	ip->udp_dst = htons(DHCP_TEST_PORT_CLIENT);
+	ip->udp_len = htons(UDP_HDR_SIZE + sizeof(*bp));
+	ip->udp_xsum = 0;
+
+	bp->bp_op = OP_BOOTREPLY;
+	bp->bp_htype = HWT_ETHER;
+	bp->bp_hlen = HWL_ETHER;
+	memcpy(&bp->bp_id, &req->bp_id, sizeof(bp->bp_id));
+	memcpy(bp->bp_chaddr, req->bp_chaddr, sizeof(bp->bp_chaddr));
+	if (type != DHCP_NAK) {
+		net_write_ip(&bp->bp_yiaddr, string_to_ip(DHCP_TEST_IP));
+		net_write_ip(&bp->bp_siaddr, string_to_ip(DHCP_TEST_SERVER));
+	}
+
+	p = (u8 *)bp->bp_vend;
+	*(__be32 *)p = htonl(DHCP_TEST_MAGIC);
+	p += 4;
+	*p++ = 53;
+	*p++ = 1;
+	*p++ = type;
+	p = sb_dhcp_put_ip(p, 54, DHCP_TEST_SERVER);
+	if (type != DHCP_NAK) {
+		p = sb_dhcp_put_ip(p, 3, DHCP_TEST_GATEWAY);
+		*p++ = 51;
+		*p++ = 4;
+		memcpy(p, &lease, 4);
+		p += 4;
+	}
+	*p = 0xff;
+
+	priv->recv_packet_length[priv->recv_packets] =
+		ETHER_HDR_SIZE + IP_UDP_HDR_SIZE + sizeof(*bp);
+	++priv->recv_packets;
+}
+
+static int sb_dhcp_handler(struct udevice *dev, void *packet,
+			   unsigned int len)
+{
+	struct unit_test_state *uts = srv.uts;
+	struct ethernet_hdr *eth = packet;
+	struct ip_udp_hdr *ip = packet + ETHER_HDR_SIZE;
+	struct bootp_hdr *bp = (void *)ip + IP_UDP_HDR_SIZE;
+	const u8 *type, *server, *requested;
+
+	if (ntohs(eth->et_protlen) == PROT_ARP)
+		srv.arps++;
+	if (!sandbox_eth_arp_req_to_reply(dev, packet, len))
+		return 0;
+	if (ntohs(eth->et_protlen) != PROT_IP || ip->ip_p != IPPROTO_UDP ||
+	    ntohs(ip->udp_dst) != DHCP_TEST_PORT_SERVER)
+		return 0;
+
+	type = sb_dhcp_option(bp, 53);
+	ut_assertnonnull(type);
+	server = sb_dhcp_option(bp, 54);
+	requested = sb_dhcp_option(bp, 50);
+
+	switch (type[2]) {
+	case DHCP_DISCOVER:
+		srv.discovers++;
+		sb_dhcp_reply(dev, bp, DHCP_OFFER);
+		break;
+	case DHCP_REQUEST:
+		ut_assertnonnull(requested);
+		if (server) {
+			srv.requests++;
+			sb_dhcp_reply(dev, bp, DHCP_ACK);
+			break;
+		}
+		srv.reboots++;
+		if (srv.silent)
+			break;
+		sb_dhcp_reply(dev, bp, srv.nak ? DHCP_NAK : DHCP_ACK);
+		break;
+	}
+
+	return 0;
+}
+
+/* Expected contents of the lease cache, for the server MAC address @mac */
+static void dhcp_test_lease(char *buf, int size, const u8 *mac)
+{
+	snprintf(buf, size, "%pM %s %s %s %pM", net_ethaddr, DHCP_TEST_IP,
+		 DHCP_TEST_GATEWAY, DHCP_TEST_SERVER, mac);
+}
+
+/* Put back an address the DHCP exchange changed, with its variable */
+static void dhcp_test_restore(const char *name, struct in_addr *addr,
+			      struct in_addr old)
+{
+	char buf[16];
+
+	*addr = old;
+	if (old.s_addr) {
+		ip_to_string(old, buf);
+		env_set(name, buf);
+	} else {
+		env_set(name, NULL);
+	}
+}
+
+/* Test skipping the DHCPDISCOVER and the ARP request with a cached lease */
+static int dm_test_dhcp_lease(struct unit_test_state *uts)
+{
+	struct in_addr ip = net_ip, gateway = net_gateway;
+	struct in_addr server_ip = net_server_ip;
+	struct eth_sandbox_priv *priv;
+	struct udevice *dev;
+	char lease[96];
+
+	memset(&srv, '\0', sizeof(srv));
+	srv.uts = uts;
+	env_set("ethact", "eth@10002000");
+	env_set("autoload", "no");
+	env_set("dhcplease", NULL);
+	ut_assertok(uclass_get_device_by_name(UCLASS_ETH, "eth@10002000",
+					      &dev));
+	priv = dev_get_priv(dev);
+	sandbox_eth_set_tx_handler(0, sb_dhcp_handler);
+	/* Sandbox keeps 'serverip' (CONFIG_BOOTP_SERVERIP) */
+	net_server_ip = string_to_ip(DHCP_TEST_SERVER);
+
+	/* The first time, the full exchange, with no server MAC yet */
+	ut_assertok(run_command("dhcp", 0));
+	ut_asserteq(1, srv.discovers);
+	ut_asserteq(1, srv.requests);
+	ut_asserteq(0, srv.reboots);
+	dhcp_test_lease(lease, sizeof(lease), net_null_ethaddr);
+	ut_asserteq_str(lease, env_get("dhcplease"));
+
+	/* A transfer from the server records its MAC address */
+	memcpy(net_server_ethaddr, priv->fake_host_hwaddr, ARP_HLEN);
+	net_server_ether_save(net_server_ip);
+	dhcp_test_lease(lease, sizeof(lease), priv->fake_host_hwaddr);
+	ut_asserteq_str(lease, env_get("dhcplease"));
+
+	/* After a reboot, only a DHCPREQUEST and no ARP request */
+	memset(&srv, '\0', sizeof(srv));
+	srv.uts = uts;
+	net_server_ether_forget();
+	ut_assertok(run_command("dhcp", 0));
+	ut_asserteq(0, srv.discovers);
+	ut_asserteq(0, srv.requests);
+	ut_asserteq(1, srv.reboots);
+	ut_asserteq_str(DHCP_TEST_IP, env_get("ipaddr"));
+	ut_asserteq_str(lease, env_get("dhcplease"));
+	net_server_ether_restore(string_to_ip(DHCP_TEST_SERVER));
+	ut_asserteq_mem(priv->fake_host_hwaddr, net_server_ethaddr, ARP_HLEN);
+	ut_asserteq(0, srv.arps);
+
+	/* No answer: the full exchange after a short wait */
+	memset(&srv, '\0', sizeof(srv));
+	srv.uts = uts;
+	srv.silent = true;
+	ut_assertok(run_command("dhcp", 0));
+	ut_asserteq(1, srv.reboots);
+	ut_asserteq(1, srv.discovers);
+	ut_asserteq(1, srv.requests);
+	ut_asserteq_str(lease, env_get("dhcplease"));
+
+	/* Refused: the cache is dropped, the server MAC address with it */
+	memset(&srv, '\0', sizeof(srv));
+	srv.uts = uts;
+	srv.nak = true;
+	ut_assertok(run_command("dhcp", 0));
+	ut_asserteq(1, srv.reboots);
+	ut_asserteq(1, srv.discovers);
+	ut_asserteq(1, srv.requests);
+	dhcp_test_lease(lease, sizeof(lease), net_null_ethaddr);
+	ut_asserteq_str(lease, env_get("dhcplease"));
+
+	/* A lease for another interface is not used */
+	env_set("dhcplease", "02:00:11:22:33:44 " DHCP_TEST_IP " "
+		DHCP_TEST_GATEWAY " " DHCP_TEST_SERVER " 00:00:11:aa:bb:cc");
+	memset(&srv, '\0', sizeof(srv));
+	srv.uts = uts;
+	ut_assertok(run_command("dhcp", 0));
+	ut_asserteq(0, srv.reboots);
+	ut_asserteq(1, srv.discovers);
+
+	sandbox_eth_set_tx_handler(0, NULL);
+	net_server_ether_forget();
+	env_set("dhcplease", NULL);
+	env_set("autoload", NULL);
+	dhcp_test_restore("ipaddr", &net_ip, ip);
+	dhcp_test_restore("gatewayip", &net_gateway, gateway);
+	dhcp_test_restore("serverip", &net_server_ip, server_ip);
+
+	return 0;
+}
+DM_TEST(dm_test_dhcp_lease, UT_TESTF_SCAN_FDT);
@@ -13,6 +13,7 @@
 #include <log.h>
 #include <malloc.h>
 #include <net.h>
+#include <time.h>
 #include <asm/eth.h>
 #include <dm/test.h>
 #include <dm/device-internal.h>
@@ -431,3 +432,184 @@ static int dm_test_eth_async_ping_reply(struct unit_test_state *uts)
 }
 
 DM_TEST(dm_test_eth_async_ping_reply, UT_TESTF_SCAN_FDT);
+
+/* Check that a full ring is drained in batches and the counters follow */
+static int dm_test_eth_rx_batch(struct unit_test_state *uts)
+{
+	const struct eth_stats *stats;
+	struct udevice *dev;
+	int i;
+
+	net_init();
+	net_ip = string_to_ip("1.2.3.4");
+	env_set("ethact", "eth@10002000");
+	ut_assertok(eth_init());
+	dev = eth_get_dev();
+	ut_assertnonnull(dev);
+	eth_reset_stats(dev);
+
+	/* Two more than the ring holds are lost */
+	for (i = 0; i < PKTBUFSRX; i++)
+		ut_assertok(sandbox_eth_recv_arp_req(dev));
+	ut_asserteq(-EOVERFLOW, sandbox_eth_recv_arp_req(dev));
+	ut_asserteq(-EOVERFLOW, sandbox_eth_recv_arp_req(dev));
+
+	while (eth_get_stats(dev)->rx_packets < PKTBUFSRX)
+		ut_asserteq(min(PKTBUFSRX, ETH_PACKETS_BATCH_RECV), eth_rx());
+	ut_assertok(eth_rx());
+
+	/* Each request was answered */
+	stats = eth_get_stats(dev);
+	ut_asserteq(PKTBUFSRX, stats->rx_packets);
+	ut_asserteq(DIV_ROUND_UP(PKTBUFSRX, ETH_PACKETS_BATCH_RECV),
+		    stats->rx_polls);
+	ut_asserteq(min(PKTBUFSRX, ETH_PACKETS_BATCH_RECV), stats->rx_max_batch);
+	ut_asserteq(2, stats->rx_overruns);
+	ut_asserteq(0, stats->rx_errors);
+	ut_asserteq(PKTBUFSRX, stats->tx_packets);
+
+	console_record_reset();
+	ut_assertok(run_command("net stats", 0));
+	ut_assert_nextline("eth0 : eth@10002000");
+	ut_assert_nextline("  rx: %d packets, %d polls, %d max batch, 2 overruns, 0 errors",
+			   PKTBUFSRX, DIV_ROUND_UP(PKTBUFSRX, ETH_PACKETS_BATCH_RECV),
+			   min(PKTBUFSRX, ETH_PACKETS_BATCH_RECV));
+	ut_assert_nextline("  tx: %d packets, 0 errors", PKTBUFSRX);
+
+	ut_assertok(run_command("net stats reset", 0));
+	ut_asserteq(0, eth_get_stats(dev)->rx_packets);
+	eth_halt();
+
+	return 0;
+}
+
+DM_TEST(dm_test_eth_rx_batch, UT_TESTF_SCAN_FDT | UT_TESTF_CONSOLE_REC);
+
+#ifdef CONFIG_IP_DEFRAG
+#define DEFRAG_TEST_FRAG	1480
+#define DEFRAG_TEST_FRAGS	8
+#define DEFRAG_TEST_LEN		(DEFRAG_TEST_FRAGS * DEFRAG_TEST_FRAG - \
+				 UDP_HDR_SIZE - 100)
+#define DEFRAG_TEST_PORT	9000
+
+static uint defrag_received;
+static uint defrag_bad;
+
+/* Contents of datagram @k, sent from port 7000 + @k */
+static void sb_defrag_datagram(uchar *dgram, uint k)
+{
+	uint i;
+
+	*(__be16 *)dgram = htons(7000 + k);
+	*(__be16 *)(dgram + 2) = htons(DEFRAG_TEST_PORT);
+	*(__be16 *)(dgram + 4) = htons(UDP_HDR_SIZE + DEFRAG_TEST_LEN);
+	*(__be16 *)(dgram + 6) = 0;
+	for (i = 0; i < DEFRAG_TEST_LEN; i++)
+		dgram[UDP_HDR_SIZE + i] = (i + 31 * k) & 0xff;
+}
+
+/* Pass fragment @frag of datagram @k to the stack */
+static void sb_defrag_send(const char *src, u16 id, uint k, uint frag)
+{
+	static uchar dgram[UDP_HDR_SIZE + DEFRAG_TEST_LEN];
+	static uchar pkt[PKTSIZE_ALIGN];
+	uint total = UDP_HDR_SIZE + DEFRAG_TEST_LEN;
+	uint off = frag * DEFRAG_TEST_FRAG;
+	uint flen = min(total - off, (uint)DEFRAG_TEST_FRAG);
+	struct ip_udp_hdr *ip = (void *)pkt + ETHER_HDR_SIZE;
+
+	sb_defrag_datagram(dgram, k);
+	net_set_ether(pkt, net_ethaddr, PROT_IP);
+	net_set_ip_header((uchar *)ip, net_ip, string_to_ip(src),
+			  IP_HDR_SIZE + flen, IPPROTO_UDP);
+	ip->ip_id = htons(id);
+	ip->ip_off = htons(off / 8 | (off + flen < total ? IP_FLAGS_MFRAG : 0));
+	ip->ip_sum = 0;
+	ip->ip_sum = compute_ip_checksum(ip, IP_HDR_SIZE);
+	memcpy((uchar *)ip + IP_HDR_SIZE, dgram + off, flen);
+
+	net_process_received_packet(pkt, ETHER_HDR_SIZE + IP_HDR_SIZE + flen);
+}
+
+static void sb_defrag_handler(uchar *pkt, unsigned int dport,
+			      struct in_addr sip, unsigned int sport,
+			      unsigned int len)
+{
+	uchar dgram[UDP_HDR_SIZE + DEFRAG_TEST_LEN];
+
+	sb_defrag_datagram(dgram, sport - 7000);
+	if (dport != DEFRAG_TEST_PORT || len != DEFRAG_TEST_LEN ||
+	    memcmp(pkt, dgram + UDP_HDR_SIZE, len))
+		defrag_bad++;
+	defrag_received++;
+}
+
+/* Test reassembling several datagrams whose fragments come interleaved */
+static int dm_test_ip_defrag(struct unit_test_state *uts)
+{
+	const struct net_defrag_stats *stats = net_defrag_get_stats();
+	uint frag, k;
+
+	net_init();
+	net_ip = string_to_ip("1.2.3.4");
+	net_set_udp_handler(sb_defrag_handler);
+	defrag_received = 0;
+	defrag_bad = 0;
+
+	/* Let what earlier tests left half done expire, but one datagram */
+	timer_test_add_offset(CONFIG_NET_DEFRAG_TIMEOUT + 1);
+	sb_defrag_send("1.1.2.2", 100, 0, 0);
+	net_defrag_reset_stats();
+
+	/* The rest of it comes too late: the first fragment is gone */
+	timer_test_add_offset(CONFIG_NET_DEFRAG_TIMEOUT + 1);
+	for (frag = 1; frag < DEFRAG_TEST_FRAGS; frag++)
+		sb_defrag_send("1.1.2.2", 100, 0, frag);
+	ut_asserteq(0, defrag_received);
+	ut_asserteq(1, stats->timeouts);
+
+	/*
+	 * Three datagrams, fragments interleaved and one of them in reverse
+	 * order; two share the same ID but come from different hosts
+	 */
+	for (frag = 0; frag < DEFRAG_TEST_FRAGS; frag++) {
+		sb_defrag_send("1.1.2.2", 200, 1, frag);
+		sb_defrag_send("1.1.2.3", 200, 2, frag);
+		sb_defrag_send("1.1.2.2", 201, 3,
+			       DEFRAG_TEST_FRAGS - 1 - frag);
+	}
+	/* A duplicate of a fragment already there is dropped */
+	sb_defrag_send("1.1.2.2", 202, 4, 0);
+	sb_defrag_send("1.1.2.2", 202, 4, 0);
+	ut_asserteq(3, defrag_received);
+	ut_asserteq(0, defrag_bad);
+	ut_asserteq(3, stats->datagrams);
+	ut_asserteq(0, stats->evicted);
+	ut_asserteq(1, stats->dropped);
+
+	/*
+	 * All slots are taken by new datagrams: the one left without its
+	 * first fragment goes, being the oldest, then the others complete
+	 */
+	for (k = 0; k < CONFIG_NET_DEFRAG_SLOTS - 1; k++)
+		sb_defrag_send("1.1.2.2", 300 + k, 5 + k, 0);
+	ut_asserteq(1, stats->evicted);
+	for (frag = 1; frag < DEFRAG_TEST_FRAGS; frag++) {
+		sb_defrag_send("1.1.2.2", 202, 4, frag);
+		for (k = 0; k < CONFIG_NET_DEFRAG_SLOTS - 1; k++)
+			sb_defrag_send("1.1.2.2", 300 + k, 5 + k, frag);
+	}
+	ut_asserteq(3 + CONFIG_NET_DEFRAG_SLOTS, defrag_received);
+	ut_asserteq(0, defrag_bad);
+	ut_asserteq(1, stats->evicted);
+	ut_asserteq(1, stats->timeouts);
+	ut_asserteq((4 + CONFIG_NET_DEFRAG_SLOTS) * DEFRAG_TEST_FRAGS,
+		    stats->fragments);
+
+	net_set_udp_handler(NULL);
+
+	return 0;
+}
+
+DM_TEST(dm_test_ip_defrag, 0);
+#endif
@@ -7,11 +7,14 @@
 #include <dm.h>
 #include <fastboot.h>
 #include <fb_mmc.h>
+#include <malloc.h>
 #include <mmc.h>
 #include <part.h>
 #include <part_efi.h>
+#include <sparse_format.h>
 #include <dm/test.h>
 #include <test/ut.h>
+#include <linux/sizes.h>
 #include <linux/stringify.h>
 
 #define FB_ALIAS_PREFIX "fastboot_partition_alias_"
@@ -93,3 +96,239 @@ static int dm_test_fastboot_mmc_part(struct unit_test_state *uts)
 	return 0;
 }
 DM_TEST(dm_test_fastboot_mmc_part, UT_TESTF_SCAN_PDATA | UT_TESTF_SCAN_FDT);
+
+#if CONFIG_IS_ENABLED(FASTBOOT_FLASH_STREAM)
+#define FB_STREAM_BLK_SZ	4096
+#define FB_STREAM_PIECE		1000
+
+/* Run a fastboot command and check the response */
+static int fb_stream_cmd(struct unit_test_state *uts, const char *cmd,
+			 const char *expect)
+{
+	char response[FASTBOOT_RESPONSE_LEN] = {0};
+	char buf[FASTBOOT_COMMAND_LEN];
+
+	strlcpy(buf, cmd, sizeof(buf));
+	fastboot_handle_command(buf, response);
+	ut_asserteq_str(expect, response);
+
+	return 0;
+}
+
+/*
+ * Download an image in pieces, as the UDP and USB transports do. The host
+ * sends all of it even if writing fails, and only then gets the response.
+ */
+static int fb_stream_download(struct unit_test_state *uts, const void *image,
+			      u32 size, const char *expect)
+{
+	char response[FASTBOOT_RESPONSE_LEN] = {0};
+	char cmd[32], data[32];
+	u32 off, len;
+
+	snprintf(cmd, sizeof(cmd), "download:%08x", size);
+	snprintf(data, sizeof(data), "DATA%08x", size);
+	ut_assertok(fb_stream_cmd(uts, cmd, data));
+
+	for (off = 0; off < size; off += len) {
+		len = min_t(u32, size - off, FB_STREAM_PIECE);
+		fastboot_data_download(image + off, len, response);
+		ut_asserteq_str("", response);
+		ut_asserteq(size - off - len, fastboot_data_remaining());
+	}
+	fastboot_data_complete(response);
+	ut_asserteq_str(expect, response);
+
+	return 0;
+}
+
+static void *fb_stream_chunk(void *p, u16 type, u32 chunk_sz, u32 data_sz)
+{
+	chunk_header_t *chunk = p;
+
+	chunk->chunk_type = type;
+	chunk->reserved1 = 0;
+	chunk->chunk_sz = chunk_sz;
+	chunk->total_sz = sizeof(*chunk) + data_sz;
+
+	return chunk + 1;
+}
+
+/* Test writing images to a partition while they are downloaded */
+static int dm_test_fastboot_mmc_stream(struct unit_test_state *uts)
+{
+	struct blk_desc *mmc_dev_desc;
+	char str_disk_guid[UUID_STR_LEN + 1];
+	struct disk_partition parts[2] = {
+		{
+			.start = 48,
+			.size = 64 * FB_STREAM_BLK_SZ / 512,
+			.name = "test1",
+		},
+		{
+			.start = 48 + 64 * FB_STREAM_BLK_SZ / 512,
+			.size = 16,
+			.name = "test2",
+		},
+	};
+	sparse_header_t *sparse;
+	u8 *image, *p, *buf, *disk;
+	u32 size, i;
+
+	ut_assertok(blk_get_device_by_str("mmc", "0", &mmc_dev_desc));
+	if (CONFIG_IS_ENABLED(RANDOM_UUID)) {
+		gen_rand_uuid_str(parts[0].uuid, UUID_STR_FORMAT_STD);
+		gen_rand_uuid_str(parts[1].uuid, UUID_STR_FORMAT_STD);
+		gen_rand_uuid_str(str_disk_guid, UUID_STR_FORMAT_STD);
+	}
+	ut_assertok(gpt_restore(mmc_dev_desc, str_disk_guid, parts,
+				ARRAY_SIZE(parts)));
+
+	/* The image is four times as large as the download buffer */
+	buf = malloc(SZ_16K);
+	ut_assertnonnull(buf);
+	fastboot_init(buf, SZ_16K);
+
+	/* The blocks left alone by the DONT_CARE chunk keep their data */
+	disk = malloc(64 * FB_STREAM_BLK_SZ);
+	ut_assertnonnull(disk);
+	memset(disk, 0x5a, 64 * FB_STREAM_BLK_SZ);
+	ut_asserteq(parts[0].size, blk_dwrite(mmc_dev_desc, parts[0].start,
+					      parts[0].size, disk));
+
+	/* RAW 10, FILL 20, DONT_CARE 4, CRC32, RAW 30 */
+	image = malloc(SZ_256K);
+	ut_assertnonnull(image);
+	sparse = (sparse_header_t *)image;
+	memset(sparse, '\0', sizeof(*sparse));
+	sparse->magic = SPARSE_HEADER_MAGIC;
+	sparse->major_version = 1;
+	sparse->file_hdr_sz = sizeof(sparse_header_t);
+	sparse->chunk_hdr_sz = sizeof(chunk_header_t);
+	sparse->blk_sz = FB_STREAM_BLK_SZ;
+	sparse->total_blks = 64;
+	sparse->total_chunks = 5;
+	p = (u8 *)(sparse + 1);
+	p = fb_stream_chunk(p, CHUNK_TYPE_RAW, 10, 10 * FB_STREAM_BLK_SZ);
+	for (i = 0; i < 10 * FB_STREAM_BLK_SZ; i++)
+		*p++ = i * 3 + (i >> 8);
+	p = fb_stream_chunk(p, CHUNK_TYPE_FILL, 20, 4);
+	*(u32 *)p = 0xdeadbeef;
+	p += 4;
+	p = fb_stream_chunk(p, CHUNK_TYPE_DONT_CARE, 4, 0);
+	p = fb_stream_chunk(p, CHUNK_TYPE_CRC32, 0, 4);
+	p += 4;
+	p = fb_stream_chunk(p, CHUNK_TYPE_RAW, 30, 30 * FB_STREAM_BLK_SZ);
+	for (i = 0; i < 30 * FB_STREAM_BLK_SZ; i++)
+		*p++ = i * 7 + (i >> 9);
+	size = p - image;
+
+	ut_assertok(fb_stream_cmd(uts, "oem stream:nothere",
+				  "FAILinvalid partition or device"));
+	ut_assertok(fb_stream_cmd(uts, "getvar:max-download-size",
+				  "OKAY0x00004000"));
+	ut_assertok(fb_stream_cmd(uts, "oem stream:test1", "OKAY"));
+	ut_assertok(fb_stream_cmd(uts, "getvar:max-download-size",
+				  "OKAY0xffffffff"));
+	ut_assertok(fb_stream_download(uts, image, size, "OKAY"));
+	ut_assertok(fb_stream_cmd(uts, "flash:test2",
+				  "FAILimage streamed to another partition"));
+	ut_assertok(fb_stream_cmd(uts, "getvar:max-download-size",
+				  "OKAY0x00004000"));
+	ut_assertok(fb_stream_cmd(uts, "oem stream:test1", "OKAY"));
+	ut_assertok(fb_stream_download(uts, image, size, "OKAY"));
+	ut_assertok(fb_stream_cmd(uts, "flash:test1", "OKAY"));
+
+	/* Arming covers one download, the next one goes to the buffer */
+	ut_assertok(fb_stream_cmd(uts, "getvar:max-download-size",
+				  "OKAY0x00004000"));
+	ut_assertok(fb_stream_cmd(uts, "download:00010000",
+				  "FAIL00010000"));
+
+	ut_asserteq(parts[0].size, blk_dread(mmc_dev_desc, parts[0].start,
+					     parts[0].size, disk));
+	p = (u8 *)(sparse + 1) + sizeof(chunk_header_t);
+	ut_asserteq_mem(p, disk, 10 * FB_STREAM_BLK_SZ);
+	for (i = 0; i < 20 * FB_STREAM_BLK_SZ / 4; i++)
+		ut_asserteq(0xdeadbeef,
+			    ((u32 *)(disk + 10 * FB_STREAM_BLK_SZ))[i]);
+	for (i = 30 * FB_STREAM_BLK_SZ; i < 34 * FB_STREAM_BLK_SZ; i++)
+		ut_asserteq(0x5a, disk[i]);
+	p = image + size - 30 * FB_STREAM_BLK_SZ;
+	ut_asserteq_mem(p, disk + 34 * FB_STREAM_BLK_SZ,
+			30 * FB_STREAM_BLK_SZ);
+
+	/* An image which is not sparse, the last block padded with zeroes */
+	ut_assertok(fb_stream_cmd(uts, "oem stream:test2", "OKAY"));
+	ut_assertok(fb_stream_download(uts, image + size - 5000, 5000,
+				       "OKAY"));
+	ut_assertok(fb_stream_cmd(uts, "flash:test2", "OKAY"));
+	ut_asserteq(10, blk_dread(mmc_dev_desc, parts[1].start, 10, disk));
+	ut_asserteq_mem(image + size - 5000, disk, 5000);
+	for (i = 5000; i < 10 * 512; i++)
+		ut_asserteq(0, disk[i]);
+
+	/* Nor is a sparse image written beyond the end of the partition */
+	ut_assertok(fb_stream_cmd(uts, "oem stream:test2", "OKAY"));
+	ut_assertok(fb_stream_download(uts, image, size,
+				       "FAILRequest would exceed partition size!"));
+	ut_assertok(fb_stream_cmd(uts, "flash:test2", "FAILno image streamed"));
+
+	/*
+	 * Nor when that is found part of the way through, after two blocks
+	 * are written. The rest of the download, much larger than the buffer,
+	 * is dropped.
+	 */
+	sparse->total_blks = 12;
+	sparse->total_chunks = 3;
+	p = (u8 *)(sparse + 1);
+	for (i = 0; i < 2; i++) {
+		p = fb_stream_chunk(p, CHUNK_TYPE_RAW, 1, FB_STREAM_BLK_SZ);
+		memset(p, i + 1, FB_STREAM_BLK_SZ);
+		p += FB_STREAM_BLK_SZ;
+	}
+	p = fb_stream_chunk(p, CHUNK_TYPE_RAW, 10, 10 * FB_STREAM_BLK_SZ);
+	p += 10 * FB_STREAM_BLK_SZ;
+	ut_assert(p - image > 2 * SZ_16K);
+	ut_assertok(fb_stream_cmd(uts, "oem stream:test2", "OKAY"));
+	ut_assertok(fb_stream_download(uts, image, p - image,
+				       "FAILRequest would exceed partition size!"));
+	ut_assertok(fb_stream_cmd(uts, "flash:test2", "FAILno image streamed"));
+
+	/* The next download is written as normal */
+	ut_assertok(fb_stream_cmd(uts, "oem stream:test2", "OKAY"));
+	ut_assertok(fb_stream_download(uts, image + size - 5000, 5000,
+				       "OKAY"));
+	ut_assertok(fb_stream_cmd(uts, "flash:test2", "OKAY"));
+
+	/*
+	 * A streamed download which is not flashed does not affect the next
+	 * one, which goes to the buffer and is flashed from there
+	 */
+	ut_assertok(fb_stream_cmd(uts, "oem stream:test2", "OKAY"));
+	ut_assertok(fb_stream_download(uts, image + size - 5000, 5000,
+				       "OKAY"));
+	ut_assertok(fb_stream_download(uts, image + size - 2048, 2048,
+				       "OKAY"));
+	ut_asserteq_mem(image + size - 2048, buf, 2048);
+	ut_assertok(fb_stream_cmd(uts, "flash:test2", "OKAY"));
+	ut_asserteq(4, blk_dread(mmc_dev_desc, parts[1].start, 4, disk));
+	ut_asserteq_mem(image + size - 2048, disk, 2048);
+
+	/* Disarming without a download */
+	ut_assertok(fb_stream_cmd(uts, "oem stream:test2", "OKAY"));
+	ut_assertok(fb_stream_cmd(uts, "oem stream", "OKAY"));
+	ut_assertok(fb_stream_cmd(uts, "getvar:max-download-size",
+				  "OKAY0x00004000"));
+	ut_assertok(fb_stream_cmd(uts, "download:00010000",
+				  "FAIL00010000"));
+
+	fastboot_init(NULL, 0);
+	free(image);
+	free(disk);
+	free(buf);
+
+	return 0;
+}
+DM_TEST(dm_test_fastboot_mmc_stream, UT_TESTF_SCAN_PDATA | UT_TESTF_SCAN_FDT);
+#endif
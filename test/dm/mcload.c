@@ -0,0 +1,408 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * Test receiving an image sent to a multicast group, against a sender
+ * emulated by the sandbox Ethernet driver, over a link dropping packets
+ */
+
+#include <common.h>
+#include <blk.h>
+#include <command.h>
+#include <dm.h>
+#include <env.h>
+#include <malloc.h>
+#include <mapmem.h>
+#include <net.h>
+#include <part.h>
+#include <uuid.h>
+#include <asm/eth.h>
+#include <dm/test.h>
+#include <net/mcload.h>
+#include <test/test.h>
+#include <test/ut.h>
+
+#define MCLOAD_TEST_GROUP	"239.1.2.3"
+#define MCLOAD_TEST_SENDER	"1.1.2.2"
+#define MCLOAD_TEST_SPORT	5000
+#define MCLOAD_TEST_SESSION	0x1234
+#define MCLOAD_TEST_ADDR	0x1000000
+#define MCLOAD_TEST_MAX_DROPS	8
+#define MCLOAD_TEST_MAX_NAKS	8
+
+/**
+ * struct mcload_test_sender - State of the emulated sender
+ *
+ * The whole image is queued once when the receiver announces the group, so
+ * it must fit in the receive queue; after that, blocks are sent only when
+ * asked for by a NAK.
+ *
+ * @uts: test state, for the ut_assert macros in the handler
+ * @file: image to send
+ * @size: size of @file
+ * @blksize: block size
+ * @blocks: number of blocks
+ * @drop: blocks not sent in the first pass
+ * @ndrops: number of entries in @drop
+ * @stray: block to send from another session during the first pass, -1 for
+ *	none
+ * @started: the first pass was sent
+ * @reports: IGMP reports received
+ * @sent: blocks sent
+ * @naks: NAKs received
+ * @nak_ranges: ranges of the first NAKs, as (first, count) pairs
+ * @nak_nranges: number of ranges of each of the first NAKs
+ * @done: DONE messages received
+ * @overruns: packets which did not fit in the receive queue
+ */
+struct mcload_test_sender {
+	struct unit_test_state *uts;
+	const uchar *file;
+	uint size;
+	uint blksize;
+	uint blocks;
+	uint drop[MCLOAD_TEST_MAX_DROPS];
+	uint ndrops;
+	int stray;
+	bool started;
+	uint reports;
+	uint sent;
+	uint naks;
+	u32 nak_ranges[MCLOAD_TEST_MAX_NAKS][8];
+	uint nak_nranges[MCLOAD_TEST_MAX_NAKS];
+	uint done;
+	uint overruns;
+};
+
+static struct mcload_test_sender snd;
+
+/* Queue one block from the sender to the group */
+static void sb_mcload_send(struct udevice *dev, uint block, u32 session)
+{
+	struct eth_sandbox_priv *priv = dev_get_priv(dev);
+	uint len = min(snd.blksize, snd.size - block * snd.blksize);
+	struct in_addr group = string_to_ip(MCLOAD_TEST_GROUP);
+	struct ethernet_hdr *eth;
+	struct mcload_hdr *hdr;
+	struct ip_udp_hdr *ip;
+
+	if (priv->recv_packets >= PKTBUFSRX) {
+		snd.overruns++;
+		return;
+	}
+
+	eth = (void *)priv->recv_packet_buffer[priv->recv_packets];
+	eth_mcast_ethaddr(group, eth->et_dest);
+	memcpy(eth->et_src, priv->fake_host_hwaddr, ARP_HLEN);
+	eth->et_protlen = htons(PROT_IP);
+
+	ip = (void *)eth + ETHER_HDR_SIZE;
+	net_set_ip_header((uchar *)ip, group, string_to_ip(MCLOAD_TEST_SENDER),
+			  IP_UDP_HDR_SIZE + sizeof(*hdr) + len, IPPROTO_UDP);
+	ip->udp_src = htons(MCLOAD_TEST_SPORT);
+	ip->udp_dst = htons(MCLOAD_DEFAULT_PORT);
+	ip->udp_len = htons(UDP_HDR_SIZE + sizeof(*hdr) + len);
+	ip->udp_xsum = 0;
+
+	hdr = (void *)ip + IP_UDP_HDR_SIZE;
+	hdr->magic = htonl(MCLOAD_MAGIC);
+	hdr->version = MCLOAD_VERSION;
+	hdr->type = MCLOAD_DATA;
+	hdr->blksize = htons(snd.blksize);
+	hdr->session = htonl(session);
+	hdr->size = htonl(snd.size);
+	hdr->block = htonl(block);
+	memcpy(hdr + 1, snd.file + block * snd.blksize, len);
+
+	priv->recv_packet_length[priv->recv_packets++] = ETHER_HDR_SIZE +
+		IP_UDP_HDR_SIZE + sizeof(*hdr) + len;
+	snd.sent++;
+}
+
+static bool sb_mcload_dropped(uint block)
+{
+	uint i;
+
+	for (i = 0; i < snd.ndrops; i++) {
+		if (snd.drop[i] == block)
+			return true;
+	}
+
+	return false;
+}
+
+static int sb_mcload_pass(struct udevice *dev)
+{
+	uint block;
+
+	for (block = 0; block < snd.blocks; block++) {
+		if (!sb_mcload_dropped(block))
+			sb_mcload_send(dev, block, MCLOAD_TEST_SESSION);
+		if (block == snd.stray)
+			sb_mcload_send(dev, block, MCLOAD_TEST_SESSION + 1);
+	}
+	snd.started = true;
+
+	return 0;
+}
+
+static int sb_mcload_handler(struct udevice *dev, void *packet,
+			     unsigned int len)
+{
+	struct eth_sandbox_priv *priv = dev_get_priv(dev);
+	struct unit_test_state *uts = snd.uts;
+	struct in_addr group = string_to_ip(MCLOAD_TEST_GROUP);
+	struct ethernet_hdr *eth = packet;
+	struct ip_udp_hdr *ip = packet + ETHER_HDR_SIZE;
+	struct mcload_range *range;
+	struct mcload_hdr *hdr;
+	uint nranges, i, j;
+	u8 mac[ARP_HLEN];
+
+	if (!sandbox_eth_arp_req_to_reply(dev, packet, len))
+		return 0;
+	if (ntohs(eth->et_protlen) != PROT_IP)
+		return 0;
+
+	if (ip->ip_p == IPPROTO_IGMP) {
+		/* A membership report, sent to the group with a TTL of 1 */
+		eth_mcast_ethaddr(group, mac);
+		ut_asserteq_mem(mac, eth->et_dest, ARP_HLEN);
+		ut_asserteq(group.s_addr, net_read_ip(&ip->ip_dst).s_addr);
+		ut_asserteq(1, ip->ip_ttl);
+		ut_asserteq(0x16, *((uchar *)ip + IP_HDR_SIZE));
+		snd.reports++;
+		if (!snd.started)
+			return sb_mcload_pass(dev);
+		return 0;
+	}
+	if (ip->ip_p != IPPROTO_UDP)
+		return 0;
+
+	/* Replies come straight back to the sender */
+	ut_asserteq_mem(priv->fake_host_hwaddr, eth->et_dest, ARP_HLEN);
+	ut_asserteq(string_to_ip(MCLOAD_TEST_SENDER).s_addr,
+		    net_read_ip(&ip->ip_dst).s_addr);
+	ut_asserteq(MCLOAD_TEST_SPORT, ntohs(ip->udp_dst));
+	ut_asserteq(MCLOAD_DEFAULT_PORT, ntohs(ip->udp_src));
+
+	hdr = (void *)ip + IP_UDP_HDR_SIZE;
+	ut_asserteq(MCLOAD_MAGIC, ntohl(hdr->magic));
+	ut_asserteq(MCLOAD_TEST_SESSION, ntohl(hdr->session));
+	if (hdr->type == MCLOAD_DONE) {
+		snd.done++;
+		return 0;
+	}
+	ut_asserteq(MCLOAD_NAK, hdr->type);
+
+	nranges = ntohl(hdr->block);
+	ut_assert(nranges > 0 && nranges <= MCLOAD_NAK_RANGES);
+	range = (void *)(hdr + 1);
+	if (snd.naks < MCLOAD_TEST_MAX_NAKS) {
+		snd.nak_nranges[snd.naks] = nranges;
+		for (i = 0; i < min(nranges, 4U); i++) {
+			snd.nak_ranges[snd.naks][2 * i] =
+				ntohl(range[i].first);
+			snd.nak_ranges[snd.naks][2 * i + 1] =
+				ntohl(range[i].count);
+		}
+	}
+	snd.naks++;
+
+	/* Send the missing blocks again, to the whole group */
+	for (i = 0; i < nranges; i++) {
+		for (j = 0; j < ntohl(range[i].count); j++)
+			sb_mcload_send(dev, ntohl(range[i].first) + j,
+				       MCLOAD_TEST_SESSION);
+	}
+
+	return 0;
+}
+
+static uchar *sb_mcload_setup(struct unit_test_state *uts, uint size,
+			      uint blksize)
+{
+	uchar *file;
+	uint i;
+
+	file = malloc(size);
+	if (!file)
+		return NULL;
+	for (i = 0; i < size; i++)
+		file[i] = (i * 7 + (i >> 9)) & 0xff;
+
+	memset(&snd, '\0', sizeof(snd));
+	snd.uts = uts;
+	snd.file = file;
+	snd.size = size;
+	snd.blksize = blksize;
+	snd.blocks = DIV_ROUND_UP(size, blksize);
+	snd.stray = -1;
+
+	env_set("ethact", "eth@10002000");
+	sandbox_eth_set_tx_handler(0, sb_mcload_handler);
+
+	return file;
+}
+
+static int sb_mcload_teardown(struct unit_test_state *uts, uchar *file)
+{
+	struct eth_sandbox_priv *priv;
+	struct udevice *dev;
+
+	/* The group was left at the end */
+	ut_assertok(uclass_get_device_by_name(UCLASS_ETH, "eth@10002000",
+					      &dev));
+	priv = dev_get_priv(dev);
+	ut_asserteq(0x01, priv->mcast_ethaddr[0]);
+	ut_asserteq(0x5e, priv->mcast_ethaddr[2]);
+	ut_asserteq(0x03, priv->mcast_ethaddr[5]);
+	ut_assert(!priv->mcast_joined);
+	ut_asserteq(0, net_mcast_addr.s_addr);
+
+	sandbox_eth_set_tx_handler(0, NULL);
+	free(file);
+
+	return 0;
+}
+
+/* Test loading to memory, with losses repaired through NAKs */
+static int dm_test_mcload(struct unit_test_state *uts)
+{
+	const struct mcload_stats *stats = mcload_get_stats();
+	uchar *file;
+
+	/* The last block is shorter, and lost: the stream just stops */
+	file = sb_mcload_setup(uts, 60 * 1024 - 100, 1024);
+	ut_assertnonnull(file);
+	snd.drop[0] = 3;
+	snd.drop[1] = 17;
+	snd.drop[2] = 18;
+	snd.drop[3] = 59;
+	snd.ndrops = 4;
+	snd.stray = 10;
+
+	ut_assertok(run_command("mcload 1000000 " MCLOAD_TEST_GROUP, 0));
+	ut_asserteq(snd.size, env_get_hex("filesize", 0));
+	ut_asserteq_mem(file, map_sysmem(MCLOAD_TEST_ADDR, snd.size),
+			snd.size);
+	ut_asserteq(0, snd.overruns);
+
+	/* One NAK listed all the holes and the repairs completed the image */
+	ut_asserteq(1, snd.naks);
+	ut_asserteq(3, snd.nak_nranges[0]);
+	ut_asserteq(3, snd.nak_ranges[0][0]);
+	ut_asserteq(1, snd.nak_ranges[0][1]);
+	ut_asserteq(17, snd.nak_ranges[0][2]);
+	ut_asserteq(2, snd.nak_ranges[0][3]);
+	ut_asserteq(59, snd.nak_ranges[0][4]);
+	ut_asserteq(1, snd.nak_ranges[0][5]);
+	ut_asserteq(1, snd.done);
+	ut_asserteq(1, snd.reports);
+
+	ut_asserteq(snd.blocks, stats->blocks);
+	ut_asserteq(0, stats->dup);
+	ut_asserteq(1, stats->naks);
+	ut_asserteq(1, stats->timeouts);
+
+	ut_assertok(sb_mcload_teardown(uts, file));
+
+	return 0;
+}
+DM_TEST(dm_test_mcload, UT_TESTF_SCAN_FDT);
+
+/* Test writing to a block device as blocks arrive, in any order */
+static int dm_test_mcload_blk(struct unit_test_state *uts)
+{
+	const struct mcload_stats *stats = mcload_get_stats();
+	struct blk_desc *desc;
+	uchar *file, *buf;
+	uint count;
+
+	file = sb_mcload_setup(uts, 40 * 1024 + 300, 1024);
+	ut_assertnonnull(file);
+	snd.drop[0] = 0;
+	snd.drop[1] = 20;
+	snd.ndrops = 2;
+
+	ut_asserteq(0, blk_get_device_by_str("mmc", "0", &desc));
+	ut_assertok(run_command("mcload blk mmc 0 10 " MCLOAD_TEST_GROUP ":1758",
+				0));
+
+	count = DIV_ROUND_UP(snd.size, desc->blksz);
+	buf = malloc(count * desc->blksz);
+	ut_assertnonnull(buf);
+	ut_asserteq(count, blk_dread(desc, 0x10, count, buf));
+	ut_asserteq_mem(file, buf, snd.size);
+	free(buf);
+
+	/* The NAK was sent soon after the last block came, before a timeout */
+	ut_asserteq(1, snd.naks);
+	ut_asserteq(2, snd.nak_nranges[0]);
+	ut_asserteq(0, stats->timeouts);
+	ut_asserteq(1, snd.done);
+
+	/* A block size which is not a multiple of the sector size is refused */
+	snd.blksize = 1000;
+	snd.started = false;
+	ut_asserteq(1, run_command("mcload blk mmc 0 10 " MCLOAD_TEST_GROUP,
+				   0));
+
+	ut_assertok(sb_mcload_teardown(uts, file));
+
+	return 0;
+}
+DM_TEST(dm_test_mcload_blk, UT_TESTF_SCAN_FDT);
+
+/* Test that an image is written to a partition only if it fits */
+static int dm_test_mcload_part(struct unit_test_state *uts)
+{
+	char str_disk_guid[UUID_STR_LEN + 1];
+	struct disk_partition part = {
+		.start = 48,
+		.size = 100,
+		.name = "test1",
+	};
+	struct blk_desc *desc;
+	uchar *file, *buf;
+	uint count;
+
+	ut_asserteq(0, blk_get_device_by_str("mmc", "0", &desc));
+	if (CONFIG_IS_ENABLED(RANDOM_UUID)) {
+		gen_rand_uuid_str(part.uuid, UUID_STR_FORMAT_STD);
+		gen_rand_uuid_str(str_disk_guid, UUID_STR_FORMAT_STD);
+	}
+	ut_assertok(gpt_restore(desc, str_disk_guid, &part, 1));
+
+	/* 81 of the 100 blocks of the partition */
+	file = sb_mcload_setup(uts, 40 * 1024 + 300, 1024);
+	ut_assertnonnull(file);
+	ut_assertok(run_command("mcload blk mmc 0:1 13 " MCLOAD_TEST_GROUP, 0));
+	count = DIV_ROUND_UP(snd.size, desc->blksz);
+	buf = malloc(count * desc->blksz);
+	ut_assertnonnull(buf);
+	ut_asserteq(count, blk_dread(desc, part.start + 0x13, count, buf));
+	ut_asserteq_mem(file, buf, snd.size);
+	free(buf);
+	ut_asserteq(1, snd.done);
+
+	/* One block further, the image would run past the end of the partition */
+	snd.started = false;
+	ut_asserteq(1, run_command("mcload blk mmc 0:1 14 " MCLOAD_TEST_GROUP,
+				   0));
+	ut_asserteq(1, snd.done);
+
+	ut_assertok(sb_mcload_teardown(uts, file));
+
+	return 0;
+}
+DM_TEST(dm_test_mcload_part, UT_TESTF_SCAN_FDT);
+
+/* Test that a group outside 224.0.0.0/4 is refused */
+static int dm_test_mcload_group(struct unit_test_state *uts)
+{
+	ut_asserteq(-EINVAL, mcload_set_group("1.1.2.2"));
+	ut_asserteq(-EINVAL, mcload_set_group("239.1.2.3:0"));
+	ut_assertok(mcload_set_group("224.0.0.100:4000"));
+
+	return 0;
+}
+DM_TEST(dm_test_mcload_group, 0);
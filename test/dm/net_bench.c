@@ -0,0 +1,177 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * Test the network throughput benchmark against the traffic generator and
+ * a counting tx handler of the sandbox Ethernet driver. Run with -v, the
+ * tests also print the time per packet spent in the stack.
+ */
+
+#include <common.h>
+#include <command.h>
+#include <dm.h>
+#include <env.h>
+#include <net.h>
+#include <time.h>
+#include <asm/eth.h>
+#include <dm/test.h>
+#include <net/bench.h>
+#include <test/test.h>
+#include <test/ut.h>
+
+#define BENCH_TEST_HOST		"1.1.2.2"
+#define BENCH_TEST_SPORT	5002
+#define BENCH_TEST_PACKETS	5000
+#define BENCH_TEST_SIZE		64
+
+/**
+ * struct bench_test_peer - State of the emulated host
+ *
+ * @uts: test state, for the ut_assert macros in the handler
+ * @seq: number of the next packet generated
+ * @lost: packets numbered but not generated, as on a lossy link
+ * @done: the END packet was generated
+ * @received: packets received from the board, END excluded
+ * @ends: END packets received
+ * @end_seq: sequence number of the last END packet
+ * @bad_seq: packets received out of order
+ */
+struct bench_test_peer {
+	struct unit_test_state *uts;
+	u32 seq;
+	uint lost;
+	bool done;
+	uint received;
+	uint ends;
+	u32 end_seq;
+	uint bad_seq;
+};
+
+static struct bench_test_peer peer;
+
+/* Generate the packets of the host, every 1000th one lost on the way */
+static int sb_bench_gen(struct udevice *dev, void *packet)
+{
+	struct eth_sandbox_priv *priv = dev_get_priv(dev);
+	struct ethernet_hdr *eth = packet;
+	struct ip_udp_hdr *ip = packet + ETHER_HDR_SIZE;
+	struct net_bench_hdr *hdr = (void *)ip + IP_UDP_HDR_SIZE;
+	bool end;
+
+	if (peer.done)
+		return 0;
+	if (peer.seq % 1000 == 999) {
+		peer.lost++;
+		peer.seq++;
+	}
+	end = peer.seq >= BENCH_TEST_PACKETS;
+
+	memcpy(eth->et_dest, net_ethaddr, ARP_HLEN);
+	memcpy(eth->et_src, priv->fake_host_hwaddr, ARP_HLEN);
+	eth->et_protlen = htons(PROT_IP);
+
+	net_set_ip_header((uchar *)ip, net_ip, string_to_ip(BENCH_TEST_HOST),
+			  IP_UDP_HDR_SIZE + BENCH_TEST_SIZE, IPPROTO_UDP);
+	ip->udp_src = htons(BENCH_TEST_SPORT);
+	ip->udp_dst = htons(NET_BENCH_PORT);
+	ip->udp_len = htons(UDP_HDR_SIZE + BENCH_TEST_SIZE);
+	ip->udp_xsum = 0;
+
+	hdr->magic = htonl(NET_BENCH_MAGIC);
+	if (end) {
+		hdr->seq = htonl(BENCH_TEST_PACKETS);
+		hdr->flags = htonl(NET_BENCH_END);
+		peer.done = true;
+	} else {
+		hdr->seq = htonl(peer.seq++);
+		hdr->flags = 0;
+	}
+
+	return ETHER_HDR_SIZE + IP_UDP_HDR_SIZE + BENCH_TEST_SIZE;
+}
+
+/* Test counting the packets of a fast sender */
+static int dm_test_net_bench_sink(struct unit_test_state *uts)
+{
+	const struct net_bench_result *res = net_bench_get_result();
+
+	memset(&peer, '\0', sizeof(peer));
+	env_set("ethact", "eth@10002000");
+	sandbox_eth_set_rx_generator(0, sb_bench_gen);
+
+	ut_assertok(run_command("net bench sink", 0));
+	ut_asserteq(BENCH_TEST_PACKETS / 1000, peer.lost);
+	ut_asserteq(BENCH_TEST_PACKETS - peer.lost, res->packets);
+	ut_asserteq(peer.lost, res->lost);
+	ut_asserteq((BENCH_TEST_PACKETS - peer.lost) * BENCH_TEST_SIZE,
+		    res->bytes);
+
+	/* Nothing on another port */
+	memset(&peer, '\0', sizeof(peer));
+	sandbox_eth_set_rx_generator(0, sb_bench_gen);
+	sandbox_eth_skip_timeout();
+	ut_asserteq(1, run_command("net bench sink 5003 1", 0));
+	sandbox_eth_set_rx_generator(0, NULL);
+
+	return 0;
+}
+DM_TEST(dm_test_net_bench_sink, UT_TESTF_SCAN_FDT);
+
+/* Count the packets of the board, each one taking a millisecond to send */
+static int sb_bench_handler(struct udevice *dev, void *packet,
+			    unsigned int len)
+{
+	struct eth_sandbox_priv *priv = dev_get_priv(dev);
+	struct unit_test_state *uts = peer.uts;
+	struct ethernet_hdr *eth = packet;
+	struct ip_udp_hdr *ip = packet + ETHER_HDR_SIZE;
+	struct net_bench_hdr *hdr = (void *)ip + IP_UDP_HDR_SIZE;
+
+	if (!sandbox_eth_arp_req_to_reply(dev, packet, len))
+		return 0;
+	if (ntohs(eth->et_protlen) != PROT_IP || ip->ip_p != IPPROTO_UDP)
+		return 0;
+
+	ut_asserteq_mem(priv->fake_host_hwaddr, eth->et_dest, ARP_HLEN);
+	ut_asserteq(NET_BENCH_PORT, ntohs(ip->udp_dst));
+	ut_asserteq(UDP_HDR_SIZE + 100, ntohs(ip->udp_len));
+	ut_asserteq(NET_BENCH_MAGIC, ntohl(hdr->magic));
+	if (ntohl(hdr->flags) & NET_BENCH_END) {
+		peer.ends++;
+		peer.end_seq = ntohl(hdr->seq);
+		return 0;
+	}
+	if (ntohl(hdr->seq) != peer.received)
+		peer.bad_seq++;
+	peer.received++;
+	timer_test_add_offset(1);
+
+	return 0;
+}
+
+/* Test sending for a given time */
+static int dm_test_net_bench_source(struct unit_test_state *uts)
+{
+	const struct net_bench_result *res = net_bench_get_result();
+
+	memset(&peer, '\0', sizeof(peer));
+	peer.uts = uts;
+	env_set("ethact", "eth@10002000");
+	sandbox_eth_set_tx_handler(0, sb_bench_handler);
+
+	ut_assertok(run_command("net bench source " BENCH_TEST_HOST " 1 100",
+				0));
+	ut_assert(peer.received >= 1000);
+	ut_asserteq(peer.received, res->packets);
+	ut_asserteq(peer.received * 100, res->bytes);
+	ut_asserteq(0, peer.bad_seq);
+	ut_asserteq(3, peer.ends);
+	ut_asserteq(peer.received, peer.end_seq);
+
+	ut_asserteq(1, run_command("net bench source " BENCH_TEST_HOST
+				   " 1 8", 0));
+	ut_asserteq(1, run_command("net bench source " BENCH_TEST_HOST
+				   " 1 1500", 0));
+	sandbox_eth_set_tx_handler(0, NULL);
+
+	return 0;
+}
+DM_TEST(dm_test_net_bench_source, UT_TESTF_SCAN_FDT);
@@ -0,0 +1,439 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * Test NFS transfers with several READs in flight against an NFS server
+ * emulated by the sandbox Ethernet driver
+ */
+
+#include <common.h>
+#include <command.h>
+#include <dm.h>
+#include <env.h>
+#include <malloc.h>
+#include <mapmem.h>
+#include <net.h>
+#include <asm/eth.h>
+#include <dm/test.h>
+#include <test/test.h>
+#include <test/ut.h>
+#include "../../net/nfs.h"
+
+#define NFS_TEST_MOUNT_PORT	635
+#define NFS_TEST_NFS_PORT	2049
+#define NFS_TEST_ADDR		0x1000000
+#define NFS_TEST_MAX_READ	NFS_MAXDATA
+#define NFS_TEST_FRAG		1480	/* IP payload of a full frame */
+#define NFS_TEST_MAX_XIDS	256
+
+/**
+ * struct nfs_test_server - State of the emulated portmap, mount and NFS server
+ *
+ * @uts: test state, for the ut_assert macros in the handler
+ * @file: file to send
+ * @size: size of @file
+ * @v3_only: refuse NFSv2
+ * @reorder: queue each reply in front of those the client did not read yet
+ * @rtmax: largest READ announced by FSINFO
+ * @short_len: largest READ actually answered, 0 for no limit
+ * @drop_offset: offset of the READ request to lose once, -1 for none
+ * @client_port: UDP port of the client
+ * @ip_id: IP identification of the next reply
+ * @reads: number of READ requests answered
+ * @max_count: largest READ asked for
+ * @lost_xid: XID of the READ request lost
+ * @resent: number of times the lost READ request was sent again
+ * @retrans: number of READ requests answered twice
+ * @reordered: number of replies queued in front of others
+ * @overruns: replies which did not fit in the receive queue
+ * @errors: calls the server does not know
+ * @xids: XIDs of the READ requests answered
+ */
+struct nfs_test_server {
+	struct unit_test_state *uts;
+	const uchar *file;
+	uint size;
+	bool v3_only;
+	bool reorder;
+	uint rtmax;
+	uint short_len;
+	int drop_offset;
+	u16 client_port;
+	u16 ip_id;
+	uint reads;
+	uint max_count;
+	u32 lost_xid;
+	uint resent;
+	uint retrans;
+	uint reordered;
+	uint overruns;
+	uint errors;
+	u32 xids[NFS_TEST_MAX_XIDS];
+};
+
+static struct nfs_test_server srv;
+
+/*
+ * Move the frames queued from @first on in front of the others waiting,
+ * behind those the client is processing
+ */
+static void sb_nfs_to_front(struct eth_sandbox_priv *priv, int first)
+{
+	int busy = priv->recv_busy;
+	int n = priv->recv_packets - first;
+	uchar *buf[PKTBUFSRX];
+	int len[PKTBUFSRX];
+
+	memcpy(buf, priv->recv_packet_buffer + first, n * sizeof(*buf));
+	memcpy(len, priv->recv_packet_length + first, n * sizeof(*len));
+	memmove(priv->recv_packet_buffer + busy + n,
+		priv->recv_packet_buffer + busy, (first - busy) * sizeof(*buf));
+	memmove(priv->recv_packet_length + busy + n,
+		priv->recv_packet_length + busy, (first - busy) * sizeof(*len));
+	memcpy(priv->recv_packet_buffer + busy, buf, n * sizeof(*buf));
+	memcpy(priv->recv_packet_length + busy, len, n * sizeof(*len));
+}
+
+/* Queue a UDP datagram from the server, in IP fragments if it is large */
+static int sb_nfs_send(struct udevice *dev, u8 *dest_mac, uint sport,
+		       const void *data, uint len)
+{
+	static uchar dgram[UDP_HDR_SIZE + NFS_READ_HDR_SIZE + NFS_TEST_MAX_READ];
+	struct eth_sandbox_priv *priv = dev_get_priv(dev);
+	uint total = UDP_HDR_SIZE + len;
+	int first = priv->recv_packets;
+	uint off;
+
+	if (first + DIV_ROUND_UP(total, NFS_TEST_FRAG) > PKTBUFSRX) {
+		srv.overruns++;
+		return -EAGAIN;
+	}
+
+	*(__be16 *)dgram = htons(sport);
+	*(__be16 *)(dgram + 2) = htons(srv.client_port);
+	*(__be16 *)(dgram + 4) = htons(total);
+	*(__be16 *)(dgram + 6) = 0;
+	memcpy(dgram + UDP_HDR_SIZE, data, len);
+
+	for (off = 0; off < total; off += NFS_TEST_FRAG) {
+		uint flen = min(total - off, (uint)NFS_TEST_FRAG);
+		struct ethernet_hdr *eth;
+		struct ip_udp_hdr *ip;
+
+		eth = (void *)priv->recv_packet_buffer[priv->recv_packets];
+		memcpy(eth->et_dest, dest_mac, ARP_HLEN);
+		memcpy(eth->et_src, priv->fake_host_hwaddr, ARP_HLEN);
+		eth->et_protlen = htons(PROT_IP);
+
+		ip = (void *)eth + ETHER_HDR_SIZE;
+		net_set_ip_header((uchar *)ip, net_ip, priv->fake_host_ipaddr,
+				  IP_HDR_SIZE + flen, IPPROTO_UDP);
+		ip->ip_id = htons(srv.ip_id);
+		ip->ip_off = htons(off / 8 |
+				   (off + flen < total ? IP_FLAGS_MFRAG : 0));
+		ip->ip_sum = 0;
+		ip->ip_sum = compute_ip_checksum(ip, IP_HDR_SIZE);
+		memcpy((uchar *)ip + IP_HDR_SIZE, dgram + off, flen);
+
+		priv->recv_packet_length[priv->recv_packets++] =
+			ETHER_HDR_SIZE + IP_HDR_SIZE + flen;
+	}
+	srv.ip_id++;
+
+	/* The packets handed to the client stay first */
+	if (srv.reorder && first > priv->recv_busy) {
+		sb_nfs_to_front(priv, first);
+		srv.reordered++;
+	}
+
+	return 0;
+}
+
+/* Skip the header, credential and verifier of an RPC call */
+static u32 *sb_nfs_args(u32 *call)
+{
+	u32 *p = call + 6;
+
+	p += 2 + ntohl(p[1]) / 4;
+	p += 2 + ntohl(p[1]) / 4;
+
+	return p;
+}
+
+/* NFSv2 attributes of the file */
+static u32 *sb_nfs_fattr(u32 *p)
+{
+	memset(p, '\0', 17 * sizeof(u32));
+	p[0] = htonl(1);	/* NFREG */
+	p[5] = htonl(srv.size);
+
+	return p + 17;
+}
+
+/* Answer a READ, or return NULL to lose the request */
+static u32 *sb_nfs_read(u32 xid, uint vers, uint offset, uint count, u32 *p)
+{
+	bool eof;
+	uint i;
+
+	if (offset == srv.drop_offset) {
+		srv.drop_offset = -1;
+		srv.lost_xid = xid;
+		return NULL;
+	}
+	if (xid == srv.lost_xid)
+		srv.resent++;
+	for (i = 0; i < min(srv.reads, (uint)NFS_TEST_MAX_XIDS); i++) {
+		if (srv.xids[i] == xid)
+			srv.retrans++;
+	}
+	if (srv.reads < NFS_TEST_MAX_XIDS)
+		srv.xids[srv.reads] = xid;
+	srv.reads++;
+	srv.max_count = max(srv.max_count, count);
+
+	count = min(count, (uint)NFS_TEST_MAX_READ);
+	if (srv.short_len)
+		count = min(count, srv.short_len);
+	count = offset < srv.size ? min(count, srv.size - offset) : 0;
+	eof = offset + count >= srv.size;
+
+	*p++ = 0;		/* NFS_OK */
+	if (vers == 2) {
+		p = sb_nfs_fattr(p);
+	} else {
+		*p++ = 0;	/* no attributes */
+		*p++ = htonl(count);
+		*p++ = htonl(eof);
+	}
+	*p++ = htonl(count);
+	memcpy(p, srv.file + offset, count);
+
+	return p + DIV_ROUND_UP(count, 4);
+}
+
+/* Answer an NFS call after the RPC header in @reply, NULL to lose it */
+static u32 *sb_nfs_proc(u32 xid, uint vers, uint proc, u32 *args, u32 *reply)
+{
+	u32 *p = reply + 6;
+
+	if (vers == 2 && proc == NFS_LOOKUP) {
+		*p++ = 0;
+		memset(p, 0x22, NFS_FHSIZE);
+		p += NFS_FHSIZE / 4;
+		return sb_nfs_fattr(p);
+	}
+	if (vers == 2 && proc == NFS_READ) {
+		args += NFS_FHSIZE / 4;
+		return sb_nfs_read(xid, vers, ntohl(args[0]), ntohl(args[1]),
+				   p);
+	}
+	if (vers == 3 && proc == NFS3PROC_LOOKUP) {
+		*p++ = 0;
+		*p++ = htonl(NFS_FHSIZE);
+		memset(p, 0x33, NFS_FHSIZE);
+		p += NFS_FHSIZE / 4;
+		*p++ = 0;	/* no object attributes */
+		*p++ = 0;	/* no directory attributes */
+		return p;
+	}
+	if (vers == 3 && proc == NFS3PROC_FSINFO) {
+		*p++ = 0;
+		*p++ = 0;	/* no attributes */
+		*p++ = htonl(srv.rtmax);
+		*p++ = htonl(srv.rtmax);
+		*p++ = htonl(512);
+		memset(p, '\0', 9 * sizeof(u32));
+		return p + 9;
+	}
+	if (vers == 3 && proc == NFS_READ) {
+		/* Skip the file handle and the upper half of the offset */
+		args += 1 + ntohl(args[0]) / 4;
+		return sb_nfs_read(xid, vers, ntohl(args[1]), ntohl(args[2]),
+				   p);
+	}
+	srv.errors++;
+	reply[5] = htonl(NFS_RPC_PROC_UNAVAIL);
+
+	return p;
+}
+
+static int sb_nfs_handler(struct udevice *dev, void *packet,
+			  unsigned int len)
+{
+	static u32 reply[(NFS_READ_HDR_SIZE + NFS_TEST_MAX_READ) / 4];
+	struct unit_test_state *uts = srv.uts;
+	struct ethernet_hdr *eth = packet;
+	struct ip_udp_hdr *ip = packet + ETHER_HDR_SIZE;
+	uint dport, prog, vers, proc;
+	u32 call[256], *args, *p;
+
+	if (!sandbox_eth_arp_req_to_reply(dev, packet, len))
+		return 0;
+	if (ntohs(eth->et_protlen) != PROT_IP || ip->ip_p != IPPROTO_UDP)
+		return 0;
+
+	len = ntohs(ip->udp_len) - UDP_HDR_SIZE;
+	ut_assert(len <= sizeof(call));
+	memcpy(call, (uchar *)ip + IP_UDP_HDR_SIZE, len);
+	ut_asserteq(MSG_CALL, ntohl(call[1]));
+	srv.client_port = ntohs(ip->udp_src);
+	dport = ntohs(ip->udp_dst);
+	prog = ntohl(call[3]);
+	vers = ntohl(call[4]);
+	proc = ntohl(call[5]);
+	args = sb_nfs_args(call);
+
+	reply[0] = call[0];
+	reply[1] = htonl(MSG_REPLY);
+	reply[2] = 0;		/* accepted */
+	reply[3] = 0;		/* AUTH_NONE verifier */
+	reply[4] = 0;
+	reply[5] = htonl(NFS_RPC_SUCCESS);
+	p = &reply[6];
+
+	switch (dport) {
+	case SUNRPC_PORT:
+		ut_asserteq(PROG_PORTMAP, prog);
+		ut_asserteq(PORTMAP_GETPORT, proc);
+		*p++ = htonl(ntohl(args[0]) == PROG_MOUNT ?
+			     NFS_TEST_MOUNT_PORT : NFS_TEST_NFS_PORT);
+		break;
+	case NFS_TEST_MOUNT_PORT:
+		ut_asserteq(PROG_MOUNT, prog);
+		if (proc == MOUNT_ADDENTRY) {
+			*p++ = 0;
+			memset(p, 0x11, NFS_FHSIZE);
+			p += NFS_FHSIZE / 4;
+		} else {
+			ut_asserteq(MOUNT_UMOUNTALL, proc);
+		}
+		break;
+	case NFS_TEST_NFS_PORT:
+		ut_asserteq(PROG_NFS, prog);
+		if (vers == 2 && srv.v3_only) {
+			reply[5] = htonl(NFS_RPC_PROG_MISMATCH);
+			*p++ = htonl(3);
+			*p++ = htonl(3);
+			break;
+		}
+		p = sb_nfs_proc(ntohl(call[0]), vers, proc, args, reply);
+		if (!p)
+			return 0;
+		break;
+	default:
+		srv.errors++;
+		return -EINVAL;
+	}
+
+	return sb_nfs_send(dev, eth->et_src, dport, reply,
+			   (uchar *)p - (uchar *)reply);
+}
+
+static uchar *sb_nfs_setup(struct unit_test_state *uts, uint size)
+{
+	uchar *file;
+	uint i;
+
+	file = malloc(size);
+	if (!file)
+		return NULL;
+	for (i = 0; i < size; i++)
+		file[i] = (i * 7 + (i >> 12)) & 0xff;
+
+	memset(&srv, '\0', sizeof(srv));
+	srv.uts = uts;
+	srv.file = file;
+	srv.size = size;
+	srv.drop_offset = -1;
+
+	env_set("ethact", "eth@10002000");
+	sandbox_eth_set_tx_handler(0, sb_nfs_handler);
+
+	return file;
+}
+
+static void sb_nfs_teardown(uchar *file)
+{
+	sandbox_eth_set_tx_handler(0, NULL);
+	free(file);
+}
+
+static int sb_nfs_check(struct unit_test_state *uts)
+{
+	ut_asserteq(srv.size, env_get_hex("filesize", 0));
+	ut_asserteq_mem(srv.file, map_sysmem(NFS_TEST_ADDR, srv.size),
+			srv.size);
+	ut_asserteq(0, srv.overruns);
+	ut_asserteq(0, srv.errors);
+
+	return 0;
+}
+
+/* Test NFSv2 reads of the largest size, answered out of order */
+static int dm_test_nfs_pipeline(struct unit_test_state *uts)
+{
+	uchar *file;
+
+	file = sb_nfs_setup(uts, 100 * 1024 + 123);
+	ut_assertnonnull(file);
+	srv.reorder = true;
+
+	ut_assertok(run_command("nfs 1000000 1.1.2.2:/export/pipe.bin", 0));
+	ut_assertok(sb_nfs_check(uts));
+	ut_asserteq(NFS_MAXDATA, srv.max_count);
+	ut_asserteq(DIV_ROUND_UP(srv.size, NFS_MAXDATA), srv.reads);
+	ut_asserteq(0, srv.retrans);
+
+	/* Each burst of the window comes back in reverse order */
+	ut_assert(srv.reordered >= CONFIG_NFS_READ_WINDOW - 1);
+
+	sb_nfs_teardown(file);
+
+	return 0;
+}
+DM_TEST(dm_test_nfs_pipeline, UT_TESTF_SCAN_FDT);
+
+/* Test that only the lost READ is sent again, with the same XID */
+static int dm_test_nfs_loss(struct unit_test_state *uts)
+{
+	uchar *file;
+
+	file = sb_nfs_setup(uts, 64 * 1024);
+	ut_assertnonnull(file);
+	srv.drop_offset = 3 * NFS_MAXDATA;
+
+	ut_assertok(run_command("nfs 1000000 1.1.2.2:/export/loss.bin", 0));
+	ut_assertok(sb_nfs_check(uts));
+	ut_asserteq(srv.size / NFS_MAXDATA, srv.reads);
+	ut_asserteq(1, srv.resent);
+	ut_asserteq(0, srv.retrans);
+
+	sb_nfs_teardown(file);
+
+	return 0;
+}
+DM_TEST(dm_test_nfs_loss, UT_TESTF_SCAN_FDT);
+
+/*
+ * Test NFSv3 reads sized by FSINFO, with short reads before the end. The
+ * client keeps to NFSv3 once a server refused NFSv2, so this test runs last.
+ */
+static int dm_test_nfs_v3(struct unit_test_state *uts)
+{
+	uchar *file;
+
+	file = sb_nfs_setup(uts, 64 * 1024 + 5);
+	ut_assertnonnull(file);
+	srv.v3_only = true;
+	srv.rtmax = 6000;
+	srv.short_len = 3000;
+
+	ut_assertok(run_command("nfs 1000000 1.1.2.2:/export/v3.bin", 0));
+	ut_assertok(sb_nfs_check(uts));
+	ut_asserteq(4096, srv.max_count);
+	ut_asserteq(0, srv.retrans);
+
+	sb_nfs_teardown(file);
+
+	return 0;
+}
+DM_TEST(dm_test_nfs_v3, UT_TESTF_SCAN_FDT);
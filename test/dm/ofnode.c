@@ -3,11 +3,16 @@
 #include <common.h>
 #include <dm.h>
 #include <log.h>
+#include <of_live.h>
+#include <os.h>
+#include <asm/global_data.h>
 #include <dm/of_extra.h>
 #include <dm/test.h>
 #include <test/test.h>
 #include <test/ut.h>
 
+DECLARE_GLOBAL_DATA_PTR;
+
 static int dm_test_ofnode_compatible(struct unit_test_state *uts)
 {
 	ofnode root_node = ofnode_path("/");
@@ -351,3 +356,82 @@ static int dm_test_ofnode_for_each_compatible_node(struct unit_test_state *uts)
 	return 0;
 }
 DM_TEST(dm_test_ofnode_for_each_compatible_node, UT_TESTF_SCAN_FDT);
+
+/* Check that the live tree at @np is the same as @ref, from of_live_build() */
+static int ofnode_check_live_image(struct unit_test_state *uts,
+				   const struct device_node *np,
+				   const struct device_node *ref)
+{
+	const struct device_node *child, *ref_child;
+	const struct property *pp, *ref_pp;
+
+	ut_asserteq_str(ref->full_name, np->full_name);
+	ut_asserteq_str(ref->name, np->name);
+	ut_asserteq_str(ref->type, np->type);
+	ut_asserteq(ref->phandle, np->phandle);
+
+	for (pp = np->properties, ref_pp = ref->properties; ref_pp;
+	     pp = pp->next, ref_pp = ref_pp->next) {
+		ut_assertnonnull(pp);
+		ut_asserteq_str(ref_pp->name, pp->name);
+		ut_asserteq(ref_pp->length, pp->length);
+		ut_asserteq_mem(ref_pp->value, pp->value, ref_pp->length);
+		/* Values not recreated by of_live_build() are in the FDT */
+		if (ref_pp->value != ref_pp + 1)
+			ut_asserteq_ptr(ref_pp->value, pp->value);
+	}
+	ut_assertnull(pp);
+
+	for (child = np->child, ref_child = ref->child; ref_child;
+	     child = child->sibling, ref_child = ref_child->sibling) {
+		ut_assertnonnull(child);
+		ut_asserteq_ptr(np, child->parent);
+		ut_assertok(ofnode_check_live_image(uts, child, ref_child));
+	}
+	ut_assertnull(child);
+
+	return 0;
+}
+
+/* Test setting up the live tree from the image built by mklivetree */
+static int dm_test_ofnode_live_image(struct unit_test_state *uts)
+{
+	struct device_node *root, *ref;
+	struct of_live_image *hdr;
+	void *image, *fdt;
+	int size;
+
+	ut_assertok(of_live_build(gd->fdt_blob, &ref));
+
+	/* On sandbox, each call reads a new copy of the image */
+	image = board_of_live_image();
+	ut_assertnonnull(image);
+	ut_assertok(of_live_map(image, gd->fdt_blob, &root));
+	ut_assertnull(root->parent);
+	ut_assertok(ofnode_check_live_image(uts, root, ref));
+	os_free(image);
+
+	ut_asserteq(-ENOENT, of_live_map(NULL, gd->fdt_blob, &root));
+
+	/* An image for another target is refused */
+	hdr = board_of_live_image();
+	ut_assertnonnull(hdr);
+	hdr->ptr_size = cpu_to_fdt32(sizeof(void *) == 8 ? 4 : 8);
+	ut_asserteq(-EINVAL, of_live_map(hdr, gd->fdt_blob, &root));
+	os_free(hdr);
+
+	/* So is one built from another FDT */
+	size = fdt_totalsize(gd->fdt_blob);
+	fdt = malloc(size);
+	ut_assertnonnull(fdt);
+	memcpy(fdt, gd->fdt_blob, size);
+	ut_assertok(fdt_setprop_inplace_u32(fdt, 0, "#size-cells", 2));
+	image = board_of_live_image();
+	ut_assertnonnull(image);
+	ut_asserteq(-ESTALE, of_live_map(image, fdt, &root));
+	os_free(image);
+	free(fdt);
+
+	return 0;
+}
+DM_TEST(dm_test_ofnode_live_image, UT_TESTF_LIVE_TREE);
@@ -0,0 +1,202 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * Test probing devices in parallel, overlapping their waits
+ */
+
+#include <common.h>
+#include <dm.h>
+#include <dm/device-internal.h>
+#include <dm/lists.h>
+#include <dm/root.h>
+#include <dm/test.h>
+#include <test/test.h>
+#include <test/ut.h>
+
+/* Number of polls each of the two steps of the probe of a device takes */
+#define PROBE_ASYNC_STEP_POLLS	3
+#define PROBE_ASYNC_DEVS	3
+
+/* Number of polls of the steps of all the devices so far */
+static int probe_async_polls;
+
+/**
+ * struct probe_async_plat - Behaviour of a test device
+ *
+ * @fail: the second step fails
+ * @needs: device which must be probed first
+ */
+struct probe_async_plat {
+	bool fail;
+	struct udevice *needs;
+};
+
+/**
+ * struct probe_async_priv - State of the probe of a test device
+ *
+ * @polls: number of polls of the current step
+ * @steps: number of steps over
+ * @first: value of probe_async_polls at the first poll of the device
+ * @last: value of probe_async_polls when its last step was over
+ */
+struct probe_async_priv {
+	int polls;
+	int steps;
+	int first;
+	int last;
+};
+
+/* Count a poll of the current step, returning true once the step is over */
+static bool probe_async_test_poll(struct udevice *dev)
+{
+	struct probe_async_priv *priv = dev_get_priv(dev);
+
+	if (!priv->first)
+		priv->first = probe_async_polls + 1;
+	probe_async_polls++;
+	if (++priv->polls < PROBE_ASYNC_STEP_POLLS)
+		return false;
+	priv->polls = 0;
+	priv->steps++;
+	priv->last = probe_async_polls;
+
+	return true;
+}
+
+static int probe_async_test_ready(struct udevice *dev)
+{
+	struct probe_async_plat *plat = dev_get_plat(dev);
+
+	if (!probe_async_test_poll(dev))
+		return -EAGAIN;
+
+	return plat->fail ? -EIO : 0;
+}
+
+/* The first step leaves another one, like a reset followed by a wait */
+static int probe_async_test_reset(struct udevice *dev)
+{
+	if (!probe_async_test_poll(dev))
+		return -EAGAIN;
+
+	return device_probe_yield(dev, probe_async_test_ready);
+}
+
+static int probe_async_test_probe(struct udevice *dev)
+{
+	struct probe_async_plat *plat = dev_get_plat(dev);
+	struct probe_async_priv *needs_priv;
+	int ret;
+
+	if (plat->needs) {
+		ret = device_probe(plat->needs);
+		if (ret)
+			return ret;
+		needs_priv = dev_get_priv(plat->needs);
+		if (needs_priv->steps != 2)
+			return -EBUSY;
+	}
+
+	return device_probe_yield(dev, probe_async_test_reset);
+}
+
+U_BOOT_DRIVER(probe_async_test) = {
+	.name	= "probe_async_test",
+	.id	= UCLASS_TEST_DUMMY,
+	.probe	= probe_async_test_probe,
+	.priv_auto	= sizeof(struct probe_async_priv),
+};
+
+static int probe_async_check(struct unit_test_state *uts,
+			     struct udevice *devs[], int count)
+{
+	struct probe_async_priv *priv;
+	int i;
+
+	for (i = 0; i < count; i++) {
+		ut_assert(device_active(devs[i]));
+		priv = dev_get_priv(devs[i]);
+		ut_asserteq(2, priv->steps);
+	}
+
+	return 0;
+}
+
+/* Test that the waits in the probe of several devices overlap */
+static int dm_test_probe_async(struct unit_test_state *uts)
+{
+	struct probe_async_plat plat[PROBE_ASYNC_DEVS + 1] = {};
+	struct udevice *devs[PROBE_ASYNC_DEVS + 1];
+	struct probe_async_priv *priv[PROBE_ASYNC_DEVS];
+	int i, j, start;
+	char name[20];
+
+	for (i = 0; i <= PROBE_ASYNC_DEVS; i++) {
+		snprintf(name, sizeof(name), "probe-async-%d", i);
+		ut_assertok(device_bind(dm_root(),
+					DM_DRIVER_GET(probe_async_test),
+					strdup(name), &plat[i], ofnode_null(),
+					&devs[i]));
+		device_set_name_alloced(devs[i]);
+	}
+
+	/* One after the other, each probe is over before the next starts */
+	start = probe_async_polls;
+	for (i = 0; i < PROBE_ASYNC_DEVS; i++)
+		ut_assertok(device_probe(devs[i]));
+	ut_assertok(probe_async_check(uts, devs, PROBE_ASYNC_DEVS));
+	ut_asserteq(PROBE_ASYNC_DEVS * 2 * PROBE_ASYNC_STEP_POLLS,
+		    probe_async_polls - start);
+	for (i = 0; i < PROBE_ASYNC_DEVS; i++)
+		priv[i] = dev_get_priv(devs[i]);
+	for (i = 1; i < PROBE_ASYNC_DEVS; i++)
+		ut_assert(priv[i - 1]->last < priv[i]->first);
+
+	/*
+	 * In parallel, the steps are polled in turn: every device is polled
+	 * before any probe is over, and no poll is wasted
+	 */
+	for (i = 0; i < PROBE_ASYNC_DEVS; i++)
+		ut_assertok(device_remove(devs[i], DM_REMOVE_NORMAL));
+	start = probe_async_polls;
+	ut_assertok(device_probe_parallel(devs, PROBE_ASYNC_DEVS));
+	ut_assertok(probe_async_check(uts, devs, PROBE_ASYNC_DEVS));
+	ut_asserteq(PROBE_ASYNC_DEVS * 2 * PROBE_ASYNC_STEP_POLLS,
+		    probe_async_polls - start);
+	for (i = 0; i < PROBE_ASYNC_DEVS; i++)
+		priv[i] = dev_get_priv(devs[i]);
+	for (i = 0; i < PROBE_ASYNC_DEVS; i++) {
+		ut_asserteq(start + 1 + i, priv[i]->first);
+		for (j = 0; j < PROBE_ASYNC_DEVS; j++)
+			ut_assert(priv[i]->first < priv[j]->last);
+	}
+
+	/* A device needing another one waits for its probe to be over */
+	for (i = 0; i < PROBE_ASYNC_DEVS; i++)
+		ut_assertok(device_remove(devs[i], DM_REMOVE_NORMAL));
+	plat[PROBE_ASYNC_DEVS].needs = devs[0];
+	ut_assertok(device_probe_parallel(devs, PROBE_ASYNC_DEVS + 1));
+	ut_assertok(probe_async_check(uts, devs, PROBE_ASYNC_DEVS + 1));
+
+	/* A device failing does not stop the others */
+	for (i = 0; i <= PROBE_ASYNC_DEVS; i++)
+		ut_assertok(device_remove(devs[i], DM_REMOVE_NORMAL));
+	plat[1].fail = true;
+	ut_asserteq(-EIO, device_probe_parallel(devs, PROBE_ASYNC_DEVS + 1));
+	ut_assert(!device_active(devs[1]));
+	ut_assert(device_active(devs[0]));
+	ut_assert(device_active(devs[2]));
+	ut_assert(device_active(devs[3]));
+
+	/* Outside device_probe_parallel(), the probe waits straight away */
+	plat[1].fail = false;
+	ut_assertok(device_probe(devs[1]));
+	ut_assertok(probe_async_check(uts, devs, PROBE_ASYNC_DEVS + 1));
+
+	for (i = 0; i <= PROBE_ASYNC_DEVS; i++) {
+		ut_assertok(device_remove(devs[i], DM_REMOVE_NORMAL));
+		ut_assertok(device_unbind(devs[i]));
+	}
+
+	return 0;
+}
+DM_TEST(dm_test_probe_async, 0);
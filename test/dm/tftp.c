@@ -0,0 +1,609 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * Test TFTP transfers with a window against a TFTP server emulated by the
+ * sandbox Ethernet driver, over a link dropping packets
+ */
+
+#include <common.h>
+#include <command.h>
+#include <dm.h>
+#include <env.h>
+#include <malloc.h>
+#include <mapmem.h>
+#include <net.h>
+#include <asm/eth.h>
+#include <dm/test.h>
+#include <net/tftp.h>
+#include <test/test.h>
+#include <test/ut.h>
+
+#define TFTP_TEST_PORT		69
+#define TFTP_TEST_TID		4000
+#define TFTP_TEST_ADDR		0x1000000
+#define TFTP_TEST_XFERS		8
+
+/**
+ * struct tftp_test_file - File of the emulated server
+ *
+ * @name: name of the file
+ * @offset: offset of its contents in the file given to sb_tftp_setup()
+ * @size: size of the file
+ */
+struct tftp_test_file {
+	const char *name;
+	uint offset;
+	uint size;
+};
+
+/**
+ * struct tftp_test_xfer - Transfer of a file by the emulated server
+ *
+ * Blocks are numbered from 1 without wrapping; the packets carry the lower
+ * 16 bits of the number.
+ *
+ * @data: contents of the file
+ * @size: size of the file
+ * @client_port: UDP port of the client
+ * @tid: UDP port of the server for this transfer
+ * @blksize: block size agreed with the client
+ * @windowsize: window size agreed with the client
+ * @last_block: number of the last block, shorter than @blksize
+ * @acked: last block acknowledged by the client
+ * @open: the transfer is going on
+ */
+struct tftp_test_xfer {
+	const uchar *data;
+	uint size;
+	u16 client_port;
+	u16 tid;
+	uint blksize;
+	uint windowsize;
+	uint last_block;
+	uint acked;
+	bool open;
+};
+
+/**
+ * struct tftp_test_server - State of the emulated TFTP server
+ *
+ * @uts: test state, for the ut_assert macros in the handler
+ * @file: file to send, whatever the name asked for if @files is NULL
+ * @size: size of @file
+ * @files: files served by name, found in @file
+ * @num_files: number of entries in @files
+ * @reorder: send the first two blocks of each window swapped
+ * @xfers: transfers, one per client port
+ * @num_xfers: number of entries used in @xfers
+ * @cur: last transfer started
+ * @req_windowsize: window size asked for by the client, 0 if none
+ * @sent: number of data blocks sent
+ * @overruns: packets which did not fit in the receive queue
+ * @arps: ARP requests received
+ * @open: transfers going on
+ * @max_open: most transfers going on at the same time
+ */
+struct tftp_test_server {
+	struct unit_test_state *uts;
+	const uchar *file;
+	uint size;
+	const struct tftp_test_file *files;
+	uint num_files;
+	bool reorder;
+	struct tftp_test_xfer xfers[TFTP_TEST_XFERS];
+	uint num_xfers;
+	struct tftp_test_xfer *cur;
+	uint req_windowsize;
+	uint sent;
+	uint overruns;
+	uint arps;
+	uint open;
+	uint max_open;
+};
+
+static struct tftp_test_server srv;
+
+/* Queue a UDP packet from the server */
+static int sb_tftp_send(struct udevice *dev, u8 *dest_mac,
+			struct tftp_test_xfer *xfer, const void *data, uint len)
+{
+	struct eth_sandbox_priv *priv = dev_get_priv(dev);
+	struct ethernet_hdr *eth;
+	struct ip_udp_hdr *ip;
+
+	if (priv->recv_packets >= PKTBUFSRX) {
+		srv.overruns++;
+		return -EAGAIN;
+	}
+
+	eth = (void *)priv->recv_packet_buffer[priv->recv_packets];
+	memcpy(eth->et_dest, dest_mac, ARP_HLEN);
+	memcpy(eth->et_src, priv->fake_host_hwaddr, ARP_HLEN);
+	eth->et_protlen = htons(PROT_IP);
+
+	ip = (void *)eth + ETHER_HDR_SIZE;
+	net_set_ip_header((uchar *)ip, net_ip, priv->fake_host_ipaddr,
+			  IP_UDP_HDR_SIZE + len, IPPROTO_UDP);
+	ip->udp_src = htons(xfer->tid);
+	ip->udp_dst = htons(xfer->client_port);
+	ip->udp_len = htons(UDP_HDR_SIZE + len);
+	ip->udp_xsum = 0;
+	memcpy((uchar *)ip + IP_UDP_HDR_SIZE, data, len);
+
+	priv->recv_packet_length[priv->recv_packets++] = ETHER_HDR_SIZE +
+		IP_UDP_HDR_SIZE + len;
+
+	return 0;
+}
+
+static void sb_tftp_send_block(struct udevice *dev, u8 *dest_mac,
+			       struct tftp_test_xfer *xfer, uint block)
+{
+	uchar pkt[4 + 1468];
+	uint off = (block - 1) * xfer->blksize;
+	uint len = min(xfer->blksize, xfer->size - off);
+
+	*(__be16 *)pkt = htons(3);
+	*(__be16 *)(pkt + 2) = htons(block & 0xffff);
+	memcpy(pkt + 4, xfer->data + off, len);
+	sb_tftp_send(dev, dest_mac, xfer, pkt, 4 + len);
+	srv.sent++;
+}
+
+static void sb_tftp_close(struct tftp_test_xfer *xfer)
+{
+	if (xfer->open)
+		srv.open--;
+	xfer->open = false;
+}
+
+/* Find the file asked for, or answer that there is no such file */
+static int sb_tftp_open(struct udevice *dev, u8 *dest_mac,
+			struct tftp_test_xfer *xfer, const char *name)
+{
+	static const char not_found[] = "\0\5\0\1File not found";
+	uint i;
+
+	if (!srv.files) {
+		xfer->data = srv.file;
+		xfer->size = srv.size;
+	} else {
+		for (i = 0; i < srv.num_files; i++) {
+			if (!strcmp(name, srv.files[i].name))
+				break;
+		}
+		if (i == srv.num_files)
+			return sb_tftp_send(dev, dest_mac, xfer, not_found,
+					    sizeof(not_found));
+		xfer->data = srv.file + srv.files[i].offset;
+		xfer->size = srv.files[i].size;
+	}
+
+	xfer->open = true;
+	srv.open++;
+	srv.max_open = max(srv.max_open, srv.open);
+
+	return 0;
+}
+
+/* Answer a read request with an OACK for the options we know */
+static int sb_tftp_rrq(struct udevice *dev, u8 *dest_mac,
+		       struct tftp_test_xfer *xfer, char *req, uint len)
+{
+	struct unit_test_state *uts = srv.uts;
+	char oack[128], *p = oack, *opt, *end = req + len;
+
+	*(__be16 *)p = htons(6);
+	p += 2;
+	/* Skip the file name and the mode */
+	opt = req + strlen(req) + 1;
+	ut_asserteq_str("octet", opt);
+	opt += strlen(opt) + 1;
+
+	while (opt < end) {
+		char *val = opt + strlen(opt) + 1;
+		uint num = dectoul(val, NULL);
+
+		if (!strcmp(opt, "blksize")) {
+			ut_assert(num <= 1468);
+			xfer->blksize = num;
+		} else if (!strcmp(opt, "windowsize")) {
+			srv.req_windowsize = num;
+			xfer->windowsize = num;
+		} else if (strcmp(opt, "timeout")) {
+			opt = val + strlen(val) + 1;
+			continue;
+		}
+		p += sprintf(p, "%s", opt) + 1;
+		p += sprintf(p, "%u", num) + 1;
+		opt = val + strlen(val) + 1;
+	}
+
+	if (sb_tftp_open(dev, dest_mac, xfer, req) || !xfer->open)
+		return 0;
+	xfer->last_block = xfer->size / xfer->blksize + 1;
+
+	return sb_tftp_send(dev, dest_mac, xfer, oack, p - oack);
+}
+
+/* Get the transfer for a new request, the one of the port if it resends */
+static struct tftp_test_xfer *sb_tftp_new_xfer(u16 client_port)
+{
+	struct tftp_test_xfer *xfer;
+	uint i;
+
+	for (i = 0; i < srv.num_xfers; i++) {
+		if (srv.xfers[i].client_port == client_port)
+			break;
+	}
+	if (i == srv.num_xfers) {
+		for (i = 0; i < srv.num_xfers; i++) {
+			if (!srv.xfers[i].open)
+				break;
+		}
+	}
+	if (i == TFTP_TEST_XFERS)
+		return NULL;
+	if (i == srv.num_xfers)
+		srv.num_xfers++;
+
+	xfer = &srv.xfers[i];
+	sb_tftp_close(xfer);
+	memset(xfer, '\0', sizeof(*xfer));
+	xfer->client_port = client_port;
+	xfer->tid = TFTP_TEST_TID + i;
+	xfer->blksize = 512;
+	xfer->windowsize = 1;
+
+	return xfer;
+}
+
+static int sb_tftp_handler(struct udevice *dev, void *packet,
+			   unsigned int len)
+{
+	struct unit_test_state *uts = srv.uts;
+	struct ethernet_hdr *eth = packet;
+	struct ip_udp_hdr *ip = packet + ETHER_HDR_SIZE;
+	uchar *data = (uchar *)ip + IP_UDP_HDR_SIZE;
+	struct tftp_test_xfer *xfer;
+	uint block, first, last, i;
+
+	if (!sandbox_eth_arp_req_to_reply(dev, packet, len)) {
+		srv.arps++;
+		return 0;
+	}
+	if (ntohs(eth->et_protlen) != PROT_IP || ip->ip_p != IPPROTO_UDP)
+		return 0;
+
+	len = ntohs(ip->udp_len) - UDP_HDR_SIZE;
+	if (ntohs(ip->udp_dst) == TFTP_TEST_PORT) {
+		ut_asserteq(1, ntohs(*(__be16 *)data));
+		xfer = sb_tftp_new_xfer(ntohs(ip->udp_src));
+		ut_assertnonnull(xfer);
+		srv.cur = xfer;
+		return sb_tftp_rrq(dev, eth->et_src, xfer, (char *)data + 2,
+				   len - 2);
+	}
+
+	i = ntohs(ip->udp_dst) - TFTP_TEST_TID;
+	ut_assert(i < srv.num_xfers);
+	xfer = &srv.xfers[i];
+	ut_asserteq(xfer->client_port, ntohs(ip->udp_src));
+	if (ntohs(*(__be16 *)data) == 5) {
+		sb_tftp_close(xfer);
+		return 0;
+	}
+	ut_asserteq(4, ntohs(*(__be16 *)data));
+
+	/* Send a window after the block acknowledged, as in RFC 7440 */
+	block = ntohs(*(__be16 *)(data + 2));
+	xfer->acked += (s16)(block - (xfer->acked & 0xffff));
+	if (xfer->acked == xfer->last_block)
+		sb_tftp_close(xfer);
+	first = xfer->acked + 1;
+	last = min(xfer->acked + xfer->windowsize, xfer->last_block);
+	if (srv.reorder && last > first) {
+		sb_tftp_send_block(dev, eth->et_src, xfer, first + 1);
+		sb_tftp_send_block(dev, eth->et_src, xfer, first);
+		first += 2;
+	}
+	for (i = first; i <= last; i++)
+		sb_tftp_send_block(dev, eth->et_src, xfer, i);
+
+	return 0;
+}
+
+static uchar *sb_tftp_setup(struct unit_test_state *uts, uint size,
+			    int windowsize)
+{
+	uchar *file;
+	uint i;
+
+	file = malloc(size);
+	if (!file)
+		return NULL;
+	for (i = 0; i < size; i++)
+		file[i] = (i * 13 + (i >> 11)) & 0xff;
+
+	memset(&srv, '\0', sizeof(srv));
+	srv.uts = uts;
+	srv.file = file;
+	srv.size = size;
+
+	env_set("ethact", "eth@10002000");
+	env_set_ulong("tftpwindowsize", windowsize);
+	sandbox_eth_set_tx_handler(0, sb_tftp_handler);
+
+	return file;
+}
+
+static void sb_tftp_teardown(uchar *file)
+{
+	sandbox_eth_drop_rx(0, NULL, 0);
+	sandbox_eth_set_tx_handler(0, NULL);
+	env_set_ulong("tftpwindowsize", CONFIG_TFTP_WINDOWSIZE);
+	free(file);
+}
+
+static int sb_tftp_check(struct unit_test_state *uts)
+{
+	ut_asserteq(srv.size, env_get_hex("filesize", 0));
+	ut_asserteq_mem(srv.file, map_sysmem(TFTP_TEST_ADDR, srv.size),
+			srv.size);
+	ut_asserteq(0, srv.overruns);
+
+	return 0;
+}
+
+/* Test a transfer with a window and no losses */
+static int dm_test_tftp_window(struct unit_test_state *uts)
+{
+	const struct tftp_stats *stats = tftp_get_stats();
+	uchar *file;
+
+	file = sb_tftp_setup(uts, 100 * 1024 + 123, 4);
+	ut_assertnonnull(file);
+
+	ut_assertok(run_command("tftpboot 1000000 1.1.2.2:window.bin", 0));
+	ut_assertok(sb_tftp_check(uts));
+	ut_asserteq(4, srv.req_windowsize);
+	ut_asserteq(srv.cur->last_block, srv.sent);
+	ut_asserteq(srv.cur->last_block, stats->blocks);
+	ut_asserteq(0, stats->ooo);
+	ut_asserteq(0, stats->nacks);
+	ut_asserteq(4, stats->windowsize);
+	ut_asserteq(4, stats->next_windowsize);
+
+	sb_tftp_teardown(file);
+
+	return 0;
+}
+DM_TEST(dm_test_tftp_window, UT_TESTF_SCAN_FDT);
+
+/*
+ * Test that blocks received after a lost one are kept, and that the window
+ * shrinks after a transfer with losses then grows back
+ */
+static int dm_test_tftp_window_loss(struct unit_test_state *uts)
+{
+	/*
+	 * Packets are the ARP reply, the OACK, then block n is packet n + 1
+	 * until the first loss; 59 and 60 are then blocks 52 and 53
+	 */
+	static const uint drops[] = { 5, 59, 60 };
+	const struct tftp_stats *stats = tftp_get_stats();
+	uchar *file;
+
+	file = sb_tftp_setup(uts, 100 * 1024, 6);
+	ut_assertnonnull(file);
+
+	sandbox_eth_drop_rx(0, drops, ARRAY_SIZE(drops));
+	ut_assertok(run_command("tftpboot 1000000 1.1.2.2:loss.bin", 0));
+	ut_assertok(sb_tftp_check(uts));
+	ut_asserteq(6, srv.req_windowsize);
+	ut_asserteq(0, stats->timeouts);
+	ut_assert(stats->nacks >= 2);
+	ut_assert(stats->ooo > 0);
+
+	/* Only the window after each gap is sent again */
+	ut_assert(srv.sent < srv.cur->last_block + stats->nacks * 6 * 2);
+	ut_asserteq(3, stats->next_windowsize);
+
+	/* The next transfer uses the smaller window */
+	srv.sent = 0;
+	sandbox_eth_drop_rx(0, NULL, 0);
+	ut_assertok(run_command("tftpboot 1000000 1.1.2.2:loss.bin", 0));
+	ut_assertok(sb_tftp_check(uts));
+	ut_asserteq(3, srv.req_windowsize);
+	ut_asserteq(srv.cur->last_block, srv.sent);
+	ut_asserteq(0, stats->nacks);
+	ut_asserteq(6, stats->next_windowsize);
+
+	sb_tftp_teardown(file);
+
+	return 0;
+}
+DM_TEST(dm_test_tftp_window_loss, UT_TESTF_SCAN_FDT);
+
+/* Test that reordered blocks do not make the client ask for a resend */
+static int dm_test_tftp_window_reorder(struct unit_test_state *uts)
+{
+	const struct tftp_stats *stats = tftp_get_stats();
+	uchar *file;
+
+	file = sb_tftp_setup(uts, 64 * 1024, 5);
+	ut_assertnonnull(file);
+	srv.reorder = true;
+
+	ut_assertok(run_command("tftpboot 1000000 1.1.2.2:reorder.bin", 0));
+	ut_assertok(sb_tftp_check(uts));
+	ut_asserteq(srv.cur->last_block, srv.sent);
+	ut_asserteq(DIV_ROUND_UP(srv.cur->last_block, 5), stats->ooo);
+	ut_asserteq(0, stats->dup);
+	ut_asserteq(0, stats->nacks);
+
+	sb_tftp_teardown(file);
+
+	return 0;
+}
+DM_TEST(dm_test_tftp_window_reorder, UT_TESTF_SCAN_FDT);
+
+/* Test losses around the wrap of the block number */
+static int dm_test_tftp_window_wrap(struct unit_test_state *uts)
+{
+	/* Block 65534, in the window of 6 blocks from 65533 to 65538 */
+	static const uint drops[] = { 65535 };
+	const struct tftp_stats *stats = tftp_get_stats();
+	struct eth_sandbox_priv *priv;
+	struct udevice *dev;
+	uchar *file;
+
+	file = sb_tftp_setup(uts, 0x10000 * 16 + 1000, 6);
+	ut_assertnonnull(file);
+	ut_assertok(uclass_first_device_err(UCLASS_ETH, &dev));
+	priv = dev_get_priv(dev);
+	env_set("tftpblocksize", "16");
+
+	sandbox_eth_drop_rx(0, drops, ARRAY_SIZE(drops));
+	ut_assertok(run_command("tftpboot 1000000 1.1.2.2:wrap.bin", 0));
+	ut_assertok(sb_tftp_check(uts));
+	ut_asserteq(16, srv.cur->blksize);
+	ut_asserteq(1, priv->rx_dropped);
+	ut_asserteq(0, stats->timeouts);
+	ut_asserteq(1, stats->nacks);
+	ut_asserteq(4, stats->ooo);
+
+	env_set_ulong("tftpblocksize", CONFIG_TFTP_BLOCKSIZE);
+	sb_tftp_teardown(file);
+
+	return 0;
+}
+DM_TEST(dm_test_tftp_window_wrap, UT_TESTF_SCAN_FDT);
+
+static int sb_tftp_check_fetch(struct unit_test_state *uts,
+			       const struct tftp_test_file *file,
+			       const struct tftp_fetch *fetch)
+{
+	ut_assertok(fetch->err);
+	ut_asserteq(file->size, fetch->size);
+	ut_asserteq_mem(srv.file + file->offset, map_sysmem(fetch->addr,
+							    file->size),
+			file->size);
+
+	return 0;
+}
+
+/* Test fetching several files at once */
+static int dm_test_tftp_multi(struct unit_test_state *uts)
+{
+	static const struct tftp_test_file files[] = {
+		{ "vmlinuz", 0, 150 * 1024 + 3 },
+		{ "initrd", 1000, 100 * 1024 },
+		{ "board.dtb", 5000, 20 * 1024 + 77 },
+	};
+	struct tftp_fetch fetch[ARRAY_SIZE(files) + 1];
+	uchar *file;
+	uint i;
+
+	file = sb_tftp_setup(uts, 160 * 1024, 6);
+	ut_assertnonnull(file);
+	srv.files = files;
+	srv.num_files = ARRAY_SIZE(files);
+	net_server_ip = string_to_ip("1.1.2.2");
+
+	memset(fetch, '\0', sizeof(fetch));
+	for (i = 0; i < ARRAY_SIZE(fetch); i++)
+		fetch[i].addr = TFTP_TEST_ADDR + i * 0x40000;
+	for (i = 0; i < ARRAY_SIZE(files); i++)
+		fetch[i].name = files[i].name;
+
+	/* One ARP request for all, then all the transfers go together */
+	ut_assertok(tftp_fetch_files(fetch, ARRAY_SIZE(files)));
+	for (i = 0; i < ARRAY_SIZE(files); i++)
+		ut_assertok(sb_tftp_check_fetch(uts, &files[i], &fetch[i]));
+	ut_asserteq(1, srv.arps);
+	ut_asserteq(ARRAY_SIZE(files), srv.max_open);
+	ut_asserteq(0, srv.open);
+	ut_asserteq(0, srv.overruns);
+	/* The window is shared by the transfers */
+	ut_asserteq(2, srv.req_windowsize);
+
+	/* The server MAC address is kept for the next transfers */
+	srv.arps = 0;
+	ut_assertok(tftp_fetch_files(fetch, 2));
+	ut_asserteq(0, srv.arps);
+	ut_asserteq(3, srv.req_windowsize);
+	ut_assertok(run_command("tftpboot 1000000 initrd", 0));
+	ut_asserteq(0, srv.arps);
+
+	/* A missing file does not stop the others */
+	fetch[3].name = "missing";
+	ut_asserteq(-ENOENT, tftp_fetch_files(fetch, 4));
+	ut_asserteq(-ENOENT, fetch[3].err);
+	for (i = 0; i < ARRAY_SIZE(files); i++)
+		ut_assertok(sb_tftp_check_fetch(uts, &files[i], &fetch[i]));
+
+	/* Nor does a file running into the next one, which the server hears */
+	fetch[1].addr = fetch[0].addr + 0x10000;
+	ut_asserteq(-ENOSPC, tftp_fetch_files(fetch, 2));
+	ut_asserteq(-ENOSPC, fetch[0].err);
+	ut_assertok(sb_tftp_check_fetch(uts, &files[1], &fetch[1]));
+	ut_asserteq(0, srv.open);
+
+	ut_asserteq(-EINVAL, tftp_fetch_files(fetch, 0));
+
+	net_server_ip.s_addr = 0;
+	sb_tftp_teardown(file);
+
+	return 0;
+}
+DM_TEST(dm_test_tftp_multi, UT_TESTF_SCAN_FDT);
+
+/* Test that the pxe command fetches the files of the label it boots at once */
+static int dm_test_tftp_multi_pxe(struct unit_test_state *uts)
+{
+	static const char cfg[] = "default linux\n"
+		"label linux\n"
+		"  kernel vmlinuz\n"
+		"  initrd initrd\n"
+		"  fdt board.dtb\n";
+	static const struct tftp_test_file files[] = {
+		{ "vmlinuz", 0, 150 * 1024 + 3 },
+		{ "initrd", 1000, 100 * 1024 },
+		{ "board.dtb", 5000, 20 * 1024 + 77 },
+		{ "pxelinux.cfg/default", 152 * 1024, sizeof(cfg) - 1 },
+	};
+	/* Where the default environment puts them */
+	static const char *const envs[] = {
+		"kernel_addr_r", "ramdisk_addr_r", "fdt_addr_r"
+	};
+	struct tftp_fetch fetch;
+	uchar *file;
+	uint i;
+
+	file = sb_tftp_setup(uts, 160 * 1024, 6);
+	ut_assertnonnull(file);
+	memcpy(file + files[3].offset, cfg, files[3].size);
+	srv.files = files;
+	srv.num_files = ARRAY_SIZE(files);
+	net_server_ip = string_to_ip("1.1.2.2");
+
+	ut_assertok(run_command("pxe get", 0));
+	srv.arps = 0;
+	srv.max_open = 0;
+	/* The kernel is not one, so this comes back */
+	run_command("pxe boot", 0);
+	ut_asserteq(ARRAY_SIZE(envs), srv.max_open);
+	ut_asserteq(0, srv.arps);
+	for (i = 0; i < ARRAY_SIZE(envs); i++) {
+		fetch.addr = env_get_hex(envs[i], 0);
+		fetch.size = files[i].size;
+		fetch.err = 0;
+		ut_assertok(sb_tftp_check_fetch(uts, &files[i], &fetch));
+	}
+
+	net_server_ip.s_addr = 0;
+	sb_tftp_teardown(file);
+
+	return 0;
+}
+DM_TEST(dm_test_tftp_multi_pxe, UT_TESTF_SCAN_FDT);
@@ -0,0 +1,538 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * Test the TCP stack and HTTP client against an HTTP server emulated by the
+ * sandbox Ethernet driver
+ */
+
+#include <common.h>
+#include <blk.h>
+#include <command.h>
+#include <dm.h>
+#include <env.h>
+#include <malloc.h>
+#include <mapmem.h>
+#include <net.h>
+#include <part.h>
+#include <uuid.h>
+#include <asm/eth.h>
+#include <dm/test.h>
+#include <net/tcp.h>
+#include <test/test.h>
+#include <test/ut.h>
+
+#define WGET_TEST_PORT		80
+#define WGET_TEST_MSS		1400
+/* Close to the wrap of the sequence space, to exercise it */
+#define WGET_TEST_ISS		0xfffe0000
+#define WGET_TEST_ADDR		0x1000000
+#define WGET_TEST_MAX_DROPS	4
+
+/**
+ * struct wget_test_server - State of the emulated HTTP server
+ *
+ * Offsets are relative to the start of the response; the SYN of the server
+ * has sequence number WGET_TEST_ISS and the FIN takes offset @resp_len.
+ *
+ * @uts: test state, for the ut_assert macros in the handler
+ * @resp: response to send, header and body
+ * @resp_len: length of @resp
+ * @close: close the connection once the response is sent, like a server
+ *	handling "Connection: close"
+ * @drop: indexes of data segments to drop the first time they are sent
+ * @ndrops: number of entries in @drop
+ * @dropped: bitmap of the entries of @drop already dropped
+ * @client_port: TCP port of the client
+ * @client_mac: MAC address of the client
+ * @wscale: window scale offered by the client
+ * @wnd: window of the client, in bytes
+ * @rcv_nxt: next sequence number expected from the client
+ * @snd_una: oldest offset not acknowledged by the client
+ * @snd_nxt: next offset to send
+ * @dupacks: duplicate ACKs received for @snd_una
+ * @rexmit_pending: a fast retransmit waits for room in the receive queue
+ * @fast_rexmits: number of fast retransmits done
+ * @recover: @snd_nxt when the last fast retransmit was sent; until it is
+ *	acknowledged, an ACK which moves @snd_una shows the next hole
+ *	(NewReno partial ACK)
+ * @in_recovery: @recover is not acknowledged yet
+ * @fin_sent: the FIN of the server was sent
+ * @req: request received so far
+ * @req_len: length of @req
+ * @req_done: the whole request header was received
+ */
+struct wget_test_server {
+	struct unit_test_state *uts;
+	uchar *resp;
+	uint resp_len;
+	bool close;
+	int drop[WGET_TEST_MAX_DROPS];
+	int ndrops;
+	uint dropped;
+	u16 client_port;
+	u8 client_mac[ARP_HLEN];
+	int wscale;
+	u32 wnd;
+	u32 rcv_nxt;
+	u32 snd_una;
+	u32 snd_nxt;
+	int dupacks;
+	bool rexmit_pending;
+	int fast_rexmits;
+	u32 recover;
+	bool in_recovery;
+	bool fin_sent;
+	char req[1024];
+	uint req_len;
+	bool req_done;
+};
+
+static struct wget_test_server srv;
+
+static u16 sb_tcp_checksum(struct ip_tcp_hdr *ip, uint len)
+{
+	struct {
+		struct in_addr src;
+		struct in_addr dest;
+		u8 zero;
+		u8 proto;
+		u16 len;
+	} __packed ph;
+
+	net_copy_ip(&ph.src, &ip->ip_src);
+	net_copy_ip(&ph.dest, &ip->ip_dst);
+	ph.zero = 0;
+	ph.proto = IPPROTO_TCP;
+	ph.len = htons(len);
+
+	return add_ip_checksums(sizeof(ph), compute_ip_checksum(&ph,
+								sizeof(ph)),
+				compute_ip_checksum(&ip->tcp_src, len));
+}
+
+/* Queue a segment from the server, at @off in the response */
+static int sb_wget_send(struct udevice *dev, u8 flags, u32 off, uint len)
+{
+	struct eth_sandbox_priv *priv = dev_get_priv(dev);
+	int hlen = TCP_HDR_SIZE + (flags & TCP_SYN ? 8 : 0);
+	struct ethernet_hdr *eth;
+	struct ip_tcp_hdr *ip;
+	uchar *opt;
+
+	if (priv->recv_packets >= PKTBUFSRX)
+		return -EAGAIN;
+
+	eth = (void *)priv->recv_packet_buffer[priv->recv_packets];
+	memcpy(eth->et_dest, srv.client_mac, ARP_HLEN);
+	memcpy(eth->et_src, priv->fake_host_hwaddr, ARP_HLEN);
+	eth->et_protlen = htons(PROT_IP);
+
+	ip = (void *)eth + ETHER_HDR_SIZE;
+	net_set_ip_header((uchar *)ip, net_ip, priv->fake_host_ipaddr,
+			  IP_HDR_SIZE + hlen + len, IPPROTO_TCP);
+	ip->tcp_src = htons(WGET_TEST_PORT);
+	ip->tcp_dst = htons(srv.client_port);
+	ip->tcp_seq = htonl(flags & TCP_SYN ? WGET_TEST_ISS :
+			    WGET_TEST_ISS + 1 + off);
+	ip->tcp_ack = htonl(srv.rcv_nxt);
+	ip->tcp_hlen = (hlen / 4) << 4;
+	ip->tcp_flags = flags;
+	ip->tcp_win = htons(0xffff);
+	ip->tcp_xsum = 0;
+	ip->tcp_ugr = 0;
+
+	opt = (uchar *)ip + IP_TCP_HDR_SIZE;
+	if (flags & TCP_SYN) {
+		/* MSS, NOP and a window scale of 2 */
+		opt[0] = 2;
+		opt[1] = 4;
+		opt[2] = WGET_TEST_MSS >> 8;
+		opt[3] = WGET_TEST_MSS & 0xff;
+		opt[4] = 1;
+		opt[5] = 3;
+		opt[6] = 3;
+		opt[7] = 2;
+	}
+	memcpy(opt + hlen - TCP_HDR_SIZE, srv.resp + off, len);
+	ip->tcp_xsum = sb_tcp_checksum(ip, hlen + len);
+
+	priv->recv_packet_length[priv->recv_packets++] = ETHER_HDR_SIZE +
+		IP_HDR_SIZE + hlen + len;
+
+	return 0;
+}
+
+static bool sb_wget_drop(u32 off)
+{
+	int i;
+
+	for (i = 0; i < srv.ndrops; i++) {
+		if (off == srv.drop[i] * WGET_TEST_MSS &&
+		    !(srv.dropped & BIT(i))) {
+			srv.dropped |= BIT(i);
+			return true;
+		}
+	}
+
+	return false;
+}
+
+static int sb_wget_handler(struct udevice *dev, void *packet,
+			   unsigned int len)
+{
+	struct unit_test_state *uts = srv.uts;
+	struct ethernet_hdr *eth = packet;
+	struct ip_tcp_hdr *ip = packet + ETHER_HDR_SIZE;
+	bool need_ack = false;
+	uint hlen, dlen, seglen;
+	u32 seq, ack, off;
+	uchar *opt;
+	u8 flags;
+
+	if (!sandbox_eth_arp_req_to_reply(dev, packet, len))
+		return 0;
+	if (ntohs(eth->et_protlen) != PROT_IP || ip->ip_p != IPPROTO_TCP)
+		return 0;
+
+	ut_asserteq(0, sb_tcp_checksum(ip, ntohs(ip->ip_len) - IP_HDR_SIZE));
+	ut_asserteq(WGET_TEST_PORT, ntohs(ip->tcp_dst));
+	hlen = (ip->tcp_hlen >> 4) * 4;
+	dlen = ntohs(ip->ip_len) - IP_HDR_SIZE - hlen;
+	seq = ntohl(ip->tcp_seq);
+	ack = ntohl(ip->tcp_ack);
+	flags = ip->tcp_flags;
+
+	if (flags & TCP_RST)
+		return 0;
+
+	if (flags & TCP_SYN) {
+		/* The client must offer its MSS and a window scale */
+		opt = (uchar *)ip + IP_TCP_HDR_SIZE;
+		ut_asserteq(TCP_HDR_SIZE + 8, hlen);
+		ut_asserteq(2, opt[0]);
+		ut_asserteq(TCP_MSS, opt[2] << 8 | opt[3]);
+		ut_asserteq(3, opt[5]);
+		srv.wscale = opt[7];
+		srv.client_port = ntohs(ip->tcp_src);
+		memcpy(srv.client_mac, eth->et_src, ARP_HLEN);
+		srv.rcv_nxt = seq + 1;
+		sb_wget_send(dev, TCP_SYN | TCP_ACK, 0, 0);
+		return 0;
+	}
+
+	ut_assert(flags & TCP_ACK);
+	ut_asserteq(srv.client_port, ntohs(ip->tcp_src));
+	srv.wnd = ntohs(ip->tcp_win) << srv.wscale;
+
+	if (dlen) {
+		ut_asserteq(srv.rcv_nxt, seq);
+		ut_assert(srv.req_len + dlen < sizeof(srv.req));
+		memcpy(srv.req + srv.req_len, (uchar *)ip + IP_HDR_SIZE + hlen,
+		       dlen);
+		srv.req_len += dlen;
+		srv.req[srv.req_len] = '\0';
+		srv.rcv_nxt += dlen;
+		srv.req_done = strstr(srv.req, "\r\n\r\n");
+		need_ack = true;
+	}
+	if (flags & TCP_FIN) {
+		srv.rcv_nxt++;
+		need_ack = true;
+	}
+
+	off = ack - WGET_TEST_ISS - 1;
+	if ((s32)(off - srv.snd_una) > 0) {
+		srv.snd_una = off;
+		srv.dupacks = 0;
+		/*
+		 * The queue delivers in order, so everything sent before the
+		 * retransmit was seen: the segment at a partial ACK is lost too
+		 */
+		if (srv.in_recovery && (s32)(srv.recover - off) > 0) {
+			srv.rexmit_pending = true;
+			srv.fast_rexmits++;
+		} else {
+			srv.in_recovery = false;
+		}
+	} else if (!dlen && !(flags & TCP_FIN) && srv.snd_una != srv.snd_nxt &&
+		   !srv.in_recovery && ++srv.dupacks == 3) {
+		srv.rexmit_pending = true;
+		srv.fast_rexmits++;
+		srv.in_recovery = true;
+	}
+
+	if (srv.rexmit_pending && srv.snd_una < srv.resp_len &&
+	    !sb_wget_send(dev, TCP_ACK, srv.snd_una,
+			  min_t(uint, WGET_TEST_MSS,
+				srv.resp_len - srv.snd_una))) {
+		srv.rexmit_pending = false;
+		srv.recover = srv.snd_nxt;
+		need_ack = false;
+	}
+
+	while (srv.req_done && srv.snd_nxt < srv.resp_len) {
+		seglen = min_t(uint, WGET_TEST_MSS, srv.resp_len - srv.snd_nxt);
+		if (srv.snd_nxt + seglen - srv.snd_una > srv.wnd)
+			break;
+		if (!sb_wget_drop(srv.snd_nxt)) {
+			if (sb_wget_send(dev, TCP_ACK | TCP_PUSH, srv.snd_nxt,
+					 seglen))
+				break;
+			need_ack = false;
+		}
+		srv.snd_nxt += seglen;
+	}
+
+	/*
+	 * Close once the response is sent if asked to, or when the client
+	 * closes; send the FIN again if the client did not get it
+	 */
+	if (srv.snd_nxt >= srv.resp_len &&
+	    ((srv.close && !srv.fin_sent) ||
+	     ((flags & TCP_FIN) && srv.snd_una <= srv.resp_len)) &&
+	    !sb_wget_send(dev, TCP_FIN | TCP_ACK, srv.resp_len, 0)) {
+		srv.fin_sent = true;
+		srv.snd_nxt = srv.resp_len + 1;
+		need_ack = false;
+	}
+
+	if (need_ack)
+		sb_wget_send(dev, TCP_ACK, srv.snd_nxt, 0);
+
+	return 0;
+}
+
+static void sb_wget_setup(struct unit_test_state *uts, uchar *resp,
+			  uint resp_len, bool close)
+{
+	memset(&srv, '\0', sizeof(srv));
+	srv.uts = uts;
+	srv.resp = resp;
+	srv.resp_len = resp_len;
+	srv.close = close;
+
+	env_set("ethact", "eth@10002000");
+	sandbox_eth_set_tx_handler(0, sb_wget_handler);
+}
+
+static void sb_wget_fill(uchar *buf, uint len, uint seed)
+{
+	uint i;
+
+	for (i = 0; i < len; i++)
+		buf[i] = (i * 7 + (i >> 9) + seed) & 0xff;
+}
+
+/* Make a response with a Content-Length, returning its size */
+static uint sb_wget_make_resp(uchar *resp, const uchar *body, uint len)
+{
+	uint hlen;
+
+	hlen = sprintf((char *)resp,
+		       "HTTP/1.1 200 OK\r\n"
+		       "Server: sandbox\r\n"
+		       "Content-Length: %u\r\n"
+		       "Content-Type: application/octet-stream\r\n\r\n", len);
+	memcpy(resp + hlen, body, len);
+
+	return hlen + len;
+}
+
+/* Test a download to memory, with the server closing the connection */
+static int dm_test_wget(struct unit_test_state *uts)
+{
+	const struct tcp_stats *stats = tcp_get_stats();
+	uint len = 300 * 1024 + 17;
+	uchar *body, *resp;
+
+	body = malloc(len);
+	resp = malloc(len + 256);
+	ut_assertnonnull(body);
+	ut_assertnonnull(resp);
+	sb_wget_fill(body, len, 0);
+	sb_wget_setup(uts, resp, sb_wget_make_resp(resp, body, len), true);
+
+	ut_assertok(run_command("wget 1000000 http://1.1.2.2/path/image.bin",
+				0));
+	ut_assert(!strncmp(srv.req, "GET /path/image.bin HTTP/1.1\r\n", 30));
+	ut_assertnonnull(strstr(srv.req, "\r\nHost: 1.1.2.2\r\n"));
+	ut_asserteq_mem(body, map_sysmem(WGET_TEST_ADDR, len), len);
+	ut_asserteq(len, env_get_hex("filesize", 0));
+	ut_asserteq(TCP_CLOSED, tcp_get_state());
+
+	/* 256 KiB of window needs a scale of 3 */
+	ut_asserteq(3, srv.wscale);
+	ut_asserteq(3, stats->wscale);
+	ut_asserteq(0, stats->rx_ooo);
+	ut_asserteq(0, srv.fast_rexmits);
+	ut_asserteq(DIV_ROUND_UP(srv.resp_len, WGET_TEST_MSS), stats->rx_segs);
+
+	sandbox_eth_set_tx_handler(0, NULL);
+	free(resp);
+	free(body);
+
+	return 0;
+}
+DM_TEST(dm_test_wget, UT_TESTF_SCAN_FDT);
+
+/* Test that lost segments are recovered by fast retransmits */
+static int dm_test_wget_loss(struct unit_test_state *uts)
+{
+	const struct tcp_stats *stats = tcp_get_stats();
+	uint len = 200 * 1024;
+	uchar *body, *resp;
+
+	body = malloc(len);
+	resp = malloc(len + 256);
+	ut_assertnonnull(body);
+	ut_assertnonnull(resp);
+	sb_wget_fill(body, len, 0x55);
+	sb_wget_setup(uts, resp, sb_wget_make_resp(resp, body, len), false);
+	srv.drop[0] = 3;
+	srv.drop[1] = 40;
+	srv.drop[2] = 41 + 3;
+	srv.drop[3] = 100;
+	srv.ndrops = 4;
+
+	ut_assertok(run_command("wget 1000000 1.1.2.2:/file", 0));
+	ut_asserteq_mem(body, map_sysmem(WGET_TEST_ADDR, len), len);
+	ut_asserteq(0xf, srv.dropped);
+
+	/* Every loss is repaired without waiting for a timeout */
+	ut_asserteq(4, srv.fast_rexmits);
+	ut_assert(stats->rx_ooo >= 4 * 3);
+	ut_asserteq(stats->rx_ooo, stats->tx_dupacks);
+	ut_asserteq(0, stats->tx_rexmit);
+	ut_asserteq(TCP_CLOSED, tcp_get_state());
+
+	sandbox_eth_set_tx_handler(0, NULL);
+	free(resp);
+	free(body);
+
+	return 0;
+}
+DM_TEST(dm_test_wget_loss, UT_TESTF_SCAN_FDT);
+
+/* Test a chunked download written to a block device */
+static int dm_test_wget_chunked_blk(struct unit_test_state *uts)
+{
+	static const uint chunks[] = { 1, 1000, 5000, 20000, 7, 65536, 12345 };
+	struct blk_desc *desc;
+	uint len = 0, pos, i;
+	uchar *body, *resp, *buf;
+
+	for (i = 0; i < ARRAY_SIZE(chunks); i++)
+		len += chunks[i];
+	body = malloc(len);
+	resp = malloc(len + 1024);
+	buf = malloc(ALIGN(len, 512));
+	ut_assertnonnull(body);
+	ut_assertnonnull(resp);
+	ut_assertnonnull(buf);
+	sb_wget_fill(body, len, 0xaa);
+
+	pos = sprintf((char *)resp,
+		      "HTTP/1.1 200 OK\r\n"
+		      "Transfer-Encoding: chunked\r\n\r\n");
+	for (len = 0, i = 0; i < ARRAY_SIZE(chunks); i++) {
+		pos += sprintf((char *)resp + pos, i == 2 ? "%X;name=val\r\n" :
+			       "%x\r\n", chunks[i]);
+		memcpy(resp + pos, body + len, chunks[i]);
+		pos += chunks[i];
+		len += chunks[i];
+		pos += sprintf((char *)resp + pos, "\r\n");
+	}
+	pos += sprintf((char *)resp + pos, "0\r\nX-Checksum: none\r\n\r\n");
+	sb_wget_setup(uts, resp, pos, true);
+
+	ut_asserteq(0, blk_get_device_by_str("mmc", "0", &desc));
+	ut_assertok(run_command("wget blk mmc 0 10 http://1.1.2.2:80/chunked",
+				0));
+	ut_asserteq(len, env_get_hex("filesize", 0));
+	ut_asserteq(DIV_ROUND_UP(len, desc->blksz),
+		    blk_dread(desc, 0x10, DIV_ROUND_UP(len, desc->blksz), buf));
+	ut_asserteq_mem(body, buf, len);
+	ut_asserteq(0, buf[len]);
+
+	sandbox_eth_set_tx_handler(0, NULL);
+	free(buf);
+	free(resp);
+	free(body);
+
+	return 0;
+}
+DM_TEST(dm_test_wget_chunked_blk, UT_TESTF_SCAN_FDT);
+
+/* Test that the window keeps the server within the partition */
+static int dm_test_wget_limit(struct unit_test_state *uts)
+{
+	char str_disk_guid[UUID_STR_LEN + 1];
+	struct disk_partition part = {
+		.start = 48,
+		.size = 64,
+		.name = "test1",
+	};
+	struct blk_desc *desc;
+	uint len = 100 * 1024, pos, i;
+	uchar *body, *resp;
+
+	ut_asserteq(0, blk_get_device_by_str("mmc", "0", &desc));
+	if (CONFIG_IS_ENABLED(RANDOM_UUID)) {
+		gen_rand_uuid_str(part.uuid, UUID_STR_FORMAT_STD);
+		gen_rand_uuid_str(str_disk_guid, UUID_STR_FORMAT_STD);
+	}
+	ut_assertok(gpt_restore(desc, str_disk_guid, &part, 1));
+
+	body = malloc(len);
+	resp = malloc(len + 1024);
+	ut_assertnonnull(body);
+	ut_assertnonnull(resp);
+	sb_wget_fill(body, len, 0x33);
+
+	/* A length too large for the 32 KiB partition is refused at once */
+	sb_wget_setup(uts, resp, sb_wget_make_resp(resp, body, len), true);
+	ut_asserteq(1, run_command("wget blk mmc 0:1 0 http://1.1.2.2/big", 0));
+	ut_asserteq(TCP_CLOSED, tcp_get_state());
+
+	/*
+	 * Without a length, the server only sends a little more than fits
+	 * before the client gives up, not a whole window
+	 */
+	pos = sprintf((char *)resp,
+		      "HTTP/1.1 200 OK\r\n"
+		      "Transfer-Encoding: chunked\r\n\r\n");
+	for (i = 0; i < len; i += 10 * 1024) {
+		pos += sprintf((char *)resp + pos, "%x\r\n", 10 * 1024);
+		memcpy(resp + pos, body + i, 10 * 1024);
+		pos += 10 * 1024 + sprintf((char *)resp + pos + 10 * 1024,
+					   "\r\n");
+	}
+	pos += sprintf((char *)resp + pos, "0\r\n\r\n");
+	sb_wget_setup(uts, resp, pos, true);
+	ut_asserteq(1, run_command("wget blk mmc 0:1 0 http://1.1.2.2/big", 0));
+	ut_asserteq(TCP_CLOSED, tcp_get_state());
+	ut_assert(srv.snd_nxt > 32 * 1024);
+	ut_assert(srv.snd_nxt < 40 * 1024);
+
+	sandbox_eth_set_tx_handler(0, NULL);
+	free(resp);
+	free(body);
+
+	return 0;
+}
+DM_TEST(dm_test_wget_limit, UT_TESTF_SCAN_FDT);
+
+/* Test that an HTTP error makes the command fail */
+static int dm_test_wget_error(struct unit_test_state *uts)
+{
+	static const char resp[] = "HTTP/1.1 404 Not Found\r\n"
+				   "Content-Length: 9\r\n\r\nNot found";
+
+	sb_wget_setup(uts, (uchar *)resp, strlen(resp), true);
+	ut_asserteq(1, run_command("wget 1000000 http://1.1.2.2/missing", 0));
+	ut_asserteq(TCP_CLOSED, tcp_get_state());
+
+	sandbox_eth_set_tx_handler(0, NULL);
+
+	return 0;
+}
+DM_TEST(dm_test_wget_error, UT_TESTF_SCAN_FDT);
@@ -7,14 +7,21 @@
 #include <common.h>
 #include <command.h>
 #include <log.h>
+#include <malloc.h>
 #include <search.h>
 #include <stdio.h>
+#include <time.h>
 #include <test/env.h>
 #include <test/ut.h>
 
 #define SIZE 32
 #define ITERATIONS 10000
 
+/* Number of variables in the benchmark, like a large multi-variant board */
+#define BENCH_VARS	2000
+#define BENCH_LOOKUPS	20
+#define BENCH_KEY_LEN	24
+
 static int htab_fill(struct unit_test_state *uts,
 		     struct hsearch_data *htab, size_t size)
 {
@@ -124,3 +131,154 @@ static int env_test_htab_deletes(struct unit_test_state *uts)
 }
 
 ENV_TEST(env_test_htab_deletes, 0);
+
+/* Enter many more elements than the table was created for */
+static int env_test_htab_grow(struct unit_test_state *uts)
+{
+	struct hsearch_data htab;
+
+	memset(&htab, 0, sizeof(htab));
+	ut_asserteq(1, hcreate_r(SIZE, &htab));
+
+	ut_assertok(htab_fill(uts, &htab, SIZE * 20));
+	ut_assertok(htab_check_fill(uts, &htab, SIZE * 20));
+	ut_asserteq(SIZE * 20, htab.filled);
+	ut_assert(htab.size > SIZE * 20);
+
+	hdestroy_r(&htab);
+	return 0;
+}
+
+ENV_TEST(env_test_htab_grow, 0);
+
+static int htab_check_var(struct unit_test_state *uts,
+			  struct hsearch_data *htab, const char *key,
+			  const char *data)
+{
+	struct env_entry item, *ritem;
+
+	item.key = key;
+	item.data = NULL;
+	hsearch_r(item, ENV_FIND, &ritem, htab, 0);
+	if (!data) {
+		ut_assertnull(ritem);
+		return 0;
+	}
+	ut_assertnonnull(ritem);
+	ut_asserteq_str(data, ritem->data);
+
+	return 0;
+}
+
+/* Import into the table, then overwrite and delete imported entries */
+static int env_test_htab_import(struct unit_test_state *uts)
+{
+	static const char env[] = "a=1\0b=2\0a=3\0c\\=4\0d=\0\0junk=5";
+	static const char text[] = "# comment\n  b=x\\\ny\nc\\\ne=5\n";
+	struct hsearch_data htab;
+	struct env_entry item, *ritem;
+	ulong start;
+
+	start = ut_check_free();
+	memset(&htab, 0, sizeof(htab));
+	ut_asserteq(1, himport_r(&htab, env, sizeof(env), '\0', 0, 0, 0,
+				 NULL));
+	ut_assertok(htab_check_var(uts, &htab, "a", "3"));
+	ut_assertok(htab_check_var(uts, &htab, "b", "2"));
+	ut_assertok(htab_check_var(uts, &htab, "c\\", "4"));
+	ut_assertok(htab_check_var(uts, &htab, "d", NULL));
+	ut_assertok(htab_check_var(uts, &htab, "junk", NULL));
+	ut_asserteq(3, htab.filled);
+
+	/* Text with escapes, merged into the table; 'c\' is deleted */
+	ut_asserteq(1, himport_r(&htab, text, sizeof(text), '\n',
+				 H_NOCLEAR, 0, 0, NULL));
+	ut_assertok(htab_check_var(uts, &htab, "b", "x\ny"));
+	ut_assertok(htab_check_var(uts, &htab, "c\\", NULL));
+	ut_assertok(htab_check_var(uts, &htab, "e", "5"));
+
+	/* Entries from both imports can be changed and deleted */
+	item.callback = NULL;
+	item.flags = 0;
+	item.key = "a";
+	item.data = "new";
+	ut_asserteq(1, hsearch_r(item, ENV_ENTER, &ritem, &htab, 0) > 0);
+	ut_assertok(htab_check_var(uts, &htab, "a", "new"));
+	ut_assertok(hdelete_r("b", &htab, 0));
+	ut_assertok(hdelete_r("e", &htab, 0));
+	ut_asserteq(1, htab.filled);
+
+	hdestroy_r(&htab);
+	ut_assertnull(htab.blobs);
+	ut_assertok(ut_check_delta(start));
+
+	return 0;
+}
+
+ENV_TEST(env_test_htab_import, 0);
+
+/*
+ * Time importing, looking up and exporting a large environment. The names
+ * share a long prefix, as the boot scripts of board variants often do.
+ * Define LOG_DEBUG to see the timings.
+ */
+static int env_test_htab_bench(struct unit_test_state *uts)
+{
+	struct hsearch_data htab;
+	struct env_entry item, *ritem;
+	char *env, *keys, *res, *p;
+	char data[40];
+	ulong start, import_us, lookup_us, export_us;
+	ssize_t len;
+	int i, j;
+
+	env = malloc(BENCH_VARS * 40 + 1);
+	ut_assertnonnull(env);
+	keys = malloc(BENCH_VARS * BENCH_KEY_LEN);
+	ut_assertnonnull(keys);
+	for (i = 0, p = env; i < BENCH_VARS; i++) {
+		sprintf(keys + i * BENCH_KEY_LEN, "bootcmd_variant_%04d", i);
+		p += sprintf(p, "%s=run boot_%d", keys + i * BENCH_KEY_LEN,
+			     i) + 1;
+	}
+	*p++ = '\0';
+
+	memset(&htab, 0, sizeof(htab));
+	start = timer_get_us();
+	ut_asserteq(1, himport_r(&htab, env, p - env, '\0', 0, 0, 0, NULL));
+	import_us = timer_get_us() - start;
+	ut_asserteq(BENCH_VARS, htab.filled);
+
+	item.data = NULL;
+	start = timer_get_us();
+	for (j = 0; j < BENCH_LOOKUPS; j++) {
+		for (i = 0; i < BENCH_VARS; i++) {
+			item.key = keys + i * BENCH_KEY_LEN;
+			hsearch_r(item, ENV_FIND, &ritem, &htab, 0);
+			ut_assertnonnull(ritem);
+		}
+	}
+	lookup_us = timer_get_us() - start;
+	sprintf(data, "run boot_%d", BENCH_VARS - 1);
+	ut_asserteq_str(data, ritem->data);
+
+	res = NULL;
+	start = timer_get_us();
+	len = hexport_r(&htab, '\0', 0, &res, 0, 0, NULL);
+	export_us = timer_get_us() - start;
+	ut_asserteq(p - env, len);
+	ut_asserteq_mem(env, res, len);
+
+	log_debug("%d vars: import %lu us, %d lookups %lu us, export %lu us\n",
+		  BENCH_VARS, import_us, BENCH_VARS * BENCH_LOOKUPS, lookup_us,
+		  export_us);
+
+	free(res);
+	free(keys);
+	free(env);
+	hdestroy_r(&htab);
+
+	return 0;
+}
+
+ENV_TEST(env_test_htab_bench, 0);
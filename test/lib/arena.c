@@ -0,0 +1,147 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * Test region-based allocation and malloc() heap statistics
+ */
+
+#include <common.h>
+#include <arena.h>
+#include <malloc.h>
+#include <test/lib.h>
+#include <test/test.h>
+#include <test/ut.h>
+
+#define TEST_BLOCK_SIZE	0x400
+
+/* Test arena_alloc() and friends */
+static int lib_test_arena_alloc(struct unit_test_state *uts)
+{
+	struct arena arena;
+	char *ptr, *str;
+	ulong start;
+	int i;
+
+	start = ut_check_free();
+
+	arena_init(&arena, TEST_BLOCK_SIZE);
+	ut_assertnull(arena.blocks);
+
+	/* Small allocations come from the same block, suitably aligned */
+	ptr = arena_alloc(&arena, 3);
+	ut_assertnonnull(ptr);
+	ut_asserteq(0, (ulong)ptr % (2 * sizeof(size_t)));
+	str = arena_strdup(&arena, "arena");
+	ut_asserteq_str("arena", str);
+	ut_asserteq_ptr(ptr + 3, str);
+	ptr = arena_memalign(&arena, 0x40, 1);
+	ut_asserteq(0, (ulong)ptr % 0x40);
+	ptr = arena_calloc(&arena, 0x20);
+	for (i = 0; i < 0x20; i++)
+		ut_asserteq(0, ptr[i]);
+	ut_assertnull(arena.blocks->next);
+
+	/* Filling the block moves on to another one */
+	ptr = arena_alloc(&arena, TEST_BLOCK_SIZE / 2);
+	ut_assertnonnull(ptr);
+	ptr = arena_alloc(&arena, TEST_BLOCK_SIZE / 2);
+	ut_assertnonnull(ptr);
+	ut_assertnonnull(arena.blocks->next);
+	ut_assert(arena.used >= TEST_BLOCK_SIZE + 3 + 6 + 1 + 0x20);
+	ut_assert(arena.size >= arena.used);
+	ut_asserteq(arena.used, arena.peak);
+
+	arena_uninit(&arena);
+	ut_assertnull(arena.blocks);
+	ut_asserteq(0, arena.size);
+	ut_assertok(ut_check_delta(start));
+
+	return 0;
+}
+LIB_TEST(lib_test_arena_alloc, 0);
+
+/* Test that a large allocation gets its own block */
+static int lib_test_arena_large(struct unit_test_state *uts)
+{
+	struct arena arena;
+	void *small, *large;
+	ulong start;
+
+	start = ut_check_free();
+
+	arena_init(&arena, TEST_BLOCK_SIZE);
+	small = arena_alloc(&arena, 0x10);
+	large = arena_alloc(&arena, TEST_BLOCK_SIZE * 4);
+	ut_assertnonnull(large);
+
+	/* The first block still serves small allocations */
+	ut_asserteq_ptr(small + 0x10, arena_alloc(&arena, 0x10));
+	ut_assertnonnull(arena.blocks->next);
+	ut_assertnull(arena.blocks->next->next);
+	ut_assert(arena.size >= TEST_BLOCK_SIZE * 5);
+
+	arena_uninit(&arena);
+	ut_assertok(ut_check_delta(start));
+
+	return 0;
+}
+LIB_TEST(lib_test_arena_large, 0);
+
+/* Test arena_reset() */
+static int lib_test_arena_reset(struct unit_test_state *uts)
+{
+	struct arena arena;
+	size_t peak;
+	ulong start;
+	void *ptr;
+	int i;
+
+	start = ut_check_free();
+
+	arena_init(&arena, TEST_BLOCK_SIZE);
+	for (i = 0; i < 10; i++)
+		ut_assertnonnull(arena_alloc(&arena, TEST_BLOCK_SIZE / 3));
+	arena_alloc(&arena, TEST_BLOCK_SIZE * 2);
+	peak = arena.peak;
+
+	/* Only one standard block remains and it is reused */
+	arena_reset(&arena);
+	ut_assertnonnull(arena.blocks);
+	ut_assertnull(arena.blocks->next);
+	ut_asserteq(0, arena.used);
+	ut_asserteq(peak, arena.peak);
+	ptr = arena_alloc(&arena, 0x10);
+	ut_asserteq(ALIGN((ulong)(arena.blocks + 1), 2 * sizeof(size_t)),
+		    (ulong)ptr);
+
+	arena_uninit(&arena);
+	ut_assertok(ut_check_delta(start));
+
+	return 0;
+}
+LIB_TEST(lib_test_arena_reset, 0);
+
+/* Test malloc_get_usage() */
+static int lib_test_malloc_usage(struct unit_test_state *uts)
+{
+	struct malloc_usage before, after;
+	void *ptr;
+
+	ut_assertok(malloc_get_usage(&before));
+	ut_assert(before.heap_size);
+	ut_assert(before.largest_free <= before.free);
+	ut_assert(before.in_use + before.free <= before.heap_size);
+	ut_assert(before.peak >= before.in_use);
+
+	ptr = malloc(0x1000);
+	ut_assertnonnull(ptr);
+	ut_assertok(malloc_get_usage(&after));
+	ut_assert(after.in_use >= before.in_use + 0x1000);
+	ut_assert(after.free <= before.free - 0x1000);
+	free(ptr);
+
+	ut_assertok(malloc_get_usage(&after));
+	ut_asserteq(before.in_use, after.in_use);
+	ut_asserteq(before.free, after.free);
+
+	return 0;
+}
+LIB_TEST(lib_test_malloc_usage, 0);
@@ -11,6 +11,7 @@
 #include <image.h>
 #include <log.h>
 #include <malloc.h>
+#include <time.h>
 
 #include <linux/sizes.h>
 
@@ -21,6 +22,12 @@
 /* 4k ought to be enough for anybody */
 #define FDT_COPY_SIZE	(4 * SZ_1K)
 
+/* Generated trees for comparing the overlay cache with plain application */
+#define BENCH_NODES	1000
+#define BENCH_OVERLAYS	24
+#define BENCH_FRAGMENTS	8
+#define BENCH_SIZE	(256 * SZ_1K)
+
 extern u32 __dtb_test_fdt_base_begin;
 extern u32 __dtb_test_fdt_overlay_begin;
 extern u32 __dtb_test_fdt_overlay_stacked_begin;
@@ -211,6 +218,210 @@ static int fdt_overlay_stacked(struct unit_test_state *uts)
 }
 OVERLAY_TEST(fdt_overlay_stacked, 0);
 
+/* Check that two trees were built the same way, ignoring their free space */
+static int ut_fdt_same(struct unit_test_state *uts, void *fdt1, void *fdt2)
+{
+	ut_asserteq(fdt_totalsize(fdt1), fdt_totalsize(fdt2));
+	ut_asserteq(fdt_off_dt_strings(fdt1), fdt_off_dt_strings(fdt2));
+	ut_asserteq(fdt_size_dt_strings(fdt1), fdt_size_dt_strings(fdt2));
+	ut_asserteq_mem(fdt1, fdt2,
+			fdt_off_dt_strings(fdt1) + fdt_size_dt_strings(fdt1));
+
+	return 0;
+}
+
+static int fdt_overlay_cached(struct unit_test_state *uts)
+{
+	char fdt_cached[FDT_COPY_SIZE], fdto[FDT_COPY_SIZE];
+	struct fdt_overlay_cache cache;
+
+	ut_assertok(fdt_open_into(&__dtb_test_fdt_base_begin, fdt_cached,
+				  FDT_COPY_SIZE));
+	ut_assertok(fdt_overlay_cache_init(fdt_cached, &cache));
+	ut_assertnonnull(cache.label);
+
+	ut_assertok(fdt_open_into(&__dtb_test_fdt_overlay_begin, fdto,
+				  FDT_COPY_SIZE));
+	ut_assertok(fdt_overlay_apply_cached(fdt_cached, fdto, &cache));
+	ut_assertok(fdt_open_into(&__dtb_test_fdt_overlay_stacked_begin, fdto,
+				  FDT_COPY_SIZE));
+	ut_assertok(fdt_overlay_apply_cached(fdt_cached, fdto, &cache));
+	fdt_overlay_cache_uninit(&cache);
+
+	/* Same tree as the one built with fdt_overlay_apply() */
+	ut_assertok(ut_fdt_same(uts, fdt, fdt_cached));
+
+	return CMD_RET_SUCCESS;
+}
+OVERLAY_TEST(fdt_overlay_cached, 0);
+
+/* Build a tree of labelled nodes, each with a phandle */
+static int ut_fdt_make_base(struct unit_test_state *uts, void *buf)
+{
+	char name[32], path[32];
+	int i;
+
+	ut_assertok(fdt_create(buf, BENCH_SIZE));
+	ut_assertok(fdt_finish_reservemap(buf));
+	ut_assertok(fdt_begin_node(buf, ""));
+	for (i = 0; i < BENCH_NODES; i++) {
+		snprintf(name, sizeof(name), "node-%d", i);
+		ut_assertok(fdt_begin_node(buf, name));
+		ut_assertok(fdt_property_u32(buf, "phandle", i + 1));
+		ut_assertok(fdt_end_node(buf));
+	}
+	ut_assertok(fdt_begin_node(buf, "__symbols__"));
+	for (i = 0; i < BENCH_NODES; i++) {
+		snprintf(name, sizeof(name), "label%d", i);
+		snprintf(path, sizeof(path), "/node-%d", i);
+		ut_assertok(fdt_property_string(buf, name, path));
+	}
+	ut_assertok(fdt_end_node(buf));
+	ut_assertok(fdt_end_node(buf));
+	ut_assertok(fdt_finish(buf));
+
+	return 0;
+}
+
+/*
+ * Build an overlay with fragments targeting nodes of the base tree by label,
+ * and a labelled node with its own phandle
+ */
+static int ut_fdt_make_overlay(struct unit_test_state *uts, void *buf,
+			       int idx)
+{
+	char name[32], path[64];
+	int i;
+
+	ut_assertok(fdt_create(buf, FDT_COPY_SIZE));
+	ut_assertok(fdt_finish_reservemap(buf));
+	ut_assertok(fdt_begin_node(buf, ""));
+	for (i = 0; i < BENCH_FRAGMENTS; i++) {
+		snprintf(name, sizeof(name), "fragment@%d", i);
+		ut_assertok(fdt_begin_node(buf, name));
+		ut_assertok(fdt_property_u32(buf, "target", 0xffffffff));
+		ut_assertok(fdt_begin_node(buf, "__overlay__"));
+		snprintf(name, sizeof(name), "variant-%d", idx);
+		ut_assertok(fdt_property_u32(buf, name, i));
+		if (!i) {
+			ut_assertok(fdt_begin_node(buf, name));
+			ut_assertok(fdt_property_u32(buf, "phandle", 1));
+			ut_assertok(fdt_end_node(buf));
+		}
+		ut_assertok(fdt_end_node(buf));
+		ut_assertok(fdt_end_node(buf));
+	}
+	ut_assertok(fdt_begin_node(buf, "__symbols__"));
+	snprintf(name, sizeof(name), "variant%d", idx);
+	snprintf(path, sizeof(path), "/fragment@0/__overlay__/variant-%d", idx);
+	ut_assertok(fdt_property_string(buf, name, path));
+	ut_assertok(fdt_end_node(buf));
+	ut_assertok(fdt_begin_node(buf, "__fixups__"));
+	for (i = 0; i < BENCH_FRAGMENTS; i++) {
+		snprintf(name, sizeof(name), "label%d",
+			 (idx * 37 + i * 101) % BENCH_NODES);
+		snprintf(path, sizeof(path), "/fragment@%d:target:0", i);
+		ut_assertok(fdt_property_string(buf, name, path));
+	}
+	ut_assertok(fdt_end_node(buf));
+	ut_assertok(fdt_end_node(buf));
+	ut_assertok(fdt_finish(buf));
+
+	return 0;
+}
+
+/* Time applying many overlays; define LOG_DEBUG to see the timings */
+static int fdt_overlay_cached_many(struct unit_test_state *uts)
+{
+	char fdto[FDT_COPY_SIZE];
+	struct fdt_overlay_cache cache;
+	ulong plain = 0, cached, start;
+	void *base, *fdt_plain, *fdt_cached;
+	int i;
+
+	base = malloc(BENCH_SIZE);
+	fdt_plain = malloc(BENCH_SIZE);
+	fdt_cached = malloc(BENCH_SIZE);
+	ut_assert(base && fdt_plain && fdt_cached);
+	ut_assertok(ut_fdt_make_base(uts, base));
+
+	ut_assertok(fdt_open_into(base, fdt_plain, BENCH_SIZE));
+	for (i = 0; i < BENCH_OVERLAYS; i++) {
+		ut_assertok(ut_fdt_make_overlay(uts, fdto, i));
+		start = timer_get_us();
+		ut_assertok(fdt_overlay_apply(fdt_plain, fdto));
+		plain += timer_get_us() - start;
+	}
+
+	start = timer_get_us();
+	ut_assertok(fdt_open_into(base, fdt_cached, BENCH_SIZE));
+	ut_assertok(fdt_overlay_cache_init(fdt_cached, &cache));
+	cached = timer_get_us() - start;
+	for (i = 0; i < BENCH_OVERLAYS; i++) {
+		ut_assertok(ut_fdt_make_overlay(uts, fdto, i));
+		start = timer_get_us();
+		ut_assertok(fdt_overlay_apply_cached(fdt_cached, fdto, &cache));
+		cached += timer_get_us() - start;
+	}
+	fdt_overlay_cache_uninit(&cache);
+
+	ut_assertok(ut_fdt_same(uts, fdt_plain, fdt_cached));
+	log_debug("%d overlays of %d fragments on %d nodes: %lu us, cached %lu us\n",
+		  BENCH_OVERLAYS, BENCH_FRAGMENTS, BENCH_NODES, plain, cached);
+
+	free(fdt_cached);
+	free(fdt_plain);
+	free(base);
+
+	return CMD_RET_SUCCESS;
+}
+OVERLAY_TEST(fdt_overlay_cached_many, 0);
+
+/* Build an overlay whose only fragment targets a label missing from the base */
+static int ut_fdt_make_overlay_missing(struct unit_test_state *uts, void *buf)
+{
+	ut_assertok(fdt_create(buf, FDT_COPY_SIZE));
+	ut_assertok(fdt_finish_reservemap(buf));
+	ut_assertok(fdt_begin_node(buf, ""));
+	ut_assertok(fdt_begin_node(buf, "fragment@0"));
+	ut_assertok(fdt_property_u32(buf, "target", 0xffffffff));
+	ut_assertok(fdt_begin_node(buf, "__overlay__"));
+	ut_assertok(fdt_property_u32(buf, "missing-test", 1));
+	ut_assertok(fdt_end_node(buf));
+	ut_assertok(fdt_end_node(buf));
+	ut_assertok(fdt_begin_node(buf, "__fixups__"));
+	ut_assertok(fdt_property_string(buf, "nolabel", "/fragment@0:target:0"));
+	ut_assertok(fdt_end_node(buf));
+	ut_assertok(fdt_end_node(buf));
+	ut_assertok(fdt_finish(buf));
+
+	return 0;
+}
+
+/* Check that an overlay the cache cannot resolve fails as it does without */
+static int fdt_overlay_cached_missing(struct unit_test_state *uts)
+{
+	char fdt_plain[FDT_COPY_SIZE], fdt_cached[FDT_COPY_SIZE];
+	char fdto[FDT_COPY_SIZE];
+	struct fdt_overlay_cache cache;
+
+	ut_assertok(fdt_open_into(&__dtb_test_fdt_base_begin, fdt_plain,
+				  FDT_COPY_SIZE));
+	ut_assertok(ut_fdt_make_overlay_missing(uts, fdto));
+	ut_asserteq(-FDT_ERR_NOTFOUND, fdt_overlay_apply(fdt_plain, fdto));
+
+	ut_assertok(fdt_open_into(&__dtb_test_fdt_base_begin, fdt_cached,
+				  FDT_COPY_SIZE));
+	ut_assertok(fdt_overlay_cache_init(fdt_cached, &cache));
+	ut_assertok(ut_fdt_make_overlay_missing(uts, fdto));
+	ut_asserteq(-FDT_ERR_NOTFOUND,
+		    fdt_overlay_apply_cached(fdt_cached, fdto, &cache));
+	fdt_overlay_cache_uninit(&cache);
+
+	return CMD_RET_SUCCESS;
+}
+OVERLAY_TEST(fdt_overlay_cached_missing, 0);
+
 int do_ut_overlay(struct cmd_tbl *cmdtp, int flag, int argc, char *const argv[])
 {
 	struct unit_test *tests = UNIT_TEST_SUITE_START(overlay_test);
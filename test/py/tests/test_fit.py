@@ -5,6 +5,7 @@
 
 import os
 import pytest
+import re
 import struct
 import u_boot_utils as util
 
@@ -432,6 +433,14 @@ def test_fit(u_boot_console):
             check_equal(loadables2, loadables2_out,
                         'Loadables2 (ramdisk) not loaded')
 
+            # All images are verified once, in the order they are stored
+            if cons.config.buildconfig.get('config_fit_load_plan'):
+                verified = re.findall(r"Verifying '([^']*)'",
+                                      ''.join(output))
+                assert verified == ['kernel-1', 'kernel-2', 'fdt-1',
+                                    'ramdisk-1', 'ramdisk-2'], (
+                       'Unexpected verification order %s' % verified)
+
         # Kernel, FDT and Ramdisk all compressed
         with cons.log.section('(Kernel + FDT + Ramdisk) compressed'):
             params['compression'] = 'gzip'
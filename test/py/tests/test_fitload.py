@@ -0,0 +1,169 @@
+# SPDX-License-Identifier: GPL-2.0+
+#
+# Test loading a configuration of a FIT with external data from storage
+
+import os
+import pytest
+import u_boot_utils as util
+
+# FIT with two configurations which share the FDT. Only kernel-1, fdt-1 and
+# ramdisk-1 belong to conf-1.
+base_its = '''
+/dts-v1/;
+
+/ {
+        description = "FIT with external data";
+        #address-cells = <1>;
+
+        images {
+                kernel-1 {
+                        data = /incbin/("%(kernel1)s");
+                        type = "kernel";
+                        arch = "sandbox";
+                        os = "linux";
+                        compression = "none";
+                        load = <0x800000>;
+                        entry = <0x800000>;
+                        hash-1 {
+                                algo = "sha256";
+                        };
+                };
+                kernel-2 {
+                        data = /incbin/("%(kernel2)s");
+                        type = "kernel";
+                        arch = "sandbox";
+                        os = "linux";
+                        compression = "none";
+                        load = <0xa00000>;
+                        entry = <0xa00000>;
+                        hash-1 {
+                                algo = "crc32";
+                        };
+                };
+                fdt-1 {
+                        data = /incbin/("%(fdt)s");
+                        type = "flat_dt";
+                        arch = "sandbox";
+                        compression = "none";
+                        hash-1 {
+                                algo = "sha1";
+                        };
+                        hash-2 {
+                                algo = "crc32";
+                        };
+                };
+                ramdisk-1 {
+                        data = /incbin/("%(ramdisk)s");
+                        type = "ramdisk";
+                        arch = "sandbox";
+                        os = "linux";
+                        compression = "none";
+                        load = <0xc00000>;
+                        hash-1 {
+                                algo = "sha256";
+                        };
+                };
+        };
+        configurations {
+                default = "conf-1";
+                conf-1 {
+                        kernel = "kernel-1";
+                        fdt = "fdt-1";
+                        ramdisk = "ramdisk-1";
+                };
+                conf-2 {
+                        kernel = "kernel-2";
+                        fdt = "fdt-1";
+                };
+        };
+};
+'''
+
+base_fdt = '''
+/dts-v1/;
+
+/ {
+	#address-cells = <1>;
+	#size-cells = <0>;
+
+	model = "Sandbox FIT load test";
+	compatible = "sandbox";
+};
+'''
+
+@pytest.mark.boardspec('sandbox')
+@pytest.mark.buildconfigspec('cmd_fitload')
+@pytest.mark.requiredtool('dtc')
+def test_fitload(u_boot_console):
+    """Test that only the images of a configuration are read and checked"""
+    cons = u_boot_console
+
+    def make_fname(leaf):
+        return os.path.join(cons.config.build_dir, leaf)
+
+    def make_file(leaf, data):
+        fname = make_fname(leaf)
+        with open(fname, 'wb') as fd:
+            fd.write(data)
+        return fname
+
+    def read_mem(addr, size):
+        fname = make_fname('fitload-%x.bin' % addr)
+        if os.path.exists(fname):
+            os.remove(fname)
+        cons.run_command('host save hostfs - %x %s %x' % (addr, fname, size))
+        with open(fname, 'rb') as fd:
+            return fd.read()
+
+    # The first kernel spans more than one read chunk
+    kernel1 = os.urandom(0x180000 + 123)
+    kernel2 = os.urandom(0x8000 + 5)
+    ramdisk = os.urandom(0x10000 + 77)
+    dts = make_file('fitload.dts', base_fdt.encode())
+    fdt = make_fname('fitload.dtb')
+    util.run_and_log(cons, ['dtc', dts, '-O', 'dtb', '-o', fdt])
+
+    params = {
+        'kernel1': make_file('fitload-kernel1.bin', kernel1),
+        'kernel2': make_file('fitload-kernel2.bin', kernel2),
+        'ramdisk': make_file('fitload-ramdisk.bin', ramdisk),
+        'fdt': fdt,
+    }
+    its = make_file('fitload.its', (base_its % params).encode())
+    fit = make_fname('fitload.fit')
+    mkimage = cons.config.build_dir + '/tools/mkimage'
+    util.run_and_log(cons, [mkimage, '-E', '-f', its, fit])
+
+    with cons.log.section('Load from file'):
+        cons.run_command('mw.b 800000 0 500000')
+        output = cons.run_command('fitload fs hostfs - 100000 %s' % fit)
+        assert "Loading 'kernel-1'" in output
+        assert "Loading 'fdt-1'" in output
+        assert "Loading 'ramdisk-1'" in output
+        assert 'kernel-2' not in output
+        assert read_mem(0x800000, len(kernel1)) == kernel1
+        assert read_mem(0xc00000, len(ramdisk)) == ramdisk
+        assert read_mem(0xa00000, len(kernel2)) == bytes(len(kernel2))
+
+        # bootm uses the kernel where it was loaded
+        output = cons.run_command('bootm start 100000; bootm loados')
+        assert 'Bad Data Hash' not in output
+        assert 'XIP Kernel Image' in output
+
+    with cons.log.section('Load from block device'):
+        cons.run_command('host bind 0 %s' % fit)
+        output = cons.run_command('fitload blk host 0 100000 0 conf-2')
+        assert "Loading 'kernel-2'" in output
+        assert 'kernel-1' not in output
+        assert read_mem(0xa00000, len(kernel2)) == kernel2
+
+    with cons.log.section('Corrupted image'):
+        with open(fit, 'rb') as fd:
+            data = bytearray(fd.read())
+        pos = data.find(ramdisk[:64])
+        data[pos + 1000] ^= 0xff
+        bad_fit = make_file('fitload-bad.fit', bytes(data))
+        output = cons.run_command('fitload fs hostfs - 100000 %s; echo rc=$?'
+                                  % bad_fit)
+        assert 'Bad Data Hash' in output
+        assert 'rc=1' in output
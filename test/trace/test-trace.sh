@@ -10,6 +10,24 @@ TRACE_OPT="FTRACE=1"
 BASE="$(dirname $0)/.."
 . $BASE/common.sh
 
+# Buffer the call stack samples are dumped to
+SAMPLE_ADDR=1000000
+SAMPLE_SIZE=100000
+
+# Tracing is not enabled in sandbox_defconfig
+build_trace_uboot() {
+	echo "Build sandbox"
+	OPTS="O=${OUTPUT_DIR} $1"
+	echo ${OPTS}
+	make ${OPTS} sandbox_config
+	cat >>${OUTPUT_DIR}/.config <<END
+CONFIG_TRACE=y
+CONFIG_TRACE_SAMPLE=y
+END
+	make ${OPTS} olddefconfig
+	make ${OPTS} -s -j$(nproc)
+}
+
 run_trace() {
 	echo "Run trace"
 	./${OUTPUT_DIR}/u-boot <<END
@@ -54,11 +72,132 @@ check_results() {
 	fi
 }
 
+run_sample() {
+	echo "Run call stack sampling"
+	# The empty line stops autoboot; sandbox starts again on 'reset'
+	./${OUTPUT_DIR}/u-boot <<END
+
+trace sample start 100
+hash sha256 0 1000000
+hash sha256 0 1000000
+hash sha256 0 1000000
+trace sample stop
+trace samples ${SAMPLE_ADDR} ${SAMPLE_SIZE}
+hash sha256 0 1000000
+trace samples ${SAMPLE_ADDR} ${SAMPLE_SIZE}
+host save hostfs - ${SAMPLE_ADDR} ${tmp}.samples \${profoffset}
+poweroff
+END
+}
+
+check_samples() {
+	echo "Check samples"
+
+	# No samples are taken once sampling stops
+	dumps=$(grep -c "Samples dumped to 0*${SAMPLE_ADDR}," ${tmp})
+	if [ ${dumps} -ne 2 ]; then
+		fail "sample dump error"
+	fi
+	if [ $(grep "Samples dumped to" ${tmp} | uniq | wc -l) -ne 1 ]; then
+		fail "samples taken after 'trace sample stop'"
+	fi
+
+	# The profile covers all the samples, most of them hashing
+	./${OUTPUT_DIR}/tools/proftool -m ${OUTPUT_DIR}/System.map \
+		-p ${tmp}.samples dump-profile >${tmp}.out 2>/dev/null ||
+		fail "dump-profile error"
+	count=$(awk 'NR == 1 { print $1 }' ${tmp}.out)
+	if [ -z "${count}" ] || [ "${count}" -lt 10 ]; then
+		fail "too few samples: ${count}"
+	fi
+	if ! grep -q "sha256" ${tmp}.out; then
+		fail "sha256 not in the profile"
+	fi
+
+	./${OUTPUT_DIR}/tools/proftool -m ${OUTPUT_DIR}/System.map \
+		-p ${tmp}.samples dump-flamegraph >${tmp}.out 2>/dev/null ||
+		fail "dump-flamegraph error"
+	total=$(awk '{ total += $NF } END { print total }' ${tmp}.out)
+	if [ "${total}" != "${count}" ]; then
+		fail "flame graph has ${total} of ${count} samples"
+	fi
+	if ! grep -q "hash_command.*;sha256" ${tmp}.out; then
+		fail "hash call stack not in the flame graph"
+	fi
+	rm ${tmp}.samples ${tmp}.out
+}
+
+# Run proftool on a profile made up here, so that the output is known
+check_proftool() {
+	echo "Check proftool"
+
+	cat >${tmp}.map <<END
+0000000000001000 T _init
+0000000000001100 T main_loop
+0000000000001200 T hash_run
+0000000000001300 T sha256
+END
+
+	# Five samples, innermost frame first, and a call from the last
+	# function. The header holds an enum and a size_t, as on the host.
+	python3 - ${tmp}.prof <<END
+import struct
+import sys
+
+samples = [[0x310, 0x204, 0x100], [0x310, 0x204, 0x100], [0x200, 0x150],
+           [], [0x3f0]]
+with open(sys.argv[1], 'wb') as fd:
+    fd.write(struct.pack('@iN', 2, len(samples)))
+    for sample in samples:
+        fd.write(struct.pack('@%dI' % (1 + len(sample)), len(sample),
+                             *sample))
+    fd.write(struct.pack('@iN', 1, 1))
+    fd.write(struct.pack('@III', 0x200, 0x3f0, (1 << 30) | 10))
+END
+
+	./${OUTPUT_DIR}/tools/proftool -m ${tmp}.map -p ${tmp}.prof \
+		dump-profile >${tmp}.out 2>/dev/null
+	cat >${tmp}.expect <<END
+5 samples
+
+  %self     self  %total    total  function
+  60.00        3   60.00        3  sha256
+  20.00        1   60.00        3  hash_run
+   0.00        0   60.00        3  main_loop
+  20.00        1   20.00        1  (outside U-Boot)
+END
+	if ! cmp -s ${tmp}.expect ${tmp}.out; then
+		fail "dump-profile output: $(cat ${tmp}.out)"
+	fi
+
+	./${OUTPUT_DIR}/tools/proftool -m ${tmp}.map -p ${tmp}.prof \
+		dump-flamegraph >${tmp}.out 2>/dev/null
+	cat >${tmp}.expect <<END
+(outside U-Boot) 1
+main_loop;hash_run 1
+main_loop;hash_run;sha256 2
+sha256 1
+END
+	if ! cmp -s ${tmp}.expect ${tmp}.out; then
+		fail "dump-flamegraph output: $(cat ${tmp}.out)"
+	fi
+
+	./${OUTPUT_DIR}/tools/proftool -m ${tmp}.map -p ${tmp}.prof \
+		dump-ftrace >${tmp}.out 2>/dev/null
+	if ! grep -q "0.000010: hash_run <- sha256$" ${tmp}.out; then
+		fail "dump-ftrace output: $(cat ${tmp}.out)"
+	fi
+	rm ${tmp}.map ${tmp}.prof ${tmp}.out ${tmp}.expect
+}
+
 echo "Simple trace test / sanity check using sandbox"
 echo
 tmp="$(tempfile)"
-build_uboot "${TRACE_OPT}"
+build_trace_uboot "${TRACE_OPT}"
 run_trace >${tmp}
 check_results ${tmp}
+run_sample >${tmp}
+check_samples
+check_proftool
 rm ${tmp}
 echo "Test passed"
@@ -0,0 +1,163 @@
+#!/usr/bin/env python3
+# SPDX-License-Identifier: GPL-2.0+
+
+"""
+Send an image to the boards running the U-Boot 'mcload' command.
+
+Every block is sent once to the multicast group, at a fixed rate. The blocks
+the boards report missing are then sent again to the group, each one once
+even when several boards asked for it, until the expected number of boards
+reported the image complete or nothing was heard for a while.
+
+See include/net/mcload.h for the protocol.
+"""
+
+import argparse
+import os
+import select
+import socket
+import struct
+import sys
+import time
+
+MAGIC = 0x554d434c
+VERSION = 1
+DATA = 1
+NAK = 2
+DONE = 3
+HDR = struct.Struct('>IBBHIII')
+RANGE = struct.Struct('>II')
+
+def parse_args():
+    """Parse command line arguments."""
+    parser = argparse.ArgumentParser(description=__doc__.strip().split('\n')[0])
+    parser.add_argument('image', help='file to send')
+    parser.add_argument('group', help='multicast group, <ip>[:<port>]')
+    parser.add_argument('-b', '--blksize', type=int, default=1024,
+        help='block size, a multiple of the block size of the target devices')
+    parser.add_argument('-r', '--rate', type=float, default=50,
+        help='rate of the first pass, in Mbit/s')
+    parser.add_argument('-n', '--boards', type=int, default=0,
+        help='number of boards to wait for, 0 to stop when they go quiet')
+    parser.add_argument('-i', '--interface', default='0.0.0.0',
+        help='IP address of the interface to send from')
+    parser.add_argument('-t', '--ttl', type=int, default=1,
+        help='TTL of the packets sent to the group')
+    parser.add_argument('-w', '--wait', type=float, default=5,
+        help='seconds to wait for boards before giving up')
+
+    return parser.parse_args()
+
+class Sender:
+    """Multicast sender of one image."""
+
+    def __init__(self, args, data):
+        self.data = data
+        self.blksize = args.blksize
+        self.blocks = (len(data) + self.blksize - 1) // self.blksize
+        self.session = int.from_bytes(os.urandom(4), 'big')
+        self.gap = self.blksize * 8 / (args.rate * 1e6)
+        self.wait = args.wait
+        self.boards = args.boards
+        self.done = set()
+        self.naks = 0
+        self.resent = 0
+
+        host, _, port = args.group.partition(':')
+        self.group = (host, int(port) if port else 1758)
+        self.sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+        self.sock.setsockopt(socket.IPPROTO_IP, socket.IP_MULTICAST_TTL,
+                             args.ttl)
+        self.sock.setsockopt(socket.IPPROTO_IP, socket.IP_MULTICAST_IF,
+                             socket.inet_aton(args.interface))
+        self.sock.bind((args.interface, 0))
+
+    def send_block(self, block):
+        """Send one block to the group."""
+        hdr = HDR.pack(MAGIC, VERSION, DATA, self.blksize, self.session,
+                       len(self.data), block)
+        start = block * self.blksize
+        self.sock.sendto(hdr + self.data[start:start + self.blksize],
+                         self.group)
+
+    def receive(self, timeout):
+        """Collect the blocks asked for until the timeout.
+
+        Returns:
+            set of block numbers missing on at least one board
+        """
+        wanted = set()
+        end = time.monotonic() + timeout
+        while True:
+            left = end - time.monotonic()
+            if left <= 0 or not select.select([self.sock], [], [], left)[0]:
+                return wanted
+            msg, addr = self.sock.recvfrom(2048)
+            if len(msg) < HDR.size:
+                continue
+            magic, version, mtype, _, session, _, count = HDR.unpack_from(msg)
+            if magic != MAGIC or version != VERSION or session != self.session:
+                continue
+            if mtype == DONE:
+                if addr not in self.done:
+                    print(f'{addr[0]}: done')
+                self.done.add(addr)
+            elif mtype == NAK:
+                self.naks += 1
+                for i in range(count):
+                    off = HDR.size + i * RANGE.size
+                    if off + RANGE.size > len(msg):
+                        break
+                    first, num = RANGE.unpack_from(msg, off)
+                    wanted.update(range(first, min(first + num, self.blocks)))
+
+    def run(self):
+        """Send the image and repair it until the boards are done.
+
+        Returns:
+            True if the expected number of boards got the image
+        """
+        start = time.monotonic()
+        for block in range(self.blocks):
+            self.send_block(block)
+            next_time = start + (block + 1) * self.gap
+            delay = next_time - time.monotonic()
+            if delay > 0:
+                time.sleep(delay)
+        print(f'Sent {self.blocks} blocks in {time.monotonic() - start:.1f} s')
+
+        quiet = 0
+        while not self.boards or len(self.done) < self.boards:
+            wanted = self.receive(0.5)
+            if not wanted:
+                quiet += 0.5
+                if quiet >= self.wait:
+                    break
+                continue
+            quiet = 0
+            for block in sorted(wanted):
+                self.send_block(block)
+                time.sleep(self.gap)
+            self.resent += len(wanted)
+
+        print(f'{len(self.done)} boards done, {self.naks} NAKs, '
+              f'{self.resent} blocks sent again')
+        return not self.boards or len(self.done) >= self.boards
+
+def main():
+    """Main program."""
+    args = parse_args()
+    if args.blksize < 1 or args.blksize > 1400:
+        sys.exit('The block size must fit in one Ethernet frame')
+    with open(args.image, 'rb') as inf:
+        data = inf.read()
+    if not data:
+        sys.exit('Empty image')
+
+    sender = Sender(args, data)
+    print(f'Sending {len(data)} bytes to {sender.group[0]}:{sender.group[1]}, '
+          f'session {sender.session:#x}')
+    return 0 if sender.run() else 1
+
+if __name__ == '__main__':
+    sys.exit(main())
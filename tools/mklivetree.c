@@ -0,0 +1,410 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * Build the live tree image of a device tree
+ *
+ * At start-up, U-Boot builds its live tree from the flat tree, see
+ * lib/of_live.c. This tool creates the same nodes and properties on the host,
+ * laid out as on the target, so that U-Boot only has to turn the offsets they
+ * hold into pointers. See struct of_live_image for the format.
+ */
+
+#include <errno.h>
+#include <getopt.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <u-boot/crc.h>
+
+#include "fdt_host.h"
+#include <of_live.h>
+
+/* Pointers to the image and to the FDT, see OF_LIVE_IMAGE_FDT */
+#define IMAGE_PTR(off)		((uint64_t)(off) << 1)
+#define FDT_PTR(off)		(((uint64_t)(off) << 1) | OF_LIVE_IMAGE_FDT)
+
+/* Fields of struct device_node and struct property, in pointers */
+#define NODE_NAME		0
+#define NODE_TYPE		1
+#define NODE_PHANDLE		2
+#define NODE_FULL_NAME		3
+#define NODE_PROPERTIES		4
+#define NODE_PARENT		5
+#define NODE_CHILD		6
+#define NODE_SIBLING		7
+#define NODE_FIELDS		8
+
+#define PROP_NAME		0
+#define PROP_LENGTH		1
+#define PROP_VALUE		2
+#define PROP_NEXT		3
+#define PROP_FIELDS		4
+
+/**
+ * struct live_build - State of the build of an image
+ *
+ * The image is built twice, first with @image NULL only to count the nodes,
+ * properties and strings, the way of_live_build() does it.
+ *
+ * @fdt: Device tree to build the image of
+ * @ptr_size: Size of a pointer on the target
+ * @image: Image being built, NULL when counting
+ * @off_props: Offset of the property records
+ * @off_strings: Offset of the strings
+ * @num_nodes: Number of node records so far
+ * @num_props: Number of property records so far
+ * @strings_size: Size of the strings so far
+ * @null_str: Offset of the "<NULL>" string, 0 if not added yet
+ * @name_str: Offset of the "name" string, 0 if not added yet
+ */
+struct live_build {
+	const void *fdt;
+	int ptr_size;
+	char *image;
+	int off_props;
+	int off_strings;
+	int num_nodes;
+	int num_props;
+	int strings_size;
+	int null_str;
+	int name_str;
+};
+
+static void usage(const char *prog)
+{
+	fprintf(stderr, "Usage: %s [-w <pointer size>] -o <output> <input.dtb>\n"
+		"\n"
+		"Build the live tree image U-Boot sets up its live tree from\n"
+		"\t-w : size of a pointer on the target, 4 (default) or 8\n"
+		"\t-o : output file\n", prog);
+	exit(EXIT_FAILURE);
+}
+
+static int node_size(struct live_build *lb)
+{
+	return NODE_FIELDS * lb->ptr_size;
+}
+
+static int prop_size(struct live_build *lb)
+{
+	return PROP_FIELDS * lb->ptr_size;
+}
+
+static char *node_rec(struct live_build *lb, int idx)
+{
+	return lb->image + sizeof(struct of_live_image) + idx * node_size(lb);
+}
+
+static char *prop_rec(struct live_build *lb, int idx)
+{
+	return lb->image + lb->off_props + idx * prop_size(lb);
+}
+
+static void put_u32(char *rec, int field, int ptr_size, uint32_t val)
+{
+	*(fdt32_t *)(rec + field * ptr_size) = cpu_to_fdt32(val);
+}
+
+static void put_ptr(char *rec, int field, int ptr_size, uint64_t val)
+{
+	if (ptr_size == 8)
+		*(fdt64_t *)(rec + field * 8) = cpu_to_fdt64(val);
+	else
+		*(fdt32_t *)(rec + field * 4) = cpu_to_fdt32(val);
+}
+
+static uint64_t node_ptr(struct live_build *lb, int idx)
+{
+	return IMAGE_PTR(sizeof(struct of_live_image) + idx * node_size(lb));
+}
+
+static uint64_t prop_ptr(struct live_build *lb, int idx)
+{
+	return IMAGE_PTR(lb->off_props + idx * prop_size(lb));
+}
+
+/* Add a string of @len bytes, returning a pointer to it */
+static uint64_t add_string(struct live_build *lb, const char *str, int len)
+{
+	int off = lb->off_strings + lb->strings_size;
+
+	if (lb->image) {
+		memcpy(lb->image + off, str, len);
+		lb->image[off + len] = '\0';
+	}
+	lb->strings_size += len + 1;
+
+	return IMAGE_PTR(off);
+}
+
+static uint64_t add_const_string(struct live_build *lb, int *offp,
+				 const char *str)
+{
+	if (!*offp)
+		*offp = add_string(lb, str, strlen(str)) >> 1;
+
+	return IMAGE_PTR(*offp);
+}
+
+/*
+ * Add the node at @offset and its subnodes, returning the index of its
+ * record or -ve on error. @path is the full name of its parent.
+ */
+static int add_node(struct live_build *lb, int offset, int parent,
+		    const char *path)
+{
+	const void *fdt = lb->fdt;
+	uint64_t name = 0, type = 0, ptr;
+	int idx, prop, prev, child, len, ret;
+	const char *pname, *unit, *at;
+	const fdt32_t *val;
+	char *full_name;
+	char *np = NULL;
+	char *pp = NULL;
+	bool has_name = false;
+	uint32_t phandle = 0;
+
+	idx = lb->num_nodes++;
+	if (lb->image)
+		np = node_rec(lb, idx);
+
+	unit = fdt_get_name(fdt, offset, &len);
+	if (!unit)
+		return len;
+	if (parent < 0) {
+		full_name = strdup("/");
+	} else {
+		full_name = malloc(strlen(path) + len + 2);
+		if (full_name)
+			sprintf(full_name, "%s/%s", strcmp(path, "/") ? path : "",
+				unit);
+	}
+	if (!full_name)
+		return -ENOMEM;
+
+	ptr = add_string(lb, full_name, strlen(full_name));
+	if (np) {
+		put_ptr(np, NODE_FULL_NAME, lb->ptr_size, ptr);
+		if (parent >= 0)
+			put_ptr(np, NODE_PARENT, lb->ptr_size,
+				node_ptr(lb, parent));
+	}
+
+	fdt_for_each_property_offset(prop, fdt, offset) {
+		int pidx = lb->num_props++;
+
+		val = fdt_getprop_by_offset(fdt, prop, &pname, &len);
+		if (!val || !pname) {
+			free(full_name);
+			return -FDT_ERR_INTERNAL;
+		}
+		if (!strcmp(pname, "name")) {
+			if (!has_name)
+				name = FDT_PTR((char *)val - (char *)fdt);
+			has_name = true;
+		}
+		if (!type && !strcmp(pname, "device_type"))
+			type = FDT_PTR((char *)val - (char *)fdt);
+		if ((!strcmp(pname, "phandle") ||
+		     !strcmp(pname, "linux,phandle")) && !phandle)
+			phandle = fdt32_to_cpu(*val);
+		if (!strcmp(pname, "ibm,phandle"))
+			phandle = fdt32_to_cpu(*val);
+		if (!lb->image)
+			continue;
+
+		if (pp)
+			put_ptr(pp, PROP_NEXT, lb->ptr_size, prop_ptr(lb, pidx));
+		else
+			put_ptr(np, NODE_PROPERTIES, lb->ptr_size,
+				prop_ptr(lb, pidx));
+		pp = prop_rec(lb, pidx);
+		put_ptr(pp, PROP_NAME, lb->ptr_size,
+			FDT_PTR(pname - (char *)fdt));
+		put_u32(pp, PROP_LENGTH, lb->ptr_size, len);
+		put_ptr(pp, PROP_VALUE, lb->ptr_size,
+			FDT_PTR((char *)val - (char *)fdt));
+	}
+
+	/* As of_live_build(), recreate the name property from the unit name */
+	if (!has_name) {
+		int pidx = lb->num_props++;
+		uint64_t pname_ptr;
+
+		at = strrchr(unit, '@');
+		len = at ? at - unit : strlen(unit);
+		pname_ptr = add_const_string(lb, &lb->name_str, "name");
+		name = add_string(lb, unit, len);
+		if (lb->image) {
+			if (pp)
+				put_ptr(pp, PROP_NEXT, lb->ptr_size,
+					prop_ptr(lb, pidx));
+			else
+				put_ptr(np, NODE_PROPERTIES, lb->ptr_size,
+					prop_ptr(lb, pidx));
+			pp = prop_rec(lb, pidx);
+			put_ptr(pp, PROP_NAME, lb->ptr_size, pname_ptr);
+			put_u32(pp, PROP_LENGTH, lb->ptr_size, len + 1);
+			put_ptr(pp, PROP_VALUE, lb->ptr_size, name);
+		}
+	}
+	if (!type)
+		type = add_const_string(lb, &lb->null_str, "<NULL>");
+	if (np) {
+		put_ptr(np, NODE_NAME, lb->ptr_size, name);
+		put_ptr(np, NODE_TYPE, lb->ptr_size, type);
+		put_u32(np, NODE_PHANDLE, lb->ptr_size, phandle);
+	}
+
+	prev = -1;
+	fdt_for_each_subnode(child, fdt, offset) {
+		ret = add_node(lb, child, idx, full_name);
+		if (ret < 0) {
+			free(full_name);
+			return ret;
+		}
+		if (np && prev < 0)
+			put_ptr(np, NODE_CHILD, lb->ptr_size, node_ptr(lb, ret));
+		else if (np)
+			put_ptr(node_rec(lb, prev), NODE_SIBLING, lb->ptr_size,
+				node_ptr(lb, ret));
+		prev = ret;
+	}
+	free(full_name);
+	if (child < 0 && child != -FDT_ERR_NOTFOUND)
+		return child;
+
+	return idx;
+}
+
+static int build_image(struct live_build *lb)
+{
+	int ret;
+
+	lb->num_nodes = 0;
+	lb->num_props = 0;
+	lb->strings_size = 0;
+	lb->null_str = 0;
+	lb->name_str = 0;
+	ret = add_node(lb, 0, -1, NULL);
+
+	return ret < 0 ? ret : 0;
+}
+
+static void *read_file(const char *fname, long *sizep)
+{
+	FILE *f;
+	void *buf;
+	long size;
+
+	f = fopen(fname, "rb");
+	if (!f)
+		return NULL;
+	fseek(f, 0, SEEK_END);
+	size = ftell(f);
+	rewind(f);
+	buf = malloc(size);
+	if (buf && fread(buf, 1, size, f) != size) {
+		free(buf);
+		buf = NULL;
+	}
+	fclose(f);
+	*sizep = size;
+
+	return buf;
+}
+
+int main(int argc, char *argv[])
+{
+	struct live_build lb = { .ptr_size = 4 };
+	struct of_live_image *hdr;
+	const char *out_fname = NULL;
+	long fdt_size;
+	int totalsize;
+	void *fdt;
+	FILE *out;
+	int opt, ret;
+
+	while ((opt = getopt(argc, argv, "o:w:")) != -1) {
+		switch (opt) {
+		case 'o':
+			out_fname = optarg;
+			break;
+		case 'w':
+			lb.ptr_size = atoi(optarg);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (optind != argc - 1 || !out_fname ||
+	    (lb.ptr_size != 4 && lb.ptr_size != 8))
+		usage(argv[0]);
+
+	fdt = read_file(argv[optind], &fdt_size);
+	if (!fdt) {
+		fprintf(stderr, "%s: Cannot read '%s': %s\n", argv[0],
+			argv[optind], strerror(errno));
+		return EXIT_FAILURE;
+	}
+	ret = fdt_check_header(fdt);
+	if (!ret && fdt_totalsize(fdt) > fdt_size)
+		ret = -FDT_ERR_TRUNCATED;
+	if (ret) {
+		fprintf(stderr, "%s: Invalid device tree '%s': %s\n", argv[0],
+			argv[optind], fdt_strerror(ret));
+		return EXIT_FAILURE;
+	}
+	lb.fdt = fdt;
+
+	/* Count, then lay out nodes, properties and strings, as is */
+	ret = build_image(&lb);
+	if (!ret) {
+		lb.off_props = sizeof(*hdr) + lb.num_nodes * node_size(&lb);
+		lb.off_strings = lb.off_props + lb.num_props * prop_size(&lb);
+		totalsize = lb.off_strings + lb.strings_size;
+		totalsize = (totalsize + 7) & ~7;
+		lb.image = calloc(1, totalsize);
+		if (!lb.image)
+			ret = -FDT_ERR_NOSPACE;
+	}
+	if (!ret)
+		ret = build_image(&lb);
+	if (ret) {
+		fprintf(stderr, "%s: Cannot build live tree of '%s': %s\n",
+			argv[0], argv[optind], ret == -ENOMEM ?
+			strerror(ENOMEM) : fdt_strerror(ret));
+		return EXIT_FAILURE;
+	}
+
+	hdr = (struct of_live_image *)lb.image;
+	hdr->magic = cpu_to_fdt32(OF_LIVE_IMAGE_MAGIC);
+	hdr->version = cpu_to_fdt32(OF_LIVE_IMAGE_VERSION);
+	hdr->totalsize = cpu_to_fdt32(totalsize);
+	hdr->ptr_size = cpu_to_fdt32(lb.ptr_size);
+	hdr->node_size = cpu_to_fdt32(node_size(&lb));
+	hdr->prop_size = cpu_to_fdt32(prop_size(&lb));
+	hdr->off_nodes = cpu_to_fdt32(sizeof(*hdr));
+	hdr->num_nodes = cpu_to_fdt32(lb.num_nodes);
+	hdr->off_props = cpu_to_fdt32(lb.off_props);
+	hdr->num_props = cpu_to_fdt32(lb.num_props);
+	hdr->fdt_size = cpu_to_fdt32(fdt_totalsize(fdt));
+	hdr->fdt_crc = cpu_to_fdt32(crc32(0, fdt, fdt_totalsize(fdt)));
+
+	out = fopen(out_fname, "wb");
+	if (!out || fwrite(lb.image, 1, totalsize, out) != totalsize) {
+		fprintf(stderr, "%s: Cannot write '%s': %s\n", argv[0],
+			out_fname, strerror(errno));
+		if (out) {
+			fclose(out);
+			remove(out_fname);
+		}
+		return EXIT_FAILURE;
+	}
+	fclose(out);
+	free(lb.image);
+	free(fdt);
+
+	return 0;
+}
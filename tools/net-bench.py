@@ -0,0 +1,139 @@
+#!/usr/bin/env python3
+# SPDX-License-Identifier: GPL-2.0+
+
+"""
+Peer of the U-Boot 'net bench' command.
+
+'send' feeds a board running 'net bench sink' with UDP packets, as fast as
+possible or at a given rate, and closes the stream with an END packet
+telling the board how many were sent. 'recv' counts the packets of a board
+running 'net bench source' and reports the rate and the packets lost.
+
+See include/net/bench.h for the packet format.
+"""
+
+import argparse
+import socket
+import struct
+import sys
+import time
+
+MAGIC = 0x55424e43
+END = 1
+HDR = struct.Struct('>III')
+DEFAULT_PORT = 5001
+
+def parse_args():
+    """Parse command line arguments."""
+    parser = argparse.ArgumentParser(description=__doc__.strip().split('\n')[0])
+    sub = parser.add_subparsers(dest='mode', required=True)
+
+    send = sub.add_parser('send', help='send packets to a board')
+    send.add_argument('board', help='IP address of the board, <ip>[:<port>]')
+    send.add_argument('-t', '--time', type=float, default=10,
+        help='seconds to send for')
+    send.add_argument('-s', '--size', type=int, default=1472,
+        help='UDP payload bytes per packet')
+    send.add_argument('-r', '--rate', type=float, default=0,
+        help='rate in Mbit/s, 0 for as fast as possible')
+
+    recv = sub.add_parser('recv', help='count the packets sent by a board')
+    recv.add_argument('-p', '--port', type=int, default=DEFAULT_PORT,
+        help='UDP port to listen on')
+    recv.add_argument('-w', '--wait', type=float, default=30,
+        help='seconds to wait for the first packet')
+
+    return parser.parse_args()
+
+def report(what, packets, nbytes, secs, lost=None):
+    """Print the outcome of a run."""
+    line = f'{what}: {packets} packets, {nbytes} bytes in {secs:.3f} s'
+    if lost is not None:
+        line += f', {lost} lost'
+    print(line)
+    if secs > 0:
+        print(f'Rate: {packets / secs:.0f} packets/s, '
+              f'{nbytes * 8 / secs / 1e6:.1f} Mbit/s')
+
+def do_send(args):
+    """Send packets to a board running 'net bench sink'."""
+    if args.size < HDR.size or args.size > 1472:
+        sys.exit(f'The size must be between {HDR.size} and 1472 bytes')
+    host, _, port = args.board.partition(':')
+    dest = (host, int(port) if port else DEFAULT_PORT)
+    sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    pad = bytes(args.size - HDR.size)
+    gap = args.size * 8 / (args.rate * 1e6) if args.rate else 0
+
+    seq = 0
+    start = time.monotonic()
+    end = start + args.time
+    while True:
+        now = time.monotonic()
+        if now >= end:
+            break
+        if gap:
+            delay = start + seq * gap - now
+            if delay > 0:
+                time.sleep(delay)
+        try:
+            sock.sendto(HDR.pack(MAGIC, seq, 0) + pad, dest)
+        except BlockingIOError:
+            continue
+        seq += 1
+    secs = time.monotonic() - start
+    for _ in range(3):
+        sock.sendto(HDR.pack(MAGIC, seq, END) + pad, dest)
+    report('Sent', seq, seq * args.size, secs)
+    return 0
+
+def do_recv(args):
+    """Count the packets of a board running 'net bench source'."""
+    sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    sock.setsockopt(socket.SOL_SOCKET, socket.SO_RCVBUF, 4 << 20)
+    sock.bind(('0.0.0.0', args.port))
+    sock.settimeout(args.wait)
+
+    packets = 0
+    nbytes = 0
+    sent = None
+    start = last = None
+    while True:
+        try:
+            msg, addr = sock.recvfrom(2048)
+        except socket.timeout:
+            break
+        if len(msg) < HDR.size:
+            continue
+        magic, seq, flags = HDR.unpack_from(msg)
+        if magic != MAGIC:
+            continue
+        if flags & END:
+            if start is not None:
+                sent = seq
+                break
+            continue
+        if start is None:
+            print(f'Receiving from {addr[0]}:{addr[1]}')
+            start = time.monotonic()
+            sock.settimeout(2)
+        last = time.monotonic()
+        packets += 1
+        nbytes += len(msg)
+
+    if start is None:
+        print('No packets received')
+        return 1
+    lost = sent - packets if sent is not None else None
+    report('Received', packets, nbytes, last - start, lost)
+    return 0
+
+def main():
+    """Main program."""
+    args = parse_args()
+    if args.mode == 'send':
+        return do_send(args)
+    return do_recv(args)
+
+if __name__ == '__main__':
+    sys.exit(main())
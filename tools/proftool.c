@@ -31,6 +31,9 @@ struct func_info {
 	const char *name;
 	unsigned long code_size;
 	unsigned long call_count;
+	unsigned long self_samples;	/* Samples with this function running */
+	unsigned long total_samples;	/* Samples with it on the stack */
+	int last_sample;	/* Last sample counted in total_samples, +1 */
 	unsigned flags;
 	/* the section this function is in */
 	struct objsection_info *objsection;
@@ -55,6 +58,9 @@ struct func_info *func_list;
 int func_count;
 struct trace_call *call_list;
 int call_count;
+uint32_t *sample_list;	/* Samples: frame count, then frame offsets */
+int sample_words;	/* Number of words in sample_list */
+int sample_count;
 int verbose;	/* Verbosity level 0=none, 1=warn, 2=notice, 3=info, 4=debug */
 unsigned long text_offset;		/* text address of first function */
 
@@ -85,6 +91,8 @@ static void usage(void)
 		"\n"
 		"Commands\n"
 		"   dump-ftrace\t\tDump out textual data in ftrace format\n"
+		"   dump-profile\t\tDump out a flat profile of the samples\n"
+		"   dump-flamegraph\tDump out the samples as folded stacks\n"
 		"\n"
 		"Options:\n"
 		"   -m <map>\tSpecify Systen.map file\n"
@@ -189,20 +197,18 @@ static struct func_info *find_caller_by_offset(uint32_t offset)
 	low = 0;
 	high = func_count - 1;
 	key.offset = offset;
-	while (high > low + 1) {
-		int mid = (low + high) / 2;
-		int result;
+	if (high < 0 || h_cmp_offset(&key, &func_list[0]) < 0)
+		return NULL;
+	while (high > low) {
+		int mid = (low + high + 1) / 2;
 
-		result = h_cmp_offset(&key, &func_list[mid]);
-		if (result > 0)
+		if (h_cmp_offset(&key, &func_list[mid]) >= 0)
 			low = mid;
-		else if (result < 0)
-			high = mid;
 		else
-			return &func_list[mid];
+			high = mid - 1;
 	}
 
-	return low >= 0 ? &func_list[low] : NULL;
+	return &func_list[low];
 }
 
 static int read_calls(FILE *fin, size_t count)
@@ -226,6 +232,36 @@ static int read_calls(FILE *fin, size_t count)
 	return 0;
 }
 
+static int read_samples(FILE *fin, size_t count)
+{
+	int alloced = 0;
+	uint32_t depth;
+	int i;
+
+	notice("sample count: %zu\n", count);
+	for (i = 0; i < count; i++) {
+		if (read_data(fin, &depth, sizeof(depth)))
+			return 1;
+		if (sample_words + 1 + depth > alloced) {
+			alloced = (sample_words + 1 + depth) * 2;
+			sample_list = realloc(sample_list,
+					      sizeof(*sample_list) * alloced);
+			if (!sample_list) {
+				error("Cannot allocate sample_list\n");
+				return -1;
+			}
+		}
+		sample_list[sample_words] = depth;
+		if (depth && read_data(fin, &sample_list[sample_words + 1],
+				       sizeof(*sample_list) * depth))
+			return 1;
+		sample_words += 1 + depth;
+	}
+	sample_count += count;
+
+	return 0;
+}
+
 static int read_profile(FILE *fin, int *not_found)
 {
 	struct trace_output_hdr hdr;
@@ -249,6 +285,11 @@ static int read_profile(FILE *fin, int *not_found)
 			if (read_calls(fin, hdr.rec_count))
 				return 1;
 			break;
+
+		case TRACE_CHUNK_SAMPLES:
+			if (read_samples(fin, hdr.rec_count))
+				return 1;
+			break;
 		}
 	}
 	return 0;
@@ -532,6 +573,148 @@ static int make_ftrace(void)
 	return 0;
 }
 
+static int h_cmp_self_samples(const void *v1, const void *v2)
+{
+	const struct func_info *f1 = *(struct func_info **)v1;
+	const struct func_info *f2 = *(struct func_info **)v2;
+
+	if (f1->self_samples != f2->self_samples)
+		return f1->self_samples < f2->self_samples ? 1 : -1;
+
+	return f1->total_samples < f2->total_samples ? 1 :
+		f1->total_samples > f2->total_samples ? -1 : 0;
+}
+
+/* Show how many samples each function was running in and on the stack */
+static int make_profile(void)
+{
+	struct func_info **sorted, *func;
+	int outside = 0, used = 0;
+	int i, pos, depth, frame;
+
+	if (!sample_count) {
+		error("No samples in the profile data\n");
+		return -1;
+	}
+	for (i = pos = 0; i < sample_count; i++, pos += 1 + depth) {
+		depth = sample_list[pos];
+		if (!depth)
+			outside++;
+		for (frame = 1; frame <= depth; frame++) {
+			func = find_caller_by_offset(sample_list[pos + frame]);
+			if (!func)
+				continue;
+			if (frame == 1)
+				func->self_samples++;
+
+			/* Count recursive functions once per sample */
+			if (func->last_sample != i + 1) {
+				func->total_samples++;
+				func->last_sample = i + 1;
+			}
+		}
+	}
+
+	sorted = calloc(func_count, sizeof(*sorted));
+	if (!sorted) {
+		error("Cannot allocate sorted function list\n");
+		return -1;
+	}
+	for (i = 0; i < func_count; i++) {
+		if (func_list[i].total_samples)
+			sorted[used++] = &func_list[i];
+	}
+	qsort(sorted, used, sizeof(*sorted), h_cmp_self_samples);
+
+	printf("%d samples\n\n", sample_count);
+	printf("  %%self     self  %%total    total  function\n");
+	for (i = 0; i < used; i++) {
+		func = sorted[i];
+		printf("%7.2f %8lu %7.2f %8lu  %s\n",
+		       func->self_samples * 100.0 / sample_count,
+		       func->self_samples,
+		       func->total_samples * 100.0 / sample_count,
+		       func->total_samples, func->name);
+	}
+	if (outside)
+		printf("%7.2f %8d %7.2f %8d  (outside U-Boot)\n",
+		       outside * 100.0 / sample_count, outside,
+		       outside * 100.0 / sample_count, outside);
+	free(sorted);
+
+	return 0;
+}
+
+static int h_cmp_string(const void *v1, const void *v2)
+{
+	return strcmp(*(char **)v1, *(char **)v2);
+}
+
+/*
+ * Write one line per distinct call stack: the functions from the outermost
+ * one, separated by semicolons, then the number of samples. This is the
+ * input of flamegraph.pl
+ */
+static int make_flamegraph(void)
+{
+	struct func_info *func;
+	char **stacks, *stack;
+	int i, pos, depth, frame, count;
+	size_t len;
+
+	if (!sample_count) {
+		error("No samples in the profile data\n");
+		return -1;
+	}
+	stacks = calloc(sample_count, sizeof(*stacks));
+	if (!stacks) {
+		error("Cannot allocate stack list\n");
+		return -1;
+	}
+	for (i = pos = 0; i < sample_count; i++, pos += 1 + depth) {
+		depth = sample_list[pos];
+		len = sizeof("(outside U-Boot)");
+		for (frame = 1; frame <= depth; frame++) {
+			func = find_caller_by_offset(sample_list[pos + frame]);
+			len += (func ? strlen(func->name) : 8) + 1;
+		}
+		stack = malloc(len);
+		if (!stack) {
+			error("Cannot allocate stack\n");
+			return -1;
+		}
+		*stack = '\0';
+		for (frame = depth; frame >= 1; frame--) {
+			uint32_t offset = sample_list[pos + frame];
+
+			func = find_caller_by_offset(offset);
+			if (func)
+				strcat(stack, func->name);
+			else
+				sprintf(stack + strlen(stack), "%x", offset);
+			if (frame > 1)
+				strcat(stack, ";");
+		}
+		if (!depth)
+			strcpy(stack, "(outside U-Boot)");
+		stacks[i] = stack;
+	}
+
+	qsort(stacks, sample_count, sizeof(*stacks), h_cmp_string);
+	for (i = 0; i < sample_count; i += count) {
+		for (count = 1; i + count < sample_count; count++) {
+			if (strcmp(stacks[i], stacks[i + count]))
+				break;
+		}
+		printf("%s %d\n", stacks[i], count);
+	}
+	for (i = 0; i < sample_count; i++)
+		free(stacks[i]);
+	free(stacks);
+
+	return 0;
+}
+
 static int prof_tool(int argc, char *const argv[],
 		     const char *prof_fname, const char *map_fname,
 		     const char *trace_config_fname)
@@ -552,6 +735,10 @@ static int prof_tool(int argc, char *const argv[],
 
 		if (0 == strcmp(cmd, "dump-ftrace"))
 			err = make_ftrace();
+		else if (0 == strcmp(cmd, "dump-profile"))
+			err = make_profile();
+		else if (0 == strcmp(cmd, "dump-flamegraph"))
+			err = make_flamegraph();
 		else
 			warn("Unknown command '%s'\n", cmd);
 	}